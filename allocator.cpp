@@ -0,0 +1,502 @@
+#include "allocator.h"
+
+#include <algorithm>
+
+static uint32_t log2Floor(VkDeviceSize value)
+{
+  uint32_t result = 0;
+  while(value >>= 1)
+    result++;
+  return result;
+}
+
+static VkDeviceSize roundUpPow2(VkDeviceSize value)
+{
+  VkDeviceSize result = 1;
+  while(result < value)
+    result <<= 1;
+  return result;
+}
+
+void createMemoryAllocator(MemoryAllocator& allocator, VkDevice device, VkPhysicalDevice physicalDevice)
+{
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(physicalDevice, &props);
+
+  allocator.device = device;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &allocator.memoryProperties);
+
+  // Rounding buddies up to the atom size means every allocation in non coherent memory can be flushed on its own
+  allocator.nonCoherentAtomSize = props.limits.nonCoherentAtomSize;
+  allocator.minAllocation = roundUpPow2(std::max(kMemoryMinAllocation, props.limits.nonCoherentAtomSize));
+  allocator.maxAllocationCount = props.limits.maxMemoryAllocationCount;
+
+  for(uint32_t i = 0 ; i < allocator.memoryProperties.memoryTypeCount ; i++)
+  {
+    VkDeviceSize heapSize = allocator.memoryProperties.memoryHeaps[allocator.memoryProperties.memoryTypes[i].heapIndex].size;
+
+    // Don't let one block take more than an eighth of a small heap like the 256MB BAR
+    VkDeviceSize blockSize = kMemoryBlockSize;
+    while(blockSize > heapSize / 8 && blockSize > allocator.minAllocation * 16)
+      blockSize /= 2;
+
+    for(uint32_t kind = 0 ; kind < ResourceKind_Count ; kind++)
+    {
+      MemoryPool& pool = allocator.pools[i][kind];
+      pool.blockSize = blockSize;
+      pool.maxOrder = log2Floor(blockSize / allocator.minAllocation);
+    }
+  }
+
+  allocator.dedicatedCount = 0;
+  allocator.dedicatedBytes = 0;
+  allocator.requestedBytes = 0;
+  allocator.deviceMemoryAllocations = 0;
+}
+
+void destroyMemoryAllocator(MemoryAllocator& allocator)
+{
+  assert(allocator.dedicatedCount == 0);
+
+  for(uint32_t i = 0 ; i < allocator.memoryProperties.memoryTypeCount ; i++)
+  {
+    for(uint32_t kind = 0 ; kind < ResourceKind_Count ; kind++)
+    {
+      for(MemoryBlock& block : allocator.pools[i][kind].blocks)
+      {
+        assert(block.allocationCount == 0);
+
+        // Freeing the memory unmaps it
+        if(block.memory)
+          vkFreeMemory(allocator.device, block.memory, 0);
+      }
+
+      allocator.pools[i][kind].blocks.clear();
+    }
+  }
+}
+
+uint32_t selectMemoryType(const VkPhysicalDeviceMemoryProperties& memoryProperties, uint32_t memoryTypeBits, VkMemoryPropertyFlags flags, VkMemoryPropertyFlags preferredFlags)
+{
+  if(preferredFlags)
+  {
+    uint32_t preferred = selectMemoryType(memoryProperties, memoryTypeBits, flags | preferredFlags);
+    if(preferred != ~0u)
+      return preferred;
+  }
+
+  for(uint32_t i = 0 ; i < memoryProperties.memoryTypeCount ; i++)
+  {
+    if((memoryTypeBits & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
+      return i;
+  }
+
+  return ~0u;
+}
+
+static VkDeviceMemory allocateDeviceMemory(MemoryAllocator& allocator, VkDeviceSize size, uint32_t memoryType, void** data)
+{
+  VkMemoryAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+  allocateInfo.allocationSize = size;
+  allocateInfo.memoryTypeIndex = memoryType;
+
+  VkDeviceMemory memory = 0;
+  VK_CHECK(vkAllocateMemory(allocator.device, &allocateInfo, 0, &memory));
+  allocator.deviceMemoryAllocations++;
+
+  *data = NULL;
+  if(allocator.memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    VK_CHECK(vkMapMemory(allocator.device, memory, 0, VK_WHOLE_SIZE, 0, data));
+
+  return memory;
+}
+
+static bool buddyAllocate(MemoryBlock& block, const MemoryPool& pool, VkDeviceSize minAllocation, uint32_t order, VkDeviceSize& offset)
+{
+  uint32_t freeOrder = order;
+  while(freeOrder <= pool.maxOrder && block.freeLists[freeOrder].empty())
+    freeOrder++;
+
+  if(freeOrder > pool.maxOrder)
+    return false;
+
+  std::unordered_set<VkDeviceSize>::iterator it = block.freeLists[freeOrder].begin();
+  offset = *it;
+  block.freeLists[freeOrder].erase(it);
+
+  // Split down to the size we want, the upper halves go back on the free lists
+  while(freeOrder > order)
+  {
+    freeOrder--;
+    block.freeLists[freeOrder].insert(offset + (minAllocation << freeOrder));
+  }
+
+  return true;
+}
+
+static void buddyFree(MemoryBlock& block, const MemoryPool& pool, VkDeviceSize minAllocation, uint32_t order, VkDeviceSize offset)
+{
+  // Merge with the buddy for as long as it is free too
+  while(order < pool.maxOrder)
+  {
+    VkDeviceSize buddy = offset ^ (minAllocation << order);
+
+    std::unordered_set<VkDeviceSize>::iterator it = block.freeLists[order].find(buddy);
+    if(it == block.freeLists[order].end())
+      break;
+
+    block.freeLists[order].erase(it);
+    offset = std::min(offset, buddy);
+    order++;
+  }
+
+  block.freeLists[order].insert(offset);
+}
+
+Allocation allocateMemory(MemoryAllocator& allocator, const VkMemoryRequirements& requirements, ResourceKind kind, VkMemoryPropertyFlags memoryFlags, VkMemoryPropertyFlags preferredFlags)
+{
+  uint32_t memoryType = selectMemoryType(allocator.memoryProperties, requirements.memoryTypeBits, memoryFlags, preferredFlags);
+  assert(memoryType != ~0u);
+
+  std::lock_guard<std::mutex> lock(allocator.mutex);
+
+  MemoryPool& pool = allocator.pools[memoryType][kind];
+
+  Allocation allocation = {};
+  allocation.memoryType = memoryType;
+  allocation.kind = kind;
+  allocation.requestedSize = requirements.size;
+
+  allocator.requestedBytes += requirements.size;
+
+  VkDeviceSize size = roundUpPow2(std::max(std::max(requirements.size, requirements.alignment), allocator.minAllocation));
+
+  if(size > pool.blockSize / 2)
+  {
+    allocation.memory = allocateDeviceMemory(allocator, requirements.size, memoryType, &allocation.data);
+    allocation.offset = 0;
+    allocation.size = requirements.size;
+    allocation.block = ~0u;
+
+    allocator.dedicatedCount++;
+    allocator.dedicatedBytes += requirements.size;
+    return allocation;
+  }
+
+  uint32_t order = log2Floor(size / allocator.minAllocation);
+
+  uint32_t blockIndex = ~0u;
+  VkDeviceSize offset = 0;
+
+  for(uint32_t i = 0 ; i < pool.blocks.size() ; i++)
+  {
+    MemoryBlock& block = pool.blocks[i];
+    if(block.memory && buddyAllocate(block, pool, allocator.minAllocation, order, offset))
+    {
+      blockIndex = i;
+      break;
+    }
+  }
+
+  if(blockIndex == ~0u)
+  {
+    // Reuse the slot of a block we gave back so indices held by live allocations stay valid
+    for(uint32_t i = 0 ; i < pool.blocks.size() && blockIndex == ~0u ; i++)
+    {
+      if(!pool.blocks[i].memory)
+        blockIndex = i;
+    }
+
+    if(blockIndex == ~0u)
+    {
+      blockIndex = uint32_t(pool.blocks.size());
+      pool.blocks.push_back(MemoryBlock());
+    }
+
+    MemoryBlock& block = pool.blocks[blockIndex];
+    block.memory = allocateDeviceMemory(allocator, pool.blockSize, memoryType, &block.data);
+    block.freeLists.assign(pool.maxOrder + 1, std::unordered_set<VkDeviceSize>());
+    block.freeLists[pool.maxOrder].insert(0);
+    block.used = 0;
+    block.allocationCount = 0;
+
+    bool allocated = buddyAllocate(block, pool, allocator.minAllocation, order, offset);
+    assert(allocated);
+    (void)allocated;
+  }
+
+  MemoryBlock& block = pool.blocks[blockIndex];
+  block.used += size;
+  block.allocationCount++;
+
+  allocation.memory = block.memory;
+  allocation.offset = offset;
+  allocation.size = size;
+  allocation.data = block.data ? static_cast<char*>(block.data) + offset : NULL;
+  allocation.block = blockIndex;
+  allocation.order = order;
+
+  return allocation;
+}
+
+void freeMemory(MemoryAllocator& allocator, const Allocation& allocation)
+{
+  if(!allocation.memory)
+    return;
+
+  std::lock_guard<std::mutex> lock(allocator.mutex);
+
+  allocator.requestedBytes -= allocation.requestedSize;
+
+  if(allocation.block == ~0u)
+  {
+    // Freeing the memory unmaps it
+    vkFreeMemory(allocator.device, allocation.memory, 0);
+
+    allocator.dedicatedCount--;
+    allocator.dedicatedBytes -= allocation.size;
+    return;
+  }
+
+  MemoryPool& pool = allocator.pools[allocation.memoryType][allocation.kind];
+  MemoryBlock& block = pool.blocks[allocation.block];
+  assert(block.memory == allocation.memory);
+
+  buddyFree(block, pool, allocator.minAllocation, allocation.order, allocation.offset);
+  block.used -= allocation.size;
+  block.allocationCount--;
+
+  // Give empty blocks back to the driver, but keep one around per pool so a single alloc/free pair doesn't thrash
+  if(block.allocationCount == 0)
+  {
+    uint32_t liveBlocks = 0;
+    for(const MemoryBlock& other : pool.blocks)
+      liveBlocks += other.memory ? 1 : 0;
+
+    if(liveBlocks > 1)
+    {
+      vkFreeMemory(allocator.device, block.memory, 0);
+      block.memory = VK_NULL_HANDLE;
+      block.data = NULL;
+      block.freeLists.clear();
+    }
+  }
+}
+
+VkMemoryPropertyFlags getMemoryFlags(const MemoryAllocator& allocator, const Allocation& allocation)
+{
+  return allocator.memoryProperties.memoryTypes[allocation.memoryType].propertyFlags;
+}
+
+MemoryStats getMemoryStats(MemoryAllocator& allocator)
+{
+  std::lock_guard<std::mutex> lock(allocator.mutex);
+
+  MemoryStats stats = {};
+  VkDeviceSize largestFreeSum = 0;
+  stats.dedicatedCount = allocator.dedicatedCount;
+  stats.allocationCount = allocator.dedicatedCount;
+  stats.deviceMemoryAllocations = allocator.deviceMemoryAllocations;
+  stats.dedicatedBytes = allocator.dedicatedBytes;
+  stats.requestedBytes = allocator.requestedBytes;
+
+  for(uint32_t i = 0 ; i < allocator.memoryProperties.memoryTypeCount ; i++)
+  {
+    for(uint32_t kind = 0 ; kind < ResourceKind_Count ; kind++)
+    {
+      const MemoryPool& pool = allocator.pools[i][kind];
+
+      for(const MemoryBlock& block : pool.blocks)
+      {
+        if(!block.memory)
+          continue;
+
+        stats.blockCount++;
+        stats.allocationCount += block.allocationCount;
+        stats.blockBytes += pool.blockSize;
+        stats.usedBytes += block.used;
+
+        for(uint32_t order = pool.maxOrder + 1 ; order-- > 0 ; )
+        {
+          if(!block.freeLists[order].empty())
+          {
+            stats.largestFreeRange = std::max(stats.largestFreeRange, allocator.minAllocation << order);
+            largestFreeSum += allocator.minAllocation << order;
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  // Free space split across blocks isn't fragmentation, only the splitting within a block counts
+  VkDeviceSize freeBytes = stats.blockBytes - stats.usedBytes;
+  stats.fragmentation = freeBytes ? 1.0f - float(largestFreeSum) / float(freeBytes) : 0.0f;
+
+  return stats;
+}
+
+void printMemoryStats(MemoryAllocator& allocator)
+{
+  MemoryStats stats = getMemoryStats(allocator);
+
+  printf("Memory: %u allocations in %u blocks (%.1f MB) + %u dedicated (%.1f MB), %llu vkAllocateMemory calls\n",
+      stats.allocationCount, stats.blockCount, stats.blockBytes / (1024.0 * 1024.0), stats.dedicatedCount, stats.dedicatedBytes / (1024.0 * 1024.0),
+      (unsigned long long)stats.deviceMemoryAllocations);
+  printf("Memory: %.1f MB used in blocks for %.1f MB requested, largest free range %.1f MB, fragmentation %.1f%%\n",
+      stats.usedBytes / (1024.0 * 1024.0), stats.requestedBytes / (1024.0 * 1024.0), stats.largestFreeRange / (1024.0 * 1024.0), stats.fragmentation * 100.0f);
+}
+
+void createLinearAllocator(LinearAllocator& linear, MemoryAllocator& allocator, VkDeviceSize size, uint32_t memoryTypeBits, VkMemoryPropertyFlags memoryFlags, VkMemoryPropertyFlags preferredFlags)
+{
+  linear.memoryType = selectMemoryType(allocator.memoryProperties, memoryTypeBits, memoryFlags, preferredFlags);
+  assert(linear.memoryType != ~0u);
+
+  linear.memoryFlags = allocator.memoryProperties.memoryTypes[linear.memoryType].propertyFlags;
+  linear.minAlignment = (linear.memoryFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) ? 1 : allocator.nonCoherentAtomSize;
+
+  {
+    std::lock_guard<std::mutex> lock(allocator.mutex);
+    linear.memory = allocateDeviceMemory(allocator, size, linear.memoryType, &linear.data);
+  }
+
+  linear.size = size;
+  linear.offset = 0;
+  linear.highWater = 0;
+}
+
+void destroyLinearAllocator(LinearAllocator& linear, MemoryAllocator& allocator)
+{
+  vkFreeMemory(allocator.device, linear.memory, 0);
+  linear.memory = VK_NULL_HANDLE;
+  linear.data = NULL;
+}
+
+bool linearAllocate(LinearAllocator& linear, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset, void** data)
+{
+  alignment = std::max(alignment, linear.minAlignment);
+
+  VkDeviceSize aligned = (linear.offset + alignment - 1) / alignment * alignment;
+  if(aligned + size > linear.size)
+    return false;
+
+  linear.offset = aligned + size;
+  linear.highWater = std::max(linear.highWater, linear.offset);
+
+  offset = aligned;
+  if(data)
+    *data = linear.data ? static_cast<char*>(linear.data) + aligned : NULL;
+
+  return true;
+}
+
+void resetLinearAllocator(LinearAllocator& linear)
+{
+  linear.offset = 0;
+}
+
+// Sizes vertex, index and uniform buffers tend to have, 256 bytes to 64KB plus some jitter so they don't all round the same way
+static VkDeviceSize benchmarkBufferSize(uint32_t& seed)
+{
+  seed = seed * 1664525u + 1013904223u;
+  return (VkDeviceSize(256) << ((seed >> 8) % 9)) + ((seed >> 16) % 1024) * 16;
+}
+
+void benchmarkMemoryAllocator(MemoryAllocator& allocator, uint32_t count)
+{
+  VkDevice device = allocator.device;
+
+  // Naive allocation runs into maxMemoryAllocationCount, leave some room for the rest of the app
+  uint32_t naiveCount = std::min(count, allocator.maxAllocationCount > 256 ? allocator.maxAllocationCount - 256 : 0);
+
+  std::vector<VkBuffer> buffers(count);
+  std::vector<VkMemoryRequirements> requirements(count);
+
+  uint32_t seed = 1;
+  for(uint32_t i = 0 ; i < count ; i++)
+  {
+    VkBufferCreateInfo createInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    createInfo.size = benchmarkBufferSize(seed);
+    createInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    VK_CHECK(vkCreateBuffer(device, &createInfo, 0, &buffers[i]));
+    vkGetBufferMemoryRequirements(device, buffers[i], &requirements[i]);
+  }
+
+  // One vkAllocateMemory per buffer. Buffers can't be rebound, so the naive run gets its own set.
+  std::vector<VkBuffer> naiveBuffers(naiveCount);
+  std::vector<VkDeviceMemory> naiveMemory(naiveCount);
+
+  for(uint32_t i = 0 ; i < naiveCount ; i++)
+  {
+    VkBufferCreateInfo createInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    createInfo.size = requirements[i].size;
+    createInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    VK_CHECK(vkCreateBuffer(device, &createInfo, 0, &naiveBuffers[i]));
+  }
+
+  double start = getTimeMs();
+  for(uint32_t i = 0 ; i < naiveCount ; i++)
+  {
+    VkMemoryAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+    allocateInfo.allocationSize = requirements[i].size;
+    allocateInfo.memoryTypeIndex = selectMemoryType(allocator.memoryProperties, requirements[i].memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    VK_CHECK(vkAllocateMemory(device, &allocateInfo, 0, &naiveMemory[i]));
+    VK_CHECK(vkBindBufferMemory(device, naiveBuffers[i], naiveMemory[i], 0));
+  }
+  double naiveAllocateTime = getTimeMs() - start;
+
+  start = getTimeMs();
+  for(uint32_t i = 0 ; i < naiveCount ; i++)
+    vkFreeMemory(device, naiveMemory[i], 0);
+  double naiveFreeTime = getTimeMs() - start;
+
+  for(VkBuffer buffer : naiveBuffers)
+    vkDestroyBuffer(device, buffer, 0);
+
+  uint64_t deviceAllocationsBefore = allocator.deviceMemoryAllocations;
+  std::vector<Allocation> allocations(count);
+
+  start = getTimeMs();
+  for(uint32_t i = 0 ; i < count ; i++)
+  {
+    allocations[i] = allocateMemory(allocator, requirements[i], ResourceKind_Linear, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VK_CHECK(vkBindBufferMemory(device, buffers[i], allocations[i].memory, allocations[i].offset));
+  }
+  double allocateTime = getTimeMs() - start;
+
+  uint64_t deviceAllocations = allocator.deviceMemoryAllocations - deviceAllocationsBefore;
+  MemoryStats filled = getMemoryStats(allocator);
+
+  // Free every other allocation and allocate again with shuffled sizes, which is what streaming does to a heap
+  start = getTimeMs();
+  for(uint32_t i = 0 ; i < count ; i += 2)
+    freeMemory(allocator, allocations[i]);
+  for(uint32_t i = 0 ; i < count ; i += 2)
+    allocations[i] = allocateMemory(allocator, requirements[(i * 7919) % count], ResourceKind_Linear, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  double churnTime = getTimeMs() - start;
+
+  MemoryStats churned = getMemoryStats(allocator);
+
+  start = getTimeMs();
+  for(const Allocation& allocation : allocations)
+    freeMemory(allocator, allocation);
+  double freeTime = getTimeMs() - start;
+
+  for(VkBuffer buffer : buffers)
+    vkDestroyBuffer(device, buffer, 0);
+
+  printf("Memory benchmark, %u buffers of 256B-80KB in device local memory:\n", count);
+  if(naiveCount)
+  {
+    printf("  naive:     %u vkAllocateMemory calls, allocate+bind %.2f ms (%.2f us each), free %.2f ms%s\n", naiveCount,
+        naiveAllocateTime, naiveAllocateTime * 1000.0 / naiveCount, naiveFreeTime, naiveCount < count ? " (capped by maxMemoryAllocationCount)" : "");
+  }
+  printf("  allocator: %llu vkAllocateMemory calls, allocate+bind %.2f ms (%.2f us each), free %.2f ms\n", (unsigned long long)deviceAllocations,
+      allocateTime, allocateTime * 1000.0 / count, freeTime);
+  printf("  allocator: %u blocks, %.1f MB used for %.1f MB requested, fragmentation %.1f%%\n", filled.blockCount,
+      filled.usedBytes / (1024.0 * 1024.0), filled.requestedBytes / (1024.0 * 1024.0), filled.fragmentation * 100.0f);
+  printf("  churn:     %u frees + %u allocations in %.2f ms, %u blocks, fragmentation %.1f%%\n", (count + 1) / 2, (count + 1) / 2,
+      churnTime, churned.blockCount, churned.fragmentation * 100.0f);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "common.h"
+
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+const VkDeviceSize kMemoryBlockSize = 64 * 1024 * 1024; // Shrunk for small heaps, see createMemoryAllocator
+const VkDeviceSize kMemoryMinAllocation = 256; // Smallest buddy, raised to nonCoherentAtomSize if that's bigger
+
+// Buffers and linear images can't share a bufferImageGranularity page with optimal images, so each memory
+// type gets separate blocks for the two instead of padding every allocation out to the granularity.
+enum ResourceKind
+{
+  ResourceKind_Linear, // Buffers and linear tiled images
+  ResourceKind_Optimal, // Optimal tiled images
+
+  ResourceKind_Count
+};
+
+struct Allocation
+{
+  VkDeviceMemory memory;
+  VkDeviceSize offset;
+  VkDeviceSize size; // What was reserved, at least what was asked for
+  VkDeviceSize requestedSize;
+  void* data; // Mapped pointer at offset, NULL unless the memory is host visible
+
+  uint32_t memoryType;
+  uint32_t block; // Index into the pool, ~0u for a dedicated allocation
+  ResourceKind kind;
+  uint32_t order; // Buddy order, block size is minAllocation << order
+};
+
+// One big VkDeviceMemory carved up with a buddy allocator. Buddies are aligned to their own size, so any
+// alignment up to the rounded size comes for free and freeing merges back in O(log n).
+struct MemoryBlock
+{
+  VkDeviceMemory memory;
+  void* data; // Whole block is mapped once if host visible, vkMapMemory can't map the same memory twice
+
+  std::vector<std::unordered_set<VkDeviceSize>> freeLists; // Free offsets per order
+  VkDeviceSize used;
+  uint32_t allocationCount;
+};
+
+struct MemoryPool
+{
+  std::vector<MemoryBlock> blocks; // Empty blocks are freed, so their slots get reused
+  VkDeviceSize blockSize;
+  uint32_t maxOrder;
+};
+
+struct MemoryStats
+{
+  uint32_t blockCount;
+  uint32_t dedicatedCount;
+  uint32_t allocationCount;
+  uint64_t deviceMemoryAllocations; // Total vkAllocateMemory calls so far
+
+  VkDeviceSize blockBytes; // Reserved from the driver in blocks
+  VkDeviceSize dedicatedBytes;
+  VkDeviceSize usedBytes; // Handed out from blocks, rounding included
+  VkDeviceSize requestedBytes; // What callers asked for
+
+  VkDeviceSize largestFreeRange;
+  float fragmentation; // 1 - largest free range / free space, per block, 0 when each block's free space is in one piece
+};
+
+struct MemoryAllocator
+{
+  VkDevice device;
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  VkDeviceSize minAllocation;
+  VkDeviceSize nonCoherentAtomSize;
+  uint32_t maxAllocationCount; // maxMemoryAllocationCount, can be as low as 4096
+
+  std::mutex mutex;
+  MemoryPool pools[VK_MAX_MEMORY_TYPES][ResourceKind_Count];
+
+  uint32_t dedicatedCount;
+  VkDeviceSize dedicatedBytes;
+  VkDeviceSize requestedBytes;
+  uint64_t deviceMemoryAllocations;
+};
+
+// Bump allocator over a single VkDeviceMemory for data that only lives for a frame. Everything is released
+// at once with resetLinearAllocator, which makes allocating a couple of adds.
+struct LinearAllocator
+{
+  VkDeviceMemory memory;
+  void* data;
+  VkDeviceSize size;
+  VkDeviceSize offset;
+  VkDeviceSize highWater; // Most ever used between resets
+  VkDeviceSize minAlignment; // nonCoherentAtomSize for non coherent memory so ranges can be flushed on their own
+  uint32_t memoryType;
+  VkMemoryPropertyFlags memoryFlags;
+};
+
+void createMemoryAllocator(MemoryAllocator& allocator, VkDevice device, VkPhysicalDevice physicalDevice);
+void destroyMemoryAllocator(MemoryAllocator& allocator); // Everything must have been freed
+
+// Returns ~0u if no memory type has the required flags. Preferred flags are tried first and dropped if nothing has them.
+uint32_t selectMemoryType(const VkPhysicalDeviceMemoryProperties& memoryProperties, uint32_t memoryTypeBits, VkMemoryPropertyFlags flags, VkMemoryPropertyFlags preferredFlags = 0);
+
+// Requests bigger than half a block get their own VkDeviceMemory
+Allocation allocateMemory(MemoryAllocator& allocator, const VkMemoryRequirements& requirements, ResourceKind kind, VkMemoryPropertyFlags memoryFlags, VkMemoryPropertyFlags preferredFlags = 0);
+void freeMemory(MemoryAllocator& allocator, const Allocation& allocation);
+
+VkMemoryPropertyFlags getMemoryFlags(const MemoryAllocator& allocator, const Allocation& allocation);
+
+MemoryStats getMemoryStats(MemoryAllocator& allocator);
+void printMemoryStats(MemoryAllocator& allocator);
+
+// Only buffers go in a linear allocator, so bufferImageGranularity never comes into it
+void createLinearAllocator(LinearAllocator& linear, MemoryAllocator& allocator, VkDeviceSize size, uint32_t memoryTypeBits, VkMemoryPropertyFlags memoryFlags, VkMemoryPropertyFlags preferredFlags = 0);
+void destroyLinearAllocator(LinearAllocator& linear, MemoryAllocator& allocator);
+
+// Returns false when the allocator is full, offset and data are only written on success
+bool linearAllocate(LinearAllocator& linear, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset, void** data = NULL);
+void resetLinearAllocator(LinearAllocator& linear);
+
+// Times allocating, churning and freeing count buffers through the allocator against one vkAllocateMemory per buffer
+void benchmarkMemoryAllocator(MemoryAllocator& allocator, uint32_t count);
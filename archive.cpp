@@ -0,0 +1,263 @@
+#include "archive.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+static const char* validateArchive(const AssetArchive& archive)
+{
+  if(archive.size < sizeof(ArchiveHeader))
+    return "file too small";
+
+  const ArchiveHeader* header = reinterpret_cast<const ArchiveHeader*>(archive.data);
+
+  if(header->magic != kArchiveMagic || header->version != kArchiveVersion)
+    return "not an archive, or from another version of farvkr-pack";
+
+  if(header->fileSize != archive.size)
+    return "truncated";
+
+  if(header->tocOffset > archive.size || (archive.size - header->tocOffset) / sizeof(ArchiveEntry) < header->entryCount)
+    return "table of contents outside the file";
+
+  const ArchiveEntry* entries = reinterpret_cast<const ArchiveEntry*>(archive.data + header->tocOffset);
+
+  for(uint32_t i = 0 ; i < header->entryCount ; i++)
+  {
+    const ArchiveEntry& entry = entries[i];
+
+    if(entry.offset > archive.size || entry.size > archive.size - entry.offset || entry.offset % kArchiveAlignment != 0)
+      return "entry outside the file";
+
+    if(memchr(entry.name, 0, sizeof(entry.name)) == NULL)
+      return "entry name not terminated";
+
+    // Lookups are a binary search
+    if(i > 0 && strcmp(entries[i - 1].name, entry.name) >= 0)
+      return "table of contents not sorted";
+  }
+
+  return NULL;
+}
+
+bool openArchive(AssetArchive& archive, const char* path)
+{
+  archive = {};
+  archive.fd = -1;
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if(fd < 0)
+  {
+    printf("Archive %s: can't open\n", path);
+    return false;
+  }
+
+  struct stat info;
+  if(fstat(fd, &info) != 0 || info.st_size <= 0)
+  {
+    printf("Archive %s: empty\n", path);
+    close(fd);
+    return false;
+  }
+
+  void* data = mmap(NULL, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  if(data == MAP_FAILED)
+  {
+    printf("Archive %s: can't map\n", path);
+    close(fd);
+    return false;
+  }
+
+  // Everything in it is going to be read during startup, let the kernel start reading ahead right away
+  madvise(data, size_t(info.st_size), MADV_WILLNEED);
+
+  archive.fd = fd;
+  archive.data = static_cast<const uint8_t*>(data);
+  archive.size = size_t(info.st_size);
+
+  if(const char* reason = validateArchive(archive))
+  {
+    printf("Archive %s: %s\n", path, reason);
+    closeArchive(archive);
+    return false;
+  }
+
+  const ArchiveHeader* header = reinterpret_cast<const ArchiveHeader*>(archive.data);
+  archive.entries = reinterpret_cast<const ArchiveEntry*>(archive.data + header->tocOffset);
+  archive.entryCount = header->entryCount;
+
+  return true;
+}
+
+void closeArchive(AssetArchive& archive)
+{
+  if(archive.data)
+    munmap(const_cast<uint8_t*>(archive.data), archive.size);
+
+  if(archive.fd >= 0)
+    close(archive.fd);
+
+  archive = {};
+  archive.fd = -1;
+}
+
+const ArchiveEntry* findAsset(const AssetArchive& archive, const char* name)
+{
+  if(!archive.data || !name)
+    return NULL;
+
+  const ArchiveEntry* end = archive.entries + archive.entryCount;
+  const ArchiveEntry* entry = std::lower_bound(archive.entries, end, name, [](const ArchiveEntry& entry, const char* name) { return strcmp(entry.name, name) < 0; });
+
+  return entry != end && strcmp(entry->name, name) == 0 ? entry : NULL;
+}
+
+bool findMeshAsset(const AssetArchive& archive, const char* name, MeshAsset& mesh)
+{
+  const ArchiveEntry* entry = findAsset(archive, name);
+  if(!entry || entry->kind != AssetKind_Mesh || entry->size < sizeof(MeshAssetHeader))
+    return false;
+
+  const uint8_t* data = static_cast<const uint8_t*>(getAssetData(archive, *entry));
+  const MeshAssetHeader* header = reinterpret_cast<const MeshAssetHeader*>(data);
+
+  // The offsets come from the file, they have to stay inside the blob
+  uint64_t vertexBytes = uint64_t(header->vertexCount) * header->vertexSize;
+  uint64_t indexBytes = uint64_t(header->indexCount) * header->indexSize;
+
+  if(header->vertexOffset > entry->size || vertexBytes > entry->size - header->vertexOffset)
+    return false;
+  if(header->indexOffset > entry->size || indexBytes > entry->size - header->indexOffset)
+    return false;
+
+  mesh.header = header;
+  mesh.vertices = data + header->vertexOffset;
+  mesh.indices = data + header->indexOffset;
+
+  return true;
+}
+
+bool findTextureAsset(const AssetArchive& archive, const char* name, TextureAsset& texture)
+{
+  const ArchiveEntry* entry = findAsset(archive, name);
+  if(!entry || entry->kind != AssetKind_Texture || entry->size < sizeof(TextureAssetHeader))
+    return false;
+
+  const uint8_t* data = static_cast<const uint8_t*>(getAssetData(archive, *entry));
+  const TextureAssetHeader* header = reinterpret_cast<const TextureAssetHeader*>(data);
+
+  if(header->mipCount == 0 || header->mipCount > kMaxTextureMips)
+    return false;
+
+  for(uint32_t i = 0 ; i < header->mipCount ; i++)
+  {
+    if(header->mips[i].offset > entry->size || header->mips[i].size > entry->size - header->mips[i].offset)
+      return false;
+  }
+
+  texture.header = header;
+  texture.data = data;
+
+  return true;
+}
+
+bool addArchiveBlob(ArchiveWriter& writer, const char* name, AssetKind kind, std::vector<uint8_t>&& blob)
+{
+  if(strlen(name) >= kArchiveNameSize)
+  {
+    printf("Archive: name %s is longer than %u characters\n", name, kArchiveNameSize - 1);
+    return false;
+  }
+
+  for(const ArchiveEntry& entry : writer.entries)
+  {
+    if(strcmp(entry.name, name) == 0)
+    {
+      printf("Archive: %s added twice\n", name);
+      return false;
+    }
+  }
+
+  ArchiveEntry entry = {};
+  strcpy(entry.name, name);
+  entry.kind = kind;
+  entry.size = blob.size();
+
+  writer.entries.push_back(entry);
+  writer.blobs.push_back(std::move(blob));
+
+  return true;
+}
+
+static uint64_t alignArchiveOffset(uint64_t offset)
+{
+  return (offset + kArchiveAlignment - 1) / kArchiveAlignment * kArchiveAlignment;
+}
+
+bool writeArchive(const ArchiveWriter& writer, const char* path)
+{
+  // Sorted by name for the lookups, the blobs follow in the same order
+  std::vector<uint32_t> order(writer.entries.size());
+  for(uint32_t i = 0 ; i < order.size() ; i++)
+    order[i] = i;
+
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return strcmp(writer.entries[a].name, writer.entries[b].name) < 0; });
+
+  ArchiveHeader header = {};
+  header.magic = kArchiveMagic;
+  header.version = kArchiveVersion;
+  header.entryCount = uint32_t(order.size());
+  header.tocOffset = sizeof(ArchiveHeader);
+
+  std::vector<ArchiveEntry> entries(order.size());
+  uint64_t offset = alignArchiveOffset(header.tocOffset + entries.size() * sizeof(ArchiveEntry));
+
+  for(size_t i = 0 ; i < order.size() ; i++)
+  {
+    entries[i] = writer.entries[order[i]];
+    entries[i].offset = offset;
+    offset = alignArchiveOffset(offset + entries[i].size);
+  }
+
+  header.fileSize = offset;
+
+  std::vector<uint8_t> contents(size_t(header.fileSize), 0);
+  memcpy(contents.data(), &header, sizeof(header));
+  if(!entries.empty())
+    memcpy(contents.data() + header.tocOffset, entries.data(), entries.size() * sizeof(ArchiveEntry));
+
+  for(size_t i = 0 ; i < order.size() ; i++)
+  {
+    const std::vector<uint8_t>& blob = writer.blobs[order[i]];
+    memcpy(contents.data() + entries[i].offset, blob.data(), blob.size());
+  }
+
+  // Write next to the real file and rename over it, a running farvkr may still have the old one mapped
+  std::string tempPath = std::string(path) + ".tmp";
+
+  FILE* file = fopen(tempPath.c_str(), "wb");
+  if(!file)
+  {
+    printf("Archive: can't open %s for writing\n", tempPath.c_str());
+    return false;
+  }
+
+  bool written = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+  written = written && fflush(file) == 0 && fsync(fileno(file)) == 0;
+  fclose(file);
+
+  if(!written || rename(tempPath.c_str(), path) != 0)
+  {
+    printf("Archive: failed to write %s\n", path);
+    remove(tempPath.c_str());
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+const uint32_t kArchiveMagic = 0x52415646; // 'FVAR'
+const uint32_t kArchiveVersion = 1;
+
+// Every blob starts on this, enough for SPIR-V words, vertex data and any optimalBufferCopyOffsetAlignment
+const uint64_t kArchiveAlignment = 256;
+
+const uint32_t kArchiveNameSize = 104;
+const uint32_t kMaxTextureMips = 16;
+
+enum AssetKind
+{
+  AssetKind_Shader, // SPIR-V as glslc wrote it
+  AssetKind_Mesh, // MeshAssetHeader, then vertices and indices
+  AssetKind_Texture, // TextureAssetHeader, then the mips
+  AssetKind_Capture, // CaptureHeader and a recorded command stream, see capture.h
+};
+
+// File layout: header, table of contents sorted by name, then the blobs. Everything is little endian and
+// read in place, nothing is parsed or copied on load.
+struct ArchiveHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entryCount;
+  uint32_t reserved;
+  uint64_t tocOffset;
+  uint64_t fileSize; // Catches truncated files
+};
+
+struct ArchiveEntry
+{
+  char name[kArchiveNameSize]; // Path the asset was packed from, zero terminated, what lookups use
+  uint32_t kind;
+  uint32_t reserved;
+  uint64_t offset; // From the start of the file, kArchiveAlignment aligned
+  uint64_t size;
+};
+
+// Vertices in the renderer's Vertex layout, already optimized for the vertex cache and fetch
+struct MeshAssetHeader
+{
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t indexSize; // 2 when the mesh has few enough vertices, otherwise 4
+  uint32_t vertexSize;
+  float center[3];
+  float radius;
+  uint64_t vertexOffset; // From the start of the blob
+  uint64_t indexOffset;
+};
+
+struct TextureMip
+{
+  uint64_t offset; // From the start of the blob
+  uint64_t size;
+  uint32_t width, height;
+};
+
+// RGBA8 mip chain down to 1x1, largest first
+struct TextureAssetHeader
+{
+  uint32_t format; // VkFormat
+  uint32_t width, height;
+  uint32_t mipCount;
+  TextureMip mips[kMaxTextureMips];
+};
+
+// An archive mapped into memory. The pages are only read in when something touches them, shader modules and
+// staging copies read straight from the mapping.
+struct AssetArchive
+{
+  int fd;
+  const uint8_t* data; // NULL if not open
+  size_t size;
+
+  const ArchiveEntry* entries;
+  uint32_t entryCount;
+};
+
+struct MeshAsset
+{
+  const MeshAssetHeader* header;
+  const void* vertices;
+  const void* indices;
+};
+
+struct TextureAsset
+{
+  const TextureAssetHeader* header;
+  const uint8_t* data; // Blob start, add the mip offsets
+};
+
+// Checks the header and that every entry lies inside the file, prints why if it doesn't
+bool openArchive(AssetArchive& archive, const char* path);
+void closeArchive(AssetArchive& archive);
+
+// Binary search over the sorted table, NULL if it's not there
+const ArchiveEntry* findAsset(const AssetArchive& archive, const char* name);
+
+inline const void* getAssetData(const AssetArchive& archive, const ArchiveEntry& entry)
+{
+  return archive.data + entry.offset;
+}
+
+// Both return false if there's no asset of that kind with that name
+bool findMeshAsset(const AssetArchive& archive, const char* name, MeshAsset& mesh);
+bool findTextureAsset(const AssetArchive& archive, const char* name, TextureAsset& texture);
+
+// Collects blobs for farvkr-pack, writeArchive lays them out and writes the file
+struct ArchiveWriter
+{
+  std::vector<ArchiveEntry> entries;
+  std::vector<std::vector<uint8_t>> blobs;
+};
+
+bool addArchiveBlob(ArchiveWriter& writer, const char* name, AssetKind kind, std::vector<uint8_t>&& blob);
+bool writeArchive(const ArchiveWriter& writer, const char* path);
@@ -0,0 +1,708 @@
+// farvkr-bench: renders synthetic scenes offscreen for a fixed number of frames and writes what they cost to JSON.
+//
+//   farvkr-bench [--workloads draws,overdraw,pipelines,resize,upload] [--frames N] [--warmup N] [--size WxH]
+//                [--draws N] [--triangles N] [--layers N] [--pipelines N] [--upload-mb N] [--output PATH]
+//
+// Every workload runs its warm-up frames first, which aren't counted, then --frames timed ones. Per workload the
+// JSON has mean, p50 and p99 CPU and GPU frame time, frames per second and the most device memory it had at once.
+// bench_compare.py compares two of these files and fails on regressions.
+
+#include "device.h"
+#include "mesh.h"
+#include "renderpass.h"
+#include "variants.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+const VkFormat kBenchFormat = VK_FORMAT_R8G8B8A8_UNORM;
+const uint32_t kBenchFramesInFlight = 2;
+
+enum BenchWorkload
+{
+  BenchWorkload_Draws, // --draws copies of a --triangles mesh in a grid
+  BenchWorkload_Overdraw, // --layers full screen quads, each one in front of the last so every layer shades every pixel
+  BenchWorkload_Pipelines, // The draws, switching between --pipelines pipelines on every draw
+  BenchWorkload_Resize, // A single mesh into a target that changes size every frame
+  BenchWorkload_Upload, // --upload-mb through the upload ring every frame next to a single mesh
+
+  BenchWorkload_Count
+};
+
+const char* const kBenchWorkloadNames[BenchWorkload_Count] = { "draws", "overdraw", "pipelines", "resize", "upload" };
+
+struct BenchOptions
+{
+  bool workloads[BenchWorkload_Count] = { true, true, true, true, true };
+  uint32_t frames = 300;
+  uint32_t warmup = 30;
+  uint32_t width = 1920;
+  uint32_t height = 1080;
+  uint32_t draws = 1000;
+  uint32_t triangles = 1000;
+  uint32_t layers = 16;
+  uint32_t pipelines = 16;
+  uint32_t uploadMB = 16;
+  const char* outputPath = "bench.json";
+};
+
+struct BenchFrame
+{
+  VkCommandPool commandPool;
+  VkCommandBuffer commandBuffer;
+  VkQueryPool timestampPool;
+  uint64_t timelineValue; // 0 until the slot was submitted
+  int32_t timed; // Timed frame index of the frame submitted last, -1 for a warm-up frame whose GPU time doesn't count
+};
+
+// A color target per frame slot, so resizing one never waits for the GPU
+struct BenchTarget
+{
+  Image color;
+  RenderAttachments attachments;
+  VkFramebuffer framebuffer;
+  uint32_t width, height;
+  bool fresh; // Still UNDEFINED
+};
+
+// What the workloads share, made once
+struct BenchContext
+{
+  VkDevice device;
+  VkPhysicalDevice physicalDevice;
+  VkQueue queue;
+  float timestampPeriod;
+
+  MemoryAllocator* allocator;
+  UploadManager* uploader;
+  BindlessHeap* heap;
+  PipelineManager* pipelines;
+  ShaderVariantRegistry* variants;
+  VkRenderPass renderPass;
+  RenderPassConfig config;
+
+  VkSemaphore frameTimeline;
+  uint64_t frameTimelineValue;
+  BenchFrame frames[kBenchFramesInFlight];
+};
+
+struct BenchStats
+{
+  double mean, p50, p99;
+};
+
+struct BenchResult
+{
+  BenchWorkload workload;
+  std::string params;
+  BenchStats cpu; // ms from the start of recording to the submit returning
+  BenchStats gpu; // ms between timestamps at the start and end of the command buffer
+  bool gpuTimed; // The queue has timestamps
+  double fps;
+  double peakMemoryMB; // Allocator blocks and dedicated allocations plus the render attachments
+  double uploadMBPerSecond; // Upload workload only
+};
+
+static bool parseWorkloads(BenchOptions& options, const char* list)
+{
+  std::fill(options.workloads, options.workloads + BenchWorkload_Count, false);
+
+  std::string names = list;
+  size_t start = 0;
+  while(start <= names.size())
+  {
+    size_t end = names.find(',', start);
+    std::string name = names.substr(start, end == std::string::npos ? std::string::npos : end - start);
+
+    uint32_t i = 0;
+    while(i < BenchWorkload_Count && name != kBenchWorkloadNames[i])
+      i++;
+
+    if(i == BenchWorkload_Count)
+    {
+      printf("Unknown workload %s\n", name.c_str());
+      return false;
+    }
+
+    options.workloads[i] = true;
+
+    if(end == std::string::npos)
+      break;
+    start = end + 1;
+  }
+
+  return true;
+}
+
+static bool parseOptions(BenchOptions& options, int argc, char** argv)
+{
+  for(int i = 1 ; i < argc ; i++)
+  {
+    const char* arg = argv[i];
+    if(i + 1 >= argc)
+      return false;
+
+    const char* value = argv[++i];
+
+    if(strcmp(arg, "--workloads") == 0)
+    {
+      if(!parseWorkloads(options, value))
+        return false;
+    }
+    else if(strcmp(arg, "--size") == 0)
+    {
+      if(sscanf(value, "%ux%u", &options.width, &options.height) != 2 || options.width == 0 || options.height == 0)
+        return false;
+    }
+    else if(strcmp(arg, "--output") == 0)
+      options.outputPath = value;
+    else if(strcmp(arg, "--frames") == 0)
+      options.frames = std::max(atoi(value), 1);
+    else if(strcmp(arg, "--warmup") == 0)
+      options.warmup = std::max(atoi(value), 0);
+    else if(strcmp(arg, "--draws") == 0)
+      options.draws = std::max(atoi(value), 1);
+    else if(strcmp(arg, "--triangles") == 0)
+      options.triangles = std::max(atoi(value), 2);
+    else if(strcmp(arg, "--layers") == 0)
+      options.layers = std::max(atoi(value), 1);
+    else if(strcmp(arg, "--pipelines") == 0)
+      options.pipelines = std::max(atoi(value), 1);
+    else if(strcmp(arg, "--upload-mb") == 0)
+      options.uploadMB = std::max(atoi(value), 1);
+    else
+      return false;
+  }
+
+  return true;
+}
+
+static void createBenchTarget(BenchTarget& target, const BenchContext& bench, uint32_t width, uint32_t height)
+{
+  createImage(target.color, bench.device, *bench.allocator, width, height, bench.config.colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+  createRenderAttachments(target.attachments, bench.device, *bench.allocator, bench.config, width, height);
+  target.framebuffer = createFramebuffer(bench.device, bench.renderPass, target.attachments, target.color.imageView, width, height);
+  target.width = width;
+  target.height = height;
+  target.fresh = true;
+}
+
+static void destroyBenchTarget(BenchTarget& target, const BenchContext& bench)
+{
+  vkDestroyFramebuffer(bench.device, target.framebuffer, NULL);
+  destroyRenderAttachments(target.attachments, bench.device);
+  destroyImage(target.color, bench.device, *bench.allocator);
+  target.framebuffer = VK_NULL_HANDLE;
+}
+
+static BenchStats getBenchStats(std::vector<double> times)
+{
+  BenchStats stats = {};
+  if(times.empty())
+    return stats;
+
+  double total = 0;
+  for(double time : times)
+    total += time;
+
+  std::sort(times.begin(), times.end());
+
+  stats.mean = total / times.size();
+  stats.p50 = times[std::min(size_t(0.5 * times.size()), times.size() - 1)];
+  stats.p99 = times[std::min(size_t(0.99 * times.size()), times.size() - 1)];
+  return stats;
+}
+
+static bool readTimestamps(const BenchContext& bench, const BenchFrame& frame, double& gpuTime)
+{
+  uint64_t timestamps[2];
+  if(vkGetQueryPoolResults(bench.device, frame.timestampPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+    return false;
+
+  gpuTime = double(timestamps[1] - timestamps[0]) * bench.timestampPeriod * 1e-6;
+  return true;
+}
+
+// Draws with a pipeline switch before every one, the pipelines only differ in name so it's the switch that costs
+static void recordPipelineSwitches(VkCommandBuffer commandBuffer, const BenchContext& bench, const GpuMesh& mesh, const std::vector<MeshDraw>& draws, const std::vector<uint32_t>& pipelines)
+{
+  MeshTextureConstants textures = { kBindlessInvalid, kBindlessInvalid, 0, ~0u };
+  vkCmdPushConstants(commandBuffer, bench.heap->layout, kBindlessPushStages, kMeshTextureConstantsOffset, sizeof(textures), &textures);
+
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mesh.vertexBuffer.buffer, &offset);
+  vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer.buffer, 0, mesh.indexType);
+
+  for(size_t i = 0 ; i < draws.size() ; i++)
+  {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(*bench.pipelines, pipelines[i % pipelines.size()]));
+    vkCmdPushConstants(commandBuffer, bench.heap->layout, kBindlessPushStages, 0, sizeof(draws[i].transform), draws[i].transform);
+    vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, 0, 0, uint32_t(i));
+  }
+}
+
+static BenchResult runWorkload(BenchContext& bench, const BenchOptions& options, BenchWorkload workload)
+{
+  BenchResult result = {};
+  result.workload = workload;
+
+  VkDevice device = bench.device;
+  char params[128] = "";
+
+  // The scene: one mesh, the draws and the pipelines they switch between
+  Mesh source;
+  uint32_t drawCount = 1;
+  uint32_t pipelineCount = 1;
+
+  switch(workload)
+  {
+  case BenchWorkload_Draws:
+    createGridMesh(source, options.triangles);
+    drawCount = options.draws;
+    snprintf(params, sizeof(params), "%u draws x %zu triangles", drawCount, source.indices.size() / 3);
+    break;
+
+  case BenchWorkload_Overdraw:
+    createGridMesh(source, 2);
+    drawCount = options.layers;
+    snprintf(params, sizeof(params), "%u full screen layers", drawCount);
+    break;
+
+  case BenchWorkload_Pipelines:
+    createGridMesh(source, options.triangles);
+    drawCount = options.draws;
+    pipelineCount = options.pipelines;
+    snprintf(params, sizeof(params), "%u draws x %zu triangles, %u pipelines", drawCount, source.indices.size() / 3, pipelineCount);
+    break;
+
+  case BenchWorkload_Resize:
+    createGridMesh(source, options.triangles);
+    snprintf(params, sizeof(params), "%zu triangles, new target every frame", source.indices.size() / 3);
+    break;
+
+  case BenchWorkload_Upload:
+    createGridMesh(source, options.triangles);
+    snprintf(params, sizeof(params), "%u MB per frame", options.uploadMB);
+    break;
+
+  default:
+    assert(!"Unknown workload");
+  }
+
+  result.params = params;
+
+  GpuMesh mesh;
+  createGpuMesh(mesh, getMeshView(source), false, device, *bench.allocator, *bench.uploader);
+  flushUploads(*bench.uploader);
+
+  std::vector<MeshDraw> draws;
+  createDrawGrid(draws, mesh, drawCount);
+
+  if(workload == BenchWorkload_Overdraw)
+  {
+    // Every layer covers the target and is nearer than the one before, so depth testing never rejects anything
+    for(uint32_t i = 0 ; i < drawCount ; i++)
+    {
+      MeshDraw& draw = draws[i];
+      memcpy(draw.transform, mesh.transform, sizeof(draw.transform));
+      draw.transform[2] = (1.0f - 2.0f * float(i + 1) / float(drawCount + 1)) / mesh.transform[3];
+    }
+  }
+
+  std::vector<uint32_t> pipelines(pipelineCount);
+  for(uint32_t i = 0 ; i < pipelineCount ; i++)
+  {
+    PipelineDesc desc;
+    bool found = getVariantPipelineDesc(*bench.variants, "bench", "mesh_vert", "mesh_frag", 0, desc);
+    assert(found);
+    (void)found;
+
+    desc.name = "bench " + std::to_string(i);
+    pipelines[i] = addPipeline(*bench.pipelines, desc);
+  }
+
+  Buffer uploadBuffer = {};
+  std::vector<uint8_t> uploadData;
+  if(workload == BenchWorkload_Upload)
+  {
+    uploadData.resize(size_t(options.uploadMB) * 1024 * 1024, 0x5a);
+    createBuffer(uploadBuffer, device, *bench.allocator, uploadData.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  }
+
+  BenchTarget targets[kBenchFramesInFlight] = {};
+
+  waitForUploads(*bench.uploader);
+  waitForPipelines(*bench.pipelines);
+  updatePipelines(*bench.pipelines, bench.frameTimelineValue, getTimelineSemaphoreValue(device, bench.frameTimeline));
+
+  std::vector<double> cpuTimes, gpuTimes;
+  cpuTimes.reserve(options.frames);
+  gpuTimes.reserve(options.frames);
+
+  VkDeviceSize peakBytes = 0;
+  uint64_t uploadedBytes = 0;
+  double start = 0;
+
+  uint32_t frameCount = options.warmup + options.frames;
+  for(uint32_t frameIndex = 0 ; frameIndex < frameCount ; frameIndex++)
+  {
+    uint32_t frameSlot = frameIndex % kBenchFramesInFlight;
+    BenchFrame& frame = bench.frames[frameSlot];
+    BenchTarget& target = targets[frameSlot];
+
+    // The warm-up frames are all in flight or done by now, so the clock starts with a quiet queue
+    if(frameIndex == options.warmup)
+    {
+      VK_CHECK(vkQueueWaitIdle(bench.queue));
+      start = getTimeMs();
+    }
+
+    waitTimelineSemaphore(device, bench.frameTimeline, frame.timelineValue);
+
+    double gpuTime;
+    if(frame.timelineValue && frame.timed >= 0 && readTimestamps(bench, frame, gpuTime))
+      gpuTimes.push_back(gpuTime);
+
+    double frameStart = getTimeMs();
+
+    // Cycles through sizes from 5/8 of --size up to all of it, never the same twice in a row for a slot
+    uint32_t width = options.width, height = options.height;
+    if(workload == BenchWorkload_Resize)
+    {
+      uint32_t step = frameIndex % 8;
+      width = std::max(options.width * (8 - step / 2) / 8, 1u);
+      height = std::max(options.height * (8 - step / 2) / 8, 1u);
+      width -= step % 2;
+    }
+
+    if(target.framebuffer && (target.width != width || target.height != height))
+      destroyBenchTarget(target, bench);
+
+    if(!target.framebuffer)
+      createBenchTarget(target, bench, width, height);
+
+    if(workload == BenchWorkload_Upload)
+    {
+      uploadBufferData(*bench.uploader, uploadBuffer, 0, uploadData.data(), uploadData.size());
+      if(frameIndex >= options.warmup)
+        uploadedBytes += uploadData.size();
+    }
+
+    flushUploads(*bench.uploader);
+
+    VkCommandBuffer commandBuffer = frame.commandBuffer;
+
+    VK_CHECK(vkResetCommandPool(device, frame.commandPool, 0));
+
+    VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+    vkCmdResetQueryPool(commandBuffer, frame.timestampPool, 0, 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.timestampPool, 0);
+
+    uint64_t uploadWaitValue = acquireUploads(*bench.uploader, commandBuffer);
+
+    // The pass leaves the target a color attachment and expects it as one
+    if(target.fresh)
+    {
+      VkImageMemoryBarrier barrier = imageBarrier(target.color.image, 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_DEPENDENCY_BY_REGION_BIT, 0, 0, 0, 0, 1, &barrier);
+      target.fresh = false;
+    }
+
+    VkClearValue clearValues[2] = {};
+    clearValues[1].depthStencil.depth = 1.0f;
+
+    VkRenderPassBeginInfo passBeginInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+    passBeginInfo.renderPass = bench.renderPass;
+    passBeginInfo.framebuffer = target.framebuffer;
+    passBeginInfo.renderArea.extent.width = target.width;
+    passBeginInfo.renderArea.extent.height = target.height;
+    passBeginInfo.clearValueCount = 2;
+    passBeginInfo.pClearValues = clearValues;
+
+    vkCmdBeginRenderPass(commandBuffer, &passBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    VkViewport viewport = { 0, float(target.height), float(target.width), -float(target.height), 0, 1 };
+    VkRect2D scissor = {};
+    scissor.extent.width = target.width;
+    scissor.extent.height = target.height;
+
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    bindBindlessHeap(*bench.heap, commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+
+    if(workload == BenchWorkload_Pipelines)
+    {
+      recordPipelineSwitches(commandBuffer, bench, mesh, draws, pipelines);
+    }
+    else
+    {
+      MeshTextureConstants textures = { kBindlessInvalid, kBindlessInvalid, 0, ~0u };
+
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(*bench.pipelines, pipelines[0]));
+      recordDrawMesh(commandBuffer, bench.heap->layout, mesh, textures, draws.data(), draws.size(), 0, MeshDrawData_Push, NULL);
+    }
+
+    vkCmdEndRenderPass(commandBuffer);
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.timestampPool, 1);
+
+    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+    frame.timelineValue = ++bench.frameTimelineValue;
+    frame.timed = frameIndex >= options.warmup ? int32_t(frameIndex - options.warmup) : -1;
+
+    VkPipelineStageFlags uploadWaitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+    timelineInfo.waitSemaphoreValueCount = uploadWaitValue ? 1 : 0;
+    timelineInfo.pWaitSemaphoreValues = &uploadWaitValue;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &frame.timelineValue;
+
+    VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = uploadWaitValue ? 1 : 0;
+    submitInfo.pWaitSemaphores = &bench.uploader->timeline;
+    submitInfo.pWaitDstStageMask = &uploadWaitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &bench.frameTimeline;
+
+    VK_CHECK(vkQueueSubmit(bench.queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+    if(frameIndex >= options.warmup)
+      cpuTimes.push_back(getTimeMs() - frameStart);
+
+    MemoryStats memory = getMemoryStats(*bench.allocator);
+    VkDeviceSize bytes = memory.blockBytes + memory.dedicatedBytes;
+    for(const BenchTarget& other : targets)
+      if(other.framebuffer)
+        bytes += getRenderAttachmentBytes(other.attachments, device);
+
+    peakBytes = std::max(peakBytes, bytes);
+  }
+
+  // Uploads count once they're done, not once they're queued
+  waitForUploads(*bench.uploader);
+  VK_CHECK(vkDeviceWaitIdle(device));
+
+  double seconds = (getTimeMs() - start) / 1000.0;
+
+  // The last frame of each slot, then the slots start over for the next workload
+  for(BenchFrame& frame : bench.frames)
+  {
+    double gpuTime;
+    if(frame.timelineValue && frame.timed >= 0 && readTimestamps(bench, frame, gpuTime))
+      gpuTimes.push_back(gpuTime);
+
+    frame.timelineValue = 0;
+    frame.timed = -1;
+  }
+
+  result.cpu = getBenchStats(cpuTimes);
+  result.gpu = getBenchStats(gpuTimes);
+  result.gpuTimed = !gpuTimes.empty();
+  result.fps = options.frames / seconds;
+  result.peakMemoryMB = peakBytes / (1024.0 * 1024.0);
+  result.uploadMBPerSecond = uploadedBytes / (1024.0 * 1024.0) / seconds;
+
+  printf("%-10s %-40s cpu %.3f/%.3f/%.3f ms  gpu %.3f/%.3f/%.3f ms  %.1f fps  %.1f MB peak",
+    kBenchWorkloadNames[workload], params, result.cpu.mean, result.cpu.p50, result.cpu.p99, result.gpu.mean, result.gpu.p50, result.gpu.p99, result.fps, result.peakMemoryMB);
+  if(workload == BenchWorkload_Upload)
+    printf("  %.1f MB/s", result.uploadMBPerSecond);
+  printf("\n");
+
+  for(BenchTarget& target : targets)
+    if(target.framebuffer)
+      destroyBenchTarget(target, bench);
+
+  if(uploadBuffer.buffer)
+    destroyBuffer(uploadBuffer, device, *bench.allocator);
+
+  destroyGpuMesh(mesh, device, *bench.allocator);
+
+  return result;
+}
+
+static void writeStats(FILE* file, const char* name, const BenchStats& stats, bool valid)
+{
+  if(valid)
+    fprintf(file, "      \"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p99\": %.4f },\n", name, stats.mean, stats.p50, stats.p99);
+  else
+    fprintf(file, "      \"%s\": null,\n", name);
+}
+
+static bool writeResults(const char* path, const BenchOptions& options, const char* deviceName, const std::vector<BenchResult>& results)
+{
+  FILE* file = fopen(path, "w");
+  if(!file)
+  {
+    printf("Can't open %s\n", path);
+    return false;
+  }
+
+  // Device names are plain ASCII, nothing in here needs escaping
+  fprintf(file, "{\n");
+  fprintf(file, "  \"device\": \"%s\",\n", deviceName);
+  fprintf(file, "  \"width\": %u,\n  \"height\": %u,\n  \"frames\": %u,\n  \"warmup\": %u,\n", options.width, options.height, options.frames, options.warmup);
+  fprintf(file, "  \"workloads\": [\n");
+
+  for(size_t i = 0 ; i < results.size() ; i++)
+  {
+    const BenchResult& result = results[i];
+
+    fprintf(file, "    {\n");
+    fprintf(file, "      \"name\": \"%s\",\n", kBenchWorkloadNames[result.workload]);
+    fprintf(file, "      \"params\": \"%s\",\n", result.params.c_str());
+    writeStats(file, "cpu_ms", result.cpu, true);
+    writeStats(file, "gpu_ms", result.gpu, result.gpuTimed);
+    if(result.workload == BenchWorkload_Upload)
+      fprintf(file, "      \"upload_mb_per_s\": %.2f,\n", result.uploadMBPerSecond);
+    fprintf(file, "      \"fps\": %.2f,\n", result.fps);
+    fprintf(file, "      \"peak_memory_mb\": %.2f\n", result.peakMemoryMB);
+    fprintf(file, "    }%s\n", i + 1 < results.size() ? "," : "");
+  }
+
+  fprintf(file, "  ]\n}\n");
+  fclose(file);
+
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  BenchOptions options;
+  if(!parseOptions(options, argc, argv))
+  {
+    printf("Usage: %s [--workloads draws,overdraw,pipelines,resize,upload] [--frames N] [--warmup N] [--size WxH]\n", argv[0]);
+    printf("         [--draws N] [--triangles N] [--layers N] [--pipelines N] [--upload-mb N] [--output PATH]\n");
+    return 1;
+  }
+
+  VkInstance instance = createInstance(false, false);
+  assert(instance);
+
+  VkPhysicalDevice physicalDevices[16];
+  uint32_t physicalDeviceCount = sizeof(physicalDevices) / sizeof(physicalDevices[0]);
+  VK_CHECK(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices));
+
+  VkPhysicalDevice physicalDevice = pickPhysicalDevice(physicalDevices, physicalDeviceCount);
+  assert(physicalDevice);
+
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(physicalDevice, &props);
+
+  QueueFamilies families = getQueueFamilies(physicalDevice);
+  VkDevice device = createDevice(instance, physicalDevice, families, false);
+  assert(device);
+
+  Queues queues;
+  vkGetDeviceQueue(device, families.graphics, 0, &queues.graphics);
+  vkGetDeviceQueue(device, families.transfer, 0, &queues.transfer);
+
+  MemoryAllocator allocator;
+  createMemoryAllocator(allocator, device, physicalDevice);
+
+  // The same queue the renderer uploads on, so the upload workload measures what streaming gets
+  UploadManager uploader;
+  createUploadManager(uploader, device, physicalDevice, allocator, queues.transfer, families.transfer, families.graphics);
+
+  BindlessHeap heap;
+  createBindlessHeap(heap, device, physicalDevice);
+
+  PipelineCache pipelineCache;
+  createPipelineCache(pipelineCache, device, physicalDevice, "pipeline_cache.bin", false);
+
+  ShaderVariantRegistry variants;
+  if(!loadShaderVariants(variants, kShaderVariantManifest))
+    return 1;
+
+  // Single sampled so the numbers are about the workload, not the resolve
+  RenderPassConfig config = {};
+  config.colorFormat = kBenchFormat;
+  config.depthFormat = pickDepthFormat(physicalDevice);
+  config.samples = VK_SAMPLE_COUNT_1_BIT;
+  config.transient = true;
+
+  VkRenderPass renderPass = createRenderPass(device, config);
+
+  PipelineManager pipelines;
+  createPipelineManager(pipelines, device, pipelineCache, renderPass, config.samples, heap.layout, NULL, false);
+
+  BenchContext bench = {};
+  bench.device = device;
+  bench.physicalDevice = physicalDevice;
+  bench.queue = queues.graphics;
+  bench.timestampPeriod = props.limits.timestampPeriod;
+  bench.allocator = &allocator;
+  bench.uploader = &uploader;
+  bench.heap = &heap;
+  bench.pipelines = &pipelines;
+  bench.variants = &variants;
+  bench.renderPass = renderPass;
+  bench.config = config;
+  bench.frameTimeline = createTimelineSemaphore(device);
+
+  for(BenchFrame& frame : bench.frames)
+  {
+    VkCommandPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = families.graphics;
+    VK_CHECK(vkCreateCommandPool(device, &poolInfo, 0, &frame.commandPool));
+
+    VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+    allocateInfo.commandPool = frame.commandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 1;
+    VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &frame.commandBuffer));
+
+    VkQueryPoolCreateInfo queryInfo = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+    queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryInfo.queryCount = 2;
+    VK_CHECK(vkCreateQueryPool(device, &queryInfo, 0, &frame.timestampPool));
+
+    frame.timed = -1;
+  }
+
+  printf("Bench: %s, %u frames after %u warm-up at %ux%u\n", props.deviceName, options.frames, options.warmup, options.width, options.height);
+
+  std::vector<BenchResult> results;
+  for(uint32_t i = 0 ; i < BenchWorkload_Count ; i++)
+  {
+    if(options.workloads[i])
+      results.push_back(runWorkload(bench, options, BenchWorkload(i)));
+  }
+
+  bool written = writeResults(options.outputPath, options, props.deviceName, results);
+  if(written)
+    printf("Bench: results written to %s\n", options.outputPath);
+
+  for(BenchFrame& frame : bench.frames)
+  {
+    vkDestroyQueryPool(device, frame.timestampPool, NULL);
+    vkFreeCommandBuffers(device, frame.commandPool, 1, &frame.commandBuffer);
+    vkDestroyCommandPool(device, frame.commandPool, NULL);
+  }
+
+  vkDestroySemaphore(device, bench.frameTimeline, NULL);
+  destroyPipelineManager(pipelines);
+  vkDestroyRenderPass(device, renderPass, NULL);
+  destroyPipelineCache(pipelineCache, device);
+  destroyBindlessHeap(heap);
+  destroyUploadManager(uploader, allocator);
+  destroyMemoryAllocator(allocator);
+
+  vkDestroyDevice(device, NULL);
+  vkDestroyInstance(instance, NULL);
+
+  return written ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+# Compares two farvkr-bench JSON files and exits with 1 if any workload got slower or bigger than the threshold.
+#
+#   python3 bench_compare.py [--threshold PERCENT] [--min-ms MS] [--allow-missing] BASELINE CURRENT
+#
+# Times are compared at p50 and p99, fps and upload throughput the other way round. Differences under --min-ms
+# are noise on anything that fast and never fail. A baseline workload the current run doesn't have fails unless
+# --allow-missing is given, and so does one that ran with different parameters, its numbers mean nothing then.
+
+import argparse
+import json
+import sys
+
+# Metric, whether higher is worse, whether it's in ms
+METRICS = [
+  ("cpu_ms.p50", True, True),
+  ("cpu_ms.p99", True, True),
+  ("gpu_ms.p50", True, True),
+  ("gpu_ms.p99", True, True),
+  ("fps", False, False),
+  ("peak_memory_mb", True, False),
+  ("upload_mb_per_s", False, False),
+]
+
+def lookup(workload, metric):
+  value = workload
+  for key in metric.split("."):
+    if not isinstance(value, dict) or value.get(key) is None:
+      return None
+    value = value[key]
+  return value
+
+def main():
+  parser = argparse.ArgumentParser()
+  parser.add_argument("baseline")
+  parser.add_argument("current")
+  parser.add_argument("--threshold", type=float, default=10.0, help="percent a metric may get worse by")
+  parser.add_argument("--min-ms", type=float, default=0.05, help="time differences smaller than this never fail")
+  parser.add_argument("--allow-missing", action="store_true", help="baseline workloads the current run skipped don't fail")
+  args = parser.parse_args()
+
+  with open(args.baseline) as file:
+    baseline = json.load(file)
+  with open(args.current) as file:
+    current = json.load(file)
+
+  if baseline.get("device") != current.get("device"):
+    print("Warning: baseline ran on %s, current on %s" % (baseline.get("device"), current.get("device")))
+
+  before = {workload["name"]: workload for workload in baseline["workloads"]}
+  after = {workload["name"]: workload for workload in current["workloads"]}
+  regressions = 0
+  failures = 0
+
+  for name in before:
+    if name not in after:
+      print("%-10s missing from the current run%s" % (name, "" if args.allow_missing else "  FAILED"))
+      failures += not args.allow_missing
+
+  for workload in current["workloads"]:
+    name = workload["name"]
+    if name not in before:
+      print("%-10s not in the baseline" % name)
+      continue
+
+    if workload.get("params") != before[name].get("params"):
+      print("%-10s parameters changed, %s against %s  FAILED" % (name, workload.get("params"), before[name].get("params")))
+      failures += 1
+      continue
+
+    for metric, higherIsWorse, isTime in METRICS:
+      old = lookup(before[name], metric)
+      new = lookup(workload, metric)
+      if old is None or new is None or old == 0:
+        continue
+
+      change = (new - old) / old * 100.0
+      worse = change if higherIsWorse else -change
+      regressed = worse > args.threshold and not (isTime and abs(new - old) < args.min_ms)
+
+      print("%-10s %-16s %10.3f -> %10.3f  %+6.1f%%%s" % (name, metric, old, new, change, "  REGRESSION" if regressed else ""))
+      regressions += regressed
+
+  if failures:
+    print("%d workloads can't be compared" % failures)
+
+  if regressions:
+    print("%d regressions over %.1f%%" % (regressions, args.threshold))
+
+  if failures or regressions:
+    return 1
+
+  print("No regressions over %.1f%%" % args.threshold)
+  return 0
+
+if __name__ == "__main__":
+  sys.exit(main())
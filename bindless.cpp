@@ -0,0 +1,222 @@
+#include "bindless.h"
+
+#include <algorithm>
+
+static const VkDescriptorType kBindlessDescriptorTypes[BindlessKind_Count] =
+{
+  VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+  VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+  VK_DESCRIPTOR_TYPE_SAMPLER,
+  VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+};
+
+void createBindlessHeap(BindlessHeap& heap, VkDevice device, VkPhysicalDevice physicalDevice)
+{
+  VkPhysicalDeviceVulkan12Properties properties12 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES };
+  VkPhysicalDeviceProperties2 properties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+  properties.pNext = &properties12;
+  vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+  assert(properties.properties.limits.maxPushConstantsSize >= kBindlessPushConstantSize);
+
+  // The spec only guarantees 4 sets, every desktop driver has at least 8
+  assert(properties.properties.limits.maxBoundDescriptorSets > kBindlessDynamicUniformSet);
+
+  uint32_t capacities[BindlessKind_Count] =
+  {
+    std::min({ kBindlessMaxStorageBuffers, properties12.maxDescriptorSetUpdateAfterBindStorageBuffers, properties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers }),
+    std::min({ kBindlessMaxSampledImages, properties12.maxDescriptorSetUpdateAfterBindSampledImages, properties12.maxPerStageDescriptorUpdateAfterBindSampledImages }),
+    std::min({ kBindlessMaxSamplers, properties12.maxDescriptorSetUpdateAfterBindSamplers, properties12.maxPerStageDescriptorUpdateAfterBindSamplers }),
+    std::min({ kBindlessMaxStorageImages, properties12.maxDescriptorSetUpdateAfterBindStorageImages, properties12.maxPerStageDescriptorUpdateAfterBindStorageImages }),
+  };
+
+  heap.device = device;
+
+  VkDescriptorPoolSize poolSizes[BindlessKind_Count];
+  for(uint32_t kind = 0 ; kind < BindlessKind_Count ; kind++)
+    poolSizes[kind] = { kBindlessDescriptorTypes[kind], capacities[kind] };
+
+  VkDescriptorPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+  poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+  poolInfo.maxSets = BindlessKind_Count;
+  poolInfo.poolSizeCount = BindlessKind_Count;
+  poolInfo.pPoolSizes = poolSizes;
+  VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, 0, &heap.descriptorPool));
+
+  static_assert(kBindlessDynamicUniformSet == BindlessKind_Count, "the dynamic uniform set goes right after the bindless ones");
+  VkDescriptorSetLayout setLayouts[BindlessKind_Count + 1];
+
+  for(uint32_t kind = 0 ; kind < BindlessKind_Count ; kind++)
+  {
+    BindlessTable& table = heap.tables[kind];
+
+    // Slots that were never written are fine as long as no shader reads them, and writing new slots
+    // doesn't disturb command buffers that are still pending
+    VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
+    bindingFlagsInfo.bindingCount = 1;
+    bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.binding = 0;
+    binding.descriptorType = kBindlessDescriptorTypes[kind];
+    binding.descriptorCount = capacities[kind];
+    binding.stageFlags = kBindlessPushStages;
+
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+    setLayoutInfo.pNext = &bindingFlagsInfo;
+    setLayoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    setLayoutInfo.bindingCount = 1;
+    setLayoutInfo.pBindings = &binding;
+    VK_CHECK(vkCreateDescriptorSetLayout(device, &setLayoutInfo, 0, &table.setLayout));
+
+    VkDescriptorSetAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+    allocateInfo.descriptorPool = heap.descriptorPool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &table.setLayout;
+    VK_CHECK(vkAllocateDescriptorSets(device, &allocateInfo, &table.set));
+
+    table.capacity = capacities[kind];
+    table.next = 0;
+
+    setLayouts[kind] = table.setLayout;
+  }
+
+  // A plain set, not update after bind, it's written once when the buffer behind it is created
+  VkDescriptorSetLayoutBinding dynamicUniformBinding = {};
+  dynamicUniformBinding.binding = 0;
+  dynamicUniformBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+  dynamicUniformBinding.descriptorCount = 1;
+  dynamicUniformBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+  VkDescriptorSetLayoutCreateInfo dynamicUniformInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+  dynamicUniformInfo.bindingCount = 1;
+  dynamicUniformInfo.pBindings = &dynamicUniformBinding;
+  VK_CHECK(vkCreateDescriptorSetLayout(device, &dynamicUniformInfo, 0, &heap.dynamicUniformLayout));
+
+  setLayouts[kBindlessDynamicUniformSet] = heap.dynamicUniformLayout;
+
+  VkPushConstantRange pushConstantRange = {};
+  pushConstantRange.stageFlags = kBindlessPushStages;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = kBindlessPushConstantSize;
+
+  VkPipelineLayoutCreateInfo layoutInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+  layoutInfo.setLayoutCount = BindlessKind_Count + 1;
+  layoutInfo.pSetLayouts = setLayouts;
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges = &pushConstantRange;
+  VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, 0, &heap.layout));
+
+  printf("Bindless: %u storage buffers, %u sampled images, %u samplers, %u storage images\n", capacities[0], capacities[1], capacities[2], capacities[3]);
+}
+
+void destroyBindlessHeap(BindlessHeap& heap)
+{
+  vkDestroyPipelineLayout(heap.device, heap.layout, 0);
+
+  // Destroying the pool frees the sets
+  vkDestroyDescriptorPool(heap.device, heap.descriptorPool, 0);
+
+  for(BindlessTable& table : heap.tables)
+    vkDestroyDescriptorSetLayout(heap.device, table.setLayout, 0);
+
+  vkDestroyDescriptorSetLayout(heap.device, heap.dynamicUniformLayout, 0);
+}
+
+// Call with the mutex held
+static uint32_t allocateIndex(BindlessTable& table)
+{
+  if(!table.freeList.empty())
+  {
+    uint32_t index = table.freeList.back();
+    table.freeList.pop_back();
+    return index;
+  }
+
+  assert(table.next < table.capacity);
+  return table.next++;
+}
+
+static void writeDescriptor(BindlessHeap& heap, BindlessKind kind, uint32_t index, const VkDescriptorBufferInfo* bufferInfo, const VkDescriptorImageInfo* imageInfo)
+{
+  VkWriteDescriptorSet write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+  write.dstSet = heap.tables[kind].set;
+  write.dstBinding = 0;
+  write.dstArrayElement = index;
+  write.descriptorCount = 1;
+  write.descriptorType = kBindlessDescriptorTypes[kind];
+  write.pBufferInfo = bufferInfo;
+  write.pImageInfo = imageInfo;
+
+  vkUpdateDescriptorSets(heap.device, 1, &write, 0, 0);
+}
+
+uint32_t registerStorageBuffer(BindlessHeap& heap, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+  std::lock_guard<std::mutex> lock(heap.mutex);
+
+  uint32_t index = allocateIndex(heap.tables[BindlessKind_StorageBuffer]);
+
+  VkDescriptorBufferInfo bufferInfo = { buffer, offset, range };
+  writeDescriptor(heap, BindlessKind_StorageBuffer, index, &bufferInfo, NULL);
+
+  return index;
+}
+
+uint32_t registerSampledImage(BindlessHeap& heap, VkImageView imageView, VkImageLayout layout)
+{
+  std::lock_guard<std::mutex> lock(heap.mutex);
+
+  uint32_t index = allocateIndex(heap.tables[BindlessKind_SampledImage]);
+
+  VkDescriptorImageInfo imageInfo = { VK_NULL_HANDLE, imageView, layout };
+  writeDescriptor(heap, BindlessKind_SampledImage, index, NULL, &imageInfo);
+
+  return index;
+}
+
+uint32_t registerSampler(BindlessHeap& heap, VkSampler sampler)
+{
+  std::lock_guard<std::mutex> lock(heap.mutex);
+
+  uint32_t index = allocateIndex(heap.tables[BindlessKind_Sampler]);
+
+  VkDescriptorImageInfo imageInfo = { sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED };
+  writeDescriptor(heap, BindlessKind_Sampler, index, NULL, &imageInfo);
+
+  return index;
+}
+
+uint32_t registerStorageImage(BindlessHeap& heap, VkImageView imageView)
+{
+  std::lock_guard<std::mutex> lock(heap.mutex);
+
+  uint32_t index = allocateIndex(heap.tables[BindlessKind_StorageImage]);
+
+  VkDescriptorImageInfo imageInfo = { VK_NULL_HANDLE, imageView, VK_IMAGE_LAYOUT_GENERAL };
+  writeDescriptor(heap, BindlessKind_StorageImage, index, NULL, &imageInfo);
+
+  return index;
+}
+
+void releaseBindless(BindlessHeap& heap, BindlessKind kind, uint32_t index)
+{
+  if(index == kBindlessInvalid)
+    return;
+
+  std::lock_guard<std::mutex> lock(heap.mutex);
+
+  assert(index < heap.tables[kind].next);
+  heap.tables[kind].freeList.push_back(index);
+}
+
+void bindBindlessHeap(const BindlessHeap& heap, VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint)
+{
+  VkDescriptorSet sets[BindlessKind_Count];
+  for(uint32_t kind = 0 ; kind < BindlessKind_Count ; kind++)
+    sets[kind] = heap.tables[kind].set;
+
+  vkCmdBindDescriptorSets(commandBuffer, bindPoint, heap.layout, 0, BindlessKind_Count, sets, 0, 0);
+}
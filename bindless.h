@@ -0,0 +1,76 @@
+#pragma once
+
+#include "common.h"
+
+#include <mutex>
+#include <vector>
+
+// Upper bounds, lowered to what the device allows
+const uint32_t kBindlessMaxStorageBuffers = 65536;
+const uint32_t kBindlessMaxSampledImages = 65536;
+const uint32_t kBindlessMaxSamplers = 4096;
+const uint32_t kBindlessMaxStorageImages = 4096;
+
+// Every pipeline shares one layout with a 128 byte push constant block visible to all stages, 128 is the
+// most every device is guaranteed to have. Pushes always use this stage mask, the spec wants the full mask
+// of the range for every byte that is written.
+const uint32_t kBindlessPushConstantSize = 128;
+const VkShaderStageFlags kBindlessPushStages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+const uint32_t kBindlessInvalid = ~0u;
+
+// After the bindless sets, one dynamic uniform buffer for per draw data that doesn't fit in push constants.
+// It's bound per draw at a dynamic offset, see TransientAllocator. 256 bytes is the largest alignment
+// dynamic offsets can need, so a block of this size never overlaps the next draw's.
+const uint32_t kBindlessDynamicUniformSet = 4;
+const uint32_t kBindlessDynamicUniformRange = 256;
+
+// Set numbers match the declarations in the shaders
+enum BindlessKind
+{
+  BindlessKind_StorageBuffer, // set 0
+  BindlessKind_SampledImage, // set 1
+  BindlessKind_Sampler, // set 2
+  BindlessKind_StorageImage, // set 3, always in GENERAL layout
+
+  BindlessKind_Count
+};
+
+struct BindlessTable
+{
+  VkDescriptorSetLayout setLayout;
+  VkDescriptorSet set;
+  uint32_t capacity;
+
+  uint32_t next; // Never handed out past this
+  std::vector<uint32_t> freeList;
+};
+
+// One big update-after-bind descriptor set per resource kind. Registering a resource writes its descriptor
+// and returns a stable index the shaders use to find it, passed in push constants or other buffers. The sets
+// are bound once per command buffer, so draws never bind descriptors no matter how many resources there are.
+struct BindlessHeap
+{
+  VkDevice device;
+  VkDescriptorPool descriptorPool;
+  VkPipelineLayout layout;
+  VkDescriptorSetLayout dynamicUniformLayout; // Set kBindlessDynamicUniformSet, whoever binds it allocates the set
+
+  std::mutex mutex; // Registering can happen from any thread
+  BindlessTable tables[BindlessKind_Count];
+};
+
+// Needs the descriptor indexing features createDevice turns on
+void createBindlessHeap(BindlessHeap& heap, VkDevice device, VkPhysicalDevice physicalDevice);
+void destroyBindlessHeap(BindlessHeap& heap);
+
+uint32_t registerStorageBuffer(BindlessHeap& heap, VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+uint32_t registerSampledImage(BindlessHeap& heap, VkImageView imageView, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+uint32_t registerSampler(BindlessHeap& heap, VkSampler sampler);
+uint32_t registerStorageImage(BindlessHeap& heap, VkImageView imageView);
+
+// The index is reused by the next register call, so no frame in flight may still be using it
+void releaseBindless(BindlessHeap& heap, BindlessKind kind, uint32_t index);
+
+// Call once per command buffer (secondaries too, they don't inherit bindings) for each bind point used
+void bindBindlessHeap(const BindlessHeap& heap, VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint);
@@ -0,0 +1,381 @@
+#include "capture.h"
+
+#include <string.h>
+
+void createCommandCapture(CommandCapture& capture, const char* path, uint32_t frameLimit, const PipelineManager& pipelines, const MeshView& mesh, bool quantized, VkFormat colorFormat, VkFormat depthFormat, VkSampleCountFlagBits samples)
+{
+  capture.path = path;
+  capture.frameLimit = frameLimit;
+
+  capture.pipelines = &pipelines;
+  capture.mesh = mesh;
+  capture.quantized = quantized;
+  capture.colorFormat = colorFormat;
+  capture.depthFormat = depthFormat;
+  capture.samples = samples;
+
+  capture.recording = false;
+  capture.written = false;
+  capture.target = VK_NULL_HANDLE;
+  capture.startTime = 0;
+
+  capture.frameStart = 0;
+  capture.frameCount = 0;
+}
+
+bool beginCaptureFrame(CommandCapture& capture, uint32_t frameIndex, uint32_t width, uint32_t height, VkImage target)
+{
+  assert(!capture.recording);
+
+  if(capture.written || capture.frameCount == capture.frameLimit)
+    return false;
+
+  double now = getTimeMs();
+  if(capture.frameCount == 0)
+    capture.startTime = now;
+
+  CaptureFrameHeader header = {};
+  header.frameIndex = frameIndex;
+  header.width = width;
+  header.height = height;
+  header.time = now - capture.startTime;
+
+  capture.frameStart = capture.frames.size();
+  capture.frames.resize(capture.frameStart + sizeof(header));
+  memcpy(capture.frames.data() + capture.frameStart, &header, sizeof(header));
+
+  capture.target = target;
+  capture.recording = true;
+
+  return true;
+}
+
+void endCaptureFrame(CommandCapture& capture)
+{
+  if(!capture.recording)
+    return;
+
+  // Frames start 8 byte aligned, the header has a double in it
+  capture.frames.resize((capture.frames.size() + 7) & ~size_t(7), 0);
+
+  CaptureFrameHeader* header = reinterpret_cast<CaptureFrameHeader*>(capture.frames.data() + capture.frameStart);
+  header->size = uint32_t(capture.frames.size() - capture.frameStart - sizeof(CaptureFrameHeader));
+
+  capture.recording = false;
+  capture.frameCount++;
+
+  if(capture.frameCount == capture.frameLimit)
+    printf("Capture: %u frames recorded, written at exit\n", capture.frameCount);
+}
+
+// Appends the command header and returns where the payload goes
+static uint8_t* appendCommand(CommandCapture& capture, CaptureCommand kind, size_t size)
+{
+  size_t padded = (size + 3) & ~size_t(3);
+  assert(padded <= 0xffff);
+
+  CaptureCommandHeader header = { uint16_t(kind), uint16_t(padded) };
+
+  size_t offset = capture.frames.size();
+  capture.frames.resize(offset + sizeof(header) + padded, 0);
+  memcpy(capture.frames.data() + offset, &header, sizeof(header));
+
+  return capture.frames.data() + offset + sizeof(header);
+}
+
+void captureBarriers(CommandCapture* capture, const VkMemoryBarrier2KHR* memoryBarrier, const VkImageMemoryBarrier2KHR* imageBarriers, uint32_t imageBarrierCount)
+{
+  if(!isCapturing(capture))
+    return;
+
+  CaptureBarrier barrier = {};
+  barrier.memoryBarrier = memoryBarrier ? 1 : 0;
+  barrier.imageBarrierCount = imageBarrierCount;
+
+  if(memoryBarrier)
+  {
+    barrier.srcStageMask = memoryBarrier->srcStageMask;
+    barrier.srcAccessMask = memoryBarrier->srcAccessMask;
+    barrier.dstStageMask = memoryBarrier->dstStageMask;
+    barrier.dstAccessMask = memoryBarrier->dstAccessMask;
+  }
+
+  uint8_t* data = appendCommand(*capture, CaptureCommand_Barrier, sizeof(barrier) + imageBarrierCount * sizeof(CaptureImageBarrier));
+  memcpy(data, &barrier, sizeof(barrier));
+
+  for(uint32_t i = 0 ; i < imageBarrierCount ; i++)
+  {
+    const VkImageMemoryBarrier2KHR& source = imageBarriers[i];
+
+    // Scenes that render through anything but the target aren't captured, see main
+    assert(source.image == capture->target);
+
+    CaptureImageBarrier image = {};
+    image.srcStageMask = source.srcStageMask;
+    image.srcAccessMask = source.srcAccessMask;
+    image.dstStageMask = source.dstStageMask;
+    image.dstAccessMask = source.dstAccessMask;
+    image.oldLayout = source.oldLayout;
+    image.newLayout = source.newLayout;
+
+    memcpy(data + sizeof(barrier) + i * sizeof(image), &image, sizeof(image));
+  }
+}
+
+void captureBeginPass(CommandCapture* capture, const VkClearValue& color, const VkClearValue& depth)
+{
+  if(!isCapturing(capture))
+    return;
+
+  CaptureBeginPass pass = {};
+  memcpy(pass.clearColor, color.color.float32, sizeof(pass.clearColor));
+  pass.clearDepth = depth.depthStencil.depth;
+
+  memcpy(appendCommand(*capture, CaptureCommand_BeginPass, sizeof(pass)), &pass, sizeof(pass));
+}
+
+void captureEndPass(CommandCapture* capture)
+{
+  if(isCapturing(capture))
+    appendCommand(*capture, CaptureCommand_EndPass, 0);
+}
+
+void captureBindPipeline(CommandCapture* capture, uint32_t pipeline)
+{
+  if(!isCapturing(capture))
+    return;
+
+  uint32_t index = 0;
+  while(index < capture->pipelineHandles.size() && capture->pipelineHandles[index] != pipeline)
+    index++;
+
+  // First time this pipeline is bound, what it was built from goes in the table
+  if(index == capture->pipelineHandles.size())
+  {
+    const PipelineDesc& desc = capture->pipelines->pipelines[pipeline].desc;
+
+    CapturePipeline entry = {};
+    strncpy(entry.name, desc.name.c_str(), kArchiveNameSize - 1);
+    strncpy(entry.shaders[0], desc.shaders[0].c_str(), kArchiveNameSize - 1);
+    strncpy(entry.shaders[1], desc.shaders[1].c_str(), kArchiveNameSize - 1);
+    entry.kind = desc.kind;
+    entry.quantized = desc.quantized;
+    entry.features = desc.features;
+    entry.specialized[0] = desc.specialized[0];
+    entry.specialized[1] = desc.specialized[1];
+
+    capture->pipelineHandles.push_back(pipeline);
+    capture->pipelineTable.push_back(entry);
+  }
+
+  memcpy(appendCommand(*capture, CaptureCommand_BindPipeline, sizeof(index)), &index, sizeof(index));
+}
+
+void captureBindMesh(CommandCapture* capture)
+{
+  if(isCapturing(capture))
+    appendCommand(*capture, CaptureCommand_BindMesh, 0);
+}
+
+void capturePushConstants(CommandCapture* capture, uint32_t offset, uint32_t size, const void* data)
+{
+  if(!isCapturing(capture))
+    return;
+
+  assert(size % 4 == 0);
+
+  uint8_t* payload = appendCommand(*capture, CaptureCommand_PushConstants, sizeof(offset) + size);
+  memcpy(payload, &offset, sizeof(offset));
+  memcpy(payload + sizeof(offset), data, size);
+}
+
+void captureDrawData(CommandCapture* capture, const MeshDraw& draw)
+{
+  if(isCapturing(capture))
+    memcpy(appendCommand(*capture, CaptureCommand_DrawData, sizeof(draw)), &draw, sizeof(draw));
+}
+
+void captureDrawIndexed(CommandCapture* capture, uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance)
+{
+  if(!isCapturing(capture))
+    return;
+
+  CaptureDraw draw = { indexCount, instanceCount, firstIndex, vertexOffset, firstInstance };
+  memcpy(appendCommand(*capture, CaptureCommand_DrawIndexed, sizeof(draw)), &draw, sizeof(draw));
+}
+
+static bool readShader(const char* path, const AssetArchive* archive, std::vector<uint8_t>& code)
+{
+  // The same order the pipeline manager looks in
+  if(const ArchiveEntry* entry = archive ? findAsset(*archive, path) : NULL)
+  {
+    const uint8_t* data = static_cast<const uint8_t*>(getAssetData(*archive, *entry));
+    code.assign(data, data + entry->size);
+    return true;
+  }
+
+  FILE* file = fopen(path, "rb");
+  if(!file)
+    return false;
+
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  code.resize(length > 0 ? size_t(length) : 0);
+  size_t rc = fread(code.data(), 1, code.size(), file);
+  fclose(file);
+
+  return length > 0 && rc == code.size();
+}
+
+static bool hasArchiveBlob(const ArchiveWriter& writer, const char* name)
+{
+  for(const ArchiveEntry& entry : writer.entries)
+  {
+    if(strcmp(entry.name, name) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+static std::vector<uint8_t> packCaptureMesh(const MeshView& mesh)
+{
+  MeshAssetHeader header = {};
+  header.vertexCount = uint32_t(mesh.vertexCount);
+  header.indexCount = uint32_t(mesh.indexCount);
+  header.indexSize = mesh.shortIndices ? 2 : 4;
+  header.vertexSize = sizeof(Vertex);
+  memcpy(header.center, mesh.center, sizeof(header.center));
+  header.radius = mesh.radius;
+  header.vertexOffset = sizeof(MeshAssetHeader);
+  header.indexOffset = header.vertexOffset + uint64_t(header.vertexCount) * header.vertexSize;
+
+  std::vector<uint8_t> blob(size_t(header.indexOffset + uint64_t(header.indexCount) * header.indexSize));
+  memcpy(blob.data(), &header, sizeof(header));
+  memcpy(blob.data() + header.vertexOffset, mesh.vertices, mesh.vertexCount * sizeof(Vertex));
+  memcpy(blob.data() + header.indexOffset, mesh.indices, mesh.indexCount * header.indexSize);
+
+  return blob;
+}
+
+bool writeCommandCapture(CommandCapture& capture, const AssetArchive* shaderArchive)
+{
+  assert(!capture.recording);
+
+  if(capture.written)
+    return true;
+
+  capture.written = true;
+
+  if(capture.frameCount == 0)
+  {
+    printf("Capture: no frames were captured, %s not written\n", capture.path.c_str());
+    return false;
+  }
+
+  CaptureHeader header = {};
+  header.magic = kCaptureMagic;
+  header.version = kCaptureVersion;
+  header.frameCount = capture.frameCount;
+  header.pipelineCount = uint32_t(capture.pipelineTable.size());
+  header.colorFormat = capture.colorFormat;
+  header.depthFormat = capture.depthFormat;
+  header.samples = capture.samples;
+  header.quantized = capture.quantized;
+  header.pipelineOffset = sizeof(CaptureHeader);
+  header.frameOffset = (header.pipelineOffset + capture.pipelineTable.size() * sizeof(CapturePipeline) + 7) & ~uint64_t(7);
+
+  std::vector<uint8_t> stream(size_t(header.frameOffset) + capture.frames.size(), 0);
+  memcpy(stream.data(), &header, sizeof(header));
+  memcpy(stream.data() + header.pipelineOffset, capture.pipelineTable.data(), capture.pipelineTable.size() * sizeof(CapturePipeline));
+  memcpy(stream.data() + header.frameOffset, capture.frames.data(), capture.frames.size());
+
+  ArchiveWriter writer;
+  bool added = addArchiveBlob(writer, kCaptureStreamName, AssetKind_Capture, std::move(stream));
+  added = added && addArchiveBlob(writer, kCaptureMeshName, AssetKind_Mesh, packCaptureMesh(capture.mesh));
+
+  for(const CapturePipeline& pipeline : capture.pipelineTable)
+  {
+    for(const char* path : pipeline.shaders)
+    {
+      if(!added || !path[0] || hasArchiveBlob(writer, path))
+        continue;
+
+      std::vector<uint8_t> code;
+      if(!readShader(path, shaderArchive, code))
+      {
+        printf("Capture: can't read %s\n", path);
+        added = false;
+        break;
+      }
+
+      added = addArchiveBlob(writer, path, AssetKind_Shader, std::move(code));
+    }
+  }
+
+  if(!added || !writeArchive(writer, capture.path.c_str()))
+    return false;
+
+  size_t total = 0;
+  for(const ArchiveEntry& entry : writer.entries)
+    total += entry.size;
+
+  printf("Capture: wrote %u frames, %zu pipelines to %s, %.1f KB (%.1f KB of commands)\n", capture.frameCount, capture.pipelineTable.size(), capture.path.c_str(), total / 1024.0, capture.frames.size() / 1024.0);
+  return true;
+}
+
+bool openCaptureStream(CaptureStream& stream, const AssetArchive& archive)
+{
+  const ArchiveEntry* entry = findAsset(archive, kCaptureStreamName);
+  if(!entry || entry->kind != AssetKind_Capture || entry->size < sizeof(CaptureHeader))
+  {
+    printf("Capture: no command stream in the archive\n");
+    return false;
+  }
+
+  const uint8_t* data = static_cast<const uint8_t*>(getAssetData(archive, *entry));
+  const CaptureHeader* header = reinterpret_cast<const CaptureHeader*>(data);
+
+  if(header->magic != kCaptureMagic || header->version != kCaptureVersion)
+  {
+    printf("Capture: not a version %u capture\n", kCaptureVersion);
+    return false;
+  }
+
+  uint64_t pipelineBytes = uint64_t(header->pipelineCount) * sizeof(CapturePipeline);
+  if(header->pipelineOffset > entry->size || pipelineBytes > entry->size - header->pipelineOffset || header->frameOffset > entry->size || header->frameOffset % 8 != 0)
+  {
+    printf("Capture: the tables don't fit in the stream\n");
+    return false;
+  }
+
+  stream.header = header;
+  stream.pipelines = reinterpret_cast<const CapturePipeline*>(data + header->pipelineOffset);
+  stream.frames.clear();
+
+  uint64_t offset = header->frameOffset;
+  for(uint32_t i = 0 ; i < header->frameCount ; i++)
+  {
+    if(sizeof(CaptureFrameHeader) > entry->size - offset)
+    {
+      printf("Capture: truncated at frame %u\n", i);
+      return false;
+    }
+
+    const CaptureFrameHeader* frame = reinterpret_cast<const CaptureFrameHeader*>(data + offset);
+    offset += sizeof(CaptureFrameHeader);
+
+    if(frame->size > entry->size - offset)
+    {
+      printf("Capture: truncated at frame %u\n", i);
+      return false;
+    }
+
+    stream.frames.push_back(frame);
+    offset += frame->size;
+  }
+
+  return true;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "archive.h"
+#include "mesh.h"
+#include "pipelines.h"
+
+#include <string>
+#include <vector>
+
+const uint32_t kCaptureMagic = 0x50414346; // 'FCAP'
+const uint32_t kCaptureVersion = 1;
+
+// The capture is an asset archive: the command stream and the mesh under these names, and every shader the
+// pipelines use under its path, so the replay's pipeline manager finds them the way it would in --archive
+const char* const kCaptureStreamName = "capture";
+const char* const kCaptureMeshName = "capture mesh";
+
+// Every command is a CaptureCommandHeader and its payload, padded to 4 bytes
+enum CaptureCommand
+{
+  CaptureCommand_Barrier, // CaptureBarrier, then imageBarrierCount CaptureImageBarrier
+  CaptureCommand_BeginPass, // CaptureBeginPass, the viewport and scissor cover the target
+  CaptureCommand_EndPass,
+  CaptureCommand_BindPipeline, // uint32_t into the pipeline table, and the bindless heap
+  CaptureCommand_BindMesh, // The mesh's vertex and index buffer
+  CaptureCommand_PushConstants, // uint32_t offset, then the bytes
+  CaptureCommand_DrawData, // A MeshDraw for transient uniform memory, bound at its dynamic offset
+  CaptureCommand_DrawIndexed, // CaptureDraw
+
+  CaptureCommand_Count
+};
+
+struct CaptureCommandHeader
+{
+  uint16_t kind;
+  uint16_t size; // Payload bytes, a multiple of 4
+};
+
+// All of it in sync2 terms, the replay goes through vkCmdPipelineBarrier without it like the render graph does
+struct CaptureBarrier
+{
+  uint32_t memoryBarrier; // 1 if the memory fields are used
+  uint32_t imageBarrierCount;
+  uint64_t srcStageMask, srcAccessMask;
+  uint64_t dstStageMask, dstAccessMask;
+};
+
+// Only the frame's color target has barriers in a capture
+struct CaptureImageBarrier
+{
+  uint64_t srcStageMask, srcAccessMask;
+  uint64_t dstStageMask, dstAccessMask;
+  uint32_t oldLayout, newLayout;
+};
+
+struct CaptureBeginPass
+{
+  float clearColor[4];
+  float clearDepth;
+};
+
+struct CaptureDraw
+{
+  uint32_t indexCount;
+  uint32_t instanceCount;
+  uint32_t firstIndex;
+  int32_t vertexOffset;
+  uint32_t firstInstance;
+};
+
+struct CapturePipeline
+{
+  char name[kArchiveNameSize];
+  char shaders[2][kArchiveNameSize]; // Paths, the shaders are in the archive under them
+  uint32_t kind;
+  uint32_t quantized;
+  uint32_t features;
+  uint32_t specialized[2];
+};
+
+struct CaptureFrameHeader
+{
+  uint32_t frameIndex; // The renderer's, frames it didn't capture leave gaps
+  uint32_t width, height;
+  uint32_t size; // Bytes of commands after the header
+  double time; // ms since the first captured frame began recording, for replaying at the original pace
+};
+
+// Start of the kCaptureStreamName blob, then the pipeline table and the frames one after the other
+struct CaptureHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t frameCount;
+  uint32_t pipelineCount;
+  uint32_t colorFormat; // The render pass the frames were recorded in
+  uint32_t depthFormat;
+  uint32_t samples;
+  uint32_t quantized; // The mesh was uploaded quantized
+  uint64_t pipelineOffset; // From the start of the blob
+  uint64_t frameOffset;
+};
+
+// Records the commands of up to frameLimit frames as the renderer issues them and writes them out with the
+// mesh and the shaders once it's done. Only the render thread, or the job recording the frame, touches it.
+// Draws are captured inline, so a capture always records without secondaries: the commands are the same,
+// just in one stream.
+struct CommandCapture
+{
+  std::string path;
+  uint32_t frameLimit;
+
+  const PipelineManager* pipelines;
+  MeshView mesh; // Has to stay valid until the capture is written
+  bool quantized;
+  VkFormat colorFormat, depthFormat;
+  VkSampleCountFlagBits samples;
+
+  bool recording; // Between beginCaptureFrame and endCaptureFrame
+  bool written;
+  VkImage target; // The frame's color target, the only image barriers may be for
+  double startTime;
+
+  std::vector<uint32_t> pipelineHandles; // Manager handles, the index is what BindPipeline records
+  std::vector<CapturePipeline> pipelineTable;
+  std::vector<uint8_t> frames; // CaptureFrameHeader and commands for every frame so far
+  size_t frameStart; // Of the frame being recorded in frames
+  uint32_t frameCount;
+};
+
+void createCommandCapture(CommandCapture& capture, const char* path, uint32_t frameLimit, const PipelineManager& pipelines, const MeshView& mesh, bool quantized, VkFormat colorFormat, VkFormat depthFormat, VkSampleCountFlagBits samples);
+
+// Returns false once the limit is reached, the frame isn't captured then. The frame renders into target.
+bool beginCaptureFrame(CommandCapture& capture, uint32_t frameIndex, uint32_t width, uint32_t height, VkImage target);
+void endCaptureFrame(CommandCapture& capture);
+
+inline bool isCapturing(const CommandCapture* capture)
+{
+  return capture && capture->recording;
+}
+
+// Each does nothing unless isCapturing
+void captureBarriers(CommandCapture* capture, const VkMemoryBarrier2KHR* memoryBarrier, const VkImageMemoryBarrier2KHR* imageBarriers, uint32_t imageBarrierCount);
+void captureBeginPass(CommandCapture* capture, const VkClearValue& color, const VkClearValue& depth);
+void captureEndPass(CommandCapture* capture);
+void captureBindPipeline(CommandCapture* capture, uint32_t pipeline);
+void captureBindMesh(CommandCapture* capture);
+void capturePushConstants(CommandCapture* capture, uint32_t offset, uint32_t size, const void* data);
+void captureDrawData(CommandCapture* capture, const MeshDraw& draw);
+void captureDrawIndexed(CommandCapture* capture, uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance);
+
+// Writes the archive, once. shaderArchive is where the shaders came from if they didn't come from files.
+bool writeCommandCapture(CommandCapture& capture, const AssetArchive* shaderArchive);
+
+// The replay side: the header, pipeline table and frames of a capture archive, all pointing into the mapping
+struct CaptureStream
+{
+  const CaptureHeader* header;
+  const CapturePipeline* pipelines;
+  std::vector<const CaptureFrameHeader*> frames; // Each one's commands follow it
+};
+
+// Checks the header and walks the frames, prints why if something's off
+bool openCaptureStream(CaptureStream& stream, const AssetArchive& archive);
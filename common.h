@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdio.h>
+#include <cassert>
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+
+#define VK_CHECK(call) do { VkResult result_ = call; assert(result_ == VK_SUCCESS); } while(0)
+
+// Wall clock in milliseconds, only meaningful as a difference between two calls
+inline double getTimeMs()
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,97 @@
+#include "culling.h"
+
+#include <string.h>
+
+const uint32_t kCullGroupSize = 64; // local_size_x in cull_comp.glsl
+const VkDeviceSize kDrawHeaderSize = 16; // Count at the start of the draw buffer, padded so the draws stay aligned
+
+// Matches the push constant block in cull_comp.glsl, exactly the 128 bytes every device has
+struct CullConstants
+{
+  float planes[6][4];
+  float meshSphere[4];
+  uint32_t objectCount;
+  uint32_t indexCount;
+  uint32_t objectBuffer;
+  uint32_t drawBuffer;
+};
+
+static_assert(sizeof(CullConstants) <= kBindlessPushConstantSize, "cull constants don't fit in the push constant block");
+
+// There is no camera yet, mesh_vert.glsl puts [-1, 1] on every axis straight into clip space
+static const float kViewFrustum[6][4] =
+{
+  { 1, 0, 0, 1 }, { -1, 0, 0, 1 },
+  { 0, 1, 0, 1 }, { 0, -1, 0, 1 },
+  { 0, 0, 1, 1 }, { 0, 0, -1, 1 },
+};
+
+bool isGpuCullingSupported(VkPhysicalDevice physicalDevice)
+{
+  VkPhysicalDeviceVulkan12Features features12 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+  VkPhysicalDeviceFeatures2 features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+  features.pNext = &features12;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+  return features.features.multiDrawIndirect && features.features.drawIndirectFirstInstance && features12.drawIndirectCount;
+}
+
+void createGpuCulling(GpuCulling& culling, VkDevice device, MemoryAllocator& allocator, UploadManager& uploader, BindlessHeap& heap, const std::vector<MeshDraw>& draws)
+{
+  culling.objectCount = uint32_t(draws.size());
+
+  createBuffer(culling.objectBuffer, device, allocator, draws.size() * sizeof(MeshDraw), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  createBuffer(culling.drawBuffer, device, allocator, kDrawHeaderSize + draws.size() * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  culling.uploadToken = uploadBufferData(uploader, culling.objectBuffer, 0, draws.data(), draws.size() * sizeof(MeshDraw));
+
+  culling.objectHandle = registerStorageBuffer(heap, culling.objectBuffer.buffer);
+  culling.drawHandle = registerStorageBuffer(heap, culling.drawBuffer.buffer);
+}
+
+void destroyGpuCulling(GpuCulling& culling, VkDevice device, MemoryAllocator& allocator, BindlessHeap& heap)
+{
+  releaseBindless(heap, BindlessKind_StorageBuffer, culling.objectHandle);
+  releaseBindless(heap, BindlessKind_StorageBuffer, culling.drawHandle);
+
+  destroyBuffer(culling.objectBuffer, device, allocator);
+  destroyBuffer(culling.drawBuffer, device, allocator);
+}
+
+void recordCulling(const GpuCulling& culling, VkCommandBuffer commandBuffer, const BindlessHeap& heap, VkPipeline pipeline, const GpuMesh& mesh)
+{
+  vkCmdFillBuffer(commandBuffer, culling.drawBuffer.buffer, 0, sizeof(uint32_t), 0);
+
+  VkBufferMemoryBarrier fillBarrier = bufferBarrier(culling.drawBuffer.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, 0, 1, &fillBarrier, 0, 0);
+
+  CullConstants constants = {};
+  memcpy(constants.planes, kViewFrustum, sizeof(kViewFrustum));
+  constants.meshSphere[0] = mesh.boundsCenter[0];
+  constants.meshSphere[1] = mesh.boundsCenter[1];
+  constants.meshSphere[2] = mesh.boundsCenter[2];
+  constants.meshSphere[3] = mesh.boundsRadius;
+  constants.objectCount = culling.objectCount;
+  constants.indexCount = mesh.indexCount;
+  constants.objectBuffer = culling.objectHandle;
+  constants.drawBuffer = culling.drawHandle;
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+  vkCmdPushConstants(commandBuffer, heap.layout, kBindlessPushStages, 0, sizeof(constants), &constants);
+  vkCmdDispatch(commandBuffer, (culling.objectCount + kCullGroupSize - 1) / kCullGroupSize, 1, 1);
+}
+
+void recordDrawIndirect(const GpuCulling& culling, VkCommandBuffer commandBuffer, const BindlessHeap& heap, VkPipeline pipeline, const GpuMesh& mesh, const MeshTextureConstants& textures)
+{
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+  // objectBuffer in mesh_vert.glsl's push constants, right after the transform CPU draws use
+  vkCmdPushConstants(commandBuffer, heap.layout, kBindlessPushStages, sizeof(MeshDraw), sizeof(uint32_t), &culling.objectHandle);
+  vkCmdPushConstants(commandBuffer, heap.layout, kBindlessPushStages, kMeshTextureConstantsOffset, sizeof(textures), &textures);
+
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mesh.vertexBuffer.buffer, &offset);
+  vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer.buffer, 0, mesh.indexType);
+
+  vkCmdDrawIndexedIndirectCount(commandBuffer, culling.drawBuffer.buffer, kDrawHeaderSize, culling.drawBuffer.buffer, 0, culling.objectCount, sizeof(VkDrawIndexedIndirectCommand));
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "bindless.h"
+#include "mesh.h"
+#include "upload.h"
+
+// GPU driven drawing: object transforms live in a storage buffer, a compute pass frustum culls them and writes
+// a compacted list of indirect draws, and vkCmdDrawIndexedIndirectCount draws whatever survived. The CPU
+// records the same handful of commands whether there are ten objects or a million.
+struct GpuCulling
+{
+  Buffer objectBuffer; // MeshDraw per object
+  Buffer drawBuffer; // Visible count in the first 16 bytes, then a VkDrawIndexedIndirectCommand per visible object
+  uint32_t objectCount;
+  uint64_t uploadToken;
+
+  // Bindless indices the shaders find the buffers through
+  uint32_t objectHandle;
+  uint32_t drawHandle;
+};
+
+// multiDrawIndirect, drawIndirectFirstInstance and drawIndirectCount, createDevice turns them on if they're there
+bool isGpuCullingSupported(VkPhysicalDevice physicalDevice);
+
+// The cull pipeline comes from the pipeline manager, built from shaders/cull_comp.spv with the heap's layout
+void createGpuCulling(GpuCulling& culling, VkDevice device, MemoryAllocator& allocator, UploadManager& uploader, BindlessHeap& heap, const std::vector<MeshDraw>& draws);
+void destroyGpuCulling(GpuCulling& culling, VkDevice device, MemoryAllocator& allocator, BindlessHeap& heap);
+
+// Outside the render pass, before recordDrawIndirect. The heap has to be bound for compute. Only the barrier
+// between clearing the count and the dispatch is recorded here; the caller orders the draw buffer against last
+// frame's draws before and the indirect read after, which the render graph does with the transfer and compute
+// write and indirect read usages.
+void recordCulling(const GpuCulling& culling, VkCommandBuffer commandBuffer, const BindlessHeap& heap, VkPipeline pipeline, const GpuMesh& mesh);
+
+// Inside the render pass, pipeline has to use the INDIRECT vertex shader. The heap has to be bound for graphics.
+void recordDrawIndirect(const GpuCulling& culling, VkCommandBuffer commandBuffer, const BindlessHeap& heap, VkPipeline pipeline, const GpuMesh& mesh, const MeshTextureConstants& textures);
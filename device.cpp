@@ -0,0 +1,345 @@
+#ifdef __linux__
+#define VK_USE_PLATFORM_XLIB_KHR
+#endif
+
+#include "device.h"
+
+#ifdef __APPLE__
+  #include <vulkan/vulkan_macos.h>
+#endif
+
+#include <string.h>
+
+#include <vector>
+
+VkPhysicalDevice pickPhysicalDevice(VkPhysicalDevice* physicalDevices, uint32_t physicalDeviceCount)
+{
+  for(uint32_t i = 0 ; i < physicalDeviceCount ; i++)
+  {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physicalDevices[i], &props);
+
+    if(props.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+    {
+      printf("Picking discrete GPU: %s\n", props.deviceName);
+      return physicalDevices[i];
+    }
+  }
+  
+  // TODO: Check if device supports presenting. This is weird in linux because you need the surface first, but how can we have a surface and no device?
+
+  if(physicalDeviceCount > 0)
+  {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physicalDevices[0], &props);
+
+    printf("Picking fallback GPU: %s\n", props.deviceName);
+    return physicalDevices[0];
+  }
+
+  printf("No devices or drivers support Vulkan!\n");
+  return VK_NULL_HANDLE;
+
+}
+
+bool isInstanceLayerSupported(const char* name)
+{
+  uint32_t layerCount = 0;
+  VK_CHECK(vkEnumerateInstanceLayerProperties(&layerCount, 0));
+
+  std::vector<VkLayerProperties> layers(layerCount);
+  VK_CHECK(vkEnumerateInstanceLayerProperties(&layerCount, layers.data()));
+
+  for(uint32_t i = 0 ; i < layerCount ; i++)
+  {
+    if(strcmp(layers[i].layerName, name) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+bool isInstanceExtensionSupported(const char* name)
+{
+  uint32_t extensionCount = 0;
+  VK_CHECK(vkEnumerateInstanceExtensionProperties(0, &extensionCount, 0));
+
+  std::vector<VkExtensionProperties> extensions(extensionCount);
+  VK_CHECK(vkEnumerateInstanceExtensionProperties(0, &extensionCount, extensions.data()));
+
+  for(uint32_t i = 0 ; i < extensionCount ; i++)
+  {
+    if(strcmp(extensions[i].extensionName, name) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+VkInstance createInstance(bool presentation, bool validation)
+{
+  // Create vulkan instance
+  // TODO: Should probably check if the device supports vulkan 1.2 via vkEnumerateInstanceVersion.
+  VkApplicationInfo appInfo = { VK_STRUCTURE_TYPE_APPLICATION_INFO };
+  appInfo.apiVersion = VK_API_VERSION_1_2;
+
+
+  VkInstanceCreateInfo createInfo = {VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO};
+  createInfo.pApplicationInfo = &appInfo;
+
+  // Add validation layers
+  // CI machines usually don't have the SDK installed, so run without them rather than failing
+  const char* debugLayers[] = 
+  {
+    "VK_LAYER_KHRONOS_validation"
+  };
+
+  if(validation && isInstanceLayerSupported(debugLayers[0]))
+  {
+    createInfo.ppEnabledLayerNames = debugLayers;
+    createInfo.enabledLayerCount = sizeof(debugLayers) / sizeof(debugLayers[0]);
+  }
+  else if(validation)
+  {
+    printf("%s not found, running without validation\n", debugLayers[0]);
+  }
+
+  // Add surface extension
+  std::vector<const char*> extensions;
+
+  if(presentation)
+  {
+    extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+#ifdef VK_USE_PLATFORM_XLIB_KHR
+    extensions.push_back(VK_KHR_XLIB_SURFACE_EXTENSION_NAME);
+#endif
+#ifdef __APPLE__
+    extensions.push_back(VK_MVK_MACOS_SURFACE_EXTENSION_NAME);
+#endif
+  }
+
+  if(isInstanceExtensionSupported(VK_EXT_DEBUG_REPORT_EXTENSION_NAME))
+    extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+
+  createInfo.ppEnabledExtensionNames = extensions.data();
+  createInfo.enabledExtensionCount = uint32_t(extensions.size());
+
+  VkInstance instance = 0;
+  VK_CHECK(vkCreateInstance(&createInfo, 0, &instance));
+
+
+  return instance;
+}
+
+QueueFamilies getQueueFamilies(VkPhysicalDevice physicalDevice)
+{
+  uint32_t queueFamilyPropertyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertyCount, 0);
+
+  std::vector<VkQueueFamilyProperties> queueFamilyProperties;
+  queueFamilyProperties.resize(queueFamilyPropertyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertyCount, queueFamilyProperties.data());
+
+  QueueFamilies families = { VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED };
+
+  for(uint32_t i = 0 ; i < queueFamilyPropertyCount ; i++)
+  {
+    VkQueueFlags flags = queueFamilyProperties[i].queueFlags;
+
+    if((flags & VK_QUEUE_GRAPHICS_BIT) && families.graphics == VK_QUEUE_FAMILY_IGNORED)
+      families.graphics = i;
+
+    if((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && families.compute == VK_QUEUE_FAMILY_IGNORED)
+      families.compute = i;
+
+    // Transfer only families are the copy engines, they don't take time away from rendering
+    if((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && families.transfer == VK_QUEUE_FAMILY_IGNORED)
+      families.transfer = i;
+  }
+
+  if(families.compute == VK_QUEUE_FAMILY_IGNORED)
+    families.compute = families.graphics;
+
+  if(families.transfer == VK_QUEUE_FAMILY_IGNORED)
+    families.transfer = families.graphics;
+
+  return families;
+}
+
+bool isDeviceExtensionSupported(VkPhysicalDevice physicalDevice, const char* name)
+{
+  uint32_t extensionCount = 0;
+  VK_CHECK(vkEnumerateDeviceExtensionProperties(physicalDevice, 0, &extensionCount, 0));
+
+  std::vector<VkExtensionProperties> extensions(extensionCount);
+  VK_CHECK(vkEnumerateDeviceExtensionProperties(physicalDevice, 0, &extensionCount, extensions.data()));
+
+  for(uint32_t i = 0 ; i < extensionCount ; i++)
+  {
+    if(strcmp(extensions[i].extensionName, name) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+bool isPresentWaitSupported(VkPhysicalDevice physicalDevice)
+{
+  if(!isDeviceExtensionSupported(physicalDevice, VK_KHR_PRESENT_ID_EXTENSION_NAME) || !isDeviceExtensionSupported(physicalDevice, VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+    return false;
+
+  VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR };
+  VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR };
+  presentIdFeatures.pNext = &presentWaitFeatures;
+
+  VkPhysicalDeviceFeatures2 features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+  features.pNext = &presentIdFeatures;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+  return presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+}
+
+bool isSynchronization2Supported(VkPhysicalDevice physicalDevice)
+{
+  if(!isDeviceExtensionSupported(physicalDevice, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME))
+    return false;
+
+  VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR };
+
+  VkPhysicalDeviceFeatures2 features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+  features.pNext = &synchronization2Features;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+  return synchronization2Features.synchronization2;
+}
+
+VkDevice createDevice(VkInstance instance, VkPhysicalDevice physicalDevice, const QueueFamilies& families, bool presentation)
+{
+  float queuePriorities[] = {1.0f};
+
+  // Timeline semaphores and descriptor indexing are core in 1.2 but still have to be turned on
+  VkPhysicalDeviceVulkan12Features supportedFeatures12 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+  VkPhysicalDeviceFeatures2 supportedFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+  supportedFeatures.pNext = &supportedFeatures12;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+  assert(supportedFeatures12.timelineSemaphore);
+
+  VkPhysicalDeviceVulkan12Features features12 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+  features12.timelineSemaphore = VK_TRUE;
+  features12.drawIndirectCount = supportedFeatures12.drawIndirectCount;
+
+  // Bindless resources, see BindlessHeap. Every desktop driver with 1.2 has these.
+  assert(supportedFeatures12.descriptorIndexing);
+  assert(supportedFeatures12.runtimeDescriptorArray);
+  assert(supportedFeatures12.descriptorBindingPartiallyBound);
+  assert(supportedFeatures12.descriptorBindingUpdateUnusedWhilePending);
+  assert(supportedFeatures12.descriptorBindingStorageBufferUpdateAfterBind);
+  assert(supportedFeatures12.descriptorBindingSampledImageUpdateAfterBind);
+  assert(supportedFeatures12.descriptorBindingStorageImageUpdateAfterBind);
+  assert(supportedFeatures12.shaderStorageBufferArrayNonUniformIndexing);
+  assert(supportedFeatures12.shaderSampledImageArrayNonUniformIndexing);
+
+  features12.descriptorIndexing = VK_TRUE;
+  features12.runtimeDescriptorArray = VK_TRUE;
+  features12.descriptorBindingPartiallyBound = VK_TRUE;
+  features12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+  features12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+  features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+  features12.descriptorBindingStorageImageUpdateAfterBind = VK_TRUE;
+  features12.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+  features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+
+  // The profiler collects pipeline statistics when the device has them
+  VkPhysicalDeviceFeatures features = {};
+  features.pipelineStatisticsQuery = supportedFeatures.features.pipelineStatisticsQuery;
+
+  // Lets secondary command buffers run inside the profiler's statistics query
+  features.inheritedQueries = supportedFeatures.features.inheritedQueries;
+
+  // GPU culling writes one draw per visible object, each finds its transform through firstInstance
+  features.multiDrawIndirect = supportedFeatures.features.multiDrawIndirect;
+  features.drawIndirectFirstInstance = supportedFeatures.features.drawIndirectFirstInstance;
+
+  // Texture streaming feedback is written from the fragment shader, BC1 textures are decoded on the CPU without it
+  features.fragmentStoresAndAtomics = supportedFeatures.features.fragmentStoresAndAtomics;
+  features.textureCompressionBC = supportedFeatures.features.textureCompressionBC;
+
+  // One queue per distinct family
+  uint32_t familyIndices[] = { families.graphics, families.compute, families.transfer };
+  std::vector<VkDeviceQueueCreateInfo> queueInfos;
+
+  for(uint32_t familyIndex : familyIndices)
+  {
+    bool duplicate = false;
+    for(const VkDeviceQueueCreateInfo& queueInfo : queueInfos)
+      duplicate |= queueInfo.queueFamilyIndex == familyIndex;
+
+    if(duplicate)
+      continue;
+
+    VkDeviceQueueCreateInfo queueInfo = { VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO };
+    queueInfo.queueFamilyIndex = familyIndex;
+    queueInfo.queueCount = 1;
+    queueInfo.pQueuePriorities = queuePriorities;
+    queueInfos.push_back(queueInfo);
+  }
+
+  // Add swap chain extension
+  std::vector<const char*> extensions;
+
+  if(presentation)
+    extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+  // For the submit to present latency, see LatencyTracker
+  VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR };
+  VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR };
+
+  if(presentation && isPresentWaitSupported(physicalDevice))
+  {
+    extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+    extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+
+    presentIdFeatures.presentId = VK_TRUE;
+    presentWaitFeatures.presentWait = VK_TRUE;
+    presentIdFeatures.pNext = &presentWaitFeatures;
+    features12.pNext = &presentIdFeatures;
+  }
+
+  VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR };
+
+  if(isSynchronization2Supported(physicalDevice))
+  {
+    extensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+
+    synchronization2Features.synchronization2 = VK_TRUE;
+    synchronization2Features.pNext = features12.pNext;
+    features12.pNext = &synchronization2Features;
+  }
+
+  // Optional extensions are only turned on when the driver has them, portability subset only exists on MoltenVK
+  const char* optionalExtensions[] =
+  {
+    "VK_KHR_portability_subset",
+    VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME,
+    VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+  };
+
+  for(const char* extension : optionalExtensions)
+  {
+    if(isDeviceExtensionSupported(physicalDevice, extension))
+      extensions.push_back(extension);
+  }
+
+  // Create logical device
+  VkDeviceCreateInfo createInfo = { VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
+  createInfo.pNext = &features12;
+  createInfo.pEnabledFeatures = &features;
+  createInfo.queueCreateInfoCount = uint32_t(queueInfos.size());
+  createInfo.pQueueCreateInfos = queueInfos.data();
+  createInfo.enabledExtensionCount = uint32_t(extensions.size());
+  createInfo.ppEnabledExtensionNames = extensions.data();
+  VkDevice device = 0;
+  VK_CHECK(vkCreateDevice(physicalDevice, &createInfo, 0, &device));
+
+  return device;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common.h"
+
+// Families the queues come from. Compute and transfer are their own family when the device has one, so async
+// compute and DMA copies can run next to graphics, otherwise they share the graphics family and queue.
+struct QueueFamilies
+{
+  uint32_t graphics;
+  uint32_t compute;
+  uint32_t transfer;
+};
+
+struct Queues
+{
+  VkQueue graphics;
+  VkQueue compute;
+  VkQueue transfer;
+};
+
+// The first discrete GPU, or the first device there is. VK_NULL_HANDLE if there are none.
+VkPhysicalDevice pickPhysicalDevice(VkPhysicalDevice* physicalDevices, uint32_t physicalDeviceCount);
+
+bool isInstanceLayerSupported(const char* name);
+bool isInstanceExtensionSupported(const char* name);
+
+// Headless instances leave out the surface extensions so they work on machines without a display. Validation
+// turns the Khronos layer on when it's installed.
+VkInstance createInstance(bool presentation, bool validation);
+
+QueueFamilies getQueueFamilies(VkPhysicalDevice physicalDevice);
+
+bool isDeviceExtensionSupported(VkPhysicalDevice physicalDevice, const char* name);
+
+// Present ids and waiting on them, which is how we find out when a frame made it to the screen
+bool isPresentWaitSupported(VkPhysicalDevice physicalDevice);
+
+// Barriers with separate stage masks per barrier, the render graph falls back to the old ones without it
+bool isSynchronization2Supported(VkPhysicalDevice physicalDevice);
+
+// A queue per distinct family, with the 1.2 features the bindless heap and timeline semaphores need and
+// whatever optional features and extensions the device has
+VkDevice createDevice(VkInstance instance, VkPhysicalDevice physicalDevice, const QueueFamilies& families, bool presentation);
@@ -11,9 +11,7 @@
 #define VK_USE_PLATFORM_XLIB_KHR
 #endif
 
-#include <stdio.h>
-#include <cassert>
-#include <vulkan/vulkan.h>
+#include "common.h"
 
 #ifdef __APPLE__
   #include <vulkan/vulkan_macos.h>
@@ -26,87 +24,54 @@
   #include <SDL_vulkan.h>
 #endif
 
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <vector>
 #include <algorithm>
 
-#define _DEBUG
-
-#define VK_CHECK(call) do { VkResult result_ = call; assert(result_ == VK_SUCCESS); } while(0)
-
-VkPhysicalDevice pickPhysicalDevice(VkPhysicalDevice* physicalDevices, uint32_t physicalDeviceCount)
-{
-  for(uint32_t i = 0 ; i < physicalDeviceCount ; i++)
-  {
-    VkPhysicalDeviceProperties props;
-    vkGetPhysicalDeviceProperties(physicalDevices[i], &props);
-
-    if(props.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
-    {
-      printf("Picking discrete GPU: %s\n", props.deviceName);
-      return physicalDevices[i];
-    }
-  }
-  
-  // TODO: Check if device supports presenting. This is weird in linux because you need the surface first, but how can we have a surface and no device?
-
-  if(physicalDeviceCount > 0)
-  {
-    VkPhysicalDeviceProperties props;
-    vkGetPhysicalDeviceProperties(physicalDevices[0], &props);
-
-    printf("Picking fallback GPU: %s\n", props.deviceName);
-    return physicalDevices[0];
-  }
-
-  printf("No devices or drivers support Vulkan!\n");
-  return VK_NULL_HANDLE;
-
-}
-
-VkInstance createInstance()
-{
-  // Create vulkan instance
-  // TODO: Should probably check if the device supports vulkan 1.2 via vkEnumerateInstanceVersion.
-  VkApplicationInfo appInfo = { VK_STRUCTURE_TYPE_APPLICATION_INFO };
-  appInfo.apiVersion = VK_API_VERSION_1_2;
-
-
-  VkInstanceCreateInfo createInfo = {VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO};
-  createInfo.pApplicationInfo = &appInfo;
-
-  // Add validation layers
-#ifdef _DEBUG
-  const char* debugLayers[] = 
-  {
-    "VK_LAYER_KHRONOS_validation"
-  };
-
-  createInfo.ppEnabledLayerNames = debugLayers;
-  createInfo.enabledLayerCount = sizeof(debugLayers) / sizeof(debugLayers[0]);
-#endif
-
-  // Add surface extension
-  const char* extensions[] = 
-  {
-    VK_KHR_SURFACE_EXTENSION_NAME,
-#ifdef VK_USE_PLATFORM_XLIB_KHR
-    VK_KHR_XLIB_SURFACE_EXTENSION_NAME,
-#endif
-    VK_EXT_DEBUG_REPORT_EXTENSION_NAME,
-#ifdef __APPLE__
-    VK_MVK_MACOS_SURFACE_EXTENSION_NAME,
-#endif
-  };
+#include "allocator.h"
+#include "archive.h"
+#include "bindless.h"
+#include "capture.h"
+#include "culling.h"
+#include "device.h"
+#include "mesh.h"
+#include "pipeline_cache.h"
+#include "pipelines.h"
+#include "post.h"
+#include "present.h"
+#include "profiler.h"
+#include "readback.h"
+#include "recorder.h"
+#include "rendergraph.h"
+#include "renderpass.h"
+#include "resources.h"
+#include "scene.h"
+#include "sync.h"
+#include "textures.h"
+#include "transient.h"
+#include "upload.h"
+#include "variants.h"
 
-  createInfo.ppEnabledExtensionNames = extensions;
-  createInfo.enabledExtensionCount = sizeof(extensions) / sizeof(extensions[0]);
+#define _DEBUG
 
-  VkInstance instance = 0;
-  VK_CHECK(vkCreateInstance(&createInfo, 0, &instance));
+// How many frames the CPU may record ahead of the GPU. 2 is enough to overlap recording with execution,
+// 3 hides more jitter at the cost of an extra frame of latency.
+const uint32_t kDefaultFramesInFlight = 2;
+const uint32_t kMaxFramesInFlight = 3;
+const uint32_t kMaxRecordThreads = 64;
 
+// Headless frames are read back as RGBA8, so render straight into that
+const VkFormat kHeadlessFormat = VK_FORMAT_R8G8B8A8_UNORM;
 
-  return instance;
-}
+// ns an acquire may block before the loop looks at events again, an occluded window can hold every image
+const uint64_t kAcquireTimeout = 100 * 1000 * 1000;
 
 #ifdef __linux__
 VkSurfaceKHR createSurface(SDL_Window* window, VkInstance instance, SDL_SysWMinfo* wm_info)
@@ -133,53 +98,6 @@ VkSurfaceKHR createSurfaceFromSDL(SDL_Window* window, VkInstance instance)
   return surface;
 }
 
-uint32_t getGraphicsQueueFamily(VkPhysicalDevice physicalDevice)
-{
-  uint32_t queueFamilyPropertyCount = 0;
-  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertyCount, 0);
-
-  std::vector<VkQueueFamilyProperties> queueFamilyProperties;
-  queueFamilyProperties.resize(queueFamilyPropertyCount);
-  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertyCount, queueFamilyProperties.data());
-
-  for(uint32_t i = 0 ; i < queueFamilyPropertyCount ; i++)
-  {
-    if(queueFamilyProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
-      return i;
-  }
-
-  return VK_QUEUE_FAMILY_IGNORED;
-}
-
-VkDevice createDevice(VkInstance instance, VkPhysicalDevice physicalDevice)
-{
-
-  float queuePriorities[] = {1.0f};
-
-  VkDeviceQueueCreateInfo queueInfo = { VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO };
-  queueInfo.queueFamilyIndex = 0; // TODO: this needs to be looked up from queue properties
-  queueInfo.queueCount = 1;
-  queueInfo.pQueuePriorities = queuePriorities;
-
-  // Add swap chain extension
-  const char* extensions[] = 
-  {
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-    "VK_KHR_portability_subset",
-  };
-
-  // Create logical device
-  VkDeviceCreateInfo createInfo = { VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
-  createInfo.queueCreateInfoCount = 1;
-  createInfo.pQueueCreateInfos = &queueInfo;
-  createInfo.enabledExtensionCount = sizeof(extensions) / sizeof(extensions[0]);
-  createInfo.ppEnabledExtensionNames = extensions;
-  VkDevice device = 0;
-  VK_CHECK(vkCreateDevice(physicalDevice, &createInfo, 0, &device));
-
-  return device;
-}
-
 VkFormat getSwapchainFormat(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface)
 {
   uint32_t formatCount = 0;
@@ -208,7 +126,8 @@ VkFormat getSwapchainFormat(VkPhysicalDevice physicalDevice, VkSurfaceKHR surfac
   return formats[0].format;
 }
 
-VkSwapchainKHR createSwapchain(VkDevice device, VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkFormat swapchainFormat, uint32_t* familyIndex, uint32_t width, uint32_t height, VkSwapchainKHR oldSwapchain = 0)
+// With post processing the images are copied into instead of rendered to, and shared with the post queue's family
+VkSwapchainKHR createSwapchain(VkDevice device, VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkFormat swapchainFormat, VkPresentModeKHR presentMode, uint32_t* familyIndex, uint32_t width, uint32_t height, const PostProcess* post, VkSwapchainKHR oldSwapchain = 0)
 {
 
   // Get surface capabilities
@@ -229,7 +148,7 @@ VkSwapchainKHR createSwapchain(VkDevice device, VkPhysicalDevice physicalDevice,
   VkSwapchainCreateInfoKHR createInfo = { VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR };
 
   createInfo.surface = surface;
-  createInfo.minImageCount = std::max(2u, surfaceCaps.minImageCount); // For double buffer setup
+  createInfo.minImageCount = getSwapchainImageCount(surfaceCaps, presentMode);
   createInfo.imageFormat = swapchainFormat; // TODO: find format that device supports
   createInfo.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
   createInfo.imageExtent.width = width;
@@ -238,9 +157,22 @@ VkSwapchainKHR createSwapchain(VkDevice device, VkPhysicalDevice physicalDevice,
   createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
   createInfo.queueFamilyIndexCount = 1;
   createInfo.pQueueFamilyIndices = familyIndex;
+
+  if(post)
+  {
+    assert(surfaceCaps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+    if(post->familyCount > 1)
+    {
+      createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+      createInfo.queueFamilyIndexCount = post->familyCount;
+      createInfo.pQueueFamilyIndices = post->families;
+    }
+  }
   createInfo.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
   createInfo.compositeAlpha = surfaceCompostite;
-  createInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR; // TODO: check if device supports?
+  createInfo.presentMode = presentMode; // From choosePresentMode, so the surface supports it
   createInfo.oldSwapchain = oldSwapchain;
 
   VkSwapchainKHR swapChain;
@@ -250,17 +182,6 @@ VkSwapchainKHR createSwapchain(VkDevice device, VkPhysicalDevice physicalDevice,
 }
 
 
-VkSemaphore createSemaphore(VkDevice device)
-{
-  // Create semaphore needed for presenting
-  VkSemaphoreCreateInfo createInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
-
-  VkSemaphore semaphore;
-  VK_CHECK(vkCreateSemaphore(device, &createInfo, 0, &semaphore));
-
-  return semaphore;
-}
-
 VkCommandPool createCommandPool(VkDevice device, uint32_t familyIndex)
 {
   VkCommandPoolCreateInfo createInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
@@ -274,180 +195,6 @@ VkCommandPool createCommandPool(VkDevice device, uint32_t familyIndex)
   return commandPool;
 }
 
-VkRenderPass createRenderPass(VkDevice device, VkFormat format)
-{
-
-  VkAttachmentDescription attachments[1] = {};
-  attachments[0].format = format;
-  attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
-  attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  // Need to store or we can't render the contents to the screen
-  attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-  // We don't need a stencil, so operations are don't care.
-  attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-  attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-  attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-  VkAttachmentReference colorAttachments = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-
-  // Need at least one subpass for some reason
-  VkSubpassDescription subpass = {};
-  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-  subpass.colorAttachmentCount = 1;
-  subpass.pColorAttachments = &colorAttachments;
-
-  VkRenderPassCreateInfo createInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
-  createInfo.attachmentCount = 1;
-  createInfo.pAttachments = attachments;
-  createInfo.subpassCount = 1;
-  createInfo.pSubpasses = &subpass;
-
-  VkRenderPass renderPass;
-  VK_CHECK(vkCreateRenderPass(device, &createInfo, 0, &renderPass));
-
-  return renderPass;
-}
-
-VkFramebuffer createFramebuffer(VkDevice device, VkRenderPass renderPass, VkImageView imageView, uint32_t width, uint32_t height)
-{
-  VkFramebufferCreateInfo createInfo = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
-  createInfo.renderPass = renderPass;
-  createInfo.attachmentCount = 1;
-  createInfo.pAttachments = &imageView;
-  createInfo.width = width;
-  createInfo.height = height;
-  createInfo.layers = 1;
-
-  VkFramebuffer framebuffer;
-  VK_CHECK(vkCreateFramebuffer(device, &createInfo, 0, &framebuffer));
-
-  return framebuffer;
-}
-
-VkImageView createImageView(VkDevice device, VkImage image, VkFormat format)
-{
-  VkImageViewCreateInfo createInfo = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
-  createInfo.image = image;
-  createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-  createInfo.format = format;
-  createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  createInfo.subresourceRange.levelCount = 1;
-  createInfo.subresourceRange.layerCount = 1;
-
-  VkImageView view;
-  VK_CHECK(vkCreateImageView(device, &createInfo, 0, &view));
-  
-  return view;
-}
-
-VkShaderModule loadShader(VkDevice device, const char* path)
-{
-  FILE* file = fopen(path, "rb");
-  assert(file);
-
-  fseek(file, 0, SEEK_END);
-  uint32_t length = ftell(file);
-  assert(length >= 0);
-  fseek(file, 0, SEEK_SET);
-
-  char* buffer = (char*)malloc(length);
-  assert(buffer);
-
-  size_t rc = fread(buffer, 1, length, file);
-  assert(rc == size_t(length));
-  fclose(file);
-
-  //assert(length % 4 == 0); // Code size is uint32_t, so 4 bytes
-
-  VkShaderModuleCreateInfo createInfo = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
-  createInfo.codeSize = length;
-  createInfo.pCode = reinterpret_cast<const uint32_t*>(buffer);
-  VkShaderModule shaderModule;
-  VK_CHECK(vkCreateShaderModule(device, &createInfo, NULL, &shaderModule));
-
-  return shaderModule;
-}
-
-VkPipelineLayout createPipelineLayout(VkDevice device)
-{
-  VkPipelineLayoutCreateInfo createInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
-
-  VkPipelineLayout pipelineLayout;
-  VK_CHECK(vkCreatePipelineLayout(device, &createInfo, NULL, &pipelineLayout));
-
-  return pipelineLayout;
-}
-
-VkPipeline createGraphicsPipeline(VkDevice device, VkPipelineCache pipelineCache, VkRenderPass renderPass, VkPipelineLayout layout, VkShaderModule triangleVertSM, VkShaderModule triangleFragSM)
-{
-  // TODO: Do this next time
-  // Pipeline cache is really important
-  VkGraphicsPipelineCreateInfo createInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
-
-  VkPipelineShaderStageCreateInfo stages[2] {};
-  stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-  stages[0].module = triangleVertSM;
-  stages[0].pName = "main";
-  stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  stages[1].module = triangleFragSM;
-  stages[1].pName = "main";
-
-  createInfo.stageCount = sizeof(stages) / sizeof(stages[0]);
-  createInfo.pStages = stages;
-
-  VkPipelineVertexInputStateCreateInfo vertexInputInfo = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
-  createInfo.pVertexInputState = &vertexInputInfo;
-
-  VkPipelineInputAssemblyStateCreateInfo inputAssembly = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
-  inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-  createInfo.pInputAssemblyState = &inputAssembly;
-
-  VkPipelineTessellationStateCreateInfo tessellationState = { VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO };
-  createInfo.pTessellationState = &tessellationState;
-
-  VkPipelineViewportStateCreateInfo viewportState = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
-  viewportState.viewportCount = 1;
-  viewportState.scissorCount = 1;
-  createInfo.pViewportState = &viewportState;
-
-  VkPipelineRasterizationStateCreateInfo rasterizationState = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
-  rasterizationState.lineWidth = 1.0f;
-  createInfo.pRasterizationState = &rasterizationState;
-
-  VkPipelineMultisampleStateCreateInfo multisampleState = { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
-  multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-  createInfo.pMultisampleState = &multisampleState;
-
-  VkPipelineDepthStencilStateCreateInfo depthStencilState = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
-  createInfo.pDepthStencilState = &depthStencilState;
-
-
-  VkPipelineColorBlendAttachmentState colorAttachmentState = {};
-  colorAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-
-  VkPipelineColorBlendStateCreateInfo colorBlendState = { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
-  colorBlendState.pAttachments = &colorAttachmentState;
-  colorBlendState.attachmentCount = 1;
-  createInfo.pColorBlendState = &colorBlendState;
-
-  VkPipelineDynamicStateCreateInfo dynamicState = { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
-  VkDynamicState                dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
-  dynamicState.dynamicStateCount = sizeof(dynamicStates) / sizeof(dynamicStates[0]);
-  dynamicState.pDynamicStates = dynamicStates;
-  createInfo.pDynamicState = &dynamicState;
-
-  createInfo.layout = layout;
-  createInfo.renderPass = renderPass;
-
-  VkPipeline pipeline;
-  VK_CHECK(vkCreateGraphicsPipelines(device, pipelineCache, 1, &createInfo, NULL, &pipeline));
-
-  return pipeline;
-}
-
 VkBool32 debugReportCallback(VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT objectType, uint64_t object, size_t location, int32_t messageCode, const char* pLayerPrefix, const char* pMessage, void* pUserData)
 {
 
@@ -467,6 +214,10 @@ VkDebugReportCallbackEXT registerDebugCallback(VkInstance instance)
   // How to load extensions manually
   PFN_vkCreateDebugReportCallbackEXT vkCreateDebugReportCallbackEXT = (PFN_vkCreateDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugReportCallbackEXT");
 
+  // Not there if the instance was created without VK_EXT_debug_report
+  if(!vkCreateDebugReportCallbackEXT)
+    return VK_NULL_HANDLE;
+
   VkDebugReportCallbackEXT debugCallback = {};
   VkDebugReportCallbackCreateInfoEXT createInfo = { VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT };
   createInfo.flags = VK_DEBUG_REPORT_WARNING_BIT_EXT | VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT | VK_DEBUG_REPORT_ERROR_BIT_EXT;
@@ -477,37 +228,26 @@ VkDebugReportCallbackEXT registerDebugCallback(VkInstance instance)
   return debugCallback;
 }
 
-VkImageMemoryBarrier imageBarrier(VkImage image, VkAccessFlags srcAccessMask, VkImageLayout srcImageLayout, VkAccessFlags dstAccessMask, VkImageLayout dstImageLayout)
-{
-  VkImageMemoryBarrier imMemBarrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
-  imMemBarrier.srcAccessMask = srcAccessMask;
-  imMemBarrier.dstAccessMask = dstAccessMask;
-  imMemBarrier.oldLayout = srcImageLayout;
-  imMemBarrier.newLayout = dstImageLayout;
-  imMemBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED; // We won't be switching graphics queues when we do this just image layouts
-  imMemBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED; // We won't be switching graphics queues when we do this just image layouts
-  imMemBarrier.image = image;
-  imMemBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT; // Assume that we don't have depth and are only transitioning color
-  imMemBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS; // Transitioning entire image like all mip levels
-  imMemBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS; // Transitioning all array layers
-
-  return imMemBarrier;
-}
-
 struct Swapchain
 {
   VkSwapchainKHR swapchain;
 
   std::vector<VkImage> images;
   std::vector<VkImageView> imageViews;
-  std::vector<VkFramebuffer> framebuffers;
+  std::vector<VkFramebuffer> framebuffers; // Per image, or per frame slot over the post scene images
+  RenderAttachments attachments; // Depth and multisampled color at the swapchain's size
+
+  // Present waits on these. They are per image instead of per frame because we can only reuse one once
+  // the image has come back from the presentation engine, and acquiring the image tells us exactly that.
+  std::vector<VkSemaphore> releaseSemaphores;
 
   uint32_t width, height;
+  VkPresentModeKHR presentMode;
 };
 
 void destroySwapchain(const Swapchain& swapchain, VkDevice device)
 {
-  for(uint32_t i = 0 ; i < swapchain.images.size() ; i++)
+  for(uint32_t i = 0 ; i < swapchain.framebuffers.size() ; i++)
   {
     vkDestroyFramebuffer(device, swapchain.framebuffers[i], NULL);
   }
@@ -515,15 +255,22 @@ void destroySwapchain(const Swapchain& swapchain, VkDevice device)
   {
     vkDestroyImageView(device, swapchain.imageViews[i], NULL);
   }
+  for(uint32_t i = 0 ; i < swapchain.images.size() ; i++)
+  {
+    vkDestroySemaphore(device, swapchain.releaseSemaphores[i], NULL);
+  }
+  destroyRenderAttachments(swapchain.attachments, device);
   vkDestroySwapchainKHR(device, swapchain.swapchain, 0);
 }
 
-void createSwapchain(Swapchain& swapchain, VkDevice device, VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkFormat swapchainFormat, uint32_t* familyIndex, uint32_t width, uint32_t height, VkRenderPass renderPass, VkSwapchainKHR oldSwapchain = 0)
+// With post processing the scene renders into the post scene images, which have to be at the same size already
+void createSwapchain(Swapchain& swapchain, VkDevice device, VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkFormat swapchainFormat, VkPresentModeKHR presentMode, uint32_t* familyIndex, uint32_t width, uint32_t height, VkRenderPass renderPass, const MemoryAllocator& allocator, const RenderPassConfig& config, const PostProcess* post, VkSwapchainKHR oldSwapchain = 0)
 {
-  swapchain.swapchain = createSwapchain(device, physicalDevice, surface, swapchainFormat, familyIndex, width, height, oldSwapchain);
+  swapchain.swapchain = createSwapchain(device, physicalDevice, surface, swapchainFormat, presentMode, familyIndex, width, height, post, oldSwapchain);
 
   swapchain.width = width;
   swapchain.height = height;
+  swapchain.presentMode = presentMode;
 
   uint32_t swapchainImageCount = 0;
   VK_CHECK(vkGetSwapchainImagesKHR(device, swapchain.swapchain, &swapchainImageCount, 0));
@@ -534,229 +281,1887 @@ void createSwapchain(Swapchain& swapchain, VkDevice device, VkPhysicalDevice phy
   for(uint32_t i = 0 ; i < swapchainImageCount ; i++)
     swapchain.imageViews[i] = createImageView(device, swapchain.images[i], swapchainFormat);
 
-  swapchain.framebuffers.resize(swapchainImageCount);
+  createRenderAttachments(swapchain.attachments, device, allocator, config, width, height);
+
+  if(post)
+  {
+    assert(post->targets.width == width && post->targets.height == height);
+
+    swapchain.framebuffers.resize(post->targets.scenes.size());
+    for(uint32_t i = 0 ; i < swapchain.framebuffers.size() ; i++)
+      swapchain.framebuffers[i] = createFramebuffer(device, renderPass, swapchain.attachments, post->targets.scenes[i].imageView, swapchain.width, swapchain.height);
+  }
+  else
+  {
+    swapchain.framebuffers.resize(swapchainImageCount);
+    for(uint32_t i = 0 ; i < swapchainImageCount ; i++)
+      swapchain.framebuffers[i] = createFramebuffer(device, renderPass, swapchain.attachments, swapchain.imageViews[i], swapchain.width, swapchain.height);
+  }
+
+  swapchain.releaseSemaphores.resize(swapchainImageCount);
   for(uint32_t i = 0 ; i < swapchainImageCount ; i++)
-    swapchain.framebuffers[i] = createFramebuffer(device, renderPass, swapchain.imageViews[i], swapchain.width, swapchain.height);
+    swapchain.releaseSemaphores[i] = createSemaphore(device);
 }
 
-void resizeSwapchain(Swapchain& swapchain, VkDevice device, VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkFormat swapchainFormat, uint32_t* familyIndex, uint32_t width, uint32_t height, VkRenderPass renderPass)
+// Size the swapchain should have now, 0x0 while the window is minimized. Some platforms leave it to the
+// swapchain, then it's the window's drawable size.
+void getSurfaceExtent(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, SDL_Window* window, uint32_t& width, uint32_t& height)
 {
-  VkSwapchainKHR oldSwapchain = swapchain.swapchain;
+  VkSurfaceCapabilitiesKHR surfaceCaps;
+  VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCaps));
 
-  Swapchain old = swapchain;
+  if(surfaceCaps.currentExtent.width != ~0u)
+  {
+    width = surfaceCaps.currentExtent.width;
+    height = surfaceCaps.currentExtent.height;
+    return;
+  }
 
-  createSwapchain(swapchain, device, physicalDevice, surface, swapchainFormat, familyIndex, width, height, renderPass, oldSwapchain);
-  VK_CHECK(vkDeviceWaitIdle(device));
-  destroySwapchain(old, device);
+  int drawableWidth = 0, drawableHeight = 0;
+  SDL_Vulkan_GetDrawableSize(window, &drawableWidth, &drawableHeight);
+
+  width = std::min(std::max(uint32_t(drawableWidth), surfaceCaps.minImageExtent.width), surfaceCaps.maxImageExtent.width);
+  height = std::min(std::max(uint32_t(drawableHeight), surfaceCaps.minImageExtent.height), surfaceCaps.maxImageExtent.height);
 }
 
-int main(int argc, char** argv)
+// The new swapchain is created from the old one, which goes to the deletion queue along with everything built
+// on it, attachments included, nothing waits for the device. lastUseValue is the frame timeline value of the last frame that rendered
+// to it. Its presents went to the queue after that frame, the swapchain and the semaphores they wait on are
+// kept until the first frame after them is done too. Post processing has to be resized to the new size first.
+void resizeSwapchain(Swapchain& swapchain, VkDevice device, VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkFormat swapchainFormat, uint32_t* familyIndex, uint32_t width, uint32_t height, VkRenderPass renderPass, const MemoryAllocator& allocator, const RenderPassConfig& config, const PostProcess* post, DeletionQueue& deletions, uint64_t lastUseValue)
 {
-  // Initialize SDL
-  if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) != 0)
-  {
-    printf("Failed to initialize SDL!\n");
-    return -1;
-  }
+  Swapchain old = swapchain;
 
-  VkInstance instance = createInstance();
+  createSwapchain(swapchain, device, physicalDevice, surface, swapchainFormat, old.presentMode, familyIndex, width, height, renderPass, allocator, config, post, old.swapchain);
 
-  VkDebugReportCallbackEXT debugCallback = registerDebugCallback(instance);
+  retireRenderAttachments(old.attachments, deletions, lastUseValue);
 
-  // Get Physical device
-  VkPhysicalDevice physicalDevices[16];
-  uint32_t physicalDeviceCount = sizeof(physicalDevices) / sizeof(physicalDevices[0]);
-  VK_CHECK(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices));
+  for(uint32_t i = 0 ; i < old.framebuffers.size() ; i++)
+    deferDeletion(deletions, VK_OBJECT_TYPE_FRAMEBUFFER, (uint64_t)old.framebuffers[i], lastUseValue);
 
-  VkPhysicalDevice physicalDevice = pickPhysicalDevice(physicalDevices, physicalDeviceCount);
-  assert(physicalDevice);
+  for(uint32_t i = 0 ; i < old.images.size() ; i++)
+  {
+    deferDeletion(deletions, VK_OBJECT_TYPE_IMAGE_VIEW, (uint64_t)old.imageViews[i], lastUseValue);
+    deferDeletion(deletions, VK_OBJECT_TYPE_SEMAPHORE, (uint64_t)old.releaseSemaphores[i], lastUseValue + 1);
+  }
+
+  deferDeletion(deletions, VK_OBJECT_TYPE_SWAPCHAIN_KHR, (uint64_t)old.swapchain, lastUseValue + 1);
+}
+
+// Everything a frame needs while it is being recorded and executed. We keep one of these per frame in flight
+// so the CPU can record frame N+1 while the GPU is still working on frame N.
+struct FrameContext
+{
+  VkCommandPool commandPool;
+  VkCommandBuffer commandBuffer;
 
-  uint32_t familyIndex = getGraphicsQueueFamily(physicalDevice);
-  assert(familyIndex != VK_QUEUE_FAMILY_IGNORED);
-  VkDevice device = createDevice(instance, physicalDevice);
+  VkSemaphore acquireSemaphore; // For waiting for a GPU to be done with an Image before you render to it again
 
-  // Create Window
-  SDL_Window* window = SDL_CreateWindow("VKR", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 
-      1920, 1080, SDL_WINDOW_VULKAN | SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+  uint64_t timelineValue; // Value the frame timeline reaches once the last submit from this slot has finished
+};
 
-  // Create surface
-  // TODO: This is platform specific. Add wayland and windows stuff?
-  // TODO: Figure this stuff out. It doesn't work, but it might be handy if we don't want to use SDL.
-//#ifdef VK_USE_PLATFORM_XLIB_KHR
-  //SDL_SysWMinfo wm_info;
-  //SDL_GetWindowWMInfo(window, &wm_info);
-  //VkSurfaceKHR surface = createSurface(window, instance, &wm_info);
-//#endif
+// A windowed frame from the time its record job starts until it's submitted
+struct PendingFrame
+{
+  uint32_t frameSlot;
+  uint32_t imageIndex;
+  double inputTime;
+  uint64_t uploadWaitValue; // Set by the record job
 
-  int windowWidth,windowHeight = 0;
-  SDL_GetWindowSize(window, &windowWidth, &windowHeight);
+  JobCounter recorded;
+  bool active = false;
+};
 
-  VkSurfaceKHR surface = createSurfaceFromSDL(window, instance);
+void createFrameContexts(std::vector<FrameContext>& frames, VkDevice device, uint32_t familyIndex, uint32_t count)
+{
+  frames.resize(count);
 
-  VkBool32 presentSupprted = 0;
-  vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, familyIndex, surface, &presentSupprted);
-  assert(presentSupprted);
+  for(uint32_t i = 0 ; i < count ; i++)
+  {
+    FrameContext& frame = frames[i];
 
-  VkFormat swapchainFormat = getSwapchainFormat(physicalDevice, surface);
+    frame.commandPool = createCommandPool(device, familyIndex);
 
-  //VkSwapchainKHR swapChain = createSwapchain(device, physicalDevice, surface, swapchainFormat, &familyIndex, window);
+    VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+    allocateInfo.commandPool = frame.commandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 1;
+    VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &frame.commandBuffer));
 
-  VkSemaphore acquireSemaphore = createSemaphore(device); // For waiting for a GPU to be done with an Image before you render to it again
-  VkSemaphore releaseSemaphore = createSemaphore(device); // For waiting until command buffer commands have finished executing before showing the image on screen
+    frame.acquireSemaphore = createSemaphore(device);
+    frame.timelineValue = 0;
+  }
+}
 
-  VkQueue queue;
-  vkGetDeviceQueue(device, familyIndex, 0, &queue);
+void destroyFrameContexts(std::vector<FrameContext>& frames, VkDevice device)
+{
+  for(FrameContext& frame : frames)
+  {
+    vkFreeCommandBuffers(device, frame.commandPool, 1, &frame.commandBuffer);
+    vkDestroyCommandPool(device, frame.commandPool, NULL);
+    vkDestroySemaphore(device, frame.acquireSemaphore, NULL);
+  }
+  frames.clear();
+}
 
-  // Load shaders
-  VkShaderModule triangleVertSM = loadShader(device, "shaders/triangle_vert.spv");
-  assert(triangleVertSM);
+// What recordRenderPass draws
+struct Scene
+{
+  const GpuMesh* mesh;
+  std::vector<MeshDraw> draws;
+  const BindlessHeap* heap; // Every pipeline is created with heap->layout
 
-  VkShaderModule triangleFragSM = loadShader(device, "shaders/triangle_frag.spv");
-  assert(triangleFragSM);
+  // Handles into the manager, looked up every frame since hot reload can swap them
+  const PipelineManager* pipelines;
+  uint32_t meshPipeline;
 
+  const GpuCulling* culling; // NULL draws straight from the CPU
+  uint32_t indirectPipeline;
+  uint32_t cullPipeline;
 
-  VkRenderPass renderPass = createRenderPass(device, swapchainFormat);
+  TextureStreamer* textures; // NULL draws untextured
 
-  VkPipelineLayout pipelineLayout = createPipelineLayout(device);
+  MeshDrawData drawData; // Where the CPU draws' transforms go, the mesh pipeline's vertex shader must match
+  TransientAllocator* transient; // Uniform draw data, and counts push constant bytes; NULL for neither
 
-  // Create graphics pipeline
-  // TODO: this is critical for performance
-  VkPipelineCache pipelineCache = VK_NULL_HANDLE;
-  VkPipeline trianglePipeline = createGraphicsPipeline(device, pipelineCache, renderPass, pipelineLayout, triangleVertSM, triangleFragSM);
+  CommandCapture* capture; // NULL without --capture
+};
 
-  Swapchain swapchain;
-  createSwapchain(swapchain, device, physicalDevice, surface, swapchainFormat, &familyIndex, windowWidth, windowHeight, renderPass);
+// Nothing is drawn until every upload the scene needs has been acquired and its pipelines are built
+bool isSceneReady(const Scene& scene, const UploadManager& uploader)
+{
+  if(scene.culling)
+    return isUploadReady(uploader, scene.mesh->uploadToken) && isUploadReady(uploader, scene.culling->uploadToken) && getPipeline(*scene.pipelines, scene.indirectPipeline) && getPipeline(*scene.pipelines, scene.cullPipeline);
 
-  VkCommandPool commandPool = createCommandPool(device, familyIndex);
+  return isUploadReady(uploader, scene.mesh->uploadToken) && getPipeline(*scene.pipelines, scene.meshPipeline);
+}
 
-  VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
-  allocateInfo.commandPool = commandPool;
-  allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  allocateInfo.commandBufferCount = 1;
+// Whether the scene needs frames even though nothing happened: uploads are only picked up by a frame,
+// streamed textures go by what the last frame sampled, and a capture wants its frames
+bool isSceneSettling(const Scene& scene, const UploadManager& uploader)
+{
+  return !isSceneReady(scene, uploader) || scene.textures || (scene.capture && scene.capture->frameCount < scene.capture->frameLimit);
+}
 
-  VkCommandBuffer commandBuffer;
-  vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer);
+// Once per frame after acquireUploads. Without fragment shader feedback the draws ask for the mip that fits
+// their size on screen, the mesh is fitted into [-1, 1] so a draw covers about scale * height pixels.
+void updateSceneTextures(const Scene& scene, uint32_t frameSlot, uint32_t height, uint64_t frameValue, uint64_t completedValue)
+{
+  TextureStreamer& streamer = *scene.textures;
 
-  bool run = true;
-  while (run)
+  if(!streamer.feedback && !streamer.textures.empty())
   {
-    SDL_Event event;
-    while (SDL_PollEvent(&event))
+    for(size_t i = 0 ; i < scene.draws.size() ; i++)
     {
-      if (event.type == SDL_QUIT)
-      {
-        run = false;
-      }
+      float pixels = scene.draws[i].transform[3] * float(height);
+      uint32_t density = pixels > 1 ? uint32_t(ceilf(log2f(pixels))) : 0;
 
-      if(event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_RESIZED)
-      {
-        VkSurfaceCapabilitiesKHR curSurfaceCaps;
-        VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &curSurfaceCaps));
-        resizeSwapchain(swapchain, device, physicalDevice, surface, swapchainFormat, &familyIndex, curSurfaceCaps.currentExtent.width, curSurfaceCaps.currentExtent.height, renderPass);
-      }
+      requestTextureDensity(streamer, uint32_t(i % streamer.textures.size()), density);
     }
+  }
 
-    // Present swap chain to window
-    uint32_t imageIndex = 0;
+  updateTextureStreaming(streamer, frameSlot, frameValue, completedValue);
+}
 
-    // The assert fails on Intel GPU for some reason
-    if(vkAcquireNextImageKHR(device, swapchain.swapchain, 0, acquireSemaphore, VK_NULL_HANDLE, &imageIndex) != VK_SUCCESS) // TODO: assert in a loop is slow
-    {
-      continue;
-    }
+// Records the whole scene into the render pass. Until the scene is ready the frame is just cleared.
+// Enough draws get split into secondaries recorded on the worker threads, a few are recorded inline.
+// With GPU culling the draws come from the cull pass instead and the CPU side is the same for any draw count.
+void recordRenderPass(VkCommandBuffer commandBuffer, VkDevice device, VkRenderPass renderPass, VkFramebuffer framebuffer, uint32_t width, uint32_t height, const Scene& scene, bool ready, DrawRecorder& recorder, WorkerPool& workers, uint32_t frameSlot, VkQueryPipelineStatisticFlags statistics)
+{
+  if(ready)
+    bindBindlessHeap(*scene.heap, commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
 
-    VK_CHECK(vkResetCommandPool(device, commandPool, 0));
+  MeshTextureConstants textures = getTextureConstants(scene.textures, frameSlot);
 
-    VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+  // Without inheritedQueries a secondary can't run inside the profiler's statistics query. A captured frame
+  // records inline, the capture is one stream.
+  bool secondaries = !scene.culling && ready && getSecondaryCount(recorder, scene.draws.size()) > 1 && (!statistics || recorder.inheritedQueries) && !isCapturing(scene.capture);
 
-    // Need to transition to a valid rendering layout like to save on GPU bandwidth or something
-    VkImageMemoryBarrier renderBeginBarrier = imageBarrier(swapchain.images[imageIndex], 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_DEPENDENCY_BY_REGION_BIT, 0, 0, 0, 0, 1, &renderBeginBarrier);
+  if(secondaries)
+    recordSecondaryDraws(recorder, workers, device, frameSlot, renderPass, framebuffer, width, height, getPipeline(*scene.pipelines, scene.meshPipeline), *scene.heap, *scene.mesh, textures, scene.draws.data(), scene.draws.size(), scene.drawData, scene.transient, statistics);
 
-    VkClearColorValue color = { 48.0f / 255.0f , 10.0f / 255.0f , 36.0f / 255.0f , 1};
+  VkClearColorValue color = { 48.0f / 255.0f , 10.0f / 255.0f , 36.0f / 255.0f , 1};
 
-    VkClearValue clearColorValue = {};
-    clearColorValue.color = color;
+  // In createRenderPass order, the resolve target isn't cleared
+  VkClearValue clearValues[3] = {};
+  clearValues[0].color = color;
+  clearValues[1].depthStencil.depth = 1.0f;
 
-    VkRenderPassBeginInfo passBeginInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
-    passBeginInfo.renderPass = renderPass;
-    passBeginInfo.framebuffer = swapchain.framebuffers[imageIndex];
-    passBeginInfo.renderArea.extent.width = swapchain.width;
-    passBeginInfo.renderArea.extent.height = swapchain.height;
-    passBeginInfo.clearValueCount = 1;
-    passBeginInfo.pClearValues = &clearColorValue;
+  VkRenderPassBeginInfo passBeginInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+  passBeginInfo.renderPass = renderPass;
+  passBeginInfo.framebuffer = framebuffer;
+  passBeginInfo.renderArea.extent.width = width;
+  passBeginInfo.renderArea.extent.height = height;
+  passBeginInfo.clearValueCount = 2;
+  passBeginInfo.pClearValues = clearValues;
 
-    vkCmdBeginRenderPass(commandBuffer, &passBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+  if(secondaries)
+  {
+    // The secondaries set their own viewport and scissor, nothing else may go in this subpass
+    vkCmdBeginRenderPass(commandBuffer, &passBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    vkCmdExecuteCommands(commandBuffer, uint32_t(recorder.secondaries.size()), recorder.secondaries.data());
+    vkCmdEndRenderPass(commandBuffer);
+    return;
+  }
 
-    VkViewport viewport = { 0, float(swapchain.height), float(swapchain.width), -float(swapchain.height), 0, 1 };
-    VkRect2D scissor = {};
-    scissor.extent.height = swapchain.height;
-    scissor.extent.width = swapchain.width;
+  vkCmdBeginRenderPass(commandBuffer, &passBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+  captureBeginPass(scene.capture, clearValues[0], clearValues[1]);
 
-    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+  VkViewport viewport = { 0, float(height), float(width), -float(height), 0, 1 };
+  VkRect2D scissor = {};
+  scissor.extent.height = height;
+  scissor.extent.width = width;
 
-    // Draw calls go here
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, trianglePipeline);
-    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-    vkCmdEndRenderPass(commandBuffer);
+  // Draw calls go here
+  if(ready && scene.culling)
+  {
+    recordDrawIndirect(*scene.culling, commandBuffer, *scene.heap, getPipeline(*scene.pipelines, scene.indirectPipeline), *scene.mesh, textures);
+  }
+  else if(ready)
+  {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(*scene.pipelines, scene.meshPipeline));
+    captureBindPipeline(scene.capture, scene.meshPipeline);
+    recordDrawMesh(commandBuffer, scene.heap->layout, *scene.mesh, textures, scene.draws.data(), scene.draws.size(), 0, scene.drawData, scene.transient, scene.capture);
+  }
 
-    // Need to transition to the present image layout before presenting to the screen
-    VkImageMemoryBarrier renderEndBarrier = imageBarrier(swapchain.images[imageIndex], VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
-    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_DEPENDENCY_BY_REGION_BIT, 0, 0, 0, 0, 1, &renderEndBarrier);
+  vkCmdEndRenderPass(commandBuffer);
+  captureEndPass(scene.capture);
+}
 
-    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+// Declares the scene's passes into the graph, target is the color image the framebuffer renders to.
+// Shared by the windowed and the headless loop. The callbacks run later in executeRenderGraph, so they only
+// capture things that outlive the frame. framebuffer is read then too, so one over a transient target can be
+// made once the graph is compiled.
+void addScenePasses(RenderGraph& graph, RenderResource target, VkDevice device, VkRenderPass renderPass, const VkFramebuffer& framebuffer, uint32_t width, uint32_t height, const Scene& scene, bool ready, DrawRecorder& recorder, WorkerPool& workers, uint32_t frameSlot, VkQueryPipelineStatisticFlags statistics)
+{
+  bool culling = ready && scene.culling;
 
-    VkPipelineStageFlags submitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  RenderResource objects = 0, draws = 0;
 
+  if(culling)
+  {
+    // Last frame's draws read the draw buffer, the objects only ever come from the uploader
+    objects = importBuffer(graph, "objects", scene.culling->objectBuffer.buffer, RenderUsage_None);
+    draws = importBuffer(graph, "draws", scene.culling->drawBuffer.buffer, RenderUsage_IndirectRead);
 
-    // Need semaphore to tell GPU to not run commands until the image is ready
-    VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &acquireSemaphore;
-    submitInfo.pWaitDstStageMask = &submitStageMask;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &releaseSemaphore;
+    uint32_t cullPass = addRenderGraphPass(graph, "cull", [&scene](VkCommandBuffer commandBuffer)
+    {
+      bindBindlessHeap(*scene.heap, commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+      recordCulling(*scene.culling, commandBuffer, *scene.heap, getPipeline(*scene.pipelines, scene.cullPipeline), *scene.mesh);
+    });
 
-    vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+    useRenderResource(graph, cullPass, objects, RenderUsage_StorageReadCompute);
+    useRenderResource(graph, cullPass, draws, RenderUsage_TransferWrite); // Clears the count
+    useRenderResource(graph, cullPass, draws, RenderUsage_StorageWriteCompute);
+  }
 
-    VkPresentInfoKHR presentInfo = { VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = &releaseSemaphore;
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = &swapchain.swapchain;
-    presentInfo.pImageIndices = &imageIndex;
+  bool feedback = ready && scene.textures;
+  RenderResource textureTable = 0;
 
-    vkQueuePresentKHR(queue, &presentInfo);
-    VK_CHECK(vkDeviceWaitIdle(device));
+  if(scene.textures)
+  {
+    // Mips swapped in this frame are copied over before anything samples them, even before the scene is ready
+    addRenderGraphPass(graph, "texture streaming", [&scene](VkCommandBuffer commandBuffer)
+    {
+      recordTextureStreaming(*scene.textures, commandBuffer);
+    }, true);
 
+    // Written on the host before the submit, the frame's feedback goes back to the host once the frame is done
+    if(feedback)
+      textureTable = importBuffer(graph, "texture table", scene.textures->frames[frameSlot].table.buffer, RenderUsage_None);
   }
 
-  VK_CHECK(vkDeviceWaitIdle(device));
+  uint32_t mainPass = addRenderGraphPass(graph, "main pass", [=, &framebuffer, &scene, &recorder, &workers](VkCommandBuffer commandBuffer)
+  {
+    recordRenderPass(commandBuffer, device, renderPass, framebuffer, width, height, scene, ready, recorder, workers, frameSlot, statistics);
+  });
 
-  vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
-  vkDestroyCommandPool(device, commandPool, NULL);
-  //vkDestroyDebugReportCallbackEXT(instance, debugCallback, NULL);
-  destroySwapchain(swapchain, device);
-  vkDestroyPipeline(device, trianglePipeline, NULL);
-  vkDestroyPipelineLayout(device, pipelineLayout, NULL);
-  vkDestroyPipelineCache(device, pipelineCache, NULL);
-  vkDestroyShaderModule(device, triangleVertSM, NULL);
-  vkDestroyShaderModule(device, triangleFragSM, NULL);
-  vkDestroyRenderPass(device, renderPass, NULL);
-  vkDestroySemaphore(device, releaseSemaphore, NULL);
-  vkDestroySemaphore(device, acquireSemaphore, NULL);
-  vkDestroySurfaceKHR(instance, surface, NULL);
-  vkDestroyDevice(device, NULL);
-  PFN_vkDestroyDebugReportCallbackEXT vkDestroyDebugReportCallbackEXT = (PFN_vkDestroyDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugReportCallbackEXT");
-  vkDestroyDebugReportCallbackEXT(instance, debugCallback, NULL);
+  useRenderResource(graph, mainPass, target, RenderUsage_ColorAttachment);
+
+  if(culling)
+  {
+    useRenderResource(graph, mainPass, draws, RenderUsage_IndirectRead);
+    useRenderResource(graph, mainPass, objects, RenderUsage_StorageReadVertex);
+  }
+
+  if(feedback)
+  {
+    useRenderResource(graph, mainPass, textureTable, RenderUsage_StorageWriteFragment);
+    setRenderGraphOutput(graph, textureTable, RenderUsage_HostRead);
+  }
+}
+
+// Prints the graph's numbers whenever they differ from the last frame's, they only change with what the frame declares
+void reportRenderGraphStats(const RenderGraph& graph, RenderGraphStats& lastStats)
+{
+  if(memcmp(&graph.stats, &lastStats, sizeof(RenderGraphStats)) == 0)
+    return;
+
+  printRenderGraphStats("scene", graph.stats);
+  lastStats = graph.stats;
+}
+
+// Loads the OBJ at path, or the built in triangle without one, and optimizes it for the vertex cache and fetch
+bool loadMesh(Mesh& mesh, const char* path)
+{
+  if(!path)
+  {
+    createTriangleMesh(mesh);
+    return true;
+  }
+
+  double start = getTimeMs();
+
+  if(!loadObj(mesh, path))
+  {
+    printf("Failed to load mesh %s\n", path);
+    return false;
+  }
+
+  double loaded = getTimeMs();
+
+  MeshCacheStats before = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+  optimizeVertexCache(mesh.indices, mesh.vertices.size());
+  optimizeVertexFetch(mesh.vertices, mesh.indices);
+  MeshCacheStats after = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+  printf("Mesh %s: %zu vertices, %zu triangles, loaded in %.1f ms, optimized in %.1f ms\n", path, mesh.vertices.size(), mesh.indices.size() / 3,
+      loaded - start, getTimeMs() - loaded);
+  printf("Mesh %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", path, before.acmr, after.acmr, before.atvr, after.atvr);
+
+  return true;
+}
+
+// The mesh straight from the archive's pages, false if it isn't in there
+bool findArchivedMesh(const AssetArchive& archive, const char* path, MeshView& view)
+{
+  MeshAsset asset;
+  if(!path || !findMeshAsset(archive, path, asset) || asset.header->vertexSize != sizeof(Vertex) || (asset.header->indexSize != 2 && asset.header->indexSize != 4))
+    return false;
+
+  view = {};
+  view.vertices = static_cast<const Vertex*>(asset.vertices);
+  view.vertexCount = asset.header->vertexCount;
+  view.indices = asset.indices;
+  view.indexCount = asset.header->indexCount;
+  view.shortIndices = asset.header->indexSize == 2;
+  memcpy(view.center, asset.header->center, sizeof(view.center));
+  view.radius = asset.header->radius;
+
+  printf("Mesh %s: %zu vertices, %zu triangles, mapped from the archive\n", path, view.vertexCount, view.indexCount / 3);
+  return true;
+}
+
+// Drops a file from the page cache so the next read has to go to the disk. Only pages nobody has mapped or
+// dirtied go, which is all of them by the time the benchmark calls it.
+void evictFromPageCache(const char* path)
+{
+#ifdef __linux__
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if(fd < 0)
+    return;
+
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+#endif
+}
+
+// Startup loading of everything in the archive, once the way it's done without one: a read per file, and the
+// OBJ parse and optimization per mesh. Textures are only read, generating their mips isn't counted. The other
+// way maps the archive and touches every page of every asset, which is all creating the shader modules and
+// staging copies need. Cold runs drop the files from the page cache first, warm runs follow right after.
+void benchmarkAssetLoading(const char* archivePath)
+{
+  AssetArchive archive;
+  if(!openArchive(archive, archivePath))
+    return;
+
+  std::vector<ArchiveEntry> entries(archive.entries, archive.entries + archive.entryCount);
+  size_t archiveBytes = archive.size;
+  closeArchive(archive);
+
+  // Keeps the page touching loop from being thrown away
+  volatile uint32_t sink = 0;
+
+  auto loadFiles = [&]()
+  {
+    double start = getTimeMs();
+
+    for(const ArchiveEntry& entry : entries)
+    {
+      if(entry.kind == AssetKind_Mesh)
+      {
+        Mesh mesh;
+        if(loadObj(mesh, entry.name))
+        {
+          optimizeVertexCache(mesh.indices, mesh.vertices.size());
+          optimizeVertexFetch(mesh.vertices, mesh.indices);
+        }
+        continue;
+      }
+
+      FILE* file = fopen(entry.name, "rb");
+      if(!file)
+        continue;
+
+      fseek(file, 0, SEEK_END);
+      long length = ftell(file);
+      fseek(file, 0, SEEK_SET);
+
+      std::vector<char> contents(size_t(std::max(length, 0l)));
+      size_t rc = fread(contents.data(), 1, contents.size(), file);
+      fclose(file);
+
+      sink += uint32_t(rc);
+    }
+
+    return getTimeMs() - start;
+  };
+
+  auto loadArchive = [&]()
+  {
+    double start = getTimeMs();
+
+    AssetArchive archive;
+    if(!openArchive(archive, archivePath))
+      return 0.0;
+
+    for(uint32_t i = 0 ; i < archive.entryCount ; i++)
+    {
+      const uint8_t* data = static_cast<const uint8_t*>(getAssetData(archive, archive.entries[i]));
+      for(uint64_t offset = 0 ; offset < archive.entries[i].size ; offset += 4096)
+        sink += data[offset];
+    }
+
+    closeArchive(archive);
+
+    return getTimeMs() - start;
+  };
+
+  for(const ArchiveEntry& entry : entries)
+    evictFromPageCache(entry.name);
+
+  double filesCold = loadFiles();
+  double filesWarm = loadFiles();
+
+  evictFromPageCache(archivePath);
+
+  double archiveCold = loadArchive();
+  double archiveWarm = loadArchive();
+
+  printf("Loading %zu assets, %.1f KB archive:\n", entries.size(), archiveBytes / 1024.0);
+  printf("  %-10s %10s %10s\n", "", "cold ms", "warm ms");
+  printf("  %-10s %10.2f %10.2f\n", "files", filesCold, filesWarm);
+  printf("  %-10s %10.2f %10.2f\n", "archive", archiveCold, archiveWarm);
+
+#ifndef __linux__
+  printf("  no posix_fadvise here, cold runs may still hit the page cache\n");
+#endif
+}
+
+struct Options
+{
+  uint32_t framesInFlight = kDefaultFramesInFlight;
+  const char* pipelineCachePath = "pipeline_cache.bin";
+
+  const char* meshPath = NULL; // OBJ file, the built in triangle if not set
+  const char* archivePath = NULL; // Packed assets, shaders and the mesh come from here when it has them
+  bool quantize = false; // Half float positions and octahedral normals, 16 byte vertices instead of 32
+  uint32_t drawCount = 1; // Copies of the mesh, laid out in a grid
+
+  PresentPolicy presentPolicy = PresentPolicy_Fifo;
+  float fpsLimit = 0; // Frame limiter target, 0 is off
+  const char* latencyLogPath = NULL; // Per frame latency CSV
+  RedrawPolicy redraw = RedrawPolicy_Always;
+  uint32_t idleTimeout = 250; // ms an idle on-change loop sleeps on events before it looks for finished pipeline builds
+  const char* loopLogPath = NULL; // CPU use and wakeups once a second
+
+  uint32_t recordThreads = 0; // Threads recording draws, 0 is one per core
+  bool pipelineFrames = true; // Record a frame while the next one samples input, when there's no frame limiter
+  const char* jobTracePath = NULL; // Chrome trace of every job the worker threads ran
+  const char* capturePath = NULL; // Command stream of the first captureFrames frames that draw the scene, for farvkr-replay
+  uint32_t captureFrames = 300;
+  bool gpuCulling = false; // Cull and generate the draws in a compute pass
+
+  uint32_t msaa = 4; // Samples per pixel, as many as the device has up to this
+
+  MeshDrawData drawData = MeshDrawData_Push; // How each CPU draw gets its transform
+  bool wcCopy = false; // Write uniform draw data with non temporal stores
+
+  bool post = false; // Render HDR and finish with bloom, tonemapping and FXAA in compute
+  bool asyncCompute = true; // Post processing on the compute queue when the device has one, overlapped with the next frame
+
+  bool textures = false; // Stream the archive's textures onto the draws
+  VkDeviceSize textureBudget = 0; // Bytes the textures may take, 0 goes by what the device reports
+
+  // Headless renders a fixed number of frames into offscreen images and writes them out, no window or display needed
+  bool headless = false;
+  uint32_t frameCount = 100;
+  uint32_t width = 1920;
+  uint32_t height = 1080;
+  const char* outputDirectory = "frames";
+  ImageFileFormat outputFormat = ImageFileFormat_PPM;
+
+  bool profile = false;
+  const char* profileTracePath = NULL;
+
+  uint32_t benchMemoryCount = 0; // Run the allocator benchmark with this many buffers and exit
+  uint32_t benchRecordCount = 0; // Time recording this many draws with 1 to recordThreads threads and exit
+  const char* benchLoadPath = NULL; // Time loading this archive's assets against loading their files and exit
+  uint32_t benchCullCount = 0; // Time CPU frustum culling this many objects with every kernel and up to recordThreads threads and exit
+  bool benchAttachments = false; // Time rendering with every sample count, transient against stored attachments, and exit
+};
+
+Options parseOptions(int argc, char** argv)
+{
+  Options options;
+
+  for(int i = 1 ; i < argc ; i++)
+  {
+    if(strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+      options.framesInFlight = uint32_t(atoi(argv[++i]));
+    else if(strcmp(argv[i], "--pipeline-cache") == 0 && i + 1 < argc)
+      options.pipelineCachePath = argv[++i];
+    else if(strcmp(argv[i], "--mesh") == 0 && i + 1 < argc)
+      options.meshPath = argv[++i];
+    else if(strcmp(argv[i], "--archive") == 0 && i + 1 < argc)
+      options.archivePath = argv[++i];
+    else if(strcmp(argv[i], "--quantize") == 0)
+      options.quantize = true;
+    else if(strcmp(argv[i], "--draws") == 0 && i + 1 < argc)
+      options.drawCount = uint32_t(atoi(argv[++i]));
+    else if(strcmp(argv[i], "--present") == 0 && i + 1 < argc)
+    {
+      if(!parsePresentPolicy(argv[++i], options.presentPolicy))
+        printf("Unknown present mode %s, expected fifo, fifo-relaxed, mailbox or immediate\n", argv[i]);
+    }
+    else if(strcmp(argv[i], "--fps-limit") == 0 && i + 1 < argc)
+      options.fpsLimit = float(atof(argv[++i]));
+    else if(strcmp(argv[i], "--latency-log") == 0 && i + 1 < argc)
+      options.latencyLogPath = argv[++i];
+    else if(strcmp(argv[i], "--redraw") == 0 && i + 1 < argc)
+    {
+      if(!parseRedrawPolicy(argv[++i], options.redraw))
+        printf("Unknown redraw policy %s, expected always or on-change\n", argv[i]);
+    }
+    else if(strcmp(argv[i], "--idle-timeout") == 0 && i + 1 < argc)
+      options.idleTimeout = std::max(atoi(argv[++i]), 1);
+    else if(strcmp(argv[i], "--loop-log") == 0 && i + 1 < argc)
+      options.loopLogPath = argv[++i];
+    else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+      options.recordThreads = uint32_t(atoi(argv[++i]));
+    else if(strcmp(argv[i], "--no-pipeline") == 0)
+      options.pipelineFrames = false;
+    else if(strcmp(argv[i], "--job-trace") == 0 && i + 1 < argc)
+      options.jobTracePath = argv[++i];
+    else if(strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+      options.capturePath = argv[++i];
+    else if(strcmp(argv[i], "--capture-frames") == 0 && i + 1 < argc)
+      options.captureFrames = uint32_t(std::max(atoi(argv[++i]), 1));
+    else if(strcmp(argv[i], "--gpu-culling") == 0)
+      options.gpuCulling = true;
+    else if(strcmp(argv[i], "--msaa") == 0 && i + 1 < argc)
+      options.msaa = uint32_t(std::max(atoi(argv[++i]), 1));
+    else if(strcmp(argv[i], "--draw-data") == 0 && i + 1 < argc)
+    {
+      const char* mode = argv[++i];
+      if(strcmp(mode, "push") == 0)
+        options.drawData = MeshDrawData_Push;
+      else if(strcmp(mode, "uniform") == 0)
+        options.drawData = MeshDrawData_Uniform;
+      else
+        printf("Unknown draw data %s, expected push or uniform\n", mode);
+    }
+    else if(strcmp(argv[i], "--wc-copy") == 0)
+      options.wcCopy = true;
+    else if(strcmp(argv[i], "--post") == 0)
+      options.post = true;
+    else if(strcmp(argv[i], "--no-async-compute") == 0)
+      options.asyncCompute = false;
+    else if(strcmp(argv[i], "--textures") == 0)
+      options.textures = true;
+    else if(strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc)
+      options.textureBudget = VkDeviceSize(atoi(argv[++i])) * 1024 * 1024;
+    else if(strcmp(argv[i], "--bench-record") == 0 && i + 1 < argc)
+    {
+      options.benchRecordCount = uint32_t(atoi(argv[++i]));
+      options.headless = true;
+    }
+    else if(strcmp(argv[i], "--bench-memory") == 0 && i + 1 < argc)
+    {
+      // Doesn't need a window
+      options.benchMemoryCount = uint32_t(atoi(argv[++i]));
+      options.headless = true;
+    }
+    else if(strcmp(argv[i], "--bench-load") == 0 && i + 1 < argc)
+      options.benchLoadPath = argv[++i];
+    else if(strcmp(argv[i], "--bench-cull") == 0 && i + 1 < argc)
+      options.benchCullCount = uint32_t(atoi(argv[++i]));
+    else if(strcmp(argv[i], "--bench-attachments") == 0)
+    {
+      options.benchAttachments = true;
+      options.headless = true;
+    }
+    else if(strcmp(argv[i], "--profile") == 0)
+      options.profile = true;
+    else if(strcmp(argv[i], "--profile-trace") == 0 && i + 1 < argc)
+    {
+      options.profile = true;
+      options.profileTracePath = argv[++i];
+    }
+    else if(strcmp(argv[i], "--headless") == 0)
+      options.headless = true;
+    else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+      options.frameCount = uint32_t(atoi(argv[++i]));
+    else if(strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+    {
+      if(sscanf(argv[++i], "%ux%u", &options.width, &options.height) != 2 || options.width == 0 || options.height == 0)
+      {
+        printf("Bad size %s, expected WIDTHxHEIGHT\n", argv[i]);
+        options.width = 1920;
+        options.height = 1080;
+      }
+    }
+    else if(strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+      options.outputDirectory = argv[++i];
+    else if(strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+    {
+      if(!parseImageFileFormat(argv[++i], options.outputFormat))
+        printf("Unknown format %s, expected none, raw, ppm or png\n", argv[i]);
+    }
+    else
+      printf("Unknown option: %s\n", argv[i]);
+  }
+
+  // 1 is allowed so we can compare against the fully serialized loop
+  options.framesInFlight = std::clamp(options.framesInFlight, 1u, kMaxFramesInFlight);
+
+  options.drawCount = std::max(options.drawCount, 1u);
+
+  if(options.recordThreads == 0)
+    options.recordThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  options.recordThreads = std::min(options.recordThreads, kMaxRecordThreads);
+
+  return options;
+}
+
+// An offscreen stand in for a swapchain image
+struct OffscreenTarget
+{
+  Image color;
+  VkFramebuffer framebuffer;
+};
+
+// The frame renders into a graph transient and the readback copies it out within the same frame, so one image
+// does for every frame in flight: the graph makes its first use wait for last frame's copy. With post processing
+// the scene renders into the post scene images instead and the chain's output is what's read back.
+void renderHeadless(const Options& options, VkDevice device, MemoryAllocator& allocator, VkQueue queue, UploadManager& uploader, PipelineManager& pipelines, VkRenderPass renderPass, const RenderPassConfig& config, const Scene& scene, DrawRecorder& recorder, WorkerPool& workers, RenderGraph& graph, DeletionQueue& deletions, std::vector<FrameContext>& frames, VkSemaphore frameTimeline, uint64_t& frameTimelineValue, Profiler& profiler, PostProcess* post)
+{
+  if(options.outputFormat != ImageFileFormat_None && mkdir(options.outputDirectory, 0755) != 0 && errno != EEXIST)
+  {
+    printf("Can't create output directory %s\n", options.outputDirectory);
+    return;
+  }
+
+  // Depth and multisampled color are only used inside the render pass, one set does for every frame too
+  RenderAttachments attachments;
+  createRenderAttachments(attachments, device, allocator, config, options.width, options.height);
+
+  RenderImageDesc colorDesc = { kHeadlessFormat, options.width, options.height, 1, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT };
+
+  // Made once the graph has placed the transient, and again whenever it places a new one
+  VkFramebuffer transientFramebuffer = VK_NULL_HANDLE;
+  VkImageView transientView = VK_NULL_HANDLE;
+
+  // The post scene images are one per frame slot, the chain samples them on its own queue
+  std::vector<VkFramebuffer> sceneFramebuffers;
+  for(uint32_t i = 0 ; post && i < frames.size() ; i++)
+    sceneFramebuffers.push_back(createFramebuffer(device, renderPass, attachments, post->targets.scenes[i].imageView, options.width, options.height));
+
+  // The one the frame renders through, the main pass reads it when it records
+  VkFramebuffer framebuffer = VK_NULL_HANDLE;
+
+  // A couple of slots more than frames in flight gives the writer thread some slack before it holds up the loop
+  ReadbackRing ring;
+  createReadbackRing(ring, device, allocator, uint32_t(frames.size()) + 2, options.width, options.height, options.outputFormat, options.outputDirectory);
+
+  // Every written frame should have the mesh in it, so this is the one place that waits for uploads and pipelines
+  waitForUploads(uploader);
+  waitForPipelines(pipelines);
+  updatePipelines(pipelines, frameTimelineValue, getTimelineSemaphoreValue(device, frameTimeline));
+
+  RenderGraphStats graphStats = {};
+
+  double start = getTimeMs();
+
+  for(uint32_t frameIndex = 0 ; frameIndex < options.frameCount ; frameIndex++)
+  {
+    uint32_t frameSlot = frameIndex % uint32_t(frames.size());
+    FrameContext& frame = frames[frameSlot];
+
+    waitTimelineSemaphore(device, frameTimeline, frame.timelineValue);
+    collectDeletions(deletions, device, getTimelineSemaphoreValue(device, frameTimeline));
+
+    if(scene.transient)
+      beginTransientFrame(*scene.transient, frameSlot);
+
+    if(post)
+      beginPostFrame(*post, frameSlot, getTimelineSemaphoreValue(device, frameTimeline));
+
+    pollReadbacks(ring, device, frameTimeline);
+    uint32_t readbackSlot = acquireReadbackSlot(ring, device, frameTimeline);
+
+    VkCommandBuffer commandBuffer = frame.commandBuffer;
+
+    VK_CHECK(vkResetCommandPool(device, frame.commandPool, 0));
+
+    VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+    if(post)
+      beginPostScene(*post, commandBuffer, frameSlot);
+
+    beginProfilerFrame(profiler, device, commandBuffer, frameSlot, frameIndex);
+    beginProfilerScope(profiler, commandBuffer, "frame");
+
+    // Nothing else flushes the uploader here, texture streaming queues more every frame
+    flushUploads(uploader);
+    uint64_t uploadWaitValue = acquireUploads(uploader, commandBuffer);
+
+    if(scene.textures)
+      updateSceneTextures(scene, frameSlot, options.height, frameTimelineValue + 1, getTimelineSemaphoreValue(device, frameTimeline));
+
+    beginRenderGraph(graph);
+    RenderResource color = 0;
+
+    if(post)
+    {
+      // Last sampled by post processing, the frame slot's wait already covers that but the graph doesn't know
+      const Image& sceneImage = post->targets.scenes[frameSlot];
+      color = importImage(graph, "color", sceneImage.image, sceneImage.imageView, VK_IMAGE_ASPECT_COLOR_BIT, RenderUsage_SampledCompute, true);
+      framebuffer = sceneFramebuffers[frameSlot];
+    }
+    else
+      color = createTransientImage(graph, "color", colorDesc);
+
+    addScenePasses(graph, color, device, renderPass, framebuffer, options.width, options.height, scene, isSceneReady(scene, uploader), recorder, workers, frameSlot, getProfilerActiveStatistics(profiler));
+
+    if(post)
+    {
+      setRenderGraphOutput(graph, color, RenderUsage_SampledCompute);
+    }
+    else
+    {
+      // The copy is for the host, nothing in the graph reads it
+      uint32_t readbackPass = addRenderGraphPass(graph, "readback", [&ring, readbackSlot, &graph, color](VkCommandBuffer commandBuffer)
+      {
+        recordReadback(ring, readbackSlot, commandBuffer, getRenderGraphImage(graph, color));
+      }, true);
+
+      useRenderResource(graph, readbackPass, color, RenderUsage_TransferRead);
+    }
+
+    compileRenderGraph(graph, frameTimelineValue);
+    reportRenderGraphStats(graph, graphStats);
+
+    // The frames already submitted may still render through the old framebuffer
+    VkImageView colorView = getRenderGraphImageView(graph, color);
+    if(!post && colorView != transientView)
+    {
+      deferDeletion(deletions, VK_OBJECT_TYPE_FRAMEBUFFER, (uint64_t)transientFramebuffer, frameTimelineValue);
+      transientFramebuffer = createFramebuffer(device, renderPass, attachments, colorView, options.width, options.height);
+      transientView = colorView;
+    }
+
+    if(!post)
+      framebuffer = transientFramebuffer;
+
+    // The transient is only placed once the graph is compiled
+    if(scene.capture)
+      beginCaptureFrame(*scene.capture, frameIndex, options.width, options.height, getRenderGraphImage(graph, color));
+
+    executeRenderGraph(graph, commandBuffer, &profiler);
+
+    if(scene.capture)
+      endCaptureFrame(*scene.capture);
+
+    endProfilerScope(profiler, commandBuffer);
+
+    if(post)
+      endPostScene(*post, commandBuffer, frameSlot);
+
+    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+    frame.timelineValue = ++frameTimelineValue;
+
+    VkPipelineStageFlags uploadWaitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+    timelineInfo.waitSemaphoreValueCount = uploadWaitValue ? 1 : 0;
+    timelineInfo.pWaitSemaphoreValues = &uploadWaitValue;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &frame.timelineValue;
+
+    VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = uploadWaitValue ? 1 : 0;
+    submitInfo.pWaitSemaphores = &uploader.timeline;
+    submitInfo.pWaitDstStageMask = &uploadWaitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = post ? &post->sceneTimeline : &frameTimeline;
+
+    VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+    // The chain picks the scene up where the graphics submit left it and the frame timeline waits for it
+    if(post)
+    {
+      recordPostProcess(*post, frameSlot, [&ring, readbackSlot](VkCommandBuffer commandBuffer, VkImage output)
+      {
+        recordReadback(ring, readbackSlot, commandBuffer, output);
+      });
+
+      submitPostProcess(*post, frameSlot, frame.timelineValue, VK_NULL_HANDLE, VK_NULL_HANDLE, frameTimeline);
+    }
+
+    submitReadback(ring, readbackSlot, frameIndex, frame.timelineValue);
+  }
+
+  finishReadbacks(ring, device, frameTimeline);
+
+  double seconds = (getTimeMs() - start) / 1000.0;
+  printf("Headless: %u frames at %ux%u in %.2f s (%.1f fps)\n", ring.framesRead, options.width, options.height, seconds, ring.framesRead / seconds);
+
+  if(ring.framesWritten)
+    printf("Headless: wrote %u files to %s, %.1f MB, %.2f ms per file on the writer thread\n", ring.framesWritten, options.outputDirectory, ring.bytesWritten / (1024.0 * 1024.0), ring.writeTime / ring.framesWritten);
+
+  printMemoryStats(allocator);
+
+  destroyReadbackRing(ring, device, allocator);
+
+  // The readback ring waited for the last frame
+  vkDestroyFramebuffer(device, transientFramebuffer, NULL);
+  for(VkFramebuffer sceneFramebuffer : sceneFramebuffers)
+    vkDestroyFramebuffer(device, sceneFramebuffer, NULL);
+
+  destroyRenderAttachments(attachments, device);
+}
+
+// Times recording a frame of the scene's draws with 1, 2, 4... up to options.recordThreads threads.
+// Nothing is submitted, so this is purely the CPU side: secondaries on the workers plus the primary, and
+// declaring and compiling the render graph, which is part of every real frame too.
+// With GPU culling the thread count makes no difference, the interesting number is how little it costs.
+void benchmarkRecording(const Options& options, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator& allocator, uint32_t familyIndex, PipelineManager& pipelines, VkRenderPass renderPass, const RenderPassConfig& config, const Scene& scene, RenderGraph& graph)
+{
+  const uint32_t kWarmupFrames = 5;
+  const uint32_t kFrames = 50;
+
+  // Nothing was submitted yet, so nothing can be using a pipeline that gets replaced
+  waitForPipelines(pipelines);
+  updatePipelines(pipelines, 0, 0);
+
+  RenderAttachments attachments;
+  createRenderAttachments(attachments, device, allocator, config, options.width, options.height);
+
+  OffscreenTarget target;
+  createImage(target.color, device, allocator, options.width, options.height, config.colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+  target.framebuffer = createFramebuffer(device, renderPass, attachments, target.color.imageView, options.width, options.height);
+
+  VkCommandPool commandPool = createCommandPool(device, familyIndex);
+
+  VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+  allocateInfo.commandPool = commandPool;
+  allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocateInfo.commandBufferCount = 1;
+
+  VkCommandBuffer commandBuffer = 0;
+  VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer));
+
+  printf("Recording %zu draws%s, %u frames per thread count\n", scene.draws.size(), scene.culling ? " culled on the GPU" : "", kFrames);
+
+  double baseline = 0;
+
+  for(uint32_t threadCount = 1 ; ; threadCount = std::min(threadCount * 2, options.recordThreads))
+  {
+    WorkerPool workers;
+    createWorkerPool(workers, threadCount);
+
+    DrawRecorder recorder;
+    createDrawRecorder(recorder, device, physicalDevice, familyIndex, 1, threadCount);
+
+    double start = 0;
+
+    for(uint32_t frame = 0 ; frame < kWarmupFrames + kFrames ; frame++)
+    {
+      // The first frames allocate the secondaries and fault in driver memory
+      if(frame == kWarmupFrames)
+        start = getTimeMs();
+
+      VK_CHECK(vkResetCommandPool(device, commandPool, 0));
+
+      // Nothing is submitted, so every frame can have slot 0
+      if(scene.transient)
+        beginTransientFrame(*scene.transient, 0);
+
+      VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+      beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+      VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+      beginRenderGraph(graph);
+      RenderResource color = importImage(graph, "color", target.color.image, target.color.imageView, VK_IMAGE_ASPECT_COLOR_BIT, RenderUsage_ColorAttachment, true);
+      setRenderGraphOutput(graph, color);
+
+      addScenePasses(graph, color, device, renderPass, target.framebuffer, options.width, options.height, scene, true, recorder, workers, 0, 0);
+
+      compileRenderGraph(graph, 0);
+      executeRenderGraph(graph, commandBuffer, NULL);
+
+      VK_CHECK(vkEndCommandBuffer(commandBuffer));
+    }
+
+    double frameTime = (getTimeMs() - start) / kFrames;
+    if(threadCount == 1)
+      baseline = frameTime;
+
+    printf("  %2u threads: %.3f ms per frame, %.2fx\n", threadCount, frameTime, baseline / frameTime);
+
+    destroyDrawRecorder(recorder, device);
+    destroyWorkerPool(workers);
+
+    if(threadCount == options.recordThreads)
+      break;
+  }
+
+  vkDestroyCommandPool(device, commandPool, NULL);
+  vkDestroyFramebuffer(device, target.framebuffer, NULL);
+  destroyImage(target.color, device, allocator);
+  destroyRenderAttachments(attachments, device);
+}
+
+// Renders the scene at 1, 2, 4 and 8 samples, as far as the device goes, with depth and multisampled color
+// transient and lazily allocated against stored to ordinary memory. Each submit is kPasses render passes of
+// the whole scene into the same target, timed from submit to idle. On a tiler the transient ones should
+// cost next to nothing in bandwidth and commit next to no memory, on a desktop GPU they're about the same.
+void benchmarkAttachments(const Options& options, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator& allocator, VkQueue queue, uint32_t familyIndex, UploadManager& uploader, PipelineCache& pipelineCache, const ShaderVariantRegistry& variants, const Scene& scene)
+{
+  const uint32_t kPasses = 16;
+  const uint32_t kRuns = 5;
+
+  VkCommandPool commandPool = createCommandPool(device, familyIndex);
+
+  VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+  allocateInfo.commandPool = commandPool;
+  allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocateInfo.commandBufferCount = 1;
+
+  VkCommandBuffer commandBuffer = 0;
+  VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer));
+
+  VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+
+  // The mesh has to be on this queue before anything draws it
+  waitForUploads(uploader);
+  {
+    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+    uint64_t uploadWaitValue = acquireUploads(uploader, commandBuffer);
+    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+    VkPipelineStageFlags uploadWaitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+    timelineInfo.waitSemaphoreValueCount = uploadWaitValue ? 1 : 0;
+    timelineInfo.pWaitSemaphoreValues = &uploadWaitValue;
+
+    VkSubmitInfo acquireInfo = submitInfo;
+    acquireInfo.pNext = &timelineInfo;
+    acquireInfo.waitSemaphoreCount = uploadWaitValue ? 1 : 0;
+    acquireInfo.pWaitSemaphores = &uploader.timeline;
+    acquireInfo.pWaitDstStageMask = &uploadWaitStage;
+
+    VK_CHECK(vkQueueSubmit(queue, 1, &acquireInfo, VK_NULL_HANDLE));
+    VK_CHECK(vkQueueWaitIdle(queue));
+  }
+
+  Image color;
+  createImage(color, device, allocator, options.width, options.height, kHeadlessFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+
+  // A single recording thread draws inline, so the same recorder works for every pass in the command buffer
+  WorkerPool workers;
+  createWorkerPool(workers, 1);
+
+  DrawRecorder recorder;
+  createDrawRecorder(recorder, device, physicalDevice, familyIndex, 1, 1);
+
+  const PipelineDesc& meshDesc = scene.pipelines->pipelines[scene.meshPipeline].desc;
+
+  printf("Attachments: %ux%u, %zu draws, %u passes per submit, best of %u\n", options.width, options.height, scene.draws.size(), kPasses, kRuns);
+
+  for(uint32_t samples = VK_SAMPLE_COUNT_1_BIT ; samples <= VK_SAMPLE_COUNT_8_BIT ; samples *= 2)
+  {
+    if(pickSampleCount(physicalDevice, samples) != samples)
+      continue;
+
+    for(bool transient : { true, false })
+    {
+      RenderPassConfig config = { kHeadlessFormat, pickDepthFormat(physicalDevice), VkSampleCountFlagBits(samples), transient };
+
+      VkRenderPass renderPass = createRenderPass(device, config);
+
+      RenderAttachments attachments;
+      createRenderAttachments(attachments, device, allocator, config, options.width, options.height);
+
+      VkFramebuffer framebuffer = createFramebuffer(device, renderPass, attachments, color.imageView, options.width, options.height);
+
+      // Pipelines have to match the render pass's sample count, so each config gets its own
+      PipelineManager pipelines;
+      createPipelineManager(pipelines, device, pipelineCache, renderPass, config.samples, scene.heap->layout, scene.pipelines->archive, false);
+
+      Scene passScene = scene;
+      passScene.pipelines = &pipelines;
+      passScene.culling = NULL;
+      passScene.textures = NULL;
+
+      // The attachments are what's measured, the draws take their transforms the cheapest way and all
+      // those passes can't run out of a transient frame
+      passScene.drawData = MeshDrawData_Push;
+      passScene.transient = NULL;
+      PipelineDesc passDesc;
+      bool found = getVariantPipelineDesc(variants, meshDesc.name.c_str(), "mesh_vert", "mesh_frag", meshDesc.quantized ? ShaderFeature_Quantized : 0, passDesc);
+      assert(found);
+      passScene.meshPipeline = addPipeline(pipelines, passDesc);
+
+      waitForPipelines(pipelines);
+      updatePipelines(pipelines, 0, 0);
+
+      double best = 0;
+
+      // The first run faults in the lazily allocated memory, if the driver backs it at all
+      for(uint32_t run = 0 ; run < kRuns + 1 ; run++)
+      {
+        VK_CHECK(vkResetCommandPool(device, commandPool, 0));
+        VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+        // The render pass expects a color attachment, what was in it doesn't matter
+        VkImageMemoryBarrier barrier = imageBarrier(color.image, 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+        // The render pass's external dependency orders the passes against each other
+        for(uint32_t pass = 0 ; pass < kPasses ; pass++)
+          recordRenderPass(commandBuffer, device, renderPass, framebuffer, options.width, options.height, passScene, true, recorder, workers, 0, 0);
+
+        VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+        double start = getTimeMs();
+        VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+        VK_CHECK(vkQueueWaitIdle(queue));
+        double passTime = (getTimeMs() - start) / kPasses;
+
+        if(run > 0 && (best == 0 || passTime < best))
+          best = passTime;
+      }
+
+      VkDeviceSize allocated = attachments.color.size + attachments.depth.size;
+      VkDeviceSize committed = getRenderAttachmentBytes(attachments, device);
+      bool lazy = attachments.color.lazy || attachments.depth.lazy;
+
+      printf("  %ux %-9s: %.3f ms per pass, %.1f MB allocated, %.1f MB committed%s\n", samples, transient ? "transient" : "stored", best,
+        allocated / (1024.0 * 1024.0), committed / (1024.0 * 1024.0), lazy ? " lazily" : "");
+
+      destroyPipelineManager(pipelines);
+      vkDestroyFramebuffer(device, framebuffer, NULL);
+      destroyRenderAttachments(attachments, device);
+      vkDestroyRenderPass(device, renderPass, NULL);
+    }
+  }
+
+  destroyDrawRecorder(recorder, device);
+  destroyWorkerPool(workers);
+  destroyImage(color, device, allocator);
+  vkDestroyCommandPool(device, commandPool, NULL);
+}
+
+int main(int argc, char** argv)
+{
+  double startupTime = getTimeMs();
+
+  Options options = parseOptions(argc, argv);
+
+  if(options.benchLoadPath)
+  {
+    benchmarkAssetLoading(options.benchLoadPath);
+    return 0;
+  }
+
+  if(options.benchCullCount)
+  {
+    benchmarkSceneCulling(options.benchCullCount, options.recordThreads);
+    return 0;
+  }
+
+  // Mapped for the whole run, the pipeline manager reads shaders from it on its threads
+  AssetArchive archive = {};
+  if(options.archivePath && !openArchive(archive, options.archivePath))
+    return -1;
+
+  Mesh mesh;
+  MeshView meshView;
+  if(!findArchivedMesh(archive, options.meshPath, meshView))
+  {
+    if(!loadMesh(mesh, options.meshPath))
+      return -1;
+
+    meshView = getMeshView(mesh);
+  }
+
+  // Headless runs never touch SDL video or the WSI extensions, so they work without a display
+  bool presentation = !options.headless;
+
+  // Initialize SDL
+  if (presentation && SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) != 0)
+  {
+    printf("Failed to initialize SDL!\n");
+    return -1;
+  }
+
+#ifdef _DEBUG
+  VkInstance instance = createInstance(presentation, true);
+#else
+  VkInstance instance = createInstance(presentation, false);
+#endif
+
+  VkDebugReportCallbackEXT debugCallback = registerDebugCallback(instance);
+
+  // Get Physical device
+  VkPhysicalDevice physicalDevices[16];
+  uint32_t physicalDeviceCount = sizeof(physicalDevices) / sizeof(physicalDevices[0]);
+  VK_CHECK(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices));
+
+  VkPhysicalDevice physicalDevice = pickPhysicalDevice(physicalDevices, physicalDeviceCount);
+  assert(physicalDevice);
+
+  QueueFamilies families = getQueueFamilies(physicalDevice);
+  assert(families.graphics != VK_QUEUE_FAMILY_IGNORED);
+  printf("Queue families: graphics %u, compute %u, transfer %u\n", families.graphics, families.compute, families.transfer);
+
+  uint32_t familyIndex = families.graphics;
+  VkDevice device = createDevice(instance, physicalDevice, families, presentation);
+
+  MemoryAllocator allocator;
+  createMemoryAllocator(allocator, device, physicalDevice);
+
+  if(options.benchMemoryCount)
+  {
+    benchmarkMemoryAllocator(allocator, options.benchMemoryCount);
+
+    if(options.archivePath)
+      closeArchive(archive);
+
+    destroyMemoryAllocator(allocator);
+    vkDestroyDevice(device, NULL);
+    if(debugCallback)
+    {
+      PFN_vkDestroyDebugReportCallbackEXT vkDestroyDebugReportCallbackEXT = (PFN_vkDestroyDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugReportCallbackEXT");
+      vkDestroyDebugReportCallbackEXT(instance, debugCallback, NULL);
+    }
+    vkDestroyInstance(instance, NULL);
+    return 0;
+  }
+
+  SDL_Window* window = NULL;
+  VkSurfaceKHR surface = VK_NULL_HANDLE;
+  int windowWidth = 0, windowHeight = 0;
+  VkFormat swapchainFormat = kHeadlessFormat;
+  VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+  if(presentation)
+  {
+    // Create Window
+    window = SDL_CreateWindow("VKR", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 
+        1920, 1080, SDL_WINDOW_VULKAN | SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+
+    // Create surface
+    // TODO: This is platform specific. Add wayland and windows stuff?
+    // TODO: Figure this stuff out. It doesn't work, but it might be handy if we don't want to use SDL.
+  //#ifdef VK_USE_PLATFORM_XLIB_KHR
+    //SDL_SysWMinfo wm_info;
+    //SDL_GetWindowWMInfo(window, &wm_info);
+    //VkSurfaceKHR surface = createSurface(window, instance, &wm_info);
+  //#endif
+
+    SDL_GetWindowSize(window, &windowWidth, &windowHeight);
+
+    surface = createSurfaceFromSDL(window, instance);
+
+    VkBool32 presentSupprted = 0;
+    vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, familyIndex, surface, &presentSupprted);
+    assert(presentSupprted);
+
+    swapchainFormat = getSwapchainFormat(physicalDevice, surface);
+
+    presentMode = choosePresentMode(physicalDevice, surface, options.presentPolicy);
+  }
+
+  //VkSwapchainKHR swapChain = createSwapchain(device, physicalDevice, surface, swapchainFormat, presentMode, &familyIndex, window);
+
+  // Signaled with an increasing value by every submit, the CPU waits on it before reusing a frame slot
+  VkSemaphore frameTimeline = createTimelineSemaphore(device);
+  uint64_t frameTimelineValue = 0;
+
+  // Families that fell back to graphics share its queue
+  Queues queues = {};
+  vkGetDeviceQueue(device, families.graphics, 0, &queues.graphics);
+  vkGetDeviceQueue(device, families.compute, 0, &queues.compute);
+  vkGetDeviceQueue(device, families.transfer, 0, &queues.transfer);
+
+  UploadManager uploader;
+  createUploadManager(uploader, device, physicalDevice, allocator, queues.transfer, families.transfer, families.graphics);
+
+  // With post processing the scene renders HDR and only the chain's output goes to the swapchain
+  RenderPassConfig renderPassConfig = { options.post ? kPostSceneFormat : swapchainFormat, pickDepthFormat(physicalDevice), pickSampleCount(physicalDevice, options.msaa), true };
+  printf("Render pass: %ux MSAA, depth format %d\n", renderPassConfig.samples, renderPassConfig.depthFormat);
+
+  VkRenderPass renderPass = createRenderPass(device, renderPassConfig);
+
+  // Every pipeline uses the heap's layout, resources are found through indices in push constants
+  BindlessHeap bindlessHeap;
+  createBindlessHeap(bindlessHeap, device, physicalDevice);
+
+  PipelineCache pipelineCache;
+  createPipelineCache(pipelineCache, device, physicalDevice, options.pipelineCachePath, isDeviceExtensionSupported(physicalDevice, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME));
+
+  // Pipelines build in the background from here on, a cache miss is the slowest part of startup and the
+  // frame loop clears the screen until they're done. Windowed runs also rebuild them when a shader changes.
+  PipelineManager pipelines;
+  createPipelineManager(pipelines, device, pipelineCache, renderPass, renderPassConfig.samples, bindlessHeap.layout, options.archivePath ? &archive : NULL, presentation);
+
+  // The mesh shaders come in variants per feature set, see shaders/permute.sh
+  ShaderVariantRegistry variants = {};
+  if(!loadShaderVariants(variants, kShaderVariantManifest))
+    return -1;
+
+  GpuMesh gpuMesh;
+  createGpuMesh(gpuMesh, meshView, options.quantize, device, allocator, uploader);
+
+  Scene scene = {};
+  scene.mesh = &gpuMesh;
+  scene.heap = &bindlessHeap;
+  scene.pipelines = &pipelines;
+  scene.drawData = options.drawData;
+
+  // Textures only stream out of an archive. If the streamer doesn't come up the shader still checks the table.
+  ShaderFeatures meshFeatures = 0;
+  if(options.quantize)
+    meshFeatures |= ShaderFeature_Quantized;
+  if(options.drawData == MeshDrawData_Uniform)
+    meshFeatures |= ShaderFeature_UniformDraws;
+  if(options.textures && options.archivePath)
+    meshFeatures |= ShaderFeature_Textured;
+
+  scene.meshPipeline = addVariantPipeline(variants, pipelines, options.quantize ? "mesh quantized" : "mesh", "mesh_vert", "mesh_frag", meshFeatures);
+  if(scene.meshPipeline == ~0u)
+    return -1;
+  createDrawGrid(scene.draws, gpuMesh, options.benchRecordCount ? options.benchRecordCount : options.drawCount);
+
+  bool gpuCulling = options.gpuCulling && isGpuCullingSupported(physicalDevice);
+  if(options.gpuCulling && !gpuCulling)
+    printf("GPU culling: needs multiDrawIndirect, drawIndirectFirstInstance and drawIndirectCount, drawing from the CPU\n");
+
+  GpuCulling culling = {};
+
+  if(gpuCulling)
+  {
+    createGpuCulling(culling, device, allocator, uploader, bindlessHeap, scene.draws);
+    scene.culling = &culling;
+    scene.indirectPipeline = addVariantPipeline(variants, pipelines, "mesh indirect", "mesh_vert", "mesh_frag", (meshFeatures & ~ShaderFeature_UniformDraws) | ShaderFeature_Indirect);
+    if(scene.indirectPipeline == ~0u)
+      return -1;
+    scene.cullPipeline = addComputePipeline(pipelines, "cull", "shaders/cull_comp.spv");
+  }
+
+  flushUploads(uploader);
+
+  // Sized like the target, the swapchain renders through its scene images
+  PostProcess post = {};
+  if(options.post)
+    createPostProcess(post, device, physicalDevice, allocator, bindlessHeap, pipelines, families.graphics, queues.graphics, families.compute, queues.compute, options.asyncCompute, isSynchronization2Supported(physicalDevice), options.framesInFlight,
+      presentation ? uint32_t(windowWidth) : options.width, presentation ? uint32_t(windowHeight) : options.height, swapchainFormat);
+
+  PostProcess* postProcess = options.post ? &post : NULL;
+
+  Swapchain swapchain = {};
+  if(presentation)
+  {
+    createSwapchain(swapchain, device, physicalDevice, surface, swapchainFormat, presentMode, &familyIndex, windowWidth, windowHeight, renderPass, allocator, renderPassConfig, postProcess);
+    printf("Present mode: %s, %zu swapchain images\n", getPresentModeName(presentMode), swapchain.images.size());
+  }
+
+  std::vector<FrameContext> frames;
+  createFrameContexts(frames, device, familyIndex, options.framesInFlight);
+  printf("Frames in flight: %u\n", options.framesInFlight);
+
+  // Needs a table per frame slot, so it comes after the frames. The small mips go to the uploader right away.
+  TextureStreamer textureStreamer = {};
+
+  if(options.textures && !options.archivePath)
+    printf("Textures: --textures needs --archive, drawing untextured\n");
+  else if(options.textures && createTextureStreamer(textureStreamer, device, physicalDevice, allocator, uploader, bindlessHeap, archive, uint32_t(frames.size()), isDeviceExtensionSupported(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME), options.textureBudget))
+  {
+    scene.textures = &textureStreamer;
+    flushUploads(uploader);
+  }
+
+  // A region per frame slot, with room for every draw's uniforms. Push constant runs use it to count bytes.
+  TransientAllocator transient;
+  createTransientAllocator(transient, device, physicalDevice, allocator, bindlessHeap, uint32_t(frames.size()), scene.draws.size() * kBindlessDynamicUniformRange, options.wcCopy);
+  scene.transient = &transient;
+  printf("Draw data: %s\n", options.drawData == MeshDrawData_Uniform ? "dynamic uniform offsets" : "push constants");
+
+  Profiler profiler;
+  createProfiler(profiler, device, physicalDevice, familyIndex, uint32_t(frames.size()), options.profile, options.profileTracePath);
+
+  WorkerPool workers;
+  createWorkerPool(workers, options.recordThreads);
+
+  if(options.jobTracePath && !setJobTrace(workers, options.jobTracePath))
+    printf("Jobs: can't open %s for writing\n", options.jobTracePath);
+
+  DrawRecorder recorder;
+  createDrawRecorder(recorder, device, physicalDevice, familyIndex, uint32_t(frames.size()), options.recordThreads);
+  printf("Recording threads: %u, draws: %zu%s\n", options.recordThreads, scene.draws.size(), gpuCulling ? ", culled on the GPU" : "");
+
+  // Old swapchains and what was built on them, and transients the graph replaced, until the frames using them are done
+  DeletionQueue deletions = {};
+
+  RenderGraph graph;
+  createRenderGraph(graph, device, allocator, isSynchronization2Supported(physicalDevice), deletions);
+  RenderGraphStats graphStats = {};
+
+  // The stream only knows the mesh and the frame's target, culling, textures and post processing have buffers
+  // and images of their own
+  CommandCapture capture;
+  if(options.capturePath && (gpuCulling || scene.textures || postProcess))
+    printf("Capture: only the CPU drawn scene is captured, not with --gpu-culling, --textures or --post\n");
+  else if(options.capturePath)
+  {
+    createCommandCapture(capture, options.capturePath, options.captureFrames, pipelines, meshView, options.quantize, renderPassConfig.colorFormat, renderPassConfig.depthFormat, renderPassConfig.samples);
+    scene.capture = &capture;
+    graph.capture = &capture;
+  }
+
+  if(options.benchRecordCount)
+    benchmarkRecording(options, device, physicalDevice, allocator, familyIndex, pipelines, renderPass, renderPassConfig, scene, graph);
+  else if(options.benchAttachments)
+    benchmarkAttachments(options, device, physicalDevice, allocator, queues.graphics, familyIndex, uploader, pipelineCache, variants, scene);
+  else if(options.headless)
+    renderHeadless(options, device, allocator, queues.graphics, uploader, pipelines, renderPass, renderPassConfig, scene, recorder, workers, graph, deletions, frames, frameTimeline, frameTimelineValue, profiler, postProcess);
+
+  uint64_t frameIndex = 0;
+
+  uint64_t statsStart = SDL_GetPerformanceCounter();
+  uint32_t statsFrames = 0;
+
+  FrameLimiter limiter;
+  createFrameLimiter(limiter, options.fpsLimit);
+
+  LatencyTracker latency;
+  createLatencyTracker(latency, device, presentation && isPresentWaitSupported(physicalDevice), options.latencyLogPath);
+
+  LoopStats loopStats;
+  createLoopStats(loopStats, options.loopLogPath);
+
+  bool run = presentation;
+  bool resizePending = false;
+  bool profilerToggle = false; // P was pressed, applied when no frame is being recorded
+
+  // Something changed since the last frame was recorded, with --redraw on-change there are no frames without it
+  bool redraw = true;
+
+  // Recording frame N runs as a job while the main thread samples input for N+1, and the GPU is on N-1 or
+  // earlier. That's a frame more from input to submit, so the limiter, which is all about that latency,
+  // keeps the frame serial, and so does a single thread, where the job has nothing to overlap with.
+  bool pipelined = options.pipelineFrames && options.fpsLimit == 0 && getWorkerThreadCount(workers) > 1;
+  printf("Frame pipeline: %s\n", pipelined ? "recording overlaps the next frame's input" : "off");
+
+  // The frame between its record job and its submit
+  PendingFrame pending;
+
+  // Input is only looked at once we have an image and the limiter is done waiting, right before recording.
+  // Pipelined, that's while the previous frame records, so nothing here may touch what recording uses.
+  auto handleEvent = [&](const SDL_Event& event)
+  {
+    if (event.type == SDL_QUIT)
+    {
+      run = false;
+    }
+
+    // P toggles the GPU profiler, turning it off prints what it collected so far
+    if(event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_p && !event.key.repeat)
+      profilerToggle = !profilerToggle;
+
+    // Handled before the next acquire, the image we might be holding belongs to this swapchain
+    if(event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_RESIZED)
+      resizePending = true;
+
+    // Exposed, restored, resized or a key, mouse motion alone doesn't change anything we draw
+    if(event.type == SDL_QUIT || event.type == SDL_KEYDOWN || event.type == SDL_WINDOWEVENT)
+      redraw = true;
+  };
+
+  auto processEvents = [&]()
+  {
+    SDL_Event event;
+    while (SDL_PollEvent(&event))
+      handleEvent(event);
+  };
+
+  // Sleeps on the event queue until something happens or the timeout is up. Blocks for real from SDL 2.0.16,
+  // older versions poll every millisecond inside, which the wakeups in the loop stats show.
+  auto waitForEvents = [&](uint32_t timeout)
+  {
+    double start = getTimeMs();
+
+    SDL_Event event;
+    if(SDL_WaitEventTimeout(&event, int(timeout)))
+    {
+      handleEvent(event);
+      processEvents();
+    }
+
+    loopStats.idleTime += getTimeMs() - start;
+    loopStats.idleWaits++;
+  };
+
+  // Waits for the pending frame's record job, then submits and presents it
+  auto submitFrame = [&]()
+  {
+    waitForJobs(workers, pending.recorded);
+    collectJobTimings(workers);
+
+    pending.active = false;
+
+    FrameContext& frame = frames[pending.frameSlot];
+    VkCommandBuffer commandBuffer = frame.commandBuffer;
+    uint32_t imageIndex = pending.imageIndex;
+
+    // The upload wait is already satisfied, it's there so the copies are visible to this submit
+    VkSemaphore waitSemaphores[] = { frame.acquireSemaphore, uploader.timeline };
+    VkPipelineStageFlags waitStageMasks[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT };
+    uint64_t waitValues[] = { 0, pending.uploadWaitValue };
+    uint32_t waitCount = pending.uploadWaitValue ? 2 : 1;
+
+    VkSemaphore releaseSemaphore = swapchain.releaseSemaphores[imageIndex];
+
+    // The release semaphore is binary, so its value is ignored
+    frame.timelineValue = ++frameTimelineValue;
+    VkSemaphore signalSemaphores[] = { releaseSemaphore, frameTimeline };
+    uint64_t signalValues[] = { 0, frame.timelineValue };
+    uint32_t signalCount = 2;
+
+    // With post processing the scene only waits for uploads, the chain's submit has the swapchain image and
+    // the frame timeline. Skipping the acquire wait is what lets the scene start before the image is back.
+    if(postProcess)
+    {
+      waitSemaphores[0] = uploader.timeline;
+      waitStageMasks[0] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+      waitValues[0] = pending.uploadWaitValue;
+      waitCount = pending.uploadWaitValue ? 1 : 0;
+
+      signalSemaphores[0] = post.sceneTimeline;
+      signalValues[0] = frame.timelineValue;
+      signalCount = 1;
+    }
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+    timelineInfo.waitSemaphoreValueCount = waitCount;
+    timelineInfo.pWaitSemaphoreValues = waitValues;
+    timelineInfo.signalSemaphoreValueCount = signalCount;
+    timelineInfo.pSignalSemaphoreValues = signalValues;
+
+    // Need semaphore to tell GPU to not run commands until the image is ready
+    VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = waitCount;
+    submitInfo.pWaitSemaphores = waitSemaphores;
+    submitInfo.pWaitDstStageMask = waitStageMasks;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = signalCount;
+    submitInfo.pSignalSemaphores = signalSemaphores;
+
+    VK_CHECK(vkQueueSubmit(queues.graphics, 1, &submitInfo, VK_NULL_HANDLE));
+
+    if(postProcess)
+      submitPostProcess(post, pending.frameSlot, frame.timelineValue, frame.acquireSemaphore, releaseSemaphore, frameTimeline);
+
+    double submitTime = getTimeMs();
+    endFrame(limiter, pending.inputTime, submitTime);
+
+    uint64_t presentId = trackFrame(latency, frameIndex, pending.inputTime, submitTime);
+
+    VkPresentIdKHR presentIdInfo = { VK_STRUCTURE_TYPE_PRESENT_ID_KHR };
+    presentIdInfo.swapchainCount = 1;
+    presentIdInfo.pPresentIds = &presentId;
+
+    VkPresentInfoKHR presentInfo = { VK_STRUCTURE_TYPE_PRESENT_INFO_KHR };
+    presentInfo.pNext = presentId ? &presentIdInfo : NULL;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &releaseSemaphore;
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = &swapchain.swapchain;
+    presentInfo.pImageIndices = &imageIndex;
+
+    // The frame was submitted either way, an out of date present just doesn't show it
+    VkResult presentResult = vkQueuePresentKHR(queues.graphics, &presentInfo);
+    if(presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR)
+      resizePending = true;
+    else
+      assert(presentResult == VK_SUCCESS);
+
+    pollPresents(latency, swapchain.swapchain);
+
+    if(frameIndex == 0)
+      printf("Time to first frame: %.1f ms\n", getTimeMs() - startupTime);
+
+    frameIndex++;
+    loopStats.frames++;
+
+    // Put the frame rate in the title once a second so we can compare frames in flight settings
+    statsFrames++;
+    uint64_t statsNow = SDL_GetPerformanceCounter();
+    double statsSeconds = double(statsNow - statsStart) / double(SDL_GetPerformanceFrequency());
+    if(statsSeconds >= 1.0)
+    {
+      char title[256];
+      int titleLength = snprintf(title, sizeof(title), "VKR - %.1f fps, %.2f ms/frame, %u frames in flight, %s", statsFrames / statsSeconds, statsSeconds * 1000.0 / statsFrames, options.framesInFlight, getPresentModeName(swapchain.presentMode));
+
+      sampleLoopStats(loopStats);
+      titleLength += snprintf(title + titleLength, sizeof(title) - titleLength, ", CPU %.0f%%, %.0f wakeups/s", loopStats.cpuPercent, loopStats.wakeupsPerSecond);
+
+      float inputToSubmit, submitToPresent;
+      takeLatencyAverages(latency, inputToSubmit, submitToPresent);
+      titleLength += snprintf(title + titleLength, sizeof(title) - titleLength, ", input to submit %.2f ms", inputToSubmit);
+      if(submitToPresent > 0)
+        titleLength += snprintf(title + titleLength, sizeof(title) - titleLength, ", submit to present %.2f ms", submitToPresent);
+
+      if(profiler.enabled)
+        snprintf(title + titleLength, sizeof(title) - titleLength, ", GPU %.2f ms", getProfilerAverage(profiler, "frame"));
+      SDL_SetWindowTitle(window, title);
+
+      statsStart = statsNow;
+      statsFrames = 0;
+    }
+  };
+
+  while (run)
+  {
+    double inputTime = 0;
+
+    // Nothing changed, so the last frame is still what the window should show. Sleep until an event comes in,
+    // or long enough that a shader rebuilt by hot reload doesn't wait too long to show up.
+    if(options.redraw == RedrawPolicy_OnChange && !redraw && !resizePending)
+    {
+      // The frame being recorded goes out first, and may be the one that finishes settling the scene
+      if(pending.active)
+        submitFrame();
+
+      if(!isSceneSettling(scene, uploader))
+      {
+        waitForEvents(options.idleTimeout);
+
+        if(updatePipelines(pipelines, frameTimelineValue, getTimelineSemaphoreValue(device, frameTimeline)))
+          redraw = true;
+
+        if(sampleLoopStats(loopStats))
+        {
+          char title[128];
+          snprintf(title, sizeof(title), "VKR - idle, CPU %.1f%%, %.0f wakeups/s", loopStats.cpuPercent, loopStats.wakeupsPerSecond);
+          SDL_SetWindowTitle(window, title);
+        }
+
+        // The frame rate in the title only counts time spent drawing
+        statsStart = SDL_GetPerformanceCounter();
+        statsFrames = 0;
+        continue;
+      }
+    }
+
+    // Waits for the GPU, sleeps and samples input while the previous frame records, then sends that one off.
+    // The GPU wait is for the next frame's slot, which is a different one than the recording frame's.
+    if(pipelined)
+    {
+      if(frames.size() > 1)
+        waitTimelineSemaphore(device, frameTimeline, frames[(frameIndex + (pending.active ? 1 : 0)) % frames.size()].timelineValue);
+
+      inputTime = waitForFrameStart(limiter, latency, swapchain.swapchain);
+      processEvents();
+
+      if(pending.active)
+        submitFrame();
+    }
+
+    if(profilerToggle)
+    {
+      setProfilerEnabled(profiler, !profiler.enabled);
+      printf("Profiler: %s\n", profiler.enabled ? "on" : "off");
+      if(!profiler.enabled)
+        printProfilerReport(profiler);
+
+      profilerToggle = false;
+    }
+
+    if(!run)
+      break;
+
+    if(resizePending)
+    {
+      uint32_t width = 0, height = 0;
+      getSurfaceExtent(physicalDevice, surface, window, width, height);
+
+      // Minimized, there's nothing to render to until the window comes back. Sleep on the event queue
+      // rather than spinning on acquires that can only fail.
+      if(width == 0 || height == 0)
+      {
+        SDL_WaitEvent(NULL);
+        processEvents();
+        continue;
+      }
+
+      // Present ids belong to the swapchain, we can't ask about them once it's gone
+      flushPresents(latency, swapchain.swapchain);
+
+      if(postProcess)
+        resizePostProcess(post, width, height, frameTimelineValue);
+
+      resizeSwapchain(swapchain, device, physicalDevice, surface, swapchainFormat, &familyIndex, width, height, renderPass, allocator, renderPassConfig, postProcess, deletions, frameTimelineValue);
+      printf("Swapchain: recreated at %ux%u\n", width, height);
+
+      resizePending = false;
+    }
+
+    uint32_t frameSlot = uint32_t(frameIndex % frames.size());
+    FrameContext& frame = frames[frameSlot];
+
+    // Only blocks if the GPU is more than framesInFlight frames behind us
+    waitTimelineSemaphore(device, frameTimeline, frame.timelineValue);
+    collectDeletions(deletions, device, getTimelineSemaphoreValue(device, frameTimeline));
+
+    // Present swap chain to window
+    uint32_t imageIndex = 0;
+
+    // Blocks until the presentation engine hands an image back, with FIFO that's where we wait for vblank.
+    // Never for long though, a window that's hidden may not give any back until it's shown again.
+    VkResult acquireResult = vkAcquireNextImageKHR(device, swapchain.swapchain, kAcquireTimeout, frame.acquireSemaphore, VK_NULL_HANDLE, &imageIndex);
+    if(acquireResult == VK_TIMEOUT || acquireResult == VK_NOT_READY)
+    {
+      // Nothing was acquired, look at events so quitting still works and try again
+      processEvents();
+      continue;
+    }
+
+    if(acquireResult == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+      // Nothing was acquired and the semaphore wasn't touched, the slot can go again with the new swapchain
+      processEvents();
+      resizePending = true;
+      continue;
+    }
+
+    assert(acquireResult == VK_SUCCESS || acquireResult == VK_SUBOPTIMAL_KHR);
+
+    // Suboptimal still presents fine, recreate once this frame is out
+    resizePending = acquireResult == VK_SUBOPTIMAL_KHR;
+
+    // Sleeps here rather than after the present, so the input we're about to read is as fresh as it can be
+    if(!pipelined)
+    {
+      inputTime = waitForFrameStart(limiter, latency, swapchain.swapchain);
+      processEvents();
+    }
+
+    // Whatever finished building since last frame, the ones it replaces stay until the frames using them are done
+    updatePipelines(pipelines, frameTimelineValue, getTimelineSemaphoreValue(device, frameTimeline));
+
+    // This frame shows everything up to here, events from now on are for the next one
+    redraw = false;
+
+    pending.frameSlot = frameSlot;
+    pending.imageIndex = imageIndex;
+    pending.inputTime = inputTime;
+    pending.active = true;
+
+    // The value this frame's submit will signal, the previous frame is already submitted
+    uint64_t frameValue = frameTimelineValue + 1;
+    uint64_t frameNumber = frameIndex;
+
+    // Everything from here to the end of the command buffer, the secondaries are jobs of their own
+    runJob(workers, "record frame", [&, frameSlot, imageIndex, frameValue, frameNumber](uint32_t)
+    {
+      VkCommandBuffer commandBuffer = frames[frameSlot].commandBuffer;
+
+      VK_CHECK(vkResetCommandPool(device, frames[frameSlot].commandPool, 0));
+
+      // The slot's wait is behind us, its region is free again
+      beginTransientFrame(transient, frameSlot);
+
+      if(postProcess)
+        beginPostFrame(post, frameSlot, getTimelineSemaphoreValue(device, frameTimeline));
+
+      VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+      beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+      VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+      if(postProcess)
+        beginPostScene(post, commandBuffer, frameSlot);
+
+      beginProfilerFrame(profiler, device, commandBuffer, frameSlot, frameNumber);
+      beginProfilerScope(profiler, commandBuffer, "frame");
+
+      // Picks up whatever the transfer queue finished since last frame, never waits for the rest
+      flushUploads(uploader);
+      pending.uploadWaitValue = acquireUploads(uploader, commandBuffer);
+
+      if(scene.textures)
+        updateSceneTextures(scene, frameSlot, swapchain.height, frameValue, getTimelineSemaphoreValue(device, frameTimeline));
+
+      // The acquire semaphore waits at color attachment output, which is where the graph picks the image up.
+      // Whatever was in it is thrown away, and it goes back to the presentation engine in the present layout.
+      // With post processing the scene goes to the slot's HDR image instead, left for the chain to sample.
+      beginRenderGraph(graph);
+      RenderResource backbuffer = 0;
+      VkFramebuffer framebuffer = VK_NULL_HANDLE;
+
+      if(postProcess)
+      {
+        const Image& sceneImage = post.targets.scenes[frameSlot];
+        backbuffer = importImage(graph, "scene color", sceneImage.image, sceneImage.imageView, VK_IMAGE_ASPECT_COLOR_BIT, RenderUsage_SampledCompute, true);
+        setRenderGraphOutput(graph, backbuffer, RenderUsage_SampledCompute);
+        framebuffer = swapchain.framebuffers[frameSlot];
+      }
+      else
+      {
+        backbuffer = importImage(graph, "backbuffer", swapchain.images[imageIndex], swapchain.imageViews[imageIndex], VK_IMAGE_ASPECT_COLOR_BIT, RenderUsage_ColorAttachment, true);
+        setRenderGraphOutput(graph, backbuffer, RenderUsage_Present);
+        framebuffer = swapchain.framebuffers[imageIndex];
+      }
+
+      // Captures start with the first frame that draws something
+      bool ready = isSceneReady(scene, uploader);
+      if(scene.capture && ready)
+        beginCaptureFrame(*scene.capture, uint32_t(frameNumber), swapchain.width, swapchain.height, swapchain.images[imageIndex]);
+
+      addScenePasses(graph, backbuffer, device, renderPass, framebuffer, swapchain.width, swapchain.height, scene, ready, recorder, workers, frameSlot, getProfilerActiveStatistics(profiler));
+
+      compileRenderGraph(graph, frameValue - 1);
+      reportRenderGraphStats(graph, graphStats);
+      executeRenderGraph(graph, commandBuffer, &profiler);
+
+      if(scene.capture)
+        endCaptureFrame(*scene.capture);
+
+      endProfilerScope(profiler, commandBuffer);
+
+      if(postProcess)
+        endPostScene(post, commandBuffer, frameSlot);
+
+      VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+      // Submitted after the scene by submitFrame, ends in the copy to the swapchain image
+      if(postProcess)
+      {
+        VkImage swapchainImage = swapchain.images[imageIndex];
+        recordPostProcess(post, frameSlot, [&post, swapchainImage](VkCommandBuffer commandBuffer, VkImage output)
+        {
+          copyPostOutput(post, commandBuffer, output, swapchainImage);
+        });
+      }
+    }, &pending.recorded);
+
+    if(!pipelined)
+      submitFrame();
+  }
+
+  // Every way out of the loop goes through submitFrame first
+  assert(!pending.active);
+
+  VK_CHECK(vkDeviceWaitIdle(device));
+
+  if(scene.capture)
+    writeCommandCapture(capture, options.archivePath ? &archive : NULL);
+
+  flushDeletions(deletions, device);
+  if(deletions.destroyed)
+    printf("Deletion queue: %u old objects destroyed after their frames were done\n", deletions.destroyed);
+
+  flushPresents(latency, swapchain.swapchain);
+  printLatencyReport(latency);
+  destroyLatencyTracker(latency);
+
+  if(presentation)
+    printLoopStats(loopStats);
+  destroyLoopStats(loopStats);
+
+  resolveProfilerFrames(profiler, device);
+  printProfilerReport(profiler);
+  destroyProfiler(profiler, device);
+
+  destroyRenderGraph(graph);
+  destroyDrawRecorder(recorder, device);
+  printJobStats(workers);
+  destroyWorkerPool(workers);
+  destroyFrameContexts(frames, device);
+  //vkDestroyDebugReportCallbackEXT(instance, debugCallback, NULL);
+  if(presentation)
+    destroySwapchain(swapchain, device);
+  if(gpuCulling)
+  {
+    destroyGpuCulling(culling, device, allocator, bindlessHeap);
+  }
+  if(scene.textures)
+  {
+    printTextureStats(textureStreamer);
+    destroyTextureStreamer(textureStreamer);
+  }
+  printTransientStats(transient);
+  destroyTransientAllocator(transient, allocator);
+  if(postProcess)
+  {
+    printPostStats(post);
+    destroyPostProcess(post);
+  }
+  destroyGpuMesh(gpuMesh, device, allocator);
+  printUploadStats(uploader);
+  destroyUploadManager(uploader, allocator);
+  printShaderVariantStats(variants);
+  destroyPipelineManager(pipelines);
+  if(options.archivePath)
+    closeArchive(archive);
+  destroyBindlessHeap(bindlessHeap);
+  savePipelineCache(pipelineCache, device, physicalDevice, options.pipelineCachePath);
+  destroyPipelineCache(pipelineCache, device);
+  destroyMemoryAllocator(allocator);
+  vkDestroyRenderPass(device, renderPass, NULL);
+  vkDestroySemaphore(device, frameTimeline, NULL);
+  if(surface)
+    vkDestroySurfaceKHR(instance, surface, NULL);
+  vkDestroyDevice(device, NULL);
+  if(debugCallback)
+  {
+    PFN_vkDestroyDebugReportCallbackEXT vkDestroyDebugReportCallbackEXT = (PFN_vkDestroyDebugReportCallbackEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugReportCallbackEXT");
+    vkDestroyDebugReportCallbackEXT(instance, debugCallback, NULL);
+  }
   vkDestroyInstance(instance, NULL);
-  SDL_DestroyWindow(window);
+  if(window)
+    SDL_DestroyWindow(window);
 
   return 0;
 }
@@ -0,0 +1,274 @@
+#include "mesh.h"
+
+#include "bindless.h"
+#include "capture.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+static uint16_t floatToHalf(float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  uint32_t sign = (bits >> 16) & 0x8000;
+  int32_t exponent = int32_t((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  // Inf and NaN
+  if((bits & 0x7fffffff) >= 0x7f800000)
+    return uint16_t(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+  if(exponent >= 31)
+    return uint16_t(sign | 0x7c00);
+
+  // Denormal or too small, round to nearest
+  if(exponent <= 0)
+  {
+    if(exponent < -10)
+      return uint16_t(sign);
+
+    mantissa |= 0x800000;
+    uint32_t shift = uint32_t(14 - exponent);
+    uint32_t half = mantissa >> shift;
+    if((mantissa >> (shift - 1)) & 1)
+      half++;
+    return uint16_t(sign | half);
+  }
+
+  // Rounding can carry into the exponent, which is the right result
+  uint32_t half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+  if(mantissa & 0x1000)
+    half++;
+  return uint16_t(half);
+}
+
+static int8_t quantizeSnorm8(float value)
+{
+  return int8_t(roundf(std::max(-1.0f, std::min(1.0f, value)) * 127.0f));
+}
+
+// Project onto the octahedron and fold the lower half over, decoded in mesh_vert.glsl
+static void encodeOctahedral(float x, float y, float z, int8_t& outX, int8_t& outY)
+{
+  float length = fabsf(x) + fabsf(y) + fabsf(z);
+  if(length == 0)
+  {
+    outX = outY = 0;
+    return;
+  }
+
+  x /= length;
+  y /= length;
+
+  if(z < 0)
+  {
+    float foldedX = (1.0f - fabsf(y)) * (x >= 0 ? 1.0f : -1.0f);
+    float foldedY = (1.0f - fabsf(x)) * (y >= 0 ? 1.0f : -1.0f);
+    x = foldedX;
+    y = foldedY;
+  }
+
+  outX = quantizeSnorm8(x);
+  outY = quantizeSnorm8(y);
+}
+
+MeshView getMeshView(const Mesh& mesh)
+{
+  MeshView view = {};
+  view.vertices = mesh.vertices.data();
+  view.vertexCount = mesh.vertices.size();
+  view.indices = mesh.indices.data();
+  view.indexCount = mesh.indices.size();
+  view.shortIndices = false;
+  memcpy(view.center, mesh.center, sizeof(view.center));
+  view.radius = mesh.radius;
+
+  return view;
+}
+
+void createGpuMesh(GpuMesh& gpuMesh, const MeshView& mesh, bool quantize, VkDevice device, MemoryAllocator& allocator, UploadManager& uploader)
+{
+  float scale = mesh.radius > 0 ? 0.9f / mesh.radius : 1.0f;
+
+  gpuMesh.quantized = quantize;
+  gpuMesh.transform[0] = -mesh.center[0];
+  gpuMesh.transform[1] = -mesh.center[1];
+  gpuMesh.transform[2] = -mesh.center[2];
+  gpuMesh.transform[3] = scale;
+
+  // The radius is half the box's largest extent, the sphere around the whole box is up to sqrt(3) times that
+  gpuMesh.boundsCenter[0] = mesh.center[0];
+  gpuMesh.boundsCenter[1] = mesh.center[1];
+  gpuMesh.boundsCenter[2] = mesh.center[2];
+  gpuMesh.boundsRadius = mesh.radius * 1.7320508f;
+
+  std::vector<QuantizedVertex> quantizedVertices;
+  const void* vertexData = mesh.vertices;
+  size_t vertexSize = mesh.vertexCount * sizeof(Vertex);
+
+  if(quantize)
+  {
+    // Half floats only have 11 bits of mantissa, so positions are normalized first to spend them on the mesh itself
+    quantizedVertices.resize(mesh.vertexCount);
+    for(size_t i = 0 ; i < mesh.vertexCount ; i++)
+    {
+      const Vertex& vertex = mesh.vertices[i];
+      QuantizedVertex& quantized = quantizedVertices[i];
+
+      quantized.px = floatToHalf((vertex.px - mesh.center[0]) * scale);
+      quantized.py = floatToHalf((vertex.py - mesh.center[1]) * scale);
+      quantized.pz = floatToHalf((vertex.pz - mesh.center[2]) * scale);
+      quantized.pw = floatToHalf(1.0f);
+      encodeOctahedral(vertex.nx, vertex.ny, vertex.nz, quantized.nx, quantized.ny);
+      quantized.padding = 0;
+      quantized.u = floatToHalf(vertex.u);
+      quantized.v = floatToHalf(vertex.v);
+    }
+
+    gpuMesh.transform[0] = gpuMesh.transform[1] = gpuMesh.transform[2] = 0;
+    gpuMesh.transform[3] = 1;
+
+    gpuMesh.boundsCenter[0] = gpuMesh.boundsCenter[1] = gpuMesh.boundsCenter[2] = 0;
+    gpuMesh.boundsRadius *= scale;
+
+    vertexData = quantizedVertices.data();
+    vertexSize = quantizedVertices.size() * sizeof(QuantizedVertex);
+  }
+
+  createBuffer(gpuMesh.vertexBuffer, device, allocator, vertexSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  uploadBufferData(uploader, gpuMesh.vertexBuffer, 0, vertexData, vertexSize);
+
+  // 16 bit indices halve index fetch when the mesh is small enough
+  std::vector<uint16_t> shortIndices;
+  const void* indexData = mesh.indices;
+  size_t indexSize = mesh.indexCount * (mesh.shortIndices ? sizeof(uint16_t) : sizeof(uint32_t));
+  gpuMesh.indexType = mesh.shortIndices ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+  if(!mesh.shortIndices && mesh.vertexCount <= 65536)
+  {
+    const uint32_t* indices = static_cast<const uint32_t*>(mesh.indices);
+    shortIndices.assign(indices, indices + mesh.indexCount);
+    indexData = shortIndices.data();
+    indexSize = shortIndices.size() * sizeof(uint16_t);
+    gpuMesh.indexType = VK_INDEX_TYPE_UINT16;
+  }
+
+  createBuffer(gpuMesh.indexBuffer, device, allocator, indexSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  gpuMesh.uploadToken = uploadBufferData(uploader, gpuMesh.indexBuffer, 0, indexData, indexSize);
+
+  gpuMesh.indexCount = uint32_t(mesh.indexCount);
+}
+
+void destroyGpuMesh(const GpuMesh& gpuMesh, VkDevice device, MemoryAllocator& allocator)
+{
+  destroyBuffer(gpuMesh.vertexBuffer, device, allocator);
+  destroyBuffer(gpuMesh.indexBuffer, device, allocator);
+}
+
+void getVertexInputDescription(bool quantized, VkVertexInputBindingDescription& binding, VkVertexInputAttributeDescription (&attributes)[3])
+{
+  binding = {};
+  binding.binding = 0;
+  binding.stride = quantized ? sizeof(QuantizedVertex) : sizeof(Vertex);
+  binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+  for(uint32_t i = 0 ; i < 3 ; i++)
+  {
+    attributes[i] = {};
+    attributes[i].location = i;
+    attributes[i].binding = 0;
+  }
+
+  if(quantized)
+  {
+    attributes[0].format = VK_FORMAT_R16G16B16A16_SFLOAT;
+    attributes[0].offset = offsetof(QuantizedVertex, px);
+    attributes[1].format = VK_FORMAT_R8G8_SNORM;
+    attributes[1].offset = offsetof(QuantizedVertex, nx);
+    attributes[2].format = VK_FORMAT_R16G16_SFLOAT;
+    attributes[2].offset = offsetof(QuantizedVertex, u);
+  }
+  else
+  {
+    attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributes[0].offset = offsetof(Vertex, px);
+    attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributes[1].offset = offsetof(Vertex, nx);
+    attributes[2].format = VK_FORMAT_R32G32_SFLOAT;
+    attributes[2].offset = offsetof(Vertex, u);
+  }
+}
+
+void createDrawGrid(std::vector<MeshDraw>& draws, const GpuMesh& mesh, uint32_t count)
+{
+  uint32_t columns = uint32_t(ceilf(sqrtf(float(count))));
+  float cellScale = 1.0f / float(columns);
+
+  draws.resize(count);
+
+  for(uint32_t i = 0 ; i < count ; i++)
+  {
+    // Cell center in [-1, 1], moved into the mesh's own space so it can go in the offset before the scale
+    float scale = mesh.transform[3] * cellScale;
+    float x = (2.0f * float(i % columns) + 1.0f) * cellScale - 1.0f;
+    float y = (2.0f * float(i / columns) + 1.0f) * cellScale - 1.0f;
+
+    MeshDraw& draw = draws[i];
+    draw.transform[0] = mesh.transform[0] + x / scale;
+    draw.transform[1] = mesh.transform[1] + y / scale;
+    draw.transform[2] = mesh.transform[2];
+    draw.transform[3] = scale;
+  }
+}
+
+void recordDrawMesh(VkCommandBuffer commandBuffer, VkPipelineLayout layout, const GpuMesh& mesh, const MeshTextureConstants& textures, const MeshDraw* draws, size_t drawCount, uint32_t firstDraw, MeshDrawData drawData, TransientAllocator* transient, CommandCapture* capture)
+{
+  vkCmdPushConstants(commandBuffer, layout, kBindlessPushStages, kMeshTextureConstantsOffset, sizeof(textures), &textures);
+  capturePushConstants(capture, kMeshTextureConstantsOffset, sizeof(textures), &textures);
+
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mesh.vertexBuffer.buffer, &offset);
+  vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer.buffer, 0, mesh.indexType);
+  captureBindMesh(capture);
+
+  if(drawData == MeshDrawData_Uniform)
+  {
+    assert(transient);
+
+    // One allocation for the whole batch, each draw's block on its own dynamic offset
+    VkDeviceSize stride = (sizeof(MeshDraw) + transient->alignment - 1) / transient->alignment * transient->alignment;
+    TransientAllocation allocation = allocateTransient(*transient, stride * drawCount);
+
+    for(size_t i = 0 ; i < drawCount ; i++)
+      copyTransient(*transient, static_cast<char*>(allocation.data) + i * stride, draws[i].transform, sizeof(MeshDraw));
+
+    fenceTransient(*transient);
+
+    for(size_t i = 0 ; i < drawCount ; i++)
+    {
+      bindTransientUniforms(*transient, commandBuffer, layout, allocation.offset + uint32_t(i * stride));
+      vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, 0, 0, firstDraw + uint32_t(i));
+
+      captureDrawData(capture, draws[i]);
+      captureDrawIndexed(capture, mesh.indexCount, 1, 0, 0, firstDraw + uint32_t(i));
+    }
+
+    transient->pushBytes += sizeof(textures);
+    return;
+  }
+
+  for(size_t i = 0 ; i < drawCount ; i++)
+  {
+    vkCmdPushConstants(commandBuffer, layout, kBindlessPushStages, 0, sizeof(draws[i].transform), draws[i].transform);
+    vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, 0, 0, firstDraw + uint32_t(i));
+
+    capturePushConstants(capture, 0, sizeof(draws[i].transform), draws[i].transform);
+    captureDrawIndexed(capture, mesh.indexCount, 1, 0, 0, firstDraw + uint32_t(i));
+  }
+
+  if(transient)
+    transient->pushBytes += sizeof(textures) + drawCount * sizeof(MeshDraw);
+}
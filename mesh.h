@@ -0,0 +1,133 @@
+#pragma once
+
+#include "resources.h"
+#include "transient.h"
+#include "upload.h"
+
+struct CommandCapture;
+
+#include <vector>
+
+struct Vertex
+{
+  float px, py, pz;
+  float nx, ny, nz;
+  float u, v;
+};
+
+// 16 bytes instead of 32: half float position, octahedral normal in two snorm bytes, half float uv
+struct QuantizedVertex
+{
+  uint16_t px, py, pz, pw;
+  int8_t nx, ny;
+  uint16_t padding;
+  uint16_t u, v;
+};
+
+struct Mesh
+{
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+
+  float center[3];
+  float radius; // Half the largest extent of the bounding box
+};
+
+// Vertex cache efficiency, lower is better. ACMR is transformed vertices per triangle (0.5 is the best a
+// regular grid gets, 3 is no reuse at all), ATVR is transformed vertices per unique vertex (1 is ideal).
+struct MeshCacheStats
+{
+  float acmr;
+  float atvr;
+};
+
+// Loading and optimizing live in meshload.cpp, which needs nothing from Vulkan so farvkr-pack builds it alone.
+// Triangulates polygons and merges identical position/uv/normal triples, missing normals are generated.
+bool loadObj(Mesh& mesh, const char* path);
+void createTriangleMesh(Mesh& mesh);
+
+// Flat square in the xy plane facing +z, split into a grid of at least triangleCount triangles, for synthetic scenes
+void createGridMesh(Mesh& mesh, uint32_t triangleCount);
+
+// Reorders triangles for the post transform vertex cache (Forsyth's linear speed algorithm), then vertices
+// in the order the index buffer first touches them so vertex fetch walks memory forwards.
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+// FIFO cache simulation, the cache size roughly matches what current GPUs have
+MeshCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = 16);
+
+// Vertex and index buffers in device local memory
+struct GpuMesh
+{
+  Buffer vertexBuffer;
+  Buffer indexBuffer;
+  VkIndexType indexType; // 16 bit when the mesh has few enough vertices
+  uint32_t indexCount;
+  bool quantized;
+  uint64_t uploadToken; // Don't draw until isUploadReady says so
+
+  // Maps the mesh into [-1, 1], pushed to the vertex shader as xyz offset and w scale
+  float transform[4];
+
+  // Bounding sphere in the vertex buffer's space, before the transform
+  float boundsCenter[3];
+  float boundsRadius;
+};
+
+// Mesh data wherever it lives, a Mesh or pages mapped from an asset archive
+struct MeshView
+{
+  const Vertex* vertices;
+  size_t vertexCount;
+  const void* indices;
+  size_t indexCount;
+  bool shortIndices; // uint16_t indices instead of uint32_t
+
+  float center[3];
+  float radius;
+};
+
+MeshView getMeshView(const Mesh& mesh);
+
+// Queues the uploads and returns right away, the data is copied into the staging ring so mesh can be freed after.
+// Unquantized vertices and indices that are already the right size are copied straight from the view.
+void createGpuMesh(GpuMesh& gpuMesh, const MeshView& mesh, bool quantize, VkDevice device, MemoryAllocator& allocator, UploadManager& uploader);
+void destroyGpuMesh(const GpuMesh& gpuMesh, VkDevice device, MemoryAllocator& allocator);
+
+// Vertex input for Vertex or QuantizedVertex, matches the location layout in mesh_vert.glsl
+void getVertexInputDescription(bool quantized, VkVertexInputBindingDescription& binding, VkVertexInputAttributeDescription (&attributes)[3]);
+
+// One copy of the mesh, transform is the xyz offset and w scale pushed to the vertex shader
+struct MeshDraw
+{
+  float transform[4];
+};
+
+// The rest of the push constants in mesh_vert.glsl and mesh_fs.glsl, after the draw's transform and the
+// indirect draws' object buffer. The same for every draw, so they're pushed once per command buffer.
+struct MeshTextureConstants
+{
+  uint32_t textureTable; // Bindless storage buffer the texture streamer fills in every frame, kBindlessInvalid draws untextured
+  uint32_t sampler;
+  uint32_t textureCount; // Draw i uses texture i % textureCount
+  uint32_t feedbackPixel; // Pixel of every 8x8 block that writes mip feedback this frame, 64 or more for none
+};
+
+const uint32_t kMeshTextureConstantsOffset = sizeof(MeshDraw) + sizeof(uint32_t);
+
+// Lays count copies of the mesh out in a square grid over [-1, 1], a single copy fills the whole thing
+void createDrawGrid(std::vector<MeshDraw>& draws, const GpuMesh& mesh, uint32_t count);
+
+// How the CPU draws hand their transform to the vertex shader
+enum MeshDrawData
+{
+  MeshDrawData_Push, // Push constants, the fast path for a payload this small
+  MeshDrawData_Uniform, // The transient uniform set at a dynamic offset per draw, for the _uniform_ vertex shaders
+};
+
+// Binds the mesh once and draws it once per entry. The instance index is the draw's index in the scene,
+// firstDraw for the first entry, the same as the indirect draws get from the cull shader. Uniform draws
+// allocate their data from transient, push draws only count their bytes there, transient may be NULL then.
+// Everything recorded also goes to capture while it's capturing.
+void recordDrawMesh(VkCommandBuffer commandBuffer, VkPipelineLayout layout, const GpuMesh& mesh, const MeshTextureConstants& textures, const MeshDraw* draws, size_t drawCount, uint32_t firstDraw, MeshDrawData drawData, TransientAllocator* transient, CommandCapture* capture = NULL);
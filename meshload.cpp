@@ -0,0 +1,483 @@
+#include "mesh.h"
+
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+static bool readFile(const char* path, std::vector<char>& contents)
+{
+  FILE* file = fopen(path, "rb");
+  if(!file)
+    return false;
+
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  if(length < 0)
+  {
+    fclose(file);
+    return false;
+  }
+
+  // Zero terminated so the parser can run strtof without checking the end
+  contents.resize(size_t(length) + 1);
+  size_t rc = fread(contents.data(), 1, size_t(length), file);
+  fclose(file);
+
+  contents[size_t(length)] = 0;
+  return rc == size_t(length);
+}
+
+static void computeBounds(Mesh& mesh)
+{
+  float minimum[3] = { INFINITY, INFINITY, INFINITY };
+  float maximum[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+  for(const Vertex& vertex : mesh.vertices)
+  {
+    const float position[3] = { vertex.px, vertex.py, vertex.pz };
+    for(int i = 0 ; i < 3 ; i++)
+    {
+      minimum[i] = std::min(minimum[i], position[i]);
+      maximum[i] = std::max(maximum[i], position[i]);
+    }
+  }
+
+  mesh.radius = 0;
+  for(int i = 0 ; i < 3 ; i++)
+  {
+    mesh.center[i] = mesh.vertices.empty() ? 0 : (minimum[i] + maximum[i]) * 0.5f;
+    mesh.radius = std::max(mesh.radius, mesh.vertices.empty() ? 0 : (maximum[i] - minimum[i]) * 0.5f);
+  }
+}
+
+// Area weighted face normals summed per vertex, for files that don't have any
+static void generateNormals(Mesh& mesh)
+{
+  for(Vertex& vertex : mesh.vertices)
+    vertex.nx = vertex.ny = vertex.nz = 0;
+
+  for(size_t i = 0 ; i < mesh.indices.size() ; i += 3)
+  {
+    Vertex& a = mesh.vertices[mesh.indices[i + 0]];
+    Vertex& b = mesh.vertices[mesh.indices[i + 1]];
+    Vertex& c = mesh.vertices[mesh.indices[i + 2]];
+
+    float e1[3] = { b.px - a.px, b.py - a.py, b.pz - a.pz };
+    float e2[3] = { c.px - a.px, c.py - a.py, c.pz - a.pz };
+    float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+
+    for(Vertex* vertex : { &a, &b, &c })
+    {
+      vertex->nx += n[0];
+      vertex->ny += n[1];
+      vertex->nz += n[2];
+    }
+  }
+
+  for(Vertex& vertex : mesh.vertices)
+  {
+    float length = sqrtf(vertex.nx * vertex.nx + vertex.ny * vertex.ny + vertex.nz * vertex.nz);
+    if(length > 0)
+    {
+      vertex.nx /= length;
+      vertex.ny /= length;
+      vertex.nz /= length;
+    }
+    else
+    {
+      vertex.nz = 1;
+    }
+  }
+}
+
+struct ObjIndex
+{
+  int position, uv, normal;
+
+  bool operator==(const ObjIndex& other) const { return position == other.position && uv == other.uv && normal == other.normal; }
+};
+
+struct ObjIndexHash
+{
+  size_t operator()(const ObjIndex& index) const
+  {
+    return size_t(index.position) * 73856093u ^ size_t(index.uv) * 19349663u ^ size_t(index.normal) * 83492791u;
+  }
+};
+
+// OBJ indices are 1 based, negative ones count back from the end. Returns 0 for missing.
+static int parseObjIndex(const char*& p, size_t count)
+{
+  int index = int(strtol(p, const_cast<char**>(&p), 10));
+  return index < 0 ? int(count) + index + 1 : index;
+}
+
+bool loadObj(Mesh& mesh, const char* path)
+{
+  std::vector<char> contents;
+  if(!readFile(path, contents))
+    return false;
+
+  std::vector<float> positions, uvs, normals;
+  std::unordered_map<ObjIndex, uint32_t, ObjIndexHash> vertexMap;
+  std::vector<uint32_t> face;
+
+  mesh.vertices.clear();
+  mesh.indices.clear();
+
+  // Rough guess from the file size so big meshes don't keep reallocating
+  vertexMap.reserve(contents.size() / 64);
+  mesh.vertices.reserve(contents.size() / 64);
+  mesh.indices.reserve(contents.size() / 16);
+
+  const char* p = contents.data();
+  while(*p)
+  {
+    while(*p == ' ' || *p == '\t')
+      p++;
+
+    if(p[0] == 'v' && p[1] == ' ')
+    {
+      p += 2;
+      for(int i = 0 ; i < 3 ; i++)
+        positions.push_back(strtof(p, const_cast<char**>(&p)));
+    }
+    else if(p[0] == 'v' && p[1] == 't' && p[2] == ' ')
+    {
+      p += 3;
+      for(int i = 0 ; i < 2 ; i++)
+        uvs.push_back(strtof(p, const_cast<char**>(&p)));
+    }
+    else if(p[0] == 'v' && p[1] == 'n' && p[2] == ' ')
+    {
+      p += 3;
+      for(int i = 0 ; i < 3 ; i++)
+        normals.push_back(strtof(p, const_cast<char**>(&p)));
+    }
+    else if(p[0] == 'f' && p[1] == ' ')
+    {
+      p += 2;
+      face.clear();
+
+      for(;;)
+      {
+        while(*p == ' ' || *p == '\t')
+          p++;
+
+        if(*p < '0' && *p != '-')
+          break;
+
+        ObjIndex index = {};
+        index.position = parseObjIndex(p, positions.size() / 3);
+        if(*p == '/')
+        {
+          p++;
+          if(*p != '/')
+            index.uv = parseObjIndex(p, uvs.size() / 2);
+          if(*p == '/')
+          {
+            p++;
+            index.normal = parseObjIndex(p, normals.size() / 3);
+          }
+        }
+
+        if(index.position <= 0 || size_t(index.position) * 3 > positions.size())
+        {
+          printf("%s: bad vertex index %d\n", path, index.position);
+          return false;
+        }
+
+        std::unordered_map<ObjIndex, uint32_t, ObjIndexHash>::iterator it = vertexMap.find(index);
+        if(it == vertexMap.end())
+        {
+          Vertex vertex = {};
+          vertex.px = positions[(index.position - 1) * 3 + 0];
+          vertex.py = positions[(index.position - 1) * 3 + 1];
+          vertex.pz = positions[(index.position - 1) * 3 + 2];
+
+          if(index.uv > 0 && size_t(index.uv) * 2 <= uvs.size())
+          {
+            vertex.u = uvs[(index.uv - 1) * 2 + 0];
+            vertex.v = uvs[(index.uv - 1) * 2 + 1];
+          }
+
+          if(index.normal > 0 && size_t(index.normal) * 3 <= normals.size())
+          {
+            vertex.nx = normals[(index.normal - 1) * 3 + 0];
+            vertex.ny = normals[(index.normal - 1) * 3 + 1];
+            vertex.nz = normals[(index.normal - 1) * 3 + 2];
+          }
+
+          it = vertexMap.insert(std::make_pair(index, uint32_t(mesh.vertices.size()))).first;
+          mesh.vertices.push_back(vertex);
+        }
+
+        face.push_back(it->second);
+      }
+
+      // Fan triangulation, fine for the convex polygons exporters write
+      for(size_t i = 2 ; i < face.size() ; i++)
+      {
+        mesh.indices.push_back(face[0]);
+        mesh.indices.push_back(face[i - 1]);
+        mesh.indices.push_back(face[i]);
+      }
+    }
+
+    while(*p && *p != '\n')
+      p++;
+    if(*p)
+      p++;
+  }
+
+  if(mesh.indices.empty())
+  {
+    printf("%s: no faces\n", path);
+    return false;
+  }
+
+  if(normals.empty())
+    generateNormals(mesh);
+
+  computeBounds(mesh);
+
+  return true;
+}
+
+void createTriangleMesh(Mesh& mesh)
+{
+  mesh.vertices =
+  {
+    { 0.0f, 0.5f, 0.0f, 0, 0, 1, 0.5f, 0.0f },
+    { 0.5f, -0.5f, 0.0f, 0, 0, 1, 1.0f, 1.0f },
+    { -0.5f, -0.5f, 0.0f, 0, 0, 1, 0.0f, 1.0f },
+  };
+  mesh.indices = { 0, 1, 2 };
+
+  computeBounds(mesh);
+}
+
+void createGridMesh(Mesh& mesh, uint32_t triangleCount)
+{
+  // Two triangles per cell, rows of cells in order so the vertex cache already does well on it
+  uint32_t cells = std::max(uint32_t(ceilf(sqrtf(float(triangleCount) * 0.5f))), 1u);
+  uint32_t columns = cells + 1;
+
+  mesh.vertices.resize(columns * columns);
+  mesh.indices.clear();
+  mesh.indices.reserve(cells * cells * 6);
+
+  for(uint32_t y = 0 ; y < columns ; y++)
+  {
+    for(uint32_t x = 0 ; x < columns ; x++)
+    {
+      float u = float(x) / float(cells);
+      float v = float(y) / float(cells);
+
+      mesh.vertices[y * columns + x] = { u - 0.5f, v - 0.5f, 0.0f, 0, 0, 1, u, 1.0f - v };
+    }
+  }
+
+  for(uint32_t y = 0 ; y < cells ; y++)
+  {
+    for(uint32_t x = 0 ; x < cells ; x++)
+    {
+      uint32_t corner = y * columns + x;
+
+      mesh.indices.insert(mesh.indices.end(), { corner, corner + 1, corner + columns + 1 });
+      mesh.indices.insert(mesh.indices.end(), { corner, corner + columns + 1, corner + columns });
+    }
+  }
+
+  computeBounds(mesh);
+}
+
+const uint32_t kVertexCacheSize = 32; // What the optimizer models, bigger than the real cache on purpose
+
+static float getVertexScore(int32_t cachePosition, uint32_t liveTriangles)
+{
+  if(liveTriangles == 0)
+    return -1.0f;
+
+  float score = 0;
+
+  // The last triangle's vertices get a fixed score so we don't just keep fanning around one vertex
+  if(cachePosition >= 0)
+    score = cachePosition < 3 ? 0.75f : powf(1.0f - float(cachePosition - 3) / float(kVertexCacheSize - 3), 1.5f);
+
+  // Vertices with few triangles left get a boost so they are finished off and leave the cache for good
+  score += 2.0f / sqrtf(float(liveTriangles));
+
+  return score;
+}
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+  size_t triangleCount = indices.size() / 3;
+  if(triangleCount == 0)
+    return;
+
+  std::vector<uint32_t> liveTriangles(vertexCount, 0);
+  for(uint32_t index : indices)
+    liveTriangles[index]++;
+
+  // Triangles using each vertex, the live ones are kept at the front of each vertex's range
+  std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+  for(size_t i = 0 ; i < vertexCount ; i++)
+    adjacencyOffsets[i + 1] = adjacencyOffsets[i] + liveTriangles[i];
+
+  std::vector<uint32_t> adjacency(indices.size());
+  {
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for(size_t i = 0 ; i < indices.size() ; i++)
+      adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+  }
+
+  std::vector<int32_t> cachePositions(vertexCount, -1);
+  std::vector<float> vertexScores(vertexCount);
+  for(size_t i = 0 ; i < vertexCount ; i++)
+    vertexScores[i] = getVertexScore(-1, liveTriangles[i]);
+
+  std::vector<float> triangleScores(triangleCount);
+  for(size_t i = 0 ; i < triangleCount ; i++)
+    triangleScores[i] = vertexScores[indices[i * 3 + 0]] + vertexScores[indices[i * 3 + 1]] + vertexScores[indices[i * 3 + 2]];
+
+  std::vector<uint8_t> emitted(triangleCount, 0);
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+
+  uint32_t cache[kVertexCacheSize + 3];
+  uint32_t cacheCount = 0;
+
+  uint32_t bestTriangle = 0;
+  size_t cursor = 0; // Where to look for a fresh triangle when nothing in the cache is left
+
+  for(size_t emittedCount = 0 ; emittedCount < triangleCount ; emittedCount++)
+  {
+    if(bestTriangle == ~0u)
+    {
+      while(emitted[cursor])
+        cursor++;
+      bestTriangle = uint32_t(cursor);
+    }
+
+    const uint32_t* triangle = &indices[bestTriangle * 3];
+    result.insert(result.end(), triangle, triangle + 3);
+    emitted[bestTriangle] = 1;
+
+    uint32_t newCache[kVertexCacheSize + 3];
+    uint32_t newCacheCount = 0;
+
+    for(int i = 0 ; i < 3 ; i++)
+    {
+      uint32_t vertex = triangle[i];
+      if(std::find(newCache, newCache + newCacheCount, vertex) == newCache + newCacheCount)
+        newCache[newCacheCount++] = vertex;
+
+      // Move the emitted triangle past the live ones
+      uint32_t* begin = &adjacency[adjacencyOffsets[vertex]];
+      uint32_t* end = begin + liveTriangles[vertex];
+      uint32_t* it = std::find(begin, end, bestTriangle);
+      assert(it != end);
+      std::swap(*it, *(end - 1));
+      liveTriangles[vertex]--;
+    }
+
+    for(uint32_t i = 0 ; i < cacheCount ; i++)
+    {
+      uint32_t vertex = cache[i];
+      if(vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+        newCache[newCacheCount++] = vertex;
+    }
+
+    // Rescore everything that moved and pick the best triangle touching the cache
+    bestTriangle = ~0u;
+    float bestScore = -1.0f;
+
+    for(uint32_t i = 0 ; i < newCacheCount ; i++)
+    {
+      uint32_t vertex = newCache[i];
+      cachePositions[vertex] = i < kVertexCacheSize ? int32_t(i) : -1;
+
+      float score = getVertexScore(cachePositions[vertex], liveTriangles[vertex]);
+      float delta = score - vertexScores[vertex];
+      vertexScores[vertex] = score;
+
+      const uint32_t* adjacent = &adjacency[adjacencyOffsets[vertex]];
+      for(uint32_t j = 0 ; j < liveTriangles[vertex] ; j++)
+      {
+        uint32_t adjacentTriangle = adjacent[j];
+        triangleScores[adjacentTriangle] += delta;
+
+        if(triangleScores[adjacentTriangle] > bestScore)
+        {
+          bestScore = triangleScores[adjacentTriangle];
+          bestTriangle = adjacentTriangle;
+        }
+      }
+    }
+
+    cacheCount = std::min(newCacheCount, kVertexCacheSize);
+    memcpy(cache, newCache, cacheCount * sizeof(uint32_t));
+  }
+
+  indices.swap(result);
+}
+
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+  std::vector<uint32_t> remap(vertices.size(), ~0u);
+  uint32_t vertexCount = 0;
+
+  for(uint32_t& index : indices)
+  {
+    if(remap[index] == ~0u)
+      remap[index] = vertexCount++;
+    index = remap[index];
+  }
+
+  // Vertices no triangle uses are dropped
+  std::vector<Vertex> reordered(vertexCount);
+  for(size_t i = 0 ; i < vertices.size() ; i++)
+  {
+    if(remap[i] != ~0u)
+      reordered[remap[i]] = vertices[i];
+  }
+
+  vertices.swap(reordered);
+}
+
+MeshCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize)
+{
+  // A vertex is in the FIFO if fewer than cacheSize misses happened since it was last loaded
+  std::vector<uint32_t> loadedAt(vertexCount, 0);
+  std::vector<uint8_t> used(vertexCount, 0);
+  uint32_t time = cacheSize + 1;
+  uint32_t misses = 0;
+  uint32_t uniqueVertices = 0;
+
+  for(uint32_t index : indices)
+  {
+    if(time - loadedAt[index] > cacheSize)
+    {
+      loadedAt[index] = time++;
+      misses++;
+    }
+
+    if(!used[index])
+    {
+      used[index] = 1;
+      uniqueVertices++;
+    }
+  }
+
+  MeshCacheStats stats = {};
+  stats.acmr = indices.empty() ? 0 : float(misses) / float(indices.size() / 3);
+  stats.atvr = uniqueVertices ? float(misses) / float(uniqueVertices) : 0;
+  return stats;
+}
@@ -0,0 +1,414 @@
+// farvkr-pack: builds the asset archive farvkr --archive maps at startup.
+//
+//   farvkr-pack [--bc1] OUTPUT INPUT...
+//
+// .spv files go in as they are, .obj meshes are loaded and optimized the same way farvkr does it at startup,
+// and .ppm images get an RGBA8 mip chain, or BC1 with --bc1. Every asset is named after the path it was packed from.
+
+#include "archive.h"
+#include "mesh.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+
+const uint32_t kFormatRGBA8 = 37; // VK_FORMAT_R8G8B8A8_UNORM
+const uint32_t kFormatBC1 = 131; // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+
+static bool hasExtension(const char* path, const char* extension)
+{
+  size_t length = strlen(path);
+  size_t extensionLength = strlen(extension);
+
+  return length >= extensionLength && strcmp(path + length - extensionLength, extension) == 0;
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>& contents)
+{
+  FILE* file = fopen(path, "rb");
+  if(!file)
+    return false;
+
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  if(length < 0)
+  {
+    fclose(file);
+    return false;
+  }
+
+  contents.resize(size_t(length));
+  size_t rc = fread(contents.data(), 1, contents.size(), file);
+  fclose(file);
+
+  return rc == contents.size();
+}
+
+static bool packShader(ArchiveWriter& writer, const char* path)
+{
+  std::vector<uint8_t> code;
+  if(!readFile(path, code) || code.size() < 4 || code.size() % 4 != 0)
+  {
+    printf("%s: not a SPIR-V file\n", path);
+    return false;
+  }
+
+  printf("%s: shader, %zu bytes\n", path, code.size());
+  return addArchiveBlob(writer, path, AssetKind_Shader, std::move(code));
+}
+
+static bool packMesh(ArchiveWriter& writer, const char* path)
+{
+  Mesh mesh;
+  if(!loadObj(mesh, path))
+  {
+    printf("%s: failed to load\n", path);
+    return false;
+  }
+
+  optimizeVertexCache(mesh.indices, mesh.vertices.size());
+  optimizeVertexFetch(mesh.vertices, mesh.indices);
+
+  // Narrowed here so farvkr can upload the indices without touching them
+  bool shortIndices = mesh.vertices.size() <= 65536;
+
+  MeshAssetHeader header = {};
+  header.vertexCount = uint32_t(mesh.vertices.size());
+  header.indexCount = uint32_t(mesh.indices.size());
+  header.indexSize = shortIndices ? 2 : 4;
+  header.vertexSize = sizeof(Vertex);
+  memcpy(header.center, mesh.center, sizeof(header.center));
+  header.radius = mesh.radius;
+  header.vertexOffset = sizeof(MeshAssetHeader);
+  header.indexOffset = header.vertexOffset + uint64_t(header.vertexCount) * header.vertexSize;
+
+  std::vector<uint8_t> blob(size_t(header.indexOffset + uint64_t(header.indexCount) * header.indexSize));
+  memcpy(blob.data(), &header, sizeof(header));
+  memcpy(blob.data() + header.vertexOffset, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+
+  if(shortIndices)
+  {
+    std::vector<uint16_t> indices(mesh.indices.begin(), mesh.indices.end());
+    memcpy(blob.data() + header.indexOffset, indices.data(), indices.size() * sizeof(uint16_t));
+  }
+  else
+    memcpy(blob.data() + header.indexOffset, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+
+  printf("%s: mesh, %u vertices, %u triangles, %zu bytes\n", path, header.vertexCount, header.indexCount / 3, blob.size());
+  return addArchiveBlob(writer, path, AssetKind_Mesh, std::move(blob));
+}
+
+// Whitespace and comments between the fields of a PPM header
+static const uint8_t* skipPpmSpace(const uint8_t* p, const uint8_t* end)
+{
+  while(p < end && (isspace(*p) || *p == '#'))
+  {
+    if(*p == '#')
+      while(p < end && *p != '\n')
+        p++;
+    else
+      p++;
+  }
+
+  return p;
+}
+
+static const uint8_t* parsePpmNumber(const uint8_t* p, const uint8_t* end, uint32_t& value)
+{
+  p = skipPpmSpace(p, end);
+
+  value = 0;
+  const uint8_t* start = p;
+  while(p < end && isdigit(*p) && value < 1000000)
+    value = value * 10 + uint32_t(*p++ - '0');
+
+  return p == start ? NULL : p;
+}
+
+// Binary 8 bit PPM, the format headless runs write
+static bool loadPpm(const char* path, std::vector<uint8_t>& pixels, uint32_t& width, uint32_t& height)
+{
+  std::vector<uint8_t> contents;
+  if(!readFile(path, contents) || contents.size() < 2 || contents[0] != 'P' || contents[1] != '6')
+    return false;
+
+  const uint8_t* end = contents.data() + contents.size();
+  const uint8_t* p = contents.data() + 2;
+
+  uint32_t maxValue = 0;
+  p = p ? parsePpmNumber(p, end, width) : NULL;
+  p = p ? parsePpmNumber(p, end, height) : NULL;
+  p = p ? parsePpmNumber(p, end, maxValue) : NULL;
+
+  // A single whitespace character separates the header from the pixels
+  if(!p || p >= end || maxValue != 255 || width == 0 || height == 0)
+    return false;
+  p++;
+
+  if(size_t(end - p) < size_t(width) * height * 3)
+    return false;
+
+  pixels.resize(size_t(width) * height * 4);
+  for(size_t i = 0 ; i < size_t(width) * height ; i++)
+  {
+    pixels[i * 4 + 0] = p[i * 3 + 0];
+    pixels[i * 4 + 1] = p[i * 3 + 1];
+    pixels[i * 4 + 2] = p[i * 3 + 2];
+    pixels[i * 4 + 3] = 255;
+  }
+
+  return true;
+}
+
+// 2x2 box filter, odd sizes clamp the last row and column
+static void downsample(const uint8_t* source, uint32_t width, uint32_t height, std::vector<uint8_t>& result, uint32_t& resultWidth, uint32_t& resultHeight)
+{
+  resultWidth = std::max(width / 2, 1u);
+  resultHeight = std::max(height / 2, 1u);
+  result.resize(size_t(resultWidth) * resultHeight * 4);
+
+  for(uint32_t y = 0 ; y < resultHeight ; y++)
+  {
+    uint32_t y0 = std::min(y * 2, height - 1);
+    uint32_t y1 = std::min(y * 2 + 1, height - 1);
+
+    for(uint32_t x = 0 ; x < resultWidth ; x++)
+    {
+      uint32_t x0 = std::min(x * 2, width - 1);
+      uint32_t x1 = std::min(x * 2 + 1, width - 1);
+
+      for(uint32_t c = 0 ; c < 4 ; c++)
+      {
+        uint32_t sum = source[(size_t(y0) * width + x0) * 4 + c] + source[(size_t(y0) * width + x1) * 4 + c] + source[(size_t(y1) * width + x0) * 4 + c] + source[(size_t(y1) * width + x1) * 4 + c];
+        result[(size_t(y) * resultWidth + x) * 4 + c] = uint8_t((sum + 2) / 4);
+      }
+    }
+  }
+}
+
+static uint16_t pack565(const uint8_t* rgb)
+{
+  return uint16_t(((rgb[0] * 31 + 127) / 255) << 11 | ((rgb[1] * 63 + 127) / 255) << 5 | (rgb[2] * 31 + 127) / 255);
+}
+
+static void unpack565(uint16_t color, uint8_t* rgb)
+{
+  rgb[0] = uint8_t(((color >> 11) & 31) * 255 / 31);
+  rgb[1] = uint8_t(((color >> 5) & 63) * 255 / 63);
+  rgb[2] = uint8_t((color & 31) * 255 / 31);
+}
+
+// 16 RGBA8 texels to an 8 byte BC1 block, always the 4 color mode. The endpoints are the corners of the
+// texels' bounding box, pulled in by a sixteenth so the extremes don't waste the palette, and every texel
+// takes the nearest of the 4 colors. Alpha is dropped, PPM has none anyway.
+static void compressBc1Block(const uint8_t texels[16][4], uint8_t* block)
+{
+  uint8_t low[3] = { 255, 255, 255 };
+  uint8_t high[3] = { 0, 0, 0 };
+
+  for(uint32_t i = 0 ; i < 16 ; i++)
+  {
+    for(uint32_t c = 0 ; c < 3 ; c++)
+    {
+      low[c] = std::min(low[c], texels[i][c]);
+      high[c] = std::max(high[c], texels[i][c]);
+    }
+  }
+
+  for(uint32_t c = 0 ; c < 3 ; c++)
+  {
+    uint8_t inset = uint8_t((high[c] - low[c]) / 16);
+    low[c] += inset;
+    high[c] -= inset;
+  }
+
+  // color0 > color1 is what selects the 4 color mode
+  uint16_t color0 = pack565(high);
+  uint16_t color1 = pack565(low);
+  if(color0 < color1)
+    std::swap(color0, color1);
+
+  uint32_t indices = 0;
+
+  if(color0 != color1)
+  {
+    uint8_t palette[4][3];
+    unpack565(color0, palette[0]);
+    unpack565(color1, palette[1]);
+
+    for(uint32_t c = 0 ; c < 3 ; c++)
+    {
+      palette[2][c] = uint8_t((2 * palette[0][c] + palette[1][c]) / 3);
+      palette[3][c] = uint8_t((palette[0][c] + 2 * palette[1][c]) / 3);
+    }
+
+    for(uint32_t i = 0 ; i < 16 ; i++)
+    {
+      uint32_t best = 0, bestDistance = ~0u;
+
+      for(uint32_t j = 0 ; j < 4 ; j++)
+      {
+        uint32_t distance = 0;
+        for(uint32_t c = 0 ; c < 3 ; c++)
+          distance += uint32_t((int(texels[i][c]) - palette[j][c]) * (int(texels[i][c]) - palette[j][c]));
+
+        if(distance < bestDistance)
+        {
+          best = j;
+          bestDistance = distance;
+        }
+      }
+
+      indices |= best << (i * 2);
+    }
+  }
+
+  block[0] = uint8_t(color0);
+  block[1] = uint8_t(color0 >> 8);
+  block[2] = uint8_t(color1);
+  block[3] = uint8_t(color1 >> 8);
+  block[4] = uint8_t(indices);
+  block[5] = uint8_t(indices >> 8);
+  block[6] = uint8_t(indices >> 16);
+  block[7] = uint8_t(indices >> 24);
+}
+
+// Blocks in rows, partial blocks at the right and bottom edges repeat the last column and row
+static std::vector<uint8_t> compressBc1(const std::vector<uint8_t>& pixels, uint32_t width, uint32_t height)
+{
+  uint32_t blocksWide = (width + 3) / 4;
+  uint32_t blocksHigh = (height + 3) / 4;
+
+  std::vector<uint8_t> blocks(size_t(blocksWide) * blocksHigh * 8);
+
+  for(uint32_t by = 0 ; by < blocksHigh ; by++)
+  {
+    for(uint32_t bx = 0 ; bx < blocksWide ; bx++)
+    {
+      uint8_t texels[16][4];
+
+      for(uint32_t i = 0 ; i < 16 ; i++)
+      {
+        uint32_t x = std::min(bx * 4 + i % 4, width - 1);
+        uint32_t y = std::min(by * 4 + i / 4, height - 1);
+        memcpy(texels[i], &pixels[(size_t(y) * width + x) * 4], 4);
+      }
+
+      compressBc1Block(texels, &blocks[(size_t(by) * blocksWide + bx) * 8]);
+    }
+  }
+
+  return blocks;
+}
+
+// The chain is always filtered in RGBA8, each mip is compressed from that so errors don't add up
+static bool packTexture(ArchiveWriter& writer, const char* path, bool bc1)
+{
+  std::vector<uint8_t> pixels;
+  uint32_t width = 0, height = 0;
+  if(!loadPpm(path, pixels, width, height))
+  {
+    printf("%s: not a binary 8 bit PPM\n", path);
+    return false;
+  }
+
+  TextureAssetHeader header = {};
+  header.format = bc1 ? kFormatBC1 : kFormatRGBA8;
+  header.width = width;
+  header.height = height;
+
+  std::vector<std::vector<uint8_t>> mips;
+  mips.push_back(std::move(pixels));
+
+  uint32_t mipWidth = width, mipHeight = height;
+  header.mips[0] = { 0, mips[0].size(), width, height };
+
+  while((mipWidth > 1 || mipHeight > 1) && mips.size() < kMaxTextureMips)
+  {
+    std::vector<uint8_t> next;
+    uint32_t nextWidth, nextHeight;
+    downsample(mips.back().data(), mipWidth, mipHeight, next, nextWidth, nextHeight);
+
+    header.mips[mips.size()] = { 0, next.size(), nextWidth, nextHeight };
+    mips.push_back(std::move(next));
+
+    mipWidth = nextWidth;
+    mipHeight = nextHeight;
+  }
+
+  header.mipCount = uint32_t(mips.size());
+
+  if(bc1)
+  {
+    for(uint32_t i = 0 ; i < header.mipCount ; i++)
+    {
+      mips[i] = compressBc1(mips[i], header.mips[i].width, header.mips[i].height);
+      header.mips[i].size = mips[i].size();
+    }
+  }
+
+  // Each mip 16 byte aligned, a buffer to image copy needs at least the texel size
+  uint64_t offset = sizeof(TextureAssetHeader);
+  for(uint32_t i = 0 ; i < header.mipCount ; i++)
+  {
+    offset = (offset + 15) & ~uint64_t(15);
+    header.mips[i].offset = offset;
+    offset += header.mips[i].size;
+  }
+
+  std::vector<uint8_t> blob(size_t(offset), 0);
+  memcpy(blob.data(), &header, sizeof(header));
+  for(uint32_t i = 0 ; i < header.mipCount ; i++)
+    memcpy(blob.data() + header.mips[i].offset, mips[i].data(), mips[i].size());
+
+  printf("%s: texture, %ux%u, %s, %u mips, %zu bytes\n", path, width, height, bc1 ? "BC1" : "RGBA8", header.mipCount, blob.size());
+  return addArchiveBlob(writer, path, AssetKind_Texture, std::move(blob));
+}
+
+int main(int argc, char** argv)
+{
+  bool bc1 = argc > 1 && strcmp(argv[1], "--bc1") == 0;
+  int first = bc1 ? 2 : 1;
+
+  if(argc < first + 2)
+  {
+    printf("Usage: farvkr-pack [--bc1] OUTPUT INPUT...\n");
+    printf("Inputs: .spv shaders, .obj meshes, .ppm textures (RGBA8, or BC1 with --bc1)\n");
+    return 1;
+  }
+
+  const char* output = argv[first];
+
+  ArchiveWriter writer;
+
+  for(int i = first + 1 ; i < argc ; i++)
+  {
+    const char* path = argv[i];
+    bool packed = false;
+
+    if(hasExtension(path, ".spv"))
+      packed = packShader(writer, path);
+    else if(hasExtension(path, ".obj"))
+      packed = packMesh(writer, path);
+    else if(hasExtension(path, ".ppm"))
+      packed = packTexture(writer, path, bc1);
+    else
+      printf("%s: don't know how to pack this\n", path);
+
+    if(!packed)
+      return 1;
+  }
+
+  if(!writeArchive(writer, output))
+    return 1;
+
+  size_t total = 0;
+  for(const ArchiveEntry& entry : writer.entries)
+    total += entry.size;
+
+  printf("Wrote %s: %zu assets, %.1f KB\n", output, writer.entries.size(), total / 1024.0);
+  return 0;
+}
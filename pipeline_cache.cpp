@@ -0,0 +1,245 @@
+#include "pipeline_cache.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+const uint32_t kPipelineCacheMagic = 0x43505646; // 'FVPC'
+const uint32_t kPipelineCacheFileVersion = 1;
+
+// Our header in front of the driver blob. It catches truncated or corrupted files and driver updates
+// before the data reaches the driver, some drivers don't cope well with garbage in pInitialData.
+struct PipelineCacheFileHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t driverVersion;
+  uint32_t dataSize;
+  uint64_t dataHash;
+};
+
+// Layout of the header every driver puts at the start of its blob (VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+struct PipelineCacheHeaderVersionOne
+{
+  uint32_t headerSize;
+  uint32_t headerVersion;
+  uint32_t vendorID;
+  uint32_t deviceID;
+  uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+static uint64_t hashData(const void* data, size_t size)
+{
+  // FNV-1a, only used to detect corruption
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for(size_t i = 0 ; i < size ; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static bool readFile(const char* path, std::vector<char>& contents)
+{
+  FILE* file = fopen(path, "rb");
+  if(!file)
+    return false;
+
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  if(length < 0)
+  {
+    fclose(file);
+    return false;
+  }
+
+  contents.resize(size_t(length));
+  size_t rc = fread(contents.data(), 1, contents.size(), file);
+  fclose(file);
+
+  return rc == contents.size();
+}
+
+// Returns why the file can't be used, or NULL if it is good for this device
+static const char* validatePipelineCacheFile(const std::vector<char>& contents, const VkPhysicalDeviceProperties& props)
+{
+  if(contents.size() < sizeof(PipelineCacheFileHeader))
+    return "file too small";
+
+  PipelineCacheFileHeader fileHeader;
+  memcpy(&fileHeader, contents.data(), sizeof(fileHeader));
+
+  if(fileHeader.magic != kPipelineCacheMagic || fileHeader.version != kPipelineCacheFileVersion)
+    return "not a pipeline cache file";
+
+  if(fileHeader.dataSize != contents.size() - sizeof(fileHeader))
+    return "truncated";
+
+  const char* data = contents.data() + sizeof(fileHeader);
+
+  if(fileHeader.dataHash != hashData(data, fileHeader.dataSize))
+    return "checksum mismatch";
+
+  if(fileHeader.driverVersion != props.driverVersion)
+    return "driver version changed";
+
+  if(fileHeader.dataSize < sizeof(PipelineCacheHeaderVersionOne))
+    return "driver header missing";
+
+  PipelineCacheHeaderVersionOne header;
+  memcpy(&header, data, sizeof(header));
+
+  if(header.headerSize < sizeof(header) || header.headerSize > fileHeader.dataSize || header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+    return "unknown driver header";
+
+  if(header.vendorID != props.vendorID)
+    return "vendor ID mismatch";
+
+  if(header.deviceID != props.deviceID)
+    return "device ID mismatch";
+
+  if(memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    return "pipeline cache UUID mismatch";
+
+  return NULL;
+}
+
+void createPipelineCache(PipelineCache& pipelineCache, VkDevice device, VkPhysicalDevice physicalDevice, const char* path, bool creationFeedback)
+{
+  double start = getTimeMs();
+
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(physicalDevice, &props);
+
+  pipelineCache.warm = false;
+  pipelineCache.creationFeedback = creationFeedback;
+  pipelineCache.hits = pipelineCache.misses = pipelineCache.unknown = 0;
+  pipelineCache.hitTime = pipelineCache.missTime = pipelineCache.unknownTime = 0;
+
+  VkPipelineCacheCreateInfo createInfo = { VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+
+  std::vector<char> contents;
+  if(readFile(path, contents))
+  {
+    const char* reason = validatePipelineCacheFile(contents, props);
+    if(reason)
+    {
+      printf("Pipeline cache: discarding %s (%s)\n", path, reason);
+    }
+    else
+    {
+      createInfo.initialDataSize = contents.size() - sizeof(PipelineCacheFileHeader);
+      createInfo.pInitialData = contents.data() + sizeof(PipelineCacheFileHeader);
+      pipelineCache.warm = true;
+    }
+  }
+  else
+  {
+    printf("Pipeline cache: %s not found, starting cold\n", path);
+  }
+
+  VK_CHECK(vkCreatePipelineCache(device, &createInfo, 0, &pipelineCache.cache));
+
+  if(pipelineCache.warm)
+    printf("Pipeline cache: loaded %zu bytes from %s in %.2f ms\n", createInfo.initialDataSize, path, getTimeMs() - start);
+}
+
+void savePipelineCache(const PipelineCache& pipelineCache, VkDevice device, VkPhysicalDevice physicalDevice, const char* path)
+{
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(physicalDevice, &props);
+
+  size_t dataSize = 0;
+  VK_CHECK(vkGetPipelineCacheData(device, pipelineCache.cache, &dataSize, 0));
+
+  std::vector<char> contents(sizeof(PipelineCacheFileHeader) + dataSize);
+  VK_CHECK(vkGetPipelineCacheData(device, pipelineCache.cache, &dataSize, contents.data() + sizeof(PipelineCacheFileHeader)));
+  contents.resize(sizeof(PipelineCacheFileHeader) + dataSize);
+
+  PipelineCacheFileHeader fileHeader = {};
+  fileHeader.magic = kPipelineCacheMagic;
+  fileHeader.version = kPipelineCacheFileVersion;
+  fileHeader.driverVersion = props.driverVersion;
+  fileHeader.dataSize = uint32_t(dataSize);
+  fileHeader.dataHash = hashData(contents.data() + sizeof(PipelineCacheFileHeader), dataSize);
+  memcpy(contents.data(), &fileHeader, sizeof(fileHeader));
+
+  // Write next to the real file and rename over it, so a crash mid-write never leaves a torn cache behind
+  std::string tempPath = std::string(path) + ".tmp";
+
+  FILE* file = fopen(tempPath.c_str(), "wb");
+  if(!file)
+  {
+    printf("Pipeline cache: can't open %s for writing\n", tempPath.c_str());
+    return;
+  }
+
+  bool written = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+  written = written && fflush(file) == 0 && fsync(fileno(file)) == 0;
+  fclose(file);
+
+  if(!written || rename(tempPath.c_str(), path) != 0)
+  {
+    printf("Pipeline cache: failed to write %s\n", path);
+    remove(tempPath.c_str());
+    return;
+  }
+
+  printf("Pipeline cache: saved %zu bytes to %s\n", dataSize, path);
+}
+
+void destroyPipelineCache(PipelineCache& pipelineCache, VkDevice device)
+{
+  vkDestroyPipelineCache(device, pipelineCache.cache, 0);
+  pipelineCache.cache = VK_NULL_HANDLE;
+}
+
+void recordPipelineCreation(PipelineCache& pipelineCache, const char* name, const VkPipelineCreationFeedbackEXT& feedback, double ms)
+{
+  std::lock_guard<std::mutex> lock(pipelineCache.statsMutex);
+
+  const char* result = "unknown";
+
+  if(feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT)
+  {
+    if(feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT)
+    {
+      result = "hit";
+      pipelineCache.hits++;
+      pipelineCache.hitTime += ms;
+    }
+    else
+    {
+      result = "miss";
+      pipelineCache.misses++;
+      pipelineCache.missTime += ms;
+    }
+  }
+  else
+  {
+    pipelineCache.unknown++;
+    pipelineCache.unknownTime += ms;
+  }
+
+  printf("Pipeline %s: %.2f ms (cache %s)\n", name, ms, result);
+}
+
+void printPipelineCacheStats(PipelineCache& pipelineCache)
+{
+  std::lock_guard<std::mutex> lock(pipelineCache.statsMutex);
+
+  printf("Pipeline cache (%s): %u hits in %.2f ms, %u misses in %.2f ms", pipelineCache.warm ? "warm" : "cold",
+      pipelineCache.hits, pipelineCache.hitTime, pipelineCache.misses, pipelineCache.missTime);
+
+  if(pipelineCache.unknown)
+    printf(", %u without feedback in %.2f ms", pipelineCache.unknown, pipelineCache.unknownTime);
+
+  printf("\n");
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "common.h"
+
+#include <mutex>
+
+// VkPipelineCache that survives between runs. The blob on disk is checked against the current device
+// before the driver ever sees it, and written back atomically on shutdown.
+struct PipelineCache
+{
+  VkPipelineCache cache;
+
+  bool warm; // A valid blob from a previous run was loaded
+  bool creationFeedback; // VK_EXT_pipeline_creation_feedback is on, so the driver tells us hits from misses
+
+  // Pipelines can be created from several threads, so the stats have their own lock
+  std::mutex statsMutex;
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t unknown; // Created without creation feedback
+  double hitTime; // ms
+  double missTime;
+  double unknownTime;
+};
+
+void createPipelineCache(PipelineCache& pipelineCache, VkDevice device, VkPhysicalDevice physicalDevice, const char* path, bool creationFeedback);
+void savePipelineCache(const PipelineCache& pipelineCache, VkDevice device, VkPhysicalDevice physicalDevice, const char* path);
+void destroyPipelineCache(PipelineCache& pipelineCache, VkDevice device);
+
+// Call after vkCreate*Pipelines with the feedback the driver filled in (zeroed if creationFeedback is off)
+void recordPipelineCreation(PipelineCache& pipelineCache, const char* name, const VkPipelineCreationFeedbackEXT& feedback, double ms);
+void printPipelineCacheStats(PipelineCache& pipelineCache);
@@ -0,0 +1,555 @@
+#include "pipelines.h"
+
+#include "mesh.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+const uint32_t kSpirvMagic = 0x07230203;
+
+VkShaderModule createShaderModule(VkDevice device, const void* code, size_t size, const char* name)
+{
+  // Code size is uint32_t, so 4 bytes
+  if(size < 4 || size % 4 != 0 || *static_cast<const uint32_t*>(code) != kSpirvMagic)
+  {
+    printf("Shader %s isn't SPIR-V\n", name);
+    return VK_NULL_HANDLE;
+  }
+
+  VkShaderModuleCreateInfo createInfo = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+  createInfo.codeSize = size;
+  createInfo.pCode = static_cast<const uint32_t*>(code);
+
+  VkShaderModule shaderModule = VK_NULL_HANDLE;
+  if(vkCreateShaderModule(device, &createInfo, NULL, &shaderModule) != VK_SUCCESS)
+    return VK_NULL_HANDLE;
+
+  return shaderModule;
+}
+
+VkShaderModule loadShader(VkDevice device, const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if(!file)
+  {
+    printf("Can't open shader %s\n", path);
+    return VK_NULL_HANDLE;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  if(length < 0)
+  {
+    fclose(file);
+    return VK_NULL_HANDLE;
+  }
+
+  // Whole words, createShaderModule rejects sizes that aren't
+  std::vector<uint32_t> code((size_t(length) + 3) / 4);
+  size_t rc = fread(code.data(), 1, size_t(length), file);
+  fclose(file);
+
+  if(rc != size_t(length))
+    return VK_NULL_HANDLE;
+
+  return createShaderModule(device, code.data(), size_t(length), path);
+}
+
+// One VkBool32 per specialized feature bit, constant_id is the bit's index
+struct PipelineSpecialization
+{
+  VkSpecializationInfo info;
+  VkSpecializationMapEntry entries[32];
+  VkBool32 values[32];
+};
+
+static const VkSpecializationInfo* getSpecialization(PipelineSpecialization& specialization, uint32_t features, uint32_t specialized)
+{
+  uint32_t count = 0;
+
+  for(uint32_t bit = 0 ; bit < 32 ; bit++)
+  {
+    if(!(specialized & (1u << bit)))
+      continue;
+
+    specialization.entries[count] = { bit, uint32_t(count * sizeof(VkBool32)), sizeof(VkBool32) };
+    specialization.values[count] = (features >> bit) & 1;
+    count++;
+  }
+
+  specialization.info.mapEntryCount = count;
+  specialization.info.pMapEntries = specialization.entries;
+  specialization.info.dataSize = count * sizeof(VkBool32);
+  specialization.info.pData = specialization.values;
+
+  return count ? &specialization.info : NULL;
+}
+
+static VkPipeline createGraphicsPipeline(VkDevice device, PipelineCache& pipelineCache, VkRenderPass renderPass, VkSampleCountFlagBits samples, VkPipelineLayout layout, VkShaderModule meshVertSM, VkShaderModule meshFragSM, const PipelineDesc& desc)
+{
+  VkGraphicsPipelineCreateInfo createInfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
+
+  PipelineSpecialization specializations[2];
+
+  VkPipelineShaderStageCreateInfo stages[2] {};
+  stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  stages[0].module = meshVertSM;
+  stages[0].pName = "main";
+  stages[0].pSpecializationInfo = getSpecialization(specializations[0], desc.features, desc.specialized[0]);
+  stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  stages[1].module = meshFragSM;
+  stages[1].pName = "main";
+  stages[1].pSpecializationInfo = getSpecialization(specializations[1], desc.features, desc.specialized[1]);
+
+  createInfo.stageCount = sizeof(stages) / sizeof(stages[0]);
+  createInfo.pStages = stages;
+
+  VkVertexInputBindingDescription vertexBinding;
+  VkVertexInputAttributeDescription vertexAttributes[3];
+  getVertexInputDescription(desc.quantized, vertexBinding, vertexAttributes);
+
+  VkPipelineVertexInputStateCreateInfo vertexInputInfo = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
+  vertexInputInfo.vertexBindingDescriptionCount = 1;
+  vertexInputInfo.pVertexBindingDescriptions = &vertexBinding;
+  vertexInputInfo.vertexAttributeDescriptionCount = sizeof(vertexAttributes) / sizeof(vertexAttributes[0]);
+  vertexInputInfo.pVertexAttributeDescriptions = vertexAttributes;
+  createInfo.pVertexInputState = &vertexInputInfo;
+
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO };
+  inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  createInfo.pInputAssemblyState = &inputAssembly;
+
+  VkPipelineTessellationStateCreateInfo tessellationState = { VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO };
+  createInfo.pTessellationState = &tessellationState;
+
+  VkPipelineViewportStateCreateInfo viewportState = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
+  viewportState.viewportCount = 1;
+  viewportState.scissorCount = 1;
+  createInfo.pViewportState = &viewportState;
+
+  VkPipelineRasterizationStateCreateInfo rasterizationState = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
+  rasterizationState.lineWidth = 1.0f;
+  createInfo.pRasterizationState = &rasterizationState;
+
+  VkPipelineMultisampleStateCreateInfo multisampleState = { VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO };
+  multisampleState.rasterizationSamples = samples;
+  createInfo.pMultisampleState = &multisampleState;
+
+  VkPipelineDepthStencilStateCreateInfo depthStencilState = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
+  depthStencilState.depthTestEnable = true;
+  depthStencilState.depthWriteEnable = true;
+  depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS;
+  createInfo.pDepthStencilState = &depthStencilState;
+
+
+  VkPipelineColorBlendAttachmentState colorAttachmentState = {};
+  colorAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+  VkPipelineColorBlendStateCreateInfo colorBlendState = { VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO };
+  colorBlendState.pAttachments = &colorAttachmentState;
+  colorBlendState.attachmentCount = 1;
+  createInfo.pColorBlendState = &colorBlendState;
+
+  VkPipelineDynamicStateCreateInfo dynamicState = { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+  VkDynamicState                dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  dynamicState.dynamicStateCount = sizeof(dynamicStates) / sizeof(dynamicStates[0]);
+  dynamicState.pDynamicStates = dynamicStates;
+  createInfo.pDynamicState = &dynamicState;
+
+  createInfo.layout = layout;
+  createInfo.renderPass = renderPass;
+
+  // Lets the driver tell us if the pipeline came out of the cache
+  VkPipelineCreationFeedbackEXT creationFeedback = {};
+  VkPipelineCreationFeedbackEXT stageFeedbacks[sizeof(stages) / sizeof(stages[0])] = {};
+  VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo = { VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT };
+  feedbackInfo.pPipelineCreationFeedback = &creationFeedback;
+  feedbackInfo.pipelineStageCreationFeedbackCount = createInfo.stageCount;
+  feedbackInfo.pPipelineStageCreationFeedbacks = stageFeedbacks;
+
+  if(pipelineCache.creationFeedback)
+    createInfo.pNext = &feedbackInfo;
+
+  double start = getTimeMs();
+
+  // Can fail on a shader that was rewritten with something broken, that just keeps the old pipeline
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  if(vkCreateGraphicsPipelines(device, pipelineCache.cache, 1, &createInfo, NULL, &pipeline) != VK_SUCCESS)
+    return VK_NULL_HANDLE;
+
+  recordPipelineCreation(pipelineCache, desc.name.c_str(), creationFeedback, getTimeMs() - start);
+
+  return pipeline;
+}
+
+static VkPipeline createComputePipeline(VkDevice device, PipelineCache& pipelineCache, VkPipelineLayout layout, VkShaderModule computeSM, const char* name)
+{
+  VkComputePipelineCreateInfo createInfo = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+  createInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  createInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  createInfo.stage.module = computeSM;
+  createInfo.stage.pName = "main";
+  createInfo.layout = layout;
+
+  VkPipelineCreationFeedbackEXT creationFeedback = {};
+  VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo = { VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT };
+  feedbackInfo.pPipelineCreationFeedback = &creationFeedback;
+
+  if(pipelineCache.creationFeedback)
+    createInfo.pNext = &feedbackInfo;
+
+  double start = getTimeMs();
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  if(vkCreateComputePipelines(device, pipelineCache.cache, 1, &createInfo, NULL, &pipeline) != VK_SUCCESS)
+    return VK_NULL_HANDLE;
+
+  recordPipelineCreation(pipelineCache, name, creationFeedback, getTimeMs() - start);
+
+  return pipeline;
+}
+
+static VkShaderModule loadPipelineShader(PipelineManager& manager, const std::string& path, bool useArchive)
+{
+  const ArchiveEntry* entry = useArchive && manager.archive ? findAsset(*manager.archive, path.c_str()) : NULL;
+
+  if(entry && entry->kind == AssetKind_Shader)
+    return createShaderModule(manager.device, getAssetData(*manager.archive, *entry), size_t(entry->size), path.c_str());
+
+  return loadShader(manager.device, path.c_str());
+}
+
+static VkPipeline buildPipeline(PipelineManager& manager, const PipelineDesc& desc, bool useArchive)
+{
+  uint32_t shaderCount = desc.kind == PipelineKind_Graphics ? 2 : 1;
+
+  VkShaderModule modules[2] = {};
+  bool loaded = true;
+
+  for(uint32_t i = 0 ; i < shaderCount ; i++)
+  {
+    modules[i] = loadPipelineShader(manager, desc.shaders[i], useArchive);
+    loaded = loaded && modules[i];
+  }
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+
+  if(loaded && desc.kind == PipelineKind_Graphics)
+    pipeline = createGraphicsPipeline(manager.device, *manager.cache, manager.renderPass, manager.samples, manager.layout, modules[0], modules[1], desc);
+  else if(loaded)
+    pipeline = createComputePipeline(manager.device, *manager.cache, manager.layout, modules[0], desc.name.c_str());
+
+  // The pipeline keeps what it needs, the modules can go right away
+  for(uint32_t i = 0 ; i < shaderCount ; i++)
+  {
+    if(modules[i])
+      vkDestroyShaderModule(manager.device, modules[i], NULL);
+  }
+
+  return pipeline;
+}
+
+static void buildThread(PipelineManager* manager)
+{
+  for(;;)
+  {
+    PipelineBuild build;
+    {
+      std::unique_lock<std::mutex> lock(manager->mutex);
+      manager->wake.wait(lock, [&]() { return manager->quit || !manager->queue.empty(); });
+
+      if(manager->quit)
+        return;
+
+      build = std::move(manager->queue.front());
+      manager->queue.pop_front();
+    }
+
+    // Only the first build, after that it's hot reload and the file is newer
+    build.pipeline = buildPipeline(*manager, build.desc, build.version == 1);
+
+    {
+      std::lock_guard<std::mutex> lock(manager->mutex);
+      manager->finished.push_back(std::move(build));
+      manager->pending--;
+    }
+    manager->idle.notify_all();
+  }
+}
+
+void createPipelineManager(PipelineManager& manager, VkDevice device, PipelineCache& cache, VkRenderPass renderPass, VkSampleCountFlagBits samples, VkPipelineLayout layout, const AssetArchive* archive, bool hotReload)
+{
+  manager.device = device;
+  manager.cache = &cache;
+  manager.renderPass = renderPass;
+  manager.samples = samples;
+  manager.layout = layout;
+  manager.archive = archive;
+
+  manager.pending = 0;
+  manager.quit = false;
+
+  manager.startTime = getTimeMs();
+  manager.startupReported = false;
+  manager.reloads = 0;
+  manager.reloadFailures = 0;
+
+  manager.shaderDirectory = "shaders";
+  manager.watch = -1;
+
+#ifdef __linux__
+  if(hotReload)
+  {
+    // Closing a file written to or moving one in covers glslc and editors that save through a temporary
+    manager.watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(manager.watch >= 0 && inotify_add_watch(manager.watch, manager.shaderDirectory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+      close(manager.watch);
+      manager.watch = -1;
+    }
+
+    if(manager.watch < 0)
+      printf("Shader hot reload: can't watch %s\n", manager.shaderDirectory.c_str());
+  }
+#else
+  if(hotReload)
+    printf("Shader hot reload: needs inotify, Linux only\n");
+#endif
+
+  uint32_t threadCount = std::max(1u, std::min(std::thread::hardware_concurrency() / 2, kMaxPipelineThreads));
+  for(uint32_t i = 0 ; i < threadCount ; i++)
+    manager.threads.push_back(std::thread(buildThread, &manager));
+}
+
+void destroyPipelineManager(PipelineManager& manager)
+{
+  // Builds that haven't started are dropped, the ones running are waited for
+  {
+    std::lock_guard<std::mutex> lock(manager.mutex);
+    manager.quit = true;
+    manager.queue.clear();
+  }
+  manager.wake.notify_all();
+
+  for(std::thread& thread : manager.threads)
+    thread.join();
+
+  manager.threads.clear();
+
+  for(const PipelineBuild& build : manager.finished)
+  {
+    if(build.pipeline)
+      vkDestroyPipeline(manager.device, build.pipeline, NULL);
+  }
+
+  for(const RetiredPipeline& retired : manager.retired)
+    vkDestroyPipeline(manager.device, retired.pipeline, NULL);
+
+  for(const ManagedPipeline& pipeline : manager.pipelines)
+  {
+    if(pipeline.pipeline)
+      vkDestroyPipeline(manager.device, pipeline.pipeline, NULL);
+  }
+
+  manager.finished.clear();
+  manager.retired.clear();
+  manager.pipelines.clear();
+
+#ifdef __linux__
+  if(manager.watch >= 0)
+    close(manager.watch);
+#endif
+}
+
+static void queueBuild(PipelineManager& manager, uint32_t index)
+{
+  ManagedPipeline& pipeline = manager.pipelines[index];
+  pipeline.version++;
+
+  PipelineBuild build;
+  build.index = index;
+  build.version = pipeline.version;
+  build.desc = pipeline.desc;
+  build.pipeline = VK_NULL_HANDLE;
+
+  {
+    std::lock_guard<std::mutex> lock(manager.mutex);
+    manager.queue.push_back(std::move(build));
+    manager.pending++;
+  }
+  manager.wake.notify_one();
+}
+
+uint32_t addPipeline(PipelineManager& manager, const PipelineDesc& desc)
+{
+  ManagedPipeline pipeline;
+  pipeline.desc = desc;
+  pipeline.pipeline = VK_NULL_HANDLE;
+  pipeline.version = 0;
+  pipeline.failed = false;
+
+  manager.pipelines.push_back(pipeline);
+
+  uint32_t index = uint32_t(manager.pipelines.size() - 1);
+  queueBuild(manager, index);
+
+  return index;
+}
+
+uint32_t addGraphicsPipeline(PipelineManager& manager, const char* name, const char* vertexShader, const char* fragmentShader, bool quantized)
+{
+  PipelineDesc desc;
+  desc.kind = PipelineKind_Graphics;
+  desc.name = name;
+  desc.shaders[0] = vertexShader;
+  desc.shaders[1] = fragmentShader;
+  desc.quantized = quantized;
+  desc.features = 0;
+  desc.specialized[0] = desc.specialized[1] = 0;
+
+  return addPipeline(manager, desc);
+}
+
+uint32_t addComputePipeline(PipelineManager& manager, const char* name, const char* computeShader)
+{
+  PipelineDesc desc;
+  desc.kind = PipelineKind_Compute;
+  desc.name = name;
+  desc.shaders[0] = computeShader;
+  desc.quantized = false;
+  desc.features = 0;
+  desc.specialized[0] = desc.specialized[1] = 0;
+
+  return addPipeline(manager, desc);
+}
+
+// Queues a build of every pipeline that uses a shader the watch saw change
+static void pollShaderChanges(PipelineManager& manager)
+{
+#ifdef __linux__
+  if(manager.watch < 0)
+    return;
+
+  alignas(inotify_event) char buffer[4096];
+  std::vector<std::string> changed;
+
+  for(;;)
+  {
+    ssize_t length = read(manager.watch, buffer, sizeof(buffer));
+    if(length <= 0)
+      break;
+
+    for(ssize_t offset = 0 ; offset < length ; )
+    {
+      const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+      offset += sizeof(inotify_event) + event->len;
+
+      if(!event->len || strlen(event->name) < 4 || strcmp(event->name + strlen(event->name) - 4, ".spv") != 0)
+        continue;
+
+      std::string path = manager.shaderDirectory + "/" + event->name;
+      if(std::find(changed.begin(), changed.end(), path) == changed.end())
+        changed.push_back(path);
+    }
+  }
+
+  for(uint32_t i = 0 ; i < manager.pipelines.size() ; i++)
+  {
+    const PipelineDesc& desc = manager.pipelines[i].desc;
+
+    bool uses = false;
+    for(const std::string& path : changed)
+      uses = uses || desc.shaders[0] == path || desc.shaders[1] == path;
+
+    if(uses)
+    {
+      printf("Shader hot reload: rebuilding %s\n", desc.name.c_str());
+      queueBuild(manager, i);
+    }
+  }
+#endif
+}
+
+bool updatePipelines(PipelineManager& manager, uint64_t submittedValue, uint64_t completedValue)
+{
+  bool swapped = false;
+
+  pollShaderChanges(manager);
+
+  std::vector<PipelineBuild> finished;
+  bool idle;
+  {
+    std::lock_guard<std::mutex> lock(manager.mutex);
+    finished.swap(manager.finished);
+    idle = manager.pending == 0;
+  }
+
+  for(const PipelineBuild& build : finished)
+  {
+    ManagedPipeline& pipeline = manager.pipelines[build.index];
+    bool reload = pipeline.version > 1;
+
+    // A newer build of the same pipeline is on its way, this one is already stale
+    if(build.version != pipeline.version)
+    {
+      if(build.pipeline)
+        vkDestroyPipeline(manager.device, build.pipeline, NULL);
+      continue;
+    }
+
+    pipeline.failed = !build.pipeline;
+
+    if(!build.pipeline)
+    {
+      printf("Pipeline %s failed to build%s\n", pipeline.desc.name.c_str(), pipeline.pipeline ? ", keeping the old one" : "");
+      manager.reloadFailures += reload ? 1 : 0;
+      continue;
+    }
+
+    if(pipeline.pipeline)
+      manager.retired.push_back({ pipeline.pipeline, submittedValue });
+
+    pipeline.pipeline = build.pipeline;
+    manager.reloads += reload ? 1 : 0;
+    swapped = true;
+
+    if(reload)
+      printf("Shader hot reload: %s swapped in\n", pipeline.desc.name.c_str());
+  }
+
+  // Retired in submit order, so the ones that are done are all at the front
+  size_t done = 0;
+  while(done < manager.retired.size() && manager.retired[done].timelineValue <= completedValue)
+  {
+    vkDestroyPipeline(manager.device, manager.retired[done].pipeline, NULL);
+    done++;
+  }
+
+  manager.retired.erase(manager.retired.begin(), manager.retired.begin() + done);
+
+  if(idle && !manager.startupReported)
+  {
+    printf("Pipelines: %zu built in %.1f ms on %zu threads, off the frame loop\n", manager.pipelines.size(), getTimeMs() - manager.startTime, manager.threads.size());
+    printPipelineCacheStats(*manager.cache);
+    manager.startupReported = true;
+  }
+
+  return swapped;
+}
+
+void waitForPipelines(PipelineManager& manager)
+{
+  std::unique_lock<std::mutex> lock(manager.mutex);
+  manager.idle.wait(lock, [&]() { return manager.pending == 0; });
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "archive.h"
+#include "pipeline_cache.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+const uint32_t kMaxPipelineThreads = 4; // Compiles are rare after startup, no point taking cores from recording
+
+enum PipelineKind
+{
+  PipelineKind_Graphics, // Mesh vertex input, the scene's render pass
+  PipelineKind_Compute,
+};
+
+struct PipelineDesc
+{
+  PipelineKind kind;
+  std::string name;
+  std::string shaders[2]; // Vertex and fragment, or just compute
+  bool quantized; // Graphics, which vertex format the vertex shader reads
+
+  // Feature bits the shaders leave as specialization constants, set from features. The constant_id is the
+  // bit's index, see variants.h.
+  uint32_t features;
+  uint32_t specialized[2];
+};
+
+struct ManagedPipeline
+{
+  PipelineDesc desc;
+  VkPipeline pipeline; // VK_NULL_HANDLE until the first build is done, draws that need it are skipped until then
+  uint32_t version; // Bumped per build queued, a build that finishes after a newer one was queued is thrown away
+  bool failed; // Last build failed, the pipeline from before (if any) is still used
+};
+
+struct PipelineBuild
+{
+  uint32_t index; // Into manager.pipelines
+  uint32_t version;
+  PipelineDesc desc; // Copied, the build threads never look at manager.pipelines
+  VkPipeline pipeline; // Result, VK_NULL_HANDLE if the build failed
+};
+
+struct RetiredPipeline
+{
+  VkPipeline pipeline;
+  uint64_t timelineValue; // Destroyed once the frame timeline gets here
+};
+
+// Builds pipelines on a few background threads, so neither startup nor a shader change ever blocks the
+// frame loop. Finished builds are only swapped in by updatePipelines on the render thread, between frames,
+// so a frame sees the same pipelines from start to end. With hot reload the shader directory is watched
+// with inotify, and every pipeline that uses a .spv that was rewritten is built again.
+struct PipelineManager
+{
+  VkDevice device;
+  PipelineCache* cache;
+  VkRenderPass renderPass;
+  VkSampleCountFlagBits samples; // The render pass's, graphics pipelines have to match it
+  VkPipelineLayout layout;
+  const AssetArchive* archive; // First builds look shaders up here before going to the file, NULL reads files only
+
+  std::vector<ManagedPipeline> pipelines; // Render thread only
+
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable wake; // A build was queued, or quit
+  std::condition_variable idle; // A build finished
+  std::deque<PipelineBuild> queue;
+  std::vector<PipelineBuild> finished;
+  uint32_t pending; // Queued or being built
+  bool quit;
+
+  std::vector<RetiredPipeline> retired; // Replaced, but frames in flight may still use them
+
+  int watch; // inotify descriptor, -1 without hot reload
+  std::string shaderDirectory;
+
+  double startTime;
+  bool startupReported; // Printed how long the first builds took
+  uint32_t reloads;
+  uint32_t reloadFailures;
+};
+
+// Only builds, pipelines are added with addGraphicsPipeline/addComputePipeline. Hot reload needs inotify, so
+// it's Linux only, and reloads always read the file since that's what changed. The archive has to stay open
+// until the manager is destroyed.
+void createPipelineManager(PipelineManager& manager, VkDevice device, PipelineCache& cache, VkRenderPass renderPass, VkSampleCountFlagBits samples, VkPipelineLayout layout, const AssetArchive* archive, bool hotReload);
+
+// The device has to be idle
+void destroyPipelineManager(PipelineManager& manager);
+
+// All of them queue the first build right away and return the handle to look the pipeline up with
+uint32_t addGraphicsPipeline(PipelineManager& manager, const char* name, const char* vertexShader, const char* fragmentShader, bool quantized);
+uint32_t addComputePipeline(PipelineManager& manager, const char* name, const char* computeShader);
+uint32_t addPipeline(PipelineManager& manager, const PipelineDesc& desc);
+
+// VK_NULL_HANDLE until the first build is done
+inline VkPipeline getPipeline(const PipelineManager& manager, uint32_t handle)
+{
+  return manager.pipelines[handle].pipeline;
+}
+
+// Call once per frame before recording. Picks up shader changes and swaps in finished builds without waiting
+// for anything. What they replace is kept until completedValue on the frame timeline reaches submittedValue,
+// the value of the last submit that could have used it. Returns true if a build was swapped in.
+bool updatePipelines(PipelineManager& manager, uint64_t submittedValue, uint64_t completedValue);
+
+// Blocks until nothing is queued or building, for runs that can't start without every pipeline. The results
+// still only show up after the next updatePipelines.
+void waitForPipelines(PipelineManager& manager);
+
+// Returns VK_NULL_HANDLE if the file is missing or isn't SPIR-V, hot reload can catch a file half written
+VkShaderModule loadShader(VkDevice device, const char* path);
+
+// Same checks, for code that is already in memory like a mapped archive
+VkShaderModule createShaderModule(VkDevice device, const void* code, size_t size, const char* name);
@@ -0,0 +1,569 @@
+#include "post.h"
+#include "sync.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+// Matches the push constants in post_comp.glsl
+struct PostConstants
+{
+  uint32_t source; // Sampled
+  uint32_t sourceLevel;
+  uint32_t destination; // Storage
+  uint32_t sampler;
+  uint32_t bloom; // Sampled, the whole chain
+  uint32_t flags;
+  float threshold;
+  float intensity;
+  float exposure;
+};
+
+const uint32_t kPostFlagFirstLevel = 1; // Bloom down from the scene, brightness threshold applied
+const uint32_t kPostFlagSwapRedBlue = 2;
+
+const float kPostBloomThreshold = 1.0f;
+const float kPostBloomIntensity = 0.05f;
+const float kPostExposure = 1.0f;
+
+static void createPostTargets(PostProcess& post, PostTargets& targets, uint32_t frameCount, uint32_t width, uint32_t height)
+{
+  targets.width = width;
+  targets.height = height;
+  targets.timelineValue = 0;
+
+  targets.scenes.resize(frameCount);
+  targets.sceneHandles.resize(frameCount);
+  for(uint32_t i = 0 ; i < frameCount ; i++)
+  {
+    createImage(targets.scenes[i], post.device, *post.allocator, width, height, kPostSceneFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 1, post.familyCount, post.families);
+    targets.sceneHandles[i] = registerSampledImage(*post.heap, targets.scenes[i].imageView);
+  }
+
+  // Down to where either side would be 0
+  uint32_t bloomWidth = std::max(width / 2, 1u);
+  uint32_t bloomHeight = std::max(height / 2, 1u);
+
+  targets.bloomLevels = 1;
+  while(targets.bloomLevels < kPostBloomLevels && (bloomWidth >> targets.bloomLevels) && (bloomHeight >> targets.bloomLevels))
+    targets.bloomLevels++;
+}
+
+static void destroyPostTargets(PostProcess& post, const PostTargets& targets)
+{
+  for(size_t i = 0 ; i < targets.scenes.size() ; i++)
+  {
+    releaseBindless(*post.heap, BindlessKind_SampledImage, targets.sceneHandles[i]);
+    destroyImage(targets.scenes[i], post.device, *post.allocator);
+  }
+}
+
+static void clearPostViews(PostViews& views)
+{
+  views = PostViews();
+  views.bloomHandle = kBindlessInvalid;
+  views.tonemappedHandle = kBindlessInvalid;
+  views.tonemappedStorageHandle = kBindlessInvalid;
+  views.outputStorageHandle = kBindlessInvalid;
+}
+
+static void destroyPostViews(PostProcess& post, const PostViews& views)
+{
+  releaseBindless(*post.heap, BindlessKind_SampledImage, views.bloomHandle);
+  for(size_t level = 0 ; level < views.bloomLevelViews.size() ; level++)
+  {
+    releaseBindless(*post.heap, BindlessKind_StorageImage, views.bloomLevelHandles[level]);
+    vkDestroyImageView(post.device, views.bloomLevelViews[level], 0);
+  }
+
+  releaseBindless(*post.heap, BindlessKind_SampledImage, views.tonemappedHandle);
+  releaseBindless(*post.heap, BindlessKind_StorageImage, views.tonemappedStorageHandle);
+  releaseBindless(*post.heap, BindlessKind_StorageImage, views.outputStorageHandle);
+}
+
+// The graph only replaces its transients when they change, with the size say, and the handles follow. A
+// transient no pass used this frame has no image.
+static void updatePostViews(PostProcess& post, RenderResource bloom, RenderResource tonemapped, RenderResource output)
+{
+  const RenderGraph& graph = post.graph;
+  PostViews& views = post.views;
+
+  if(views.bloom == getRenderGraphImage(graph, bloom) && views.tonemapped == getRenderGraphImage(graph, tonemapped) && views.output == getRenderGraphImage(graph, output))
+    return;
+
+  // The last submit may still be using them
+  views.timelineValue = post.lastFrameValue;
+  post.retiredViews.push_back(views);
+
+  clearPostViews(views);
+  views.bloom = getRenderGraphImage(graph, bloom);
+  views.tonemapped = getRenderGraphImage(graph, tonemapped);
+  views.output = getRenderGraphImage(graph, output);
+
+  if(views.bloom)
+  {
+    views.bloomHandle = registerSampledImage(*post.heap, getRenderGraphImageView(graph, bloom), VK_IMAGE_LAYOUT_GENERAL);
+
+    uint32_t bloomLevels = post.targets.bloomLevels;
+    views.bloomLevelViews.resize(bloomLevels);
+    views.bloomLevelHandles.resize(bloomLevels);
+    for(uint32_t level = 0 ; level < bloomLevels ; level++)
+    {
+      views.bloomLevelViews[level] = createImageView(post.device, views.bloom, kPostSceneFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, level);
+      views.bloomLevelHandles[level] = registerStorageImage(*post.heap, views.bloomLevelViews[level]);
+    }
+  }
+
+  if(views.tonemapped)
+  {
+    views.tonemappedHandle = registerSampledImage(*post.heap, getRenderGraphImageView(graph, tonemapped), VK_IMAGE_LAYOUT_GENERAL);
+    views.tonemappedStorageHandle = registerStorageImage(*post.heap, getRenderGraphImageView(graph, tonemapped));
+  }
+
+  views.outputStorageHandle = registerStorageImage(*post.heap, getRenderGraphImageView(graph, output));
+}
+
+void createPostProcess(PostProcess& post, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator& allocator, BindlessHeap& heap, PipelineManager& pipelines, uint32_t graphicsFamily, VkQueue graphicsQueue, uint32_t computeFamily, VkQueue computeQueue, bool async, bool synchronization2, uint32_t frameCount, uint32_t width, uint32_t height, VkFormat targetFormat)
+{
+  post.device = device;
+  post.allocator = &allocator;
+  post.heap = &heap;
+  post.pipelines = &pipelines;
+
+  post.async = async && computeFamily != graphicsFamily;
+  post.families[0] = graphicsFamily;
+  post.families[1] = computeFamily;
+  post.familyCount = post.async ? 2 : 1;
+  post.queue = post.async ? computeQueue : graphicsQueue;
+  uint32_t postFamily = post.async ? computeFamily : graphicsFamily;
+
+  post.sceneTimeline = createTimelineSemaphore(device);
+  post.swapRedBlue = targetFormat == VK_FORMAT_B8G8R8A8_UNORM;
+
+  // Bloom reads one level at a time by explicit LOD
+  VkSamplerCreateInfo samplerInfo = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+  samplerInfo.magFilter = VK_FILTER_LINEAR;
+  samplerInfo.minFilter = VK_FILTER_LINEAR;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+  VK_CHECK(vkCreateSampler(device, &samplerInfo, 0, &post.sampler));
+
+  post.samplerHandle = registerSampler(heap, post.sampler);
+
+  post.bloomDownPipeline = addComputePipeline(pipelines, "post bloom down", "shaders/post_bloom_down_comp.spv");
+  post.bloomUpPipeline = addComputePipeline(pipelines, "post bloom up", "shaders/post_bloom_up_comp.spv");
+  post.tonemapPipeline = addComputePipeline(pipelines, "post tonemap", "shaders/post_tonemap_comp.spv");
+  post.fxaaPipeline = addComputePipeline(pipelines, "post fxaa", "shaders/post_fxaa_comp.spv");
+
+  post.frames.resize(frameCount);
+  for(PostFrame& frame : post.frames)
+  {
+    VkCommandPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = postFamily;
+    VK_CHECK(vkCreateCommandPool(device, &poolInfo, 0, &frame.commandPool));
+
+    VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+    allocateInfo.commandPool = frame.commandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 1;
+    VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &frame.commandBuffer));
+
+    frame.timed = false;
+  }
+
+  createPostTargets(post, post.targets, frameCount, width, height);
+
+  // Barriers and the images between the steps come from a graph of the chain's own
+  post.deletions = {};
+  createRenderGraph(post.graph, device, allocator, synchronization2, post.deletions);
+  post.graphStats = {};
+  clearPostViews(post.views);
+  post.lastFrameValue = 0;
+
+  // Both queues write timestamps into the same pool, so both families need them
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  uint32_t queueCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, 0);
+  std::vector<VkQueueFamilyProperties> queues(queueCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, queues.data());
+
+  uint32_t validBits = std::min(queues[graphicsFamily].timestampValidBits, queues[postFamily].timestampValidBits);
+
+  post.timing = validBits > 0;
+  post.queryPool = VK_NULL_HANDLE;
+  post.timestampPeriod = properties.limits.timestampPeriod;
+  post.timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+  post.lastPostBegin = 0;
+  post.lastPostEnd = 0;
+  post.framesTimed = 0;
+  post.sceneTime = 0;
+  post.postTime = 0;
+  post.overlapTime = 0;
+
+  if(post.timing)
+  {
+    VkQueryPoolCreateInfo queryInfo = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+    queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryInfo.queryCount = frameCount * PostTimestamp_Count;
+    VK_CHECK(vkCreateQueryPool(device, &queryInfo, 0, &post.queryPool));
+  }
+
+  printf("Post: bloom with %u levels, tonemapping and FXAA on the %s queue (family %u)%s\n", post.targets.bloomLevels, post.async ? "async compute" : "graphics", postFamily,
+    async && !post.async ? ", the device has no separate compute family" : "");
+}
+
+void destroyPostProcess(PostProcess& post)
+{
+  for(const PostTargets& targets : post.retired)
+    destroyPostTargets(post, targets);
+  post.retired.clear();
+
+  destroyPostTargets(post, post.targets);
+
+  for(const PostViews& views : post.retiredViews)
+    destroyPostViews(post, views);
+  post.retiredViews.clear();
+
+  destroyPostViews(post, post.views);
+  destroyRenderGraph(post.graph);
+  flushDeletions(post.deletions, post.device);
+
+  for(const PostFrame& frame : post.frames)
+    vkDestroyCommandPool(post.device, frame.commandPool, 0);
+  post.frames.clear();
+
+  if(post.queryPool)
+    vkDestroyQueryPool(post.device, post.queryPool, 0);
+
+  releaseBindless(*post.heap, BindlessKind_Sampler, post.samplerHandle);
+  vkDestroySampler(post.device, post.sampler, 0);
+  vkDestroySemaphore(post.device, post.sceneTimeline, 0);
+}
+
+void resizePostProcess(PostProcess& post, uint32_t width, uint32_t height, uint64_t lastUseValue)
+{
+  post.targets.timelineValue = lastUseValue;
+  post.retired.push_back(post.targets);
+
+  post.targets = PostTargets();
+  createPostTargets(post, post.targets, uint32_t(post.frames.size()), width, height);
+}
+
+void beginPostFrame(PostProcess& post, uint32_t frameSlot, uint64_t completedValue)
+{
+  for(size_t i = 0 ; i < post.retired.size() ; )
+  {
+    if(post.retired[i].timelineValue > completedValue)
+    {
+      i++;
+      continue;
+    }
+
+    destroyPostTargets(post, post.retired[i]);
+    post.retired[i] = post.retired.back();
+    post.retired.pop_back();
+  }
+
+  for(size_t i = 0 ; i < post.retiredViews.size() ; )
+  {
+    if(post.retiredViews[i].timelineValue > completedValue)
+    {
+      i++;
+      continue;
+    }
+
+    destroyPostViews(post, post.retiredViews[i]);
+    post.retiredViews[i] = post.retiredViews.back();
+    post.retiredViews.pop_back();
+  }
+
+  collectDeletions(post.deletions, post.device, completedValue);
+
+  PostFrame& frame = post.frames[frameSlot];
+  if(!frame.timed)
+    return;
+
+  frame.timed = false;
+
+  // No WAIT_BIT, the slot was already waited on. A frame that isn't there breaks the chain of overlaps.
+  uint64_t timestamps[PostTimestamp_Count];
+  VkResult result = vkGetQueryPoolResults(post.device, post.queryPool, frameSlot * PostTimestamp_Count, PostTimestamp_Count, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+  if(result != VK_SUCCESS)
+  {
+    post.lastPostBegin = post.lastPostEnd = 0;
+    return;
+  }
+
+  for(uint64_t& timestamp : timestamps)
+    timestamp &= post.timestampMask;
+
+  // Timestamps from both queues are on the device's one clock, so they can be compared as they are
+  double scale = post.timestampPeriod * 1e-6;
+  uint64_t sceneBegin = timestamps[PostTimestamp_SceneBegin], sceneEnd = timestamps[PostTimestamp_SceneEnd];
+
+  // How long last frame's chain ran while this frame's scene did
+  if(post.lastPostEnd)
+  {
+    uint64_t begin = std::max(post.lastPostBegin, sceneBegin);
+    uint64_t end = std::min(post.lastPostEnd, sceneEnd);
+
+    post.overlapTime += end > begin ? double(end - begin) * scale : 0.0;
+    post.postTime += double(post.lastPostEnd - post.lastPostBegin) * scale;
+    post.sceneTime += double(sceneEnd - sceneBegin) * scale;
+    post.framesTimed++;
+  }
+
+  post.lastPostBegin = timestamps[PostTimestamp_PostBegin];
+  post.lastPostEnd = timestamps[PostTimestamp_PostEnd];
+}
+
+void beginPostScene(PostProcess& post, VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+  if(!post.timing)
+    return;
+
+  // The graphics submit always goes first, so the post queue's writes find the queries reset
+  vkCmdResetQueryPool(commandBuffer, post.queryPool, frameSlot * PostTimestamp_Count, PostTimestamp_Count);
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, post.queryPool, frameSlot * PostTimestamp_Count + PostTimestamp_SceneBegin);
+}
+
+void endPostScene(PostProcess& post, VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+  if(post.timing)
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, post.queryPool, frameSlot * PostTimestamp_Count + PostTimestamp_SceneEnd);
+}
+
+static void dispatchPost(const PostProcess& post, VkCommandBuffer commandBuffer, VkPipeline pipeline, const PostConstants& constants, uint32_t width, uint32_t height)
+{
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+  vkCmdPushConstants(commandBuffer, post.heap->layout, kBindlessPushStages, 0, sizeof(constants), &constants);
+  vkCmdDispatch(commandBuffer, (width + kPostGroupSize - 1) / kPostGroupSize, (height + kPostGroupSize - 1) / kPostGroupSize, 1);
+}
+
+// What every step has in common, the bloom handle is only there once the graph is compiled
+static PostConstants getPostConstants(const PostProcess& post)
+{
+  PostConstants constants = {};
+  constants.sampler = post.samplerHandle;
+  constants.bloom = post.views.bloomHandle;
+  constants.threshold = kPostBloomThreshold;
+  constants.intensity = kPostBloomIntensity;
+  constants.exposure = kPostExposure;
+
+  return constants;
+}
+
+void recordPostProcess(PostProcess& post, uint32_t frameSlot, const PostCopyCallback& copy)
+{
+  PostFrame& frame = post.frames[frameSlot];
+  const PostTargets& targets = post.targets;
+  RenderGraph& graph = post.graph;
+
+  VK_CHECK(vkResetCommandPool(post.device, frame.commandPool, 0));
+
+  VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_CHECK(vkBeginCommandBuffer(frame.commandBuffer, &beginInfo));
+
+  VkCommandBuffer commandBuffer = frame.commandBuffer;
+
+  if(post.timing)
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, post.queryPool, frameSlot * PostTimestamp_Count + PostTimestamp_PostBegin);
+
+  VkPipeline bloomDown = getPipeline(*post.pipelines, post.bloomDownPipeline);
+  VkPipeline bloomUp = getPipeline(*post.pipelines, post.bloomUpPipeline);
+  VkPipeline tonemap = getPipeline(*post.pipelines, post.tonemapPipeline);
+  VkPipeline fxaa = getPipeline(*post.pipelines, post.fxaaPipeline);
+
+  bool ready = bloomDown && bloomUp && tonemap && fxaa;
+
+  beginRenderGraph(graph);
+
+  // The scene graph left it ready to sample and the wait on sceneTimeline covers its writes
+  const Image& sceneImage = targets.scenes[frameSlot];
+  RenderResource scene = importImage(graph, "post scene", sceneImage.image, sceneImage.imageView, VK_IMAGE_ASPECT_COLOR_BIT, RenderUsage_SampledCompute, false);
+
+  // Bloom and tonemapped are sampled in GENERAL layout, so every use of them is a storage one
+  RenderImageDesc bloomDesc = { kPostSceneFormat, std::max(targets.width / 2, 1u), std::max(targets.height / 2, 1u), targets.bloomLevels, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT };
+  RenderImageDesc tonemappedDesc = { VK_FORMAT_R8G8B8A8_UNORM, targets.width, targets.height, 1, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT };
+  RenderImageDesc outputDesc = { VK_FORMAT_R8G8B8A8_UNORM, targets.width, targets.height, 1, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_IMAGE_ASPECT_COLOR_BIT };
+
+  RenderResource bloom = createTransientImage(graph, "bloom", bloomDesc);
+  RenderResource tonemapped = createTransientImage(graph, "tonemapped", tonemappedDesc);
+  RenderResource output = createTransientImage(graph, "post output", outputDesc);
+
+  if(ready)
+  {
+    // Each level filters the one above it, the first one the scene's bright parts
+    for(uint32_t level = 0 ; level < targets.bloomLevels ; level++)
+    {
+      uint32_t pass = addRenderGraphPass(graph, "bloom down", [&post, &targets, frameSlot, level, bloomDown](VkCommandBuffer commandBuffer)
+      {
+        PostConstants constants = getPostConstants(post);
+        constants.source = level == 0 ? targets.sceneHandles[frameSlot] : post.views.bloomHandle;
+        constants.sourceLevel = level == 0 ? 0 : level - 1;
+        constants.destination = post.views.bloomLevelHandles[level];
+        constants.flags = level == 0 ? kPostFlagFirstLevel : 0;
+
+        dispatchPost(post, commandBuffer, bloomDown, constants, std::max(targets.width >> (level + 1), 1u), std::max(targets.height >> (level + 1), 1u));
+      });
+
+      if(level == 0)
+        useRenderResource(graph, pass, scene, RenderUsage_SampledCompute);
+      useRenderResource(graph, pass, bloom, RenderUsage_StorageWriteCompute);
+    }
+
+    // Back up, each level adds the blurred one below it
+    for(uint32_t level = targets.bloomLevels - 1 ; level-- > 0 ; )
+    {
+      uint32_t pass = addRenderGraphPass(graph, "bloom up", [&post, &targets, level, bloomUp](VkCommandBuffer commandBuffer)
+      {
+        PostConstants constants = getPostConstants(post);
+        constants.source = post.views.bloomHandle;
+        constants.sourceLevel = level + 1;
+        constants.destination = post.views.bloomLevelHandles[level];
+
+        dispatchPost(post, commandBuffer, bloomUp, constants, std::max(targets.width >> (level + 1), 1u), std::max(targets.height >> (level + 1), 1u));
+      });
+
+      useRenderResource(graph, pass, bloom, RenderUsage_StorageWriteCompute);
+    }
+
+    uint32_t tonemapPass = addRenderGraphPass(graph, "tonemap", [&post, &targets, frameSlot, tonemap](VkCommandBuffer commandBuffer)
+    {
+      PostConstants constants = getPostConstants(post);
+      constants.source = targets.sceneHandles[frameSlot];
+      constants.destination = post.views.tonemappedStorageHandle;
+
+      dispatchPost(post, commandBuffer, tonemap, constants, targets.width, targets.height);
+    });
+
+    useRenderResource(graph, tonemapPass, scene, RenderUsage_SampledCompute);
+    useRenderResource(graph, tonemapPass, bloom, RenderUsage_StorageReadCompute);
+    useRenderResource(graph, tonemapPass, tonemapped, RenderUsage_StorageWriteCompute);
+
+    uint32_t fxaaPass = addRenderGraphPass(graph, "fxaa", [&post, &targets, fxaa](VkCommandBuffer commandBuffer)
+    {
+      PostConstants constants = getPostConstants(post);
+      constants.source = post.views.tonemappedHandle;
+      constants.destination = post.views.outputStorageHandle;
+      constants.flags = post.swapRedBlue ? kPostFlagSwapRedBlue : 0;
+
+      dispatchPost(post, commandBuffer, fxaa, constants, targets.width, targets.height);
+    });
+
+    useRenderResource(graph, fxaaPass, tonemapped, RenderUsage_StorageReadCompute);
+    useRenderResource(graph, fxaaPass, output, RenderUsage_StorageWriteCompute);
+  }
+  else
+  {
+    // Still building, the frame goes out black like the scene does without its pipeline
+    uint32_t clearPass = addRenderGraphPass(graph, "post clear", [&post](VkCommandBuffer commandBuffer)
+    {
+      VkClearColorValue black = {};
+      VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+      vkCmdClearColorImage(commandBuffer, post.views.output, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &black, 1, &range);
+    });
+
+    useRenderResource(graph, clearPass, output, RenderUsage_TransferWrite);
+  }
+
+  // Wherever the output goes, the graph doesn't see it
+  uint32_t copyPass = addRenderGraphPass(graph, "post copy", [&post, &copy](VkCommandBuffer commandBuffer)
+  {
+    copy(commandBuffer, post.views.output);
+  }, true);
+
+  useRenderResource(graph, copyPass, output, RenderUsage_TransferRead);
+
+  compileRenderGraph(graph, post.lastFrameValue);
+  updatePostViews(post, bloom, tonemapped, output);
+
+  if(memcmp(&graph.stats, &post.graphStats, sizeof(RenderGraphStats)) != 0)
+  {
+    printRenderGraphStats("post", graph.stats);
+    post.graphStats = graph.stats;
+  }
+
+  if(ready)
+    bindBindlessHeap(*post.heap, commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+
+  executeRenderGraph(graph, commandBuffer, NULL);
+}
+
+void copyPostOutput(const PostProcess& post, VkCommandBuffer commandBuffer, VkImage output, VkImage target)
+{
+  // TRANSFER is where the acquire semaphore is waited on, the layout change has to come after it
+  VkImageMemoryBarrier copyBarrier = imageBarrier(target, 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0, 0, 0, 1, &copyBarrier);
+
+  // Same size and a 32 bit format on both sides, the channel order was already taken care of
+  VkImageCopy region = {};
+  region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+  region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+  region.extent = { post.targets.width, post.targets.height, 1 };
+  vkCmdCopyImage(commandBuffer, output, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+  VkImageMemoryBarrier presentBarrier = imageBarrier(target, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, 0, 0, 0, 1, &presentBarrier);
+}
+
+void submitPostProcess(PostProcess& post, uint32_t frameSlot, uint64_t frameValue, VkSemaphore waitSemaphore, VkSemaphore signalSemaphore, VkSemaphore frameTimeline)
+{
+  PostFrame& frame = post.frames[frameSlot];
+
+  if(post.timing)
+    vkCmdWriteTimestamp(frame.commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, post.queryPool, frameSlot * PostTimestamp_Count + PostTimestamp_PostEnd);
+
+  VK_CHECK(vkEndCommandBuffer(frame.commandBuffer));
+
+  // The scene image's layout change is in the graphics submit, so its wait covers every stage
+  VkSemaphore waitSemaphores[] = { post.sceneTimeline, waitSemaphore };
+  VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT };
+  uint64_t waitValues[] = { frameValue, 0 }; // Binary semaphores ignore theirs
+  uint32_t waitCount = waitSemaphore ? 2 : 1;
+
+  VkSemaphore signalSemaphores[] = { frameTimeline, signalSemaphore };
+  uint64_t signalValues[] = { frameValue, 0 };
+  uint32_t signalCount = signalSemaphore ? 2 : 1;
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo = { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+  timelineInfo.waitSemaphoreValueCount = waitCount;
+  timelineInfo.pWaitSemaphoreValues = waitValues;
+  timelineInfo.signalSemaphoreValueCount = signalCount;
+  timelineInfo.pSignalSemaphoreValues = signalValues;
+
+  VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+  submitInfo.pNext = &timelineInfo;
+  submitInfo.waitSemaphoreCount = waitCount;
+  submitInfo.pWaitSemaphores = waitSemaphores;
+  submitInfo.pWaitDstStageMask = waitStages;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &frame.commandBuffer;
+  submitInfo.signalSemaphoreCount = signalCount;
+  submitInfo.pSignalSemaphores = signalSemaphores;
+
+  VK_CHECK(vkQueueSubmit(post.queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+  frame.timed = post.timing;
+  post.lastFrameValue = frameValue;
+}
+
+void printPostStats(const PostProcess& post)
+{
+  if(!post.framesTimed)
+    return;
+
+  double postTime = post.postTime / post.framesTimed;
+
+  printf("Post: %s queue, scene %.3f ms and post %.3f ms per frame over %u frames, %.1f%% of post overlapped with the next scene\n",
+    post.async ? "async compute" : "graphics", post.sceneTime / post.framesTimed, postTime, post.framesTimed,
+    post.postTime > 0 ? post.overlapTime / post.postTime * 100.0 : 0.0);
+}
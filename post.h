@@ -0,0 +1,154 @@
+#pragma once
+
+#include "bindless.h"
+#include "pipelines.h"
+#include "rendergraph.h"
+#include "resources.h"
+
+#include <functional>
+#include <vector>
+
+const VkFormat kPostSceneFormat = VK_FORMAT_R16G16B16A16_SFLOAT; // What the scene renders into when post processing runs
+const uint32_t kPostBloomLevels = 6; // Half the target's size down to 1/64th
+const uint32_t kPostGroupSize = 8; // local_size_x and _y in post_comp.glsl
+
+// Per frame slot, the scene's on the graphics queue and the chain's on the post queue
+enum PostTimestamp
+{
+  PostTimestamp_SceneBegin,
+  PostTimestamp_SceneEnd,
+  PostTimestamp_PostBegin,
+  PostTimestamp_PostEnd,
+
+  PostTimestamp_Count
+};
+
+// The scene images, per frame slot and sized to the target. The chain reads one while the next frame renders
+// into another.
+struct PostTargets
+{
+  uint32_t width, height;
+
+  std::vector<Image> scenes; // Shared between the graphics and the post queue's family
+  std::vector<uint32_t> sceneHandles; // Sampled
+  uint32_t bloomLevels; // At this size, down to where either side would be 0
+
+  uint64_t timelineValue; // Once retired, destroyed when the frame timeline gets here
+};
+
+// Bindless handles on the chain's images, which are transients of the post graph: the bloom mip chain at half
+// the target's size, the tonemapped image FXAA reads and the RGBA8 output in the target's channel order. Bloom
+// is done before FXAA writes the output, so the two share memory. Remade whenever the graph replaces them.
+struct PostViews
+{
+  VkImage bloom, tonemapped, output; // What the handles were made for, VK_NULL_HANDLE before the pipelines are built
+
+  uint32_t bloomHandle; // Sampled in GENERAL, every level
+  std::vector<VkImageView> bloomLevelViews;
+  std::vector<uint32_t> bloomLevelHandles; // Storage, one per level
+
+  uint32_t tonemappedHandle; // Sampled in GENERAL
+  uint32_t tonemappedStorageHandle;
+
+  uint32_t outputStorageHandle;
+
+  uint64_t timelineValue; // Once retired, destroyed when the frame timeline gets here
+};
+
+// Records the copy out of the chain's output, which is in TRANSFER_SRC_OPTIMAL
+typedef std::function<void(VkCommandBuffer commandBuffer, VkImage output)> PostCopyCallback;
+
+struct PostFrame
+{
+  VkCommandPool commandPool; // On the post queue's family
+  VkCommandBuffer commandBuffer;
+  bool timed; // Timestamps were written and haven't been read yet
+};
+
+// Bloom, tonemapping and FXAA as a chain of compute dispatches. The scene renders into the frame slot's HDR
+// image on the graphics queue, whose submit signals sceneTimeline with the frame's value. The chain waits for
+// that on the async compute queue, copies its output to the swapchain image or wherever the caller wants it,
+// and signals the frame timeline. So while frame N is post processed on the compute queue, frame N+1's scene
+// renders on the graphics queue. Without a compute family of its own the chain goes to the graphics queue
+// behind the scene, everything works the same and nothing overlaps.
+struct PostProcess
+{
+  VkDevice device;
+  MemoryAllocator* allocator;
+  BindlessHeap* heap;
+  const PipelineManager* pipelines;
+
+  uint32_t families[2]; // Graphics, then the compute family when the chain runs there
+  uint32_t familyCount;
+  VkQueue queue; // Where the chain runs
+  bool async;
+
+  VkSemaphore sceneTimeline;
+  VkSampler sampler; // Linear, clamped
+  uint32_t samplerHandle;
+  bool swapRedBlue; // The target is BGRA
+
+  uint32_t bloomDownPipeline;
+  uint32_t bloomUpPipeline;
+  uint32_t tonemapPipeline;
+  uint32_t fxaaPipeline;
+
+  std::vector<PostFrame> frames;
+  PostTargets targets;
+  std::vector<PostTargets> retired; // Replaced by a resize, waiting for frames in flight
+
+  // The chain's barriers and images. The post queue runs one frame at a time, so its transients only have to
+  // last for one.
+  RenderGraph graph;
+  RenderGraphStats graphStats; // Last printed
+  DeletionQueue deletions; // Transients the graph replaced
+  PostViews views;
+  std::vector<PostViews> retiredViews;
+  uint64_t lastFrameValue; // Of the last submit, the last use of whatever the graph replaces
+
+  // How much of each frame's chain ran while the next frame's scene did, off when either queue has no timestamps
+  bool timing;
+  VkQueryPool queryPool; // PostTimestamp_Count per frame slot
+  double timestampPeriod; // ns per tick
+  uint64_t timestampMask;
+  uint64_t lastPostBegin, lastPostEnd; // The chain of the frame read before, both 0 if there is none
+
+  uint32_t framesTimed;
+  double sceneTime; // ms, totals
+  double postTime;
+  double overlapTime;
+};
+
+// The pipelines are added to the manager here. async asks for the compute queue, it's only used when
+// computeFamily isn't the graphics family. targetFormat is the format the output gets copied into.
+// synchronization2 is passed on to the chain's render graph.
+void createPostProcess(PostProcess& post, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator& allocator, BindlessHeap& heap, PipelineManager& pipelines, uint32_t graphicsFamily, VkQueue graphicsQueue, uint32_t computeFamily, VkQueue computeQueue, bool async, bool synchronization2, uint32_t frameCount, uint32_t width, uint32_t height, VkFormat targetFormat);
+
+// The device has to be idle
+void destroyPostProcess(PostProcess& post);
+
+// New targets at the new size, the old ones stay until the frame timeline gets to lastUseValue
+void resizePostProcess(PostProcess& post, uint32_t width, uint32_t height, uint64_t lastUseValue);
+
+// Once per frame after the slot's wait. Reads the timestamps the slot wrote last time round and destroys
+// retired targets, views and transients completedValue covers.
+void beginPostFrame(PostProcess& post, uint32_t frameSlot, uint64_t completedValue);
+
+// First and last thing in the frame's graphics command buffer, timestamps for the overlap
+void beginPostScene(PostProcess& post, VkCommandBuffer commandBuffer, uint32_t frameSlot);
+void endPostScene(PostProcess& post, VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+// Records the chain into the slot's command buffer for the post queue and leaves it open. It ends in a pass
+// that runs copy, the output doesn't outlive the graph. Until the pipelines are built the output is black.
+void recordPostProcess(PostProcess& post, uint32_t frameSlot, const PostCopyCallback& copy);
+
+// Copies the output into a swapchain image of the same size and leaves that in PRESENT_SRC_KHR, from the copy
+// callback. The acquire semaphore has to be waited on at the transfer stage.
+void copyPostOutput(const PostProcess& post, VkCommandBuffer commandBuffer, VkImage output, VkImage target);
+
+// Ends the slot's command buffer and submits it after the graphics submit that signals frameValue on
+// sceneTimeline. It also waits for waitSemaphore at the transfer stage and signals signalSemaphore, both
+// binary and optional, and signals frameValue on the frame timeline.
+void submitPostProcess(PostProcess& post, uint32_t frameSlot, uint64_t frameValue, VkSemaphore waitSemaphore, VkSemaphore signalSemaphore, VkSemaphore frameTimeline);
+
+void printPostStats(const PostProcess& post);
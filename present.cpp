@@ -0,0 +1,411 @@
+#include "present.h"
+
+#include <string.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <thread>
+
+const double kLimiterMargin = 0.5; // ms on top of the work estimate, absorbs scheduler jitter
+const double kLimiterSpin = 1.0; // ms, the most the last stretch is spun instead of slept
+const double kLimiterSpinMargin = 0.05; // ms spun on top of the recent oversleep
+const double kOversleepDecay = 0.9; // Per sleep, so one late wakeup doesn't keep us spinning for long
+const double kLimiterPoll = 0.5; // ms between present polls while sleeping, only while there are presents to poll
+const double kWorkEstimateDecay = 0.05; // How quickly the estimate follows faster frames
+
+const uint64_t kPresentFlushTimeout = 100 * 1000 * 1000; // ns
+
+bool parsePresentPolicy(const char* name, PresentPolicy& policy)
+{
+  if(strcmp(name, "fifo") == 0)
+    policy = PresentPolicy_Fifo;
+  else if(strcmp(name, "fifo-relaxed") == 0)
+    policy = PresentPolicy_FifoRelaxed;
+  else if(strcmp(name, "mailbox") == 0)
+    policy = PresentPolicy_Mailbox;
+  else if(strcmp(name, "immediate") == 0)
+    policy = PresentPolicy_Immediate;
+  else
+    return false;
+
+  return true;
+}
+
+bool parseRedrawPolicy(const char* name, RedrawPolicy& policy)
+{
+  if(strcmp(name, "always") == 0)
+    policy = RedrawPolicy_Always;
+  else if(strcmp(name, "on-change") == 0)
+    policy = RedrawPolicy_OnChange;
+  else
+    return false;
+
+  return true;
+}
+
+const char* getPresentModeName(VkPresentModeKHR mode)
+{
+  switch(mode)
+  {
+  case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+  case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+  case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+  case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo-relaxed";
+  default: return "unknown";
+  }
+}
+
+VkPresentModeKHR choosePresentMode(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, PresentPolicy policy)
+{
+  uint32_t modeCount = 0;
+  VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &modeCount, 0));
+
+  std::vector<VkPresentModeKHR> modes(modeCount);
+  VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &modeCount, modes.data()));
+
+  // Best first. Immediate falls back to mailbox rather than tearing vsync, both don't wait for vblank.
+  VkPresentModeKHR preferred[3] = { VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_KHR };
+
+  switch(policy)
+  {
+  case PresentPolicy_Fifo:
+    break;
+  case PresentPolicy_FifoRelaxed:
+    preferred[0] = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+    break;
+  case PresentPolicy_Mailbox:
+    preferred[0] = VK_PRESENT_MODE_MAILBOX_KHR;
+    break;
+  case PresentPolicy_Immediate:
+    preferred[0] = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    preferred[1] = VK_PRESENT_MODE_MAILBOX_KHR;
+    break;
+  }
+
+  for(VkPresentModeKHR mode : preferred)
+  {
+    if(std::find(modes.begin(), modes.end(), mode) != modes.end())
+      return mode;
+  }
+
+  return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+uint32_t getSwapchainImageCount(const VkSurfaceCapabilitiesKHR& surfaceCaps, VkPresentModeKHR presentMode)
+{
+  // Mailbox needs a third image to always have one to render into while one is shown and one is waiting
+  uint32_t imageCount = std::max(presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? 3u : 2u, surfaceCaps.minImageCount);
+
+  // 0 means there's no limit
+  if(surfaceCaps.maxImageCount)
+    imageCount = std::min(imageCount, surfaceCaps.maxImageCount);
+
+  return imageCount;
+}
+
+void createFrameLimiter(FrameLimiter& limiter, float framesPerSecond)
+{
+  limiter.interval = framesPerSecond > 0 ? 1000.0 / framesPerSecond : 0;
+  limiter.nextSubmit = 0;
+  limiter.workEstimate = 0;
+  limiter.oversleep = kLimiterSpin;
+}
+
+double waitForFrameStart(FrameLimiter& limiter, LatencyTracker& tracker, VkSwapchainKHR swapchain)
+{
+  double now = getTimeMs();
+
+  if(limiter.interval == 0)
+    return now;
+
+  // Too far behind to catch up, start over from here instead of rushing out a burst of frames
+  if(now > limiter.nextSubmit + limiter.interval)
+    limiter.nextSubmit = now;
+
+  double start = limiter.nextSubmit - limiter.workEstimate - kLimiterMargin;
+
+  while(now < start)
+  {
+    pollPresents(tracker, swapchain);
+
+    // Without presents to poll there's no reason to wake up before the spin, one sleep does it
+    double remaining = start - now;
+    double spin = std::min(limiter.oversleep + kLimiterSpinMargin, kLimiterSpin);
+    if(remaining > spin)
+    {
+      double sleep = remaining - spin;
+      if(tracker.waitForPresent && !tracker.pending.empty())
+        sleep = std::min(sleep, kLimiterPoll);
+
+      std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(sleep));
+
+      double woke = getTimeMs();
+      limiter.oversleep = std::max(woke - now - sleep, limiter.oversleep * kOversleepDecay);
+      now = woke;
+      continue;
+    }
+
+    std::this_thread::yield();
+    now = getTimeMs();
+  }
+
+  return now;
+}
+
+void endFrame(FrameLimiter& limiter, double inputTime, double submitTime)
+{
+  double work = submitTime - inputTime;
+
+  // A slow frame counts right away, a fast one only a little, a frame that misses is worse than a frame that waits
+  if(work > limiter.workEstimate)
+    limiter.workEstimate = work;
+  else
+    limiter.workEstimate += (work - limiter.workEstimate) * kWorkEstimateDecay;
+
+  limiter.nextSubmit = std::max(limiter.nextSubmit, submitTime) + limiter.interval;
+}
+
+void createLatencyTracker(LatencyTracker& tracker, VkDevice device, bool presentWait, const char* logPath)
+{
+  tracker.device = device;
+  tracker.waitForPresent = presentWait ? (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(device, "vkWaitForPresentKHR") : NULL;
+
+  // Ids only have to go up, 0 means no id
+  tracker.nextPresentId = 1;
+
+  tracker.inputToSubmitTaken = 0;
+  tracker.submitToPresentTaken = 0;
+  tracker.presentsDropped = 0;
+
+  tracker.log = NULL;
+  if(logPath)
+  {
+    tracker.log = fopen(logPath, "w");
+    if(tracker.log)
+      fprintf(tracker.log, "frame,input_to_submit_ms,submit_to_present_ms\n");
+    else
+      printf("Can't open latency log %s\n", logPath);
+  }
+}
+
+void destroyLatencyTracker(LatencyTracker& tracker)
+{
+  if(tracker.log)
+    fclose(tracker.log);
+}
+
+static void logFrame(LatencyTracker& tracker, const LatencyFrame& frame, double presentTime)
+{
+  if(!tracker.log)
+    return;
+
+  // Submit to present is left empty when we don't know it
+  if(presentTime > 0)
+    fprintf(tracker.log, "%llu,%.3f,%.3f\n", (unsigned long long)frame.frameIndex, frame.submitTime - frame.inputTime, presentTime - frame.submitTime);
+  else
+    fprintf(tracker.log, "%llu,%.3f,\n", (unsigned long long)frame.frameIndex, frame.submitTime - frame.inputTime);
+}
+
+uint64_t trackFrame(LatencyTracker& tracker, uint64_t frameIndex, double inputTime, double submitTime)
+{
+  tracker.inputToSubmit.push_back(float(submitTime - inputTime));
+
+  LatencyFrame frame = {};
+  frame.frameIndex = frameIndex;
+  frame.inputTime = inputTime;
+  frame.submitTime = submitTime;
+
+  if(!tracker.waitForPresent)
+  {
+    logFrame(tracker, frame, 0);
+    return 0;
+  }
+
+  frame.presentId = tracker.nextPresentId++;
+  tracker.pending.push_back(frame);
+
+  return frame.presentId;
+}
+
+// Presents complete in order, so we only ever have to look at the oldest
+static bool waitPresent(LatencyTracker& tracker, VkSwapchainKHR swapchain, uint64_t timeout)
+{
+  const LatencyFrame& frame = tracker.pending.front();
+
+  VkResult result = tracker.waitForPresent(tracker.device, swapchain, frame.presentId, timeout);
+  if(result == VK_TIMEOUT)
+    return false;
+
+  if(result == VK_SUCCESS)
+  {
+    double presentTime = getTimeMs();
+    tracker.submitToPresent.push_back(float(presentTime - frame.submitTime));
+    logFrame(tracker, frame, presentTime);
+  }
+  else
+  {
+    // Out of date or lost surface, the present will never be seen
+    tracker.presentsDropped++;
+    logFrame(tracker, frame, 0);
+  }
+
+  tracker.pending.pop_front();
+  return true;
+}
+
+void pollPresents(LatencyTracker& tracker, VkSwapchainKHR swapchain)
+{
+  if(!tracker.waitForPresent || !swapchain)
+    return;
+
+  while(!tracker.pending.empty() && waitPresent(tracker, swapchain, 0))
+    ;
+}
+
+void flushPresents(LatencyTracker& tracker, VkSwapchainKHR swapchain)
+{
+  if(!tracker.waitForPresent || !swapchain)
+    return;
+
+  while(!tracker.pending.empty())
+  {
+    if(!waitPresent(tracker, swapchain, kPresentFlushTimeout))
+    {
+      // A minimized window can hold presents back forever, the rest won't fare any better
+      tracker.presentsDropped += uint32_t(tracker.pending.size());
+      for(const LatencyFrame& frame : tracker.pending)
+        logFrame(tracker, frame, 0);
+
+      tracker.pending.clear();
+    }
+  }
+}
+
+static float averageSince(const std::vector<float>& samples, size_t& taken)
+{
+  if(taken == samples.size())
+    return 0;
+
+  float sum = 0;
+  for(size_t i = taken ; i < samples.size() ; i++)
+    sum += samples[i];
+
+  float average = sum / float(samples.size() - taken);
+  taken = samples.size();
+
+  return average;
+}
+
+void takeLatencyAverages(LatencyTracker& tracker, float& inputToSubmit, float& submitToPresent)
+{
+  inputToSubmit = averageSince(tracker.inputToSubmit, tracker.inputToSubmitTaken);
+  submitToPresent = averageSince(tracker.submitToPresent, tracker.submitToPresentTaken);
+}
+
+static void printLatencyLine(const char* name, const std::vector<float>& samples)
+{
+  if(samples.empty())
+    return;
+
+  std::vector<float> sorted = samples;
+  std::sort(sorted.begin(), sorted.end());
+
+  float sum = 0;
+  for(float sample : sorted)
+    sum += sample;
+
+  printf("  %-18s %8.2f %8.2f %8.2f %8.2f %8.2f\n", name, sum / float(sorted.size()), sorted[0], sorted[sorted.size() / 2], sorted[sorted.size() * 99 / 100], sorted.back());
+}
+
+void printLatencyReport(const LatencyTracker& tracker)
+{
+  if(tracker.inputToSubmit.empty())
+    return;
+
+  printf("Latency over %zu frames, ms:\n", tracker.inputToSubmit.size());
+  printf("  %-18s %8s %8s %8s %8s %8s\n", "", "avg", "min", "p50", "p99", "max");
+
+  printLatencyLine("input to submit", tracker.inputToSubmit);
+  printLatencyLine("submit to present", tracker.submitToPresent);
+
+  if(!tracker.waitForPresent)
+    printf("  submit to present needs VK_KHR_present_wait\n");
+  else if(tracker.presentsDropped)
+    printf("  %u presents never showed up\n", tracker.presentsDropped);
+}
+
+static void getProcessUsage(double& cpuTime, uint64_t& switches)
+{
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  cpuTime = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+  switches = uint64_t(usage.ru_nvcsw);
+}
+
+void createLoopStats(LoopStats& stats, const char* logPath)
+{
+  stats = {};
+  stats.sampleStart = stats.runStart = getTimeMs();
+  getProcessUsage(stats.sampleCpuTime, stats.sampleSwitches);
+  stats.runCpuTime = stats.sampleCpuTime;
+  stats.runSwitches = stats.sampleSwitches;
+
+  stats.log = NULL;
+  if(logPath)
+  {
+    stats.log = fopen(logPath, "w");
+    if(stats.log)
+      fprintf(stats.log, "time_s,fps,cpu_percent,wakeups_per_s,idle_percent\n");
+    else
+      printf("Can't open loop stats log %s\n", logPath);
+  }
+}
+
+void destroyLoopStats(LoopStats& stats)
+{
+  if(stats.log)
+    fclose(stats.log);
+  stats.log = NULL;
+}
+
+bool sampleLoopStats(LoopStats& stats)
+{
+  double now = getTimeMs();
+  double elapsed = now - stats.sampleStart;
+  if(elapsed < 1000.0)
+    return false;
+
+  double cpuTime;
+  uint64_t switches;
+  getProcessUsage(cpuTime, switches);
+
+  stats.cpuPercent = float((cpuTime - stats.sampleCpuTime) / elapsed * 100.0);
+  stats.wakeupsPerSecond = float((switches - stats.sampleSwitches) * 1000.0 / elapsed);
+
+  if(stats.log)
+    fprintf(stats.log, "%.3f,%.1f,%.2f,%.1f,%.1f\n", (now - stats.runStart) / 1000.0, (stats.frames - stats.sampleFrames) * 1000.0 / elapsed,
+      stats.cpuPercent, stats.wakeupsPerSecond, (stats.idleTime - stats.sampleIdleTime) / elapsed * 100.0);
+
+  stats.sampleStart = now;
+  stats.sampleCpuTime = cpuTime;
+  stats.sampleSwitches = switches;
+  stats.sampleFrames = stats.frames;
+  stats.sampleIdleTime = stats.idleTime;
+  return true;
+}
+
+void printLoopStats(const LoopStats& stats)
+{
+  double elapsed = getTimeMs() - stats.runStart;
+  if(elapsed <= 0)
+    return;
+
+  double cpuTime;
+  uint64_t switches;
+  getProcessUsage(cpuTime, switches);
+
+  printf("Loop: %.1f%% CPU, %.0f wakeups/s over %.1f s, %u frames, %.1f%% of the time idle on the event queue in %u waits\n",
+    (cpuTime - stats.runCpuTime) / elapsed * 100.0, (switches - stats.runSwitches) * 1000.0 / elapsed, elapsed / 1000.0,
+    stats.frames, stats.idleTime / elapsed * 100.0, stats.idleWaits);
+}
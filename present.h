@@ -0,0 +1,141 @@
+#pragma once
+
+#include "common.h"
+
+#include <deque>
+#include <vector>
+
+// What the user asked for, choosePresentMode turns it into a mode the surface has
+enum PresentPolicy
+{
+  PresentPolicy_Fifo, // Vsync, always supported, up to a swapchain's worth of frames queued
+  PresentPolicy_FifoRelaxed, // Vsync, but a late frame tears instead of waiting for the next vblank
+  PresentPolicy_Mailbox, // No tearing, the newest frame replaces whatever is waiting
+  PresentPolicy_Immediate, // Lowest latency, tears
+};
+
+bool parsePresentPolicy(const char* name, PresentPolicy& policy);
+const char* getPresentModeName(VkPresentModeKHR mode);
+
+// When the window gets a new frame
+enum RedrawPolicy
+{
+  RedrawPolicy_Always, // As fast as the present mode and --fps-limit let us
+  RedrawPolicy_OnChange, // Only after something changed what a frame would show, otherwise the loop sleeps on the event queue
+};
+
+bool parseRedrawPolicy(const char* name, RedrawPolicy& policy);
+
+// Falls back to the next best mode the surface supports, and to FIFO in the end since everyone has it
+VkPresentModeKHR choosePresentMode(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, PresentPolicy policy);
+
+// As few images as the mode can live with, every extra image can be another frame of queued latency
+uint32_t getSwapchainImageCount(const VkSurfaceCapabilitiesKHR& surfaceCaps, VkPresentModeKHR presentMode);
+
+// Paces the loop to a target rate. Instead of sleeping after a frame is submitted, it sleeps before input is
+// sampled, for as long as it can while still submitting on time, so the frame shows input that is as fresh
+// as possible. The time that needs is estimated from the last frames: it jumps up on a slow frame and comes
+// back down slowly. Sleeps overshoot, so the last stretch is spun, only as long as sleeps lately overshot by.
+struct FrameLimiter
+{
+  double interval; // ms, 0 doesn't limit
+  double nextSubmit; // getTimeMs() the next frame should be submitted by
+  double workEstimate; // ms from sampling input to submit
+  double oversleep; // ms, the most sleeps overshot by lately
+};
+
+struct LatencyTracker;
+
+void createFrameLimiter(FrameLimiter& limiter, float framesPerSecond);
+
+// Returns the time input sampling starts, right away if the limiter is off. Keeps polling the tracker's
+// presents while it sleeps.
+double waitForFrameStart(FrameLimiter& limiter, LatencyTracker& tracker, VkSwapchainKHR swapchain);
+
+// Call right after the submit with the time waitForFrameStart returned
+void endFrame(FrameLimiter& limiter, double inputTime, double submitTime);
+
+struct LatencyFrame
+{
+  uint64_t frameIndex;
+  uint64_t presentId;
+  double inputTime;
+  double submitTime;
+};
+
+// Input to submit is known as soon as we submit. Submit to present needs VK_KHR_present_wait: every present
+// gets an id, and the ids are polled without blocking from the render thread, since the swapchain can't be
+// used from two threads at once. So submit to present is only as exact as how often we poll, about once a
+// frame, or every half millisecond while the frame limiter sleeps.
+struct LatencyTracker
+{
+  VkDevice device;
+  PFN_vkWaitForPresentKHR waitForPresent; // NULL without present wait, submit to present isn't measured
+
+  uint64_t nextPresentId;
+  std::deque<LatencyFrame> pending; // Presented, but not on screen yet
+
+  // ms, one per frame for the whole run
+  std::vector<float> inputToSubmit;
+  std::vector<float> submitToPresent;
+
+  // Where takeLatencyAverages left off
+  size_t inputToSubmitTaken;
+  size_t submitToPresentTaken;
+
+  uint32_t presentsDropped;
+
+  FILE* log; // One CSV line per frame, NULL if not requested
+};
+
+void createLatencyTracker(LatencyTracker& tracker, VkDevice device, bool presentWait, const char* logPath);
+void destroyLatencyTracker(LatencyTracker& tracker);
+
+// Call after the submit. Returns the id to chain into the present with VkPresentIdKHR, 0 if presents aren't tracked.
+uint64_t trackFrame(LatencyTracker& tracker, uint64_t frameIndex, double inputTime, double submitTime);
+
+// Picks up every present that has made it to the screen, never blocks
+void pollPresents(LatencyTracker& tracker, VkSwapchainKHR swapchain);
+
+// Waits for the frames still in the queue, call before the swapchain goes away. Ids of an old swapchain mean
+// nothing to the new one, anything that doesn't show up within a few frames is dropped.
+void flushPresents(LatencyTracker& tracker, VkSwapchainKHR swapchain);
+
+// Averages since the last call, either is 0 if nothing was measured
+void takeLatencyAverages(LatencyTracker& tracker, float& inputToSubmit, float& submitToPresent);
+
+void printLatencyReport(const LatencyTracker& tracker);
+
+// What the loop costs the machine while it runs: CPU time of the whole process, every thread, against wall
+// time, and voluntary context switches, each one a thread that blocked and had to be woken up again. Read
+// from getrusage about once a second.
+struct LoopStats
+{
+  double sampleStart; // ms, the current sample started here
+  double sampleCpuTime; // ms of CPU time at sampleStart
+  uint64_t sampleSwitches;
+  uint32_t sampleFrames;
+  double sampleIdleTime;
+
+  float cpuPercent; // Last sample's, 100 is one core busy
+  float wakeupsPerSecond;
+
+  double runStart;
+  double runCpuTime;
+  uint64_t runSwitches;
+
+  uint32_t frames;
+  uint32_t idleWaits; // Times the loop slept on the event queue
+  double idleTime; // ms it spent there
+
+  FILE* log; // One CSV line per sample, NULL if not requested
+};
+
+void createLoopStats(LoopStats& stats, const char* logPath);
+void destroyLoopStats(LoopStats& stats);
+
+// Call every loop iteration. Returns true when a second or more went by and cpuPercent and wakeupsPerSecond
+// are new.
+bool sampleLoopStats(LoopStats& stats);
+
+void printLoopStats(const LoopStats& stats);
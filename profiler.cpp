@@ -0,0 +1,401 @@
+#include "profiler.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+const VkQueryPipelineStatisticFlags kProfilerStatistics =
+  VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+static const char* kProfilerStatisticNames[ProfilerStatistic_Count] =
+{
+  "input_vertices",
+  "input_primitives",
+  "vertex_invocations",
+  "clipping_invocations",
+  "clipping_primitives",
+  "fragment_invocations",
+};
+
+void createProfiler(Profiler& profiler, VkDevice device, VkPhysicalDevice physicalDevice, uint32_t familyIndex, uint32_t frameCount, bool enabled, const char* tracePath)
+{
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(physicalDevice, &props);
+
+  VkPhysicalDeviceFeatures features;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+
+  uint32_t queueCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, 0);
+  std::vector<VkQueueFamilyProperties> queues(queueCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, queues.data());
+  assert(familyIndex < queueCount);
+
+  uint32_t validBits = queues[familyIndex].timestampValidBits;
+
+  profiler.supported = validBits > 0;
+  profiler.statisticsSupported = profiler.supported && features.pipelineStatisticsQuery;
+  profiler.enabled = enabled && profiler.supported;
+  profiler.timestampPeriod = props.limits.timestampPeriod;
+  profiler.timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+  profiler.current = NULL;
+  profiler.activeStatistics = ~0u;
+  profiler.trace = NULL;
+  profiler.traceBase = 0;
+  profiler.traceBaseSet = false;
+  profiler.framesResolved = 0;
+  profiler.framesDropped = 0;
+
+  if(!profiler.supported)
+  {
+    if(enabled)
+      printf("Profiler: queue family %u can't write timestamps, GPU profiling is off\n", familyIndex);
+    return;
+  }
+
+  profiler.frames.resize(frameCount);
+  for(ProfilerFrame& frame : profiler.frames)
+  {
+    VkQueryPoolCreateInfo timestampInfo = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+    timestampInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    timestampInfo.queryCount = kProfilerMaxScopes * 2;
+    VK_CHECK(vkCreateQueryPool(device, &timestampInfo, 0, &frame.timestampPool));
+
+    frame.statisticsPool = VK_NULL_HANDLE;
+    if(profiler.statisticsSupported)
+    {
+      VkQueryPoolCreateInfo statisticsInfo = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+      statisticsInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+      statisticsInfo.queryCount = kProfilerMaxScopes;
+      statisticsInfo.pipelineStatistics = kProfilerStatistics;
+      VK_CHECK(vkCreateQueryPool(device, &statisticsInfo, 0, &frame.statisticsPool));
+    }
+
+    frame.scopes.reserve(kProfilerMaxScopes);
+    frame.statisticsCount = 0;
+    frame.frameNumber = 0;
+    frame.recorded = false;
+  }
+
+  profiler.results.resize(kProfilerMaxScopes * (2 + ProfilerStatistic_Count));
+
+  if(tracePath)
+  {
+    profiler.trace = fopen(tracePath, "w");
+    if(profiler.trace)
+    {
+      fprintf(profiler.trace, "[\n");
+      fprintf(profiler.trace, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"farvkr\"}},\n");
+      fprintf(profiler.trace, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"GPU\"}}");
+    }
+    else
+    {
+      printf("Profiler: can't open %s for writing\n", tracePath);
+    }
+  }
+
+  printf("Profiler: %s, timestamp period %.2f ns, %u valid bits, pipeline statistics %s\n", profiler.enabled ? "on" : "off",
+      profiler.timestampPeriod, validBits, profiler.statisticsSupported ? "on" : "unsupported");
+}
+
+void destroyProfiler(Profiler& profiler, VkDevice device)
+{
+  for(ProfilerFrame& frame : profiler.frames)
+  {
+    vkDestroyQueryPool(device, frame.timestampPool, 0);
+    if(frame.statisticsPool)
+      vkDestroyQueryPool(device, frame.statisticsPool, 0);
+  }
+  profiler.frames.clear();
+  profiler.current = NULL;
+
+  if(profiler.trace)
+  {
+    fprintf(profiler.trace, "\n]\n");
+    fclose(profiler.trace);
+    profiler.trace = NULL;
+  }
+}
+
+void setProfilerEnabled(Profiler& profiler, bool enabled)
+{
+  profiler.enabled = enabled && profiler.supported;
+}
+
+static ProfilerHistory& getProfilerHistory(Profiler& profiler, const char* name, uint32_t depth)
+{
+  for(ProfilerHistory& history : profiler.histories)
+  {
+    if(strcmp(history.name, name) == 0)
+      return history;
+  }
+
+  ProfilerHistory history = {};
+  history.name = name;
+  history.depth = depth;
+  profiler.histories.push_back(history);
+  return profiler.histories.back();
+}
+
+static void writeTraceEvent(Profiler& profiler, const ProfilerFrame& frame, const ProfilerScope& scope, uint64_t begin, double duration, const uint64_t* statistics)
+{
+  if(!profiler.traceBaseSet)
+  {
+    profiler.traceBase = begin;
+    profiler.traceBaseSet = true;
+  }
+
+  // Chrome trace wants microseconds
+  double timestamp = double(int64_t(begin - profiler.traceBase)) * profiler.timestampPeriod / 1000.0;
+
+  fprintf(profiler.trace, ",\n{\"name\":\"%s\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu",
+      scope.name, timestamp, duration * 1000.0, (unsigned long long)frame.frameNumber);
+
+  if(statistics)
+  {
+    for(uint32_t i = 0 ; i < ProfilerStatistic_Count ; i++)
+      fprintf(profiler.trace, ",\"%s\":%llu", kProfilerStatisticNames[i], (unsigned long long)statistics[i]);
+  }
+
+  fprintf(profiler.trace, "}}");
+}
+
+static void resolveProfilerFrame(Profiler& profiler, VkDevice device, ProfilerFrame& frame)
+{
+  frame.recorded = false;
+
+  uint32_t scopeCount = uint32_t(frame.scopes.size());
+  if(scopeCount == 0)
+    return;
+
+  uint64_t* timestamps = profiler.results.data();
+  uint64_t* statistics = timestamps + kProfilerMaxScopes * 2;
+
+  // No WAIT_BIT, the frame slot was already waited on so this is a plain copy. If it ever isn't ready we drop the frame rather than stall.
+  VkResult result = vkGetQueryPoolResults(device, frame.timestampPool, 0, scopeCount * 2, scopeCount * 2 * sizeof(uint64_t), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+  if(result == VK_SUCCESS && frame.statisticsCount)
+  {
+    size_t stride = ProfilerStatistic_Count * sizeof(uint64_t);
+    result = vkGetQueryPoolResults(device, frame.statisticsPool, 0, frame.statisticsCount, frame.statisticsCount * stride, statistics, stride, VK_QUERY_RESULT_64_BIT);
+  }
+
+  if(result == VK_NOT_READY)
+  {
+    profiler.framesDropped++;
+    return;
+  }
+  VK_CHECK(result);
+
+  for(const ProfilerScope& scope : frame.scopes)
+  {
+    uint64_t begin = timestamps[scope.timestampQuery] & profiler.timestampMask;
+    uint64_t end = timestamps[scope.timestampQuery + 1] & profiler.timestampMask;
+    double duration = double((end - begin) & profiler.timestampMask) * profiler.timestampPeriod / 1e6; // ms
+
+    const uint64_t* scopeStatistics = scope.statisticsQuery != ~0u ? statistics + scope.statisticsQuery * ProfilerStatistic_Count : NULL;
+
+    ProfilerHistory& history = getProfilerHistory(profiler, scope.name, scope.depth);
+    history.samples[history.next] = float(duration);
+    history.next = (history.next + 1) % kProfilerHistorySize;
+    history.count = std::min(history.count + 1, kProfilerHistorySize);
+
+    if(scopeStatistics)
+      memcpy(history.statistics, scopeStatistics, sizeof(history.statistics));
+
+    if(profiler.trace)
+      writeTraceEvent(profiler, frame, scope, begin, duration, scopeStatistics);
+  }
+
+  profiler.framesResolved++;
+}
+
+void beginProfilerFrame(Profiler& profiler, VkDevice device, VkCommandBuffer commandBuffer, uint32_t frameSlot, uint64_t frameNumber)
+{
+  profiler.current = NULL;
+
+  if(!profiler.supported)
+    return;
+
+  ProfilerFrame& frame = profiler.frames[frameSlot];
+
+  if(frame.recorded)
+    resolveProfilerFrame(profiler, device, frame);
+
+  if(!profiler.enabled)
+    return;
+
+  vkCmdResetQueryPool(commandBuffer, frame.timestampPool, 0, kProfilerMaxScopes * 2);
+  if(frame.statisticsPool)
+    vkCmdResetQueryPool(commandBuffer, frame.statisticsPool, 0, kProfilerMaxScopes);
+
+  frame.scopes.clear();
+  frame.statisticsCount = 0;
+  frame.frameNumber = frameNumber;
+  frame.recorded = true;
+
+  profiler.current = &frame;
+  profiler.scopeStack.clear();
+  profiler.activeStatistics = ~0u;
+}
+
+void beginProfilerScope(Profiler& profiler, VkCommandBuffer commandBuffer, const char* name)
+{
+  ProfilerFrame* frame = profiler.current;
+  if(!frame)
+    return;
+
+  if(frame->scopes.size() == kProfilerMaxScopes)
+  {
+    profiler.scopeStack.push_back(~0u);
+    return;
+  }
+
+  uint32_t index = uint32_t(frame->scopes.size());
+
+  ProfilerScope scope;
+  scope.name = name;
+  scope.depth = uint32_t(profiler.scopeStack.size());
+  scope.timestampQuery = index * 2;
+  scope.statisticsQuery = ~0u;
+
+  if(frame->statisticsPool && profiler.activeStatistics == ~0u)
+  {
+    scope.statisticsQuery = frame->statisticsCount++;
+    vkCmdBeginQuery(commandBuffer, frame->statisticsPool, scope.statisticsQuery, 0);
+    profiler.activeStatistics = index;
+  }
+
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame->timestampPool, scope.timestampQuery);
+
+  frame->scopes.push_back(scope);
+  profiler.scopeStack.push_back(index);
+}
+
+void endProfilerScope(Profiler& profiler, VkCommandBuffer commandBuffer)
+{
+  ProfilerFrame* frame = profiler.current;
+  if(!frame)
+    return;
+
+  assert(!profiler.scopeStack.empty());
+  uint32_t index = profiler.scopeStack.back();
+  profiler.scopeStack.pop_back();
+
+  if(index == ~0u)
+    return;
+
+  const ProfilerScope& scope = frame->scopes[index];
+
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame->timestampPool, scope.timestampQuery + 1);
+
+  if(profiler.activeStatistics == index)
+  {
+    vkCmdEndQuery(commandBuffer, frame->statisticsPool, scope.statisticsQuery);
+    profiler.activeStatistics = ~0u;
+  }
+}
+
+VkQueryPipelineStatisticFlags getProfilerActiveStatistics(const Profiler& profiler)
+{
+  return profiler.activeStatistics != ~0u ? kProfilerStatistics : 0;
+}
+
+void resolveProfilerFrames(Profiler& profiler, VkDevice device)
+{
+  profiler.current = NULL;
+
+  // Oldest first so the histories and the trace stay in frame order
+  for(;;)
+  {
+    ProfilerFrame* oldest = NULL;
+    for(ProfilerFrame& frame : profiler.frames)
+    {
+      if(frame.recorded && (!oldest || frame.frameNumber < oldest->frameNumber))
+        oldest = &frame;
+    }
+
+    if(!oldest)
+      break;
+
+    resolveProfilerFrame(profiler, device, *oldest);
+  }
+}
+
+float getProfilerAverage(const Profiler& profiler, const char* name)
+{
+  for(const ProfilerHistory& history : profiler.histories)
+  {
+    if(strcmp(history.name, name) != 0 || history.count == 0)
+      continue;
+
+    float sum = 0;
+    for(uint32_t i = 0 ; i < history.count ; i++)
+      sum += history.samples[i];
+    return sum / history.count;
+  }
+
+  return 0;
+}
+
+void printProfilerReport(const Profiler& profiler)
+{
+  if(profiler.histories.empty())
+    return;
+
+  printf("GPU profile, %u frames resolved, %u dropped, ms over the last %u frames:\n", profiler.framesResolved, profiler.framesDropped, kProfilerHistorySize);
+  printf("  %-24s %8s %8s %8s %8s %8s  histogram min..max\n", "scope", "avg", "min", "p50", "p95", "max");
+
+  const char kBars[] = " .:-=+*#%@";
+  const uint32_t kBuckets = 16;
+
+  for(const ProfilerHistory& history : profiler.histories)
+  {
+    if(history.count == 0)
+      continue;
+
+    float sorted[kProfilerHistorySize];
+    memcpy(sorted, history.samples, history.count * sizeof(float));
+    std::sort(sorted, sorted + history.count);
+
+    float sum = 0;
+    for(uint32_t i = 0 ; i < history.count ; i++)
+      sum += sorted[i];
+
+    float minTime = sorted[0];
+    float maxTime = sorted[history.count - 1];
+
+    uint32_t buckets[kBuckets] = {};
+    uint32_t peak = 0;
+    for(uint32_t i = 0 ; i < history.count ; i++)
+    {
+      uint32_t bucket = maxTime > minTime ? uint32_t((sorted[i] - minTime) / (maxTime - minTime) * (kBuckets - 1) + 0.5f) : 0;
+      peak = std::max(peak, ++buckets[bucket]);
+    }
+
+    char histogram[kBuckets + 1];
+    for(uint32_t i = 0 ; i < kBuckets ; i++)
+      histogram[i] = kBars[buckets[i] ? 1 + buckets[i] * (sizeof(kBars) - 3) / peak : 0];
+    histogram[kBuckets] = 0;
+
+    char name[64];
+    snprintf(name, sizeof(name), "%*s%s", int(history.depth * 2), "", history.name);
+
+    printf("  %-24s %8.3f %8.3f %8.3f %8.3f %8.3f  [%s]\n", name, sum / history.count, minTime,
+        sorted[history.count / 2], sorted[history.count * 95 / 100], maxTime, histogram);
+
+    const uint64_t* statistics = history.statistics;
+    if(statistics[ProfilerStatistic_InputVertices] || statistics[ProfilerStatistic_FragmentInvocations])
+    {
+      printf("  %-24s vertices %llu, primitives %llu, vs %llu, clipped %llu -> %llu, fs %llu\n", "",
+          (unsigned long long)statistics[ProfilerStatistic_InputVertices], (unsigned long long)statistics[ProfilerStatistic_InputPrimitives],
+          (unsigned long long)statistics[ProfilerStatistic_VertexInvocations], (unsigned long long)statistics[ProfilerStatistic_ClippingInvocations],
+          (unsigned long long)statistics[ProfilerStatistic_ClippingPrimitives], (unsigned long long)statistics[ProfilerStatistic_FragmentInvocations]);
+    }
+  }
+}
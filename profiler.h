@@ -0,0 +1,109 @@
+#pragma once
+
+#include "common.h"
+
+#include <string>
+#include <vector>
+
+const uint32_t kProfilerMaxScopes = 64; // Per frame, scopes past this are dropped
+const uint32_t kProfilerHistorySize = 256; // Samples kept per scope for the rolling histogram
+
+// Order matches the bit order of the flags the statistics pool is created with, which is the order results come back in
+enum ProfilerStatistic
+{
+  ProfilerStatistic_InputVertices,
+  ProfilerStatistic_InputPrimitives,
+  ProfilerStatistic_VertexInvocations,
+  ProfilerStatistic_ClippingInvocations,
+  ProfilerStatistic_ClippingPrimitives,
+  ProfilerStatistic_FragmentInvocations,
+
+  ProfilerStatistic_Count
+};
+
+struct ProfilerScope
+{
+  const char* name; // Must outlive the profiler, string literals in practice
+  uint32_t depth;
+  uint32_t timestampQuery; // Begin, end is the next query
+  uint32_t statisticsQuery; // ~0u if this scope has no statistics, they can't nest
+};
+
+// Queries for one frame slot. The slot is only reused after its timeline wait, so the results are always
+// ready by the time we look at them and reading them back never stalls.
+struct ProfilerFrame
+{
+  VkQueryPool timestampPool;
+  VkQueryPool statisticsPool;
+
+  std::vector<ProfilerScope> scopes;
+  uint32_t statisticsCount;
+
+  uint64_t frameNumber;
+  bool recorded; // Queries were written and still need resolving
+};
+
+// Rolling window of GPU times for one scope name
+struct ProfilerHistory
+{
+  const char* name;
+  uint32_t depth; // Nesting depth the first time we saw it, only used for indenting the report
+  float samples[kProfilerHistorySize]; // ms
+  uint32_t count;
+  uint32_t next;
+
+  uint64_t statistics[ProfilerStatistic_Count]; // From the latest frame
+};
+
+struct Profiler
+{
+  bool supported; // The queue can write timestamps
+  bool statisticsSupported;
+  bool enabled;
+
+  double timestampPeriod; // ns per tick
+  uint64_t timestampMask; // Only timestampValidBits of the result are meaningful
+
+  std::vector<ProfilerFrame> frames;
+  ProfilerFrame* current; // NULL when the frame being recorded isn't profiled
+
+  std::vector<uint32_t> scopeStack;
+  uint32_t activeStatistics; // Scope index owning the open statistics query, or ~0u
+
+  std::vector<ProfilerHistory> histories;
+
+  FILE* trace; // Chrome trace (chrome://tracing, Perfetto), NULL if not requested
+  uint64_t traceBase; // First timestamp we saw, trace times are relative to it
+  bool traceBaseSet;
+
+  uint32_t framesResolved;
+  uint32_t framesDropped; // Results weren't available, should never happen
+  std::vector<uint64_t> results; // Scratch for vkGetQueryPoolResults
+};
+
+void createProfiler(Profiler& profiler, VkDevice device, VkPhysicalDevice physicalDevice, uint32_t familyIndex, uint32_t frameCount, bool enabled, const char* tracePath);
+void destroyProfiler(Profiler& profiler, VkDevice device);
+
+// Takes effect from the next beginProfilerFrame, frames already in flight are still resolved
+void setProfilerEnabled(Profiler& profiler, bool enabled);
+
+// Call right after vkBeginCommandBuffer, once the frame slot's timeline wait is done. Resolves whatever the
+// slot recorded last time round and resets its queries.
+void beginProfilerFrame(Profiler& profiler, VkDevice device, VkCommandBuffer commandBuffer, uint32_t frameSlot, uint64_t frameNumber);
+
+// Scopes nest. Pipeline statistics are only collected for scopes that don't have a parent with statistics.
+void beginProfilerScope(Profiler& profiler, VkCommandBuffer commandBuffer, const char* name);
+void endProfilerScope(Profiler& profiler, VkCommandBuffer commandBuffer);
+
+// Flags of the statistics query open right now, 0 if there is none. Secondary command buffers executed
+// inside it have to inherit them.
+VkQueryPipelineStatisticFlags getProfilerActiveStatistics(const Profiler& profiler);
+
+// Waits for nothing, only resolves frames whose slot was already waited on. Call after vkDeviceWaitIdle
+// to pick up the last frames before printing the final report.
+void resolveProfilerFrames(Profiler& profiler, VkDevice device);
+
+// Average GPU time of a scope over the rolling window, 0 if unknown
+float getProfilerAverage(const Profiler& profiler, const char* name);
+
+void printProfilerReport(const Profiler& profiler);
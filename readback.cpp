@@ -0,0 +1,361 @@
+#include "readback.h"
+
+#include "sync.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+bool parseImageFileFormat(const char* name, ImageFileFormat& format)
+{
+  if(strcmp(name, "none") == 0)
+    format = ImageFileFormat_None;
+  else if(strcmp(name, "raw") == 0)
+    format = ImageFileFormat_Raw;
+  else if(strcmp(name, "ppm") == 0)
+    format = ImageFileFormat_PPM;
+  else if(strcmp(name, "png") == 0)
+    format = ImageFileFormat_PNG;
+  else
+    return false;
+
+  return true;
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+  static uint32_t table[256];
+  static bool tableReady = false;
+
+  // Only the writer thread gets here
+  if(!tableReady)
+  {
+    for(uint32_t i = 0 ; i < 256 ; i++)
+    {
+      uint32_t c = i;
+      for(int k = 0 ; k < 8 ; k++)
+        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+    tableReady = true;
+  }
+
+  crc = ~crc;
+  for(size_t i = 0 ; i < size ; i++)
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+static void appendU32BE(std::vector<uint8_t>& out, uint32_t value)
+{
+  out.push_back(uint8_t(value >> 24));
+  out.push_back(uint8_t(value >> 16));
+  out.push_back(uint8_t(value >> 8));
+  out.push_back(uint8_t(value));
+}
+
+static void appendPngChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size)
+{
+  appendU32BE(out, uint32_t(size));
+
+  size_t typeOffset = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data, data + size);
+
+  appendU32BE(out, crc32(0, out.data() + typeOffset, size + 4));
+}
+
+// PNG with stored (uncompressed) deflate blocks. Files are big but encoding costs about a memcpy,
+// which is what we want when the point is to keep up with the GPU. Recompress offline if size matters.
+static void encodePng(std::vector<uint8_t>& out, const uint8_t* rgba, uint32_t width, uint32_t height)
+{
+  static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  out.insert(out.end(), signature, signature + 8);
+
+  uint8_t header[13] = {};
+  header[0] = uint8_t(width >> 24); header[1] = uint8_t(width >> 16); header[2] = uint8_t(width >> 8); header[3] = uint8_t(width);
+  header[4] = uint8_t(height >> 24); header[5] = uint8_t(height >> 16); header[6] = uint8_t(height >> 8); header[7] = uint8_t(height);
+  header[8] = 8; // Bit depth
+  header[9] = 2; // RGB
+  appendPngChunk(out, "IHDR", header, sizeof(header));
+
+  // Every row starts with filter type 0
+  size_t rowSize = 1 + size_t(width) * 3;
+  std::vector<uint8_t> raw(rowSize * height);
+  for(uint32_t y = 0 ; y < height ; y++)
+  {
+    uint8_t* row = &raw[y * rowSize];
+    const uint8_t* src = rgba + size_t(y) * width * 4;
+    row[0] = 0;
+    for(uint32_t x = 0 ; x < width ; x++)
+    {
+      row[1 + x * 3 + 0] = src[x * 4 + 0];
+      row[1 + x * 3 + 1] = src[x * 4 + 1];
+      row[1 + x * 3 + 2] = src[x * 4 + 2];
+    }
+  }
+
+  std::vector<uint8_t> zlib;
+  zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+  zlib.push_back(0x78);
+  zlib.push_back(0x01);
+
+  // Stored blocks hold at most 65535 bytes each
+  size_t offset = 0;
+  do
+  {
+    size_t blockSize = std::min(raw.size() - offset, size_t(65535));
+    bool last = offset + blockSize == raw.size();
+
+    zlib.push_back(last ? 1 : 0);
+    zlib.push_back(uint8_t(blockSize));
+    zlib.push_back(uint8_t(blockSize >> 8));
+    zlib.push_back(uint8_t(~blockSize));
+    zlib.push_back(uint8_t(~blockSize >> 8));
+    zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+
+    offset += blockSize;
+  } while(offset < raw.size());
+
+  uint32_t a = 1, b = 0;
+  for(size_t i = 0 ; i < raw.size() ; i++)
+  {
+    a = (a + raw[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  appendU32BE(zlib, (b << 16) | a);
+
+  appendPngChunk(out, "IDAT", zlib.data(), zlib.size());
+  appendPngChunk(out, "IEND", 0, 0);
+}
+
+static size_t writeImageFile(const ReadbackRing& ring, const ReadbackSlot& slot, std::vector<uint8_t>& scratch)
+{
+  const uint8_t* rgba = static_cast<const uint8_t*>(slot.buffer.data);
+  size_t pixelCount = size_t(ring.width) * ring.height;
+
+  const char* extension = ring.format == ImageFileFormat_Raw ? "rgba" : ring.format == ImageFileFormat_PPM ? "ppm" : "png";
+
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/frame_%05u.%s", ring.outputDirectory.c_str(), slot.frameNumber, extension);
+
+  FILE* file = fopen(path, "wb");
+  if(!file)
+  {
+    printf("Readback: can't open %s for writing\n", path);
+    return 0;
+  }
+
+  size_t written = 0;
+
+  if(ring.format == ImageFileFormat_Raw)
+  {
+    written = fwrite(rgba, 1, pixelCount * 4, file);
+  }
+  else if(ring.format == ImageFileFormat_PPM)
+  {
+    scratch.resize(pixelCount * 3);
+    for(size_t i = 0 ; i < pixelCount ; i++)
+    {
+      scratch[i * 3 + 0] = rgba[i * 4 + 0];
+      scratch[i * 3 + 1] = rgba[i * 4 + 1];
+      scratch[i * 3 + 2] = rgba[i * 4 + 2];
+    }
+
+    written = size_t(fprintf(file, "P6\n%u %u\n255\n", ring.width, ring.height));
+    written += fwrite(scratch.data(), 1, scratch.size(), file);
+  }
+  else
+  {
+    scratch.clear();
+    encodePng(scratch, rgba, ring.width, ring.height);
+    written = fwrite(scratch.data(), 1, scratch.size(), file);
+  }
+
+  fclose(file);
+
+  return written;
+}
+
+static void writerThread(ReadbackRing* ring)
+{
+  std::vector<uint8_t> scratch;
+
+  for(;;)
+  {
+    uint32_t slotIndex;
+    {
+      std::unique_lock<std::mutex> lock(ring->mutex);
+      ring->cond.wait(lock, [&]() { return ring->stop || !ring->queue.empty(); });
+
+      // Only exit once everything queued has been written
+      if(ring->queue.empty())
+        return;
+
+      slotIndex = ring->queue.front();
+      ring->queue.pop_front();
+    }
+
+    double start = getTimeMs();
+    size_t written = writeImageFile(*ring, ring->slots[slotIndex], scratch);
+    double ms = getTimeMs() - start;
+
+    {
+      std::lock_guard<std::mutex> lock(ring->mutex);
+      ring->slots[slotIndex].busy = false;
+      ring->framesWritten++;
+      ring->bytesWritten += written;
+      ring->writeTime += ms;
+    }
+    ring->cond.notify_all();
+  }
+}
+
+void createReadbackRing(ReadbackRing& ring, VkDevice device, MemoryAllocator& allocator, uint32_t slotCount, uint32_t width, uint32_t height, ImageFileFormat format, const char* outputDirectory)
+{
+  ring.slots.resize(slotCount);
+  ring.next = 0;
+  ring.width = width;
+  ring.height = height;
+  ring.format = format;
+  ring.outputDirectory = outputDirectory;
+  ring.stop = false;
+  ring.framesRead = ring.framesWritten = 0;
+  ring.bytesWritten = 0;
+  ring.writeTime = 0;
+
+  for(ReadbackSlot& slot : ring.slots)
+  {
+    // Cached memory makes the CPU reads in the writer a lot faster, uncached reads are painfully slow on most GPUs
+    createBuffer(slot.buffer, device, allocator, size_t(width) * height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    assert(slot.buffer.data);
+
+    slot.frameNumber = 0;
+    slot.timelineValue = 0;
+    slot.pending = false;
+    slot.busy = false;
+  }
+
+  if(format != ImageFileFormat_None)
+    ring.writer = std::thread(writerThread, &ring);
+}
+
+void destroyReadbackRing(ReadbackRing& ring, VkDevice device, MemoryAllocator& allocator)
+{
+  {
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    ring.stop = true;
+  }
+  ring.cond.notify_all();
+
+  if(ring.writer.joinable())
+    ring.writer.join();
+
+  for(ReadbackSlot& slot : ring.slots)
+    destroyBuffer(slot.buffer, device, allocator);
+
+  ring.slots.clear();
+}
+
+static void handOffReadback(ReadbackRing& ring, uint32_t slotIndex, VkDevice device)
+{
+  ReadbackSlot& slot = ring.slots[slotIndex];
+
+  invalidateBuffer(slot.buffer, device);
+
+  slot.pending = false;
+  ring.framesRead++;
+
+  if(ring.format == ImageFileFormat_None)
+  {
+    slot.busy = false;
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    ring.queue.push_back(slotIndex);
+  }
+  ring.cond.notify_all();
+}
+
+uint32_t acquireReadbackSlot(ReadbackRing& ring, VkDevice device, VkSemaphore timeline)
+{
+  uint32_t slotIndex = ring.next;
+  ring.next = (ring.next + 1) % ring.slots.size();
+
+  ReadbackSlot& slot = ring.slots[slotIndex];
+
+  // The ring is normally deep enough that this was handed off by pollReadbacks already
+  if(slot.pending)
+  {
+    waitTimelineSemaphore(device, timeline, slot.timelineValue);
+    handOffReadback(ring, slotIndex, device);
+  }
+
+  std::unique_lock<std::mutex> lock(ring.mutex);
+  ring.cond.wait(lock, [&]() { return !slot.busy; });
+
+  return slotIndex;
+}
+
+void recordReadback(ReadbackRing& ring, uint32_t slotIndex, VkCommandBuffer commandBuffer, VkImage image)
+{
+  ReadbackSlot& slot = ring.slots[slotIndex];
+
+  VkBufferImageCopy region = {};
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.layerCount = 1;
+  region.imageExtent = { ring.width, ring.height, 1 };
+
+  vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer.buffer, 1, &region);
+
+  // Make the copy visible to the host once the timeline says the submit is done
+  VkBufferMemoryBarrier copyBarrier = bufferBarrier(slot.buffer.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT);
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, 0, 1, &copyBarrier, 0, 0);
+}
+
+void submitReadback(ReadbackRing& ring, uint32_t slotIndex, uint32_t frameNumber, uint64_t timelineValue)
+{
+  ReadbackSlot& slot = ring.slots[slotIndex];
+
+  slot.frameNumber = frameNumber;
+  slot.timelineValue = timelineValue;
+  slot.pending = true;
+  slot.busy = true;
+}
+
+void pollReadbacks(ReadbackRing& ring, VkDevice device, VkSemaphore timeline)
+{
+  uint64_t completed = getTimelineSemaphoreValue(device, timeline);
+
+  // Hand off in submission order so the writer sees frames in order
+  for(size_t i = 0 ; i < ring.slots.size() ; i++)
+  {
+    uint32_t slotIndex = uint32_t((ring.next + i) % ring.slots.size());
+    ReadbackSlot& slot = ring.slots[slotIndex];
+
+    if(slot.pending && slot.timelineValue <= completed)
+      handOffReadback(ring, slotIndex, device);
+  }
+}
+
+void finishReadbacks(ReadbackRing& ring, VkDevice device, VkSemaphore timeline)
+{
+  uint64_t last = 0;
+  for(ReadbackSlot& slot : ring.slots)
+    if(slot.pending)
+      last = std::max(last, slot.timelineValue);
+
+  waitTimelineSemaphore(device, timeline, last);
+  pollReadbacks(ring, device, timeline);
+
+  std::unique_lock<std::mutex> lock(ring.mutex);
+  ring.cond.wait(lock, [&]()
+  {
+    for(ReadbackSlot& slot : ring.slots)
+      if(slot.busy)
+        return false;
+    return true;
+  });
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "resources.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum ImageFileFormat
+{
+  ImageFileFormat_None, // Read back but don't write, measures the GPU and copy side only
+  ImageFileFormat_Raw,
+  ImageFileFormat_PPM,
+  ImageFileFormat_PNG,
+};
+
+// Returns false if the name isn't one of none/raw/ppm/png
+bool parseImageFileFormat(const char* name, ImageFileFormat& format);
+
+struct ReadbackSlot
+{
+  Buffer buffer; // Host visible and persistently mapped, the GPU copies a finished frame in here
+
+  uint32_t frameNumber;
+  uint64_t timelineValue; // The copy is done once the frame timeline reaches this
+
+  bool pending; // Copy recorded, GPU may still be writing
+  bool busy; // Pending or still owned by the writer thread
+};
+
+// Ring of staging buffers that finished frames are copied into. Once the GPU is done with a copy the slot is
+// handed to a writer thread, so neither the queue nor the render loop waits on file IO unless the writer
+// falls a whole ring behind.
+struct ReadbackRing
+{
+  std::vector<ReadbackSlot> slots;
+  uint32_t next;
+
+  uint32_t width, height; // RGBA8 pixels
+
+  ImageFileFormat format;
+  std::string outputDirectory;
+
+  std::thread writer;
+  std::mutex mutex;
+  std::condition_variable cond; // Signaled when a slot is queued for writing or freed
+  std::deque<uint32_t> queue;
+  bool stop;
+
+  uint32_t framesRead;
+  uint32_t framesWritten;
+  uint64_t bytesWritten;
+  double writeTime; // ms spent in the writer thread
+};
+
+void createReadbackRing(ReadbackRing& ring, VkDevice device, MemoryAllocator& allocator, uint32_t slotCount, uint32_t width, uint32_t height, ImageFileFormat format, const char* outputDirectory);
+void destroyReadbackRing(ReadbackRing& ring, VkDevice device, MemoryAllocator& allocator);
+
+// Returns a free slot to copy the next frame into. Only blocks if the writer is a whole ring behind.
+uint32_t acquireReadbackSlot(ReadbackRing& ring, VkDevice device, VkSemaphore timeline);
+
+// Records the copy of an RGBA8 image in TRANSFER_SRC_OPTIMAL layout into the slot
+void recordReadback(ReadbackRing& ring, uint32_t slotIndex, VkCommandBuffer commandBuffer, VkImage image);
+
+// Call after the submit that contains the copy, timelineValue is what that submit signals
+void submitReadback(ReadbackRing& ring, uint32_t slotIndex, uint32_t frameNumber, uint64_t timelineValue);
+
+// Hands every copy the GPU has finished to the writer thread without waiting
+void pollReadbacks(ReadbackRing& ring, VkDevice device, VkSemaphore timeline);
+
+// Waits for the GPU and the writer to finish everything that was submitted
+void finishReadbacks(ReadbackRing& ring, VkDevice device, VkSemaphore timeline);
@@ -0,0 +1,113 @@
+#include "recorder.h"
+
+#include <algorithm>
+
+void createDrawRecorder(DrawRecorder& recorder, VkDevice device, VkPhysicalDevice physicalDevice, uint32_t familyIndex, uint32_t frameCount, uint32_t threadCount)
+{
+  VkPhysicalDeviceFeatures features;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+
+  recorder.threadCount = threadCount;
+  recorder.frameCount = frameCount;
+  recorder.inheritedQueries = features.inheritedQueries;
+
+  recorder.threads.resize(frameCount * threadCount);
+  for(RecorderThread& thread : recorder.threads)
+  {
+    // Reset as a whole once per frame, individual command buffers are never reset
+    VkCommandPoolCreateInfo createInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+    createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    createInfo.queueFamilyIndex = familyIndex;
+    VK_CHECK(vkCreateCommandPool(device, &createInfo, 0, &thread.commandPool));
+
+    thread.used = 0;
+  }
+}
+
+void destroyDrawRecorder(DrawRecorder& recorder, VkDevice device)
+{
+  // Destroying the pool frees its command buffers
+  for(RecorderThread& thread : recorder.threads)
+    vkDestroyCommandPool(device, thread.commandPool, 0);
+
+  recorder.threads.clear();
+  recorder.secondaries.clear();
+}
+
+uint32_t getSecondaryCount(const DrawRecorder& recorder, size_t drawCount)
+{
+  size_t count = (drawCount + kMinDrawsPerSecondary - 1) / kMinDrawsPerSecondary;
+  return uint32_t(std::clamp(count, size_t(1), size_t(recorder.threadCount)));
+}
+
+static VkCommandBuffer getSecondary(RecorderThread& thread, VkDevice device)
+{
+  if(thread.used == thread.commandBuffers.size())
+  {
+    VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+    allocateInfo.commandPool = thread.commandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocateInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer = 0;
+    VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer));
+    thread.commandBuffers.push_back(commandBuffer);
+  }
+
+  return thread.commandBuffers[thread.used++];
+}
+
+void recordSecondaryDraws(DrawRecorder& recorder, WorkerPool& workers, VkDevice device, uint32_t frameSlot, VkRenderPass renderPass, VkFramebuffer framebuffer, uint32_t width, uint32_t height, VkPipeline pipeline, const BindlessHeap& heap, const GpuMesh& mesh, const MeshTextureConstants& textures, const MeshDraw* draws, size_t drawCount, MeshDrawData drawData, TransientAllocator* transient, VkQueryPipelineStatisticFlags statistics)
+{
+  assert(frameSlot < recorder.frameCount);
+  assert(getWorkerThreadCount(workers) <= recorder.threadCount);
+  assert(!statistics || recorder.inheritedQueries);
+
+  RecorderThread* threads = &recorder.threads[frameSlot * recorder.threadCount];
+
+  for(uint32_t i = 0 ; i < recorder.threadCount ; i++)
+  {
+    VK_CHECK(vkResetCommandPool(device, threads[i].commandPool, 0));
+    threads[i].used = 0;
+  }
+
+  uint32_t secondaryCount = getSecondaryCount(recorder, drawCount);
+  size_t drawsPerSecondary = (drawCount + secondaryCount - 1) / secondaryCount;
+
+  recorder.secondaries.resize(secondaryCount);
+
+  parallelFor(workers, secondaryCount, [&](uint32_t taskIndex, uint32_t threadIndex)
+  {
+    VkCommandBuffer commandBuffer = getSecondary(threads[threadIndex], device);
+
+    VkCommandBufferInheritanceInfo inheritanceInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = framebuffer;
+    inheritanceInfo.pipelineStatistics = statistics;
+
+    VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+    // Dynamic state isn't inherited from the primary
+    VkViewport viewport = { 0, float(height), float(width), -float(height), 0, 1 };
+    VkRect2D scissor = {};
+    scissor.extent.width = width;
+    scissor.extent.height = height;
+
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    bindBindlessHeap(heap, commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+
+    size_t begin = std::min(taskIndex * drawsPerSecondary, drawCount);
+    size_t end = std::min(begin + drawsPerSecondary, drawCount);
+    recordDrawMesh(commandBuffer, heap.layout, mesh, textures, draws + begin, end - begin, uint32_t(begin), drawData, transient);
+
+    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+    recorder.secondaries[taskIndex] = commandBuffer;
+  }, "record draws");
+}
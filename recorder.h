@@ -0,0 +1,38 @@
+#pragma once
+
+#include "bindless.h"
+#include "mesh.h"
+#include "workers.h"
+
+const uint32_t kMinDrawsPerSecondary = 64; // Below this a secondary costs more than it saves
+
+// Command pool and the secondaries allocated from it for one thread in one frame slot. Pools aren't thread
+// safe, so every thread records from its own, and the slot's timeline wait tells us when it can be reset.
+struct RecorderThread
+{
+  VkCommandPool commandPool;
+  std::vector<VkCommandBuffer> commandBuffers;
+  uint32_t used; // Handed out since the last reset
+};
+
+// Records the scene's draws into secondary command buffers across a worker pool, executed from the primary
+// with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+struct DrawRecorder
+{
+  uint32_t threadCount;
+  uint32_t frameCount;
+  bool inheritedQueries; // Secondaries can run inside the profiler's statistics query
+
+  std::vector<RecorderThread> threads; // frameCount * threadCount
+  std::vector<VkCommandBuffer> secondaries; // From the last recordSecondaryDraws, in draw order
+};
+
+void createDrawRecorder(DrawRecorder& recorder, VkDevice device, VkPhysicalDevice physicalDevice, uint32_t familyIndex, uint32_t frameCount, uint32_t threadCount);
+void destroyDrawRecorder(DrawRecorder& recorder, VkDevice device);
+
+// Number of secondaries the draws would be split into, 1 means recording them inline is the better deal
+uint32_t getSecondaryCount(const DrawRecorder& recorder, size_t drawCount);
+
+// Resets the frame slot's pools and records the draws split across the pool into recorder.secondaries.
+// The secondaries inherit statistics, the flags of the query open in the primary or 0.
+void recordSecondaryDraws(DrawRecorder& recorder, WorkerPool& workers, VkDevice device, uint32_t frameSlot, VkRenderPass renderPass, VkFramebuffer framebuffer, uint32_t width, uint32_t height, VkPipeline pipeline, const BindlessHeap& heap, const GpuMesh& mesh, const MeshTextureConstants& textures, const MeshDraw* draws, size_t drawCount, MeshDrawData drawData, TransientAllocator* transient, VkQueryPipelineStatisticFlags statistics);
@@ -0,0 +1,722 @@
+#include "rendergraph.h"
+
+#include <algorithm>
+
+struct RenderUsageInfo
+{
+  VkPipelineStageFlags2KHR stages;
+  VkAccessFlags2KHR access;
+  VkImageLayout layout; // Images only
+  bool read; // Depends on what was there before, attachments count since they may load or blend
+  bool write;
+};
+
+// Only stages and access that also exist in the original flags, so the vkCmdPipelineBarrier fallback can use them as they are
+static const RenderUsageInfo kRenderUsages[RenderUsage_Count] =
+{
+  // None
+  { VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_UNDEFINED, false, false },
+  // ColorAttachment
+  { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true, true },
+  // DepthAttachment
+  { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT_KHR | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true, true },
+  // SampledFragment
+  { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true, false },
+  // SampledCompute
+  { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true, false },
+  // StorageReadVertex
+  { VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR, VK_IMAGE_LAYOUT_GENERAL, true, false },
+  // StorageReadCompute
+  { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR, VK_IMAGE_LAYOUT_GENERAL, true, false },
+  // StorageWriteCompute
+  { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_GENERAL, true, true },
+  // StorageWriteFragment
+  { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_GENERAL, true, true },
+  // IndirectRead
+  { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT_KHR, VK_IMAGE_LAYOUT_UNDEFINED, true, false },
+  // TransferRead
+  { VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, true, false },
+  // TransferWrite
+  { VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, false, true },
+  // Present, the semaphore the present waits on takes care of the rest
+  { VK_PIPELINE_STAGE_2_NONE_KHR, VK_ACCESS_2_NONE_KHR, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, true, false },
+  // HostRead, the host waits on the frame timeline before it looks
+  { VK_PIPELINE_STAGE_2_HOST_BIT_KHR, VK_ACCESS_2_HOST_READ_BIT_KHR, VK_IMAGE_LAYOUT_UNDEFINED, true, false },
+};
+
+// Only writes have to be made available, reads just have to be waited for
+static const VkAccessFlags2KHR kWriteAccess = VK_ACCESS_2_SHADER_WRITE_BIT_KHR | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR | VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR | VK_ACCESS_2_MEMORY_WRITE_BIT_KHR;
+
+void createRenderGraph(RenderGraph& graph, VkDevice device, const MemoryAllocator& allocator, bool synchronization2, DeletionQueue& deletions)
+{
+  graph.device = device;
+  graph.allocator = &allocator;
+  graph.deletions = &deletions;
+  graph.pipelineBarrier2 = synchronization2 ? (PFN_vkCmdPipelineBarrier2KHR)vkGetDeviceProcAddr(device, "vkCmdPipelineBarrier2KHR") : NULL;
+  graph.capture = NULL;
+
+  graph.transientMemory = VK_NULL_HANDLE;
+  graph.transientMemorySize = 0;
+  graph.finalBatch = ~0u;
+  graph.stats = {};
+}
+
+static void destroyTransients(RenderGraph& graph)
+{
+  for(RenderTransient& transient : graph.transients)
+  {
+    vkDestroyImageView(graph.device, transient.imageView, 0);
+    vkDestroyImage(graph.device, transient.image, 0);
+  }
+
+  graph.transients.clear();
+
+  if(graph.transientMemory)
+    vkFreeMemory(graph.device, graph.transientMemory, 0);
+
+  graph.transientMemory = VK_NULL_HANDLE;
+  graph.transientMemorySize = 0;
+}
+
+// Like destroyTransients, once the frame timeline gets to lastUseValue
+static void retireTransients(RenderGraph& graph, uint64_t lastUseValue)
+{
+  for(RenderTransient& transient : graph.transients)
+  {
+    deferDeletion(*graph.deletions, VK_OBJECT_TYPE_IMAGE_VIEW, (uint64_t)transient.imageView, lastUseValue);
+    deferDeletion(*graph.deletions, VK_OBJECT_TYPE_IMAGE, (uint64_t)transient.image, lastUseValue);
+  }
+
+  graph.transients.clear();
+
+  deferDeletion(*graph.deletions, VK_OBJECT_TYPE_DEVICE_MEMORY, (uint64_t)graph.transientMemory, lastUseValue);
+
+  graph.transientMemory = VK_NULL_HANDLE;
+  graph.transientMemorySize = 0;
+}
+
+void destroyRenderGraph(RenderGraph& graph)
+{
+  destroyTransients(graph);
+}
+
+void beginRenderGraph(RenderGraph& graph)
+{
+  graph.passes.clear();
+  graph.resources.clear();
+}
+
+static RenderResource addResource(RenderGraph& graph, const char* name, bool isImage, bool imported)
+{
+  RenderGraphResource resource = {};
+  resource.name = name;
+  resource.isImage = isImage;
+  resource.imported = imported;
+  resource.transient = ~0u;
+
+  graph.resources.push_back(resource);
+  return RenderResource(graph.resources.size() - 1);
+}
+
+RenderResource importImage(RenderGraph& graph, const char* name, VkImage image, VkImageView imageView, VkImageAspectFlags aspect, RenderUsage previousUsage, bool discard)
+{
+  // Without a previous usage there's no layout to keep the contents in
+  assert(discard || previousUsage != RenderUsage_None);
+
+  RenderResource index = addResource(graph, name, true, true);
+  RenderGraphResource& resource = graph.resources[index];
+  resource.image = image;
+  resource.imageView = imageView;
+  resource.desc.aspect = aspect;
+  resource.previousUsage = previousUsage;
+  resource.discard = discard;
+
+  return index;
+}
+
+RenderResource importBuffer(RenderGraph& graph, const char* name, VkBuffer buffer, RenderUsage previousUsage)
+{
+  RenderResource index = addResource(graph, name, false, true);
+  RenderGraphResource& resource = graph.resources[index];
+  resource.buffer = buffer;
+  resource.previousUsage = previousUsage;
+
+  return index;
+}
+
+RenderResource createTransientImage(RenderGraph& graph, const char* name, const RenderImageDesc& desc)
+{
+  assert(desc.mipLevels > 0);
+
+  RenderResource index = addResource(graph, name, true, false);
+  RenderGraphResource& resource = graph.resources[index];
+  resource.desc = desc;
+  resource.discard = true;
+
+  return index;
+}
+
+void setRenderGraphOutput(RenderGraph& graph, RenderResource resource, RenderUsage finalUsage)
+{
+  // Transients are gone after the graph, nothing can look at them
+  assert(graph.resources[resource].imported);
+  assert(finalUsage == RenderUsage_None || graph.resources[resource].isImage == (finalUsage != RenderUsage_HostRead));
+
+  graph.resources[resource].output = true;
+  graph.resources[resource].finalUsage = finalUsage;
+}
+
+uint32_t addRenderGraphPass(RenderGraph& graph, const char* name, const RenderPassCallback& record, bool sideEffects)
+{
+  RenderGraphPass pass;
+  pass.name = name;
+  pass.record = record;
+  pass.sideEffects = sideEffects;
+  pass.culled = false;
+  pass.barrierBatch = ~0u;
+
+  graph.passes.push_back(std::move(pass));
+  return uint32_t(graph.passes.size() - 1);
+}
+
+void useRenderResource(RenderGraph& graph, uint32_t pass, RenderResource resource, RenderUsage usage)
+{
+  assert(usage != RenderUsage_None && usage != RenderUsage_Present && usage != RenderUsage_HostRead);
+  assert(!graph.resources[resource].isImage || usage != RenderUsage_IndirectRead);
+  assert(graph.resources[resource].isImage || (usage != RenderUsage_ColorAttachment && usage != RenderUsage_DepthAttachment && usage != RenderUsage_SampledFragment && usage != RenderUsage_SampledCompute));
+
+  graph.passes[pass].accesses.push_back({ resource, usage });
+}
+
+VkImage getRenderGraphImage(const RenderGraph& graph, RenderResource resource)
+{
+  return graph.resources[resource].image;
+}
+
+VkImageView getRenderGraphImageView(const RenderGraph& graph, RenderResource resource)
+{
+  return graph.resources[resource].imageView;
+}
+
+// Back to front: a pass stays if it has side effects or writes something a later pass or the outside reads
+static void cullPasses(RenderGraph& graph)
+{
+  std::vector<bool> needed(graph.resources.size());
+  for(size_t i = 0 ; i < graph.resources.size() ; i++)
+    needed[i] = graph.resources[i].output;
+
+  for(size_t i = graph.passes.size() ; i-- > 0 ; )
+  {
+    RenderGraphPass& pass = graph.passes[i];
+
+    bool live = pass.sideEffects;
+    for(const RenderGraphAccess& access : pass.accesses)
+      live = live || (kRenderUsages[access.usage].write && needed[access.resource]);
+
+    pass.culled = !live;
+    if(!live)
+      continue;
+
+    for(const RenderGraphAccess& access : pass.accesses)
+    {
+      if(kRenderUsages[access.usage].read)
+        needed[access.resource] = true;
+    }
+  }
+}
+
+static bool isSameTransient(const RenderTransient& a, const RenderTransient& b)
+{
+  return a.desc.format == b.desc.format && a.desc.width == b.desc.width && a.desc.height == b.desc.height && a.desc.mipLevels == b.desc.mipLevels && a.desc.usage == b.desc.usage && a.desc.aspect == b.desc.aspect
+    && a.firstPass == b.firstPass && a.lastPass == b.lastPass;
+}
+
+static bool isLifetimeOverlapping(const RenderTransient& a, const RenderTransient& b)
+{
+  return a.firstPass <= b.lastPass && b.firstPass <= a.lastPass;
+}
+
+static bool isMemoryOverlapping(const RenderTransient& a, const RenderTransient& b)
+{
+  return a.offset < b.offset + b.requirements.size && b.offset < a.offset + a.requirements.size;
+}
+
+// Biggest first, each at the lowest offset that doesn't collide with anything alive at the same time
+static void placeTransients(RenderGraph& graph)
+{
+  std::vector<uint32_t> order(graph.transients.size());
+  for(uint32_t i = 0 ; i < order.size() ; i++)
+    order[i] = i;
+
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return graph.transients[a].requirements.size > graph.transients[b].requirements.size; });
+
+  VkMemoryRequirements requirements = {};
+  requirements.alignment = 1;
+  requirements.memoryTypeBits = ~0u;
+
+  std::vector<uint32_t> placed;
+  std::vector<VkDeviceSize> candidates;
+
+  for(uint32_t index : order)
+  {
+    RenderTransient& transient = graph.transients[index];
+    VkDeviceSize alignment = transient.requirements.alignment;
+
+    candidates.clear();
+    candidates.push_back(0);
+    for(uint32_t other : placed)
+    {
+      if(isLifetimeOverlapping(transient, graph.transients[other]))
+        candidates.push_back((graph.transients[other].offset + graph.transients[other].requirements.size + alignment - 1) / alignment * alignment);
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+
+    for(VkDeviceSize offset : candidates)
+    {
+      transient.offset = offset;
+
+      bool fits = true;
+      for(uint32_t other : placed)
+        fits = fits && !(isLifetimeOverlapping(transient, graph.transients[other]) && isMemoryOverlapping(transient, graph.transients[other]));
+
+      if(fits)
+        break;
+    }
+
+    placed.push_back(index);
+
+    requirements.size = std::max(requirements.size, transient.offset + transient.requirements.size);
+    requirements.alignment = std::max(requirements.alignment, alignment);
+    requirements.memoryTypeBits &= transient.requirements.memoryTypeBits;
+  }
+
+  // Optimal images in device local memory, every driver we know of has a type that takes them all
+  uint32_t memoryType = selectMemoryType(graph.allocator->memoryProperties, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  assert(memoryType != ~0u);
+
+  // Its own allocation rather than one from the allocator, so it can go through the deletion queue
+  VkMemoryAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+  allocateInfo.allocationSize = requirements.size;
+  allocateInfo.memoryTypeIndex = memoryType;
+  VK_CHECK(vkAllocateMemory(graph.device, &allocateInfo, 0, &graph.transientMemory));
+
+  graph.transientMemorySize = requirements.size;
+}
+
+static void createTransients(RenderGraph& graph)
+{
+  for(RenderTransient& transient : graph.transients)
+  {
+    VkImageCreateInfo createInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+    createInfo.imageType = VK_IMAGE_TYPE_2D;
+    createInfo.format = transient.desc.format;
+    createInfo.extent = { transient.desc.width, transient.desc.height, 1 };
+    createInfo.mipLevels = transient.desc.mipLevels;
+    createInfo.arrayLayers = 1;
+    createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    createInfo.usage = transient.desc.usage;
+    createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VK_CHECK(vkCreateImage(graph.device, &createInfo, 0, &transient.image));
+
+    vkGetImageMemoryRequirements(graph.device, transient.image, &transient.requirements);
+  }
+
+  if(graph.transients.empty())
+    return;
+
+  placeTransients(graph);
+
+  for(RenderTransient& transient : graph.transients)
+  {
+    VK_CHECK(vkBindImageMemory(graph.device, transient.image, graph.transientMemory, transient.offset));
+    transient.imageView = createImageView(graph.device, transient.image, transient.desc.format, transient.desc.aspect, transient.desc.mipLevels);
+  }
+}
+
+static void updateTransients(RenderGraph& graph, uint64_t lastUseValue)
+{
+  std::vector<RenderTransient> wanted;
+  std::vector<RenderResource> owners;
+
+  for(RenderResource i = 0 ; i < graph.resources.size() ; i++)
+  {
+    RenderGraphResource& resource = graph.resources[i];
+    if(resource.imported || resource.firstPass == ~0u)
+      continue;
+
+    RenderTransient transient = {};
+    transient.desc = resource.desc;
+    transient.firstPass = resource.firstPass;
+    transient.lastPass = resource.lastPass;
+
+    resource.transient = uint32_t(wanted.size());
+    wanted.push_back(transient);
+    owners.push_back(i);
+  }
+
+  bool same = wanted.size() == graph.transients.size();
+  for(size_t i = 0 ; same && i < wanted.size() ; i++)
+    same = isSameTransient(wanted[i], graph.transients[i]);
+
+  if(!same)
+  {
+    // Frames in flight may still be using the old ones
+    retireTransients(graph, lastUseValue);
+
+    graph.transients = wanted;
+    createTransients(graph);
+  }
+
+  graph.stats.transientCount = uint32_t(graph.transients.size());
+  graph.stats.transientBytes = graph.transientMemorySize;
+
+  for(size_t i = 0 ; i < graph.transients.size() ; i++)
+  {
+    RenderTransient& transient = graph.transients[i];
+    graph.stats.transientBytesUnaliased += transient.requirements.size;
+
+    transient.aliasStages = 0;
+    transient.aliasAccess = 0;
+
+    for(size_t j = 0 ; j < graph.transients.size() ; j++)
+    {
+      if(isMemoryOverlapping(transient, graph.transients[j]))
+      {
+        transient.aliasStages |= graph.resources[owners[j]].usedStages;
+        transient.aliasAccess |= graph.resources[owners[j]].usedAccess & kWriteAccess;
+      }
+    }
+
+    RenderGraphResource& resource = graph.resources[owners[i]];
+    resource.image = transient.image;
+    resource.imageView = transient.imageView;
+  }
+}
+
+static VkImageMemoryBarrier2KHR makeImageBarrier(const RenderGraphResource& resource, VkPipelineStageFlags2KHR dstStages, VkAccessFlags2KHR dstAccess, VkImageLayout newLayout)
+{
+  VkImageMemoryBarrier2KHR barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR };
+  barrier.srcStageMask = resource.state.writeStages | resource.state.readStages;
+  barrier.srcAccessMask = resource.state.writeAccess;
+  barrier.dstStageMask = dstStages;
+  barrier.dstAccessMask = dstAccess;
+  barrier.oldLayout = resource.state.layout;
+  barrier.newLayout = newLayout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = resource.image;
+  barrier.subresourceRange.aspectMask = resource.desc.aspect;
+  barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+  barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+  return barrier;
+}
+
+static uint32_t finishBatch(RenderGraph& graph, RenderBarrierBatch& batch)
+{
+  batch.imageBarrierCount = uint32_t(graph.imageBarriers.size()) - batch.firstImageBarrier;
+  if(!batch.memoryBarrier && batch.imageBarrierCount == 0)
+    return ~0u;
+
+  graph.stats.barrierBatches++;
+  graph.stats.imageBarriers += batch.imageBarrierCount;
+  graph.stats.memoryBarriers += batch.memoryBarrier ? 1 : 0;
+
+  graph.batches.push_back(batch);
+  return uint32_t(graph.batches.size() - 1);
+}
+
+static void initialState(RenderGraph& graph, RenderGraphResource& resource)
+{
+  resource.state = {};
+
+  if(resource.transient != ~0u)
+  {
+    const RenderTransient& transient = graph.transients[resource.transient];
+
+    resource.state.writeStages = transient.aliasStages;
+    resource.state.writeAccess = transient.aliasAccess;
+    resource.state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    return;
+  }
+
+  const RenderUsageInfo& previous = kRenderUsages[resource.previousUsage];
+
+  if(previous.write)
+  {
+    resource.state.writeStages = previous.stages;
+    resource.state.writeAccess = previous.access & kWriteAccess;
+  }
+  else
+    resource.state.readStages = previous.stages;
+
+  resource.state.layout = resource.discard ? VK_IMAGE_LAYOUT_UNDEFINED : previous.layout;
+}
+
+// Goes through the passes in order keeping track of where each resource is, and collects what every pass
+// needs into one batch: image barriers for layout changes, one global memory barrier for everything else.
+static void buildBarriers(RenderGraph& graph)
+{
+  graph.batches.clear();
+  graph.imageBarriers.clear();
+
+  for(RenderGraphResource& resource : graph.resources)
+    initialState(graph, resource);
+
+  // One entry per resource per pass, a pass can use a resource more than one way
+  struct PassUse
+  {
+    RenderResource resource;
+    VkPipelineStageFlags2KHR stages;
+    VkAccessFlags2KHR access;
+    VkImageLayout layout;
+    bool write;
+  };
+
+  std::vector<PassUse> uses;
+
+  for(RenderGraphPass& pass : graph.passes)
+  {
+    if(pass.culled)
+      continue;
+
+    uses.clear();
+    for(const RenderGraphAccess& access : pass.accesses)
+    {
+      const RenderUsageInfo& info = kRenderUsages[access.usage];
+
+      PassUse* use = NULL;
+      for(PassUse& other : uses)
+        use = other.resource == access.resource ? &other : use;
+
+      if(!use)
+      {
+        uses.push_back({ access.resource, 0, 0, info.layout, false });
+        use = &uses.back();
+      }
+
+      // An image can only be in one layout for the whole pass
+      assert(!graph.resources[access.resource].isImage || use->layout == info.layout);
+
+      use->stages |= info.stages;
+      use->access |= info.access;
+      use->write |= info.write;
+    }
+
+    RenderBarrierBatch batch = {};
+    batch.firstImageBarrier = uint32_t(graph.imageBarriers.size());
+    batch.memory = { VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR };
+
+    for(const PassUse& use : uses)
+    {
+      RenderGraphResource& resource = graph.resources[use.resource];
+      RenderResourceState& state = resource.state;
+
+      if(resource.isImage && state.layout != use.layout)
+      {
+        graph.imageBarriers.push_back(makeImageBarrier(resource, use.stages, use.access, use.layout));
+
+        // The transition is a write of its own, anything after the pass in other stages has to wait for it
+        state.layout = use.layout;
+        state.writeStages = use.stages;
+        state.writeAccess = use.access & kWriteAccess;
+        state.readStages = 0;
+        state.visibleStages = use.stages;
+      }
+      else if(use.write)
+      {
+        // Write after write or after read
+        if(state.writeStages | state.readStages)
+        {
+          batch.memoryBarrier = true;
+          batch.memory.srcStageMask |= state.writeStages | state.readStages;
+          batch.memory.srcAccessMask |= state.writeAccess;
+          batch.memory.dstStageMask |= use.stages;
+          batch.memory.dstAccessMask |= use.access;
+        }
+
+        state.writeStages = use.stages;
+        state.writeAccess = use.access & kWriteAccess;
+        state.readStages = 0;
+        state.visibleStages = use.stages;
+      }
+      else
+      {
+        // Read after write, unless an earlier barrier already made the write visible to these stages
+        if(state.writeStages && (use.stages & ~state.visibleStages))
+        {
+          batch.memoryBarrier = true;
+          batch.memory.srcStageMask |= state.writeStages;
+          batch.memory.srcAccessMask |= state.writeAccess;
+          batch.memory.dstStageMask |= use.stages;
+          batch.memory.dstAccessMask |= use.access;
+
+          state.visibleStages |= use.stages;
+        }
+
+        state.readStages |= use.stages;
+      }
+    }
+
+    pass.barrierBatch = finishBatch(graph, batch);
+  }
+
+  // Leave the outputs how the outside wants them
+  RenderBarrierBatch batch = {};
+  batch.firstImageBarrier = uint32_t(graph.imageBarriers.size());
+  batch.memory = { VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR };
+
+  for(RenderGraphResource& resource : graph.resources)
+  {
+    if(resource.finalUsage == RenderUsage_None)
+      continue;
+
+    const RenderUsageInfo& info = kRenderUsages[resource.finalUsage];
+
+    if(resource.isImage && resource.state.layout != info.layout)
+      graph.imageBarriers.push_back(makeImageBarrier(resource, info.stages, info.access, info.layout));
+    else if(!resource.isImage && resource.state.writeStages)
+    {
+      batch.memoryBarrier = true;
+      batch.memory.srcStageMask |= resource.state.writeStages;
+      batch.memory.srcAccessMask |= resource.state.writeAccess;
+      batch.memory.dstStageMask |= info.stages;
+      batch.memory.dstAccessMask |= info.access;
+    }
+  }
+
+  graph.finalBatch = finishBatch(graph, batch);
+}
+
+void compileRenderGraph(RenderGraph& graph, uint64_t lastUseValue)
+{
+  graph.stats = {};
+  graph.stats.passCount = uint32_t(graph.passes.size());
+
+  cullPasses(graph);
+
+  for(RenderGraphResource& resource : graph.resources)
+  {
+    resource.firstPass = ~0u;
+    resource.lastPass = ~0u;
+    resource.usedStages = 0;
+    resource.usedAccess = 0;
+  }
+
+  for(uint32_t i = 0 ; i < graph.passes.size() ; i++)
+  {
+    const RenderGraphPass& pass = graph.passes[i];
+    if(pass.culled)
+    {
+      graph.stats.passesCulled++;
+      continue;
+    }
+
+    for(const RenderGraphAccess& access : pass.accesses)
+    {
+      RenderGraphResource& resource = graph.resources[access.resource];
+
+      if(resource.firstPass == ~0u)
+        resource.firstPass = i;
+      resource.lastPass = i;
+
+      resource.usedStages |= kRenderUsages[access.usage].stages;
+      resource.usedAccess |= kRenderUsages[access.usage].access;
+    }
+  }
+
+  updateTransients(graph, lastUseValue);
+  buildBarriers(graph);
+}
+
+void recordPipelineBarriers(PFN_vkCmdPipelineBarrier2KHR pipelineBarrier2, VkCommandBuffer commandBuffer, const VkMemoryBarrier2KHR* memory, const VkImageMemoryBarrier2KHR* imageBarriers, uint32_t imageBarrierCount)
+{
+  if(pipelineBarrier2)
+  {
+    VkDependencyInfoKHR dependencyInfo = { VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR };
+    dependencyInfo.memoryBarrierCount = memory ? 1 : 0;
+    dependencyInfo.pMemoryBarriers = memory;
+    dependencyInfo.imageMemoryBarrierCount = imageBarrierCount;
+    dependencyInfo.pImageMemoryBarriers = imageBarriers;
+
+    pipelineBarrier2(commandBuffer, &dependencyInfo);
+    return;
+  }
+
+  // The original barrier has one pair of stage masks for the whole call, so the batch gets the union
+  VkPipelineStageFlags srcStages = VkPipelineStageFlags(memory ? memory->srcStageMask : 0);
+  VkPipelineStageFlags dstStages = VkPipelineStageFlags(memory ? memory->dstStageMask : 0);
+
+  VkMemoryBarrier memoryBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+  memoryBarrier.srcAccessMask = VkAccessFlags(memory ? memory->srcAccessMask : 0);
+  memoryBarrier.dstAccessMask = VkAccessFlags(memory ? memory->dstAccessMask : 0);
+
+  std::vector<VkImageMemoryBarrier> legacyImageBarriers(imageBarrierCount);
+  for(uint32_t i = 0 ; i < imageBarrierCount ; i++)
+  {
+    const VkImageMemoryBarrier2KHR& barrier = imageBarriers[i];
+
+    srcStages |= VkPipelineStageFlags(barrier.srcStageMask);
+    dstStages |= VkPipelineStageFlags(barrier.dstStageMask);
+
+    VkImageMemoryBarrier& legacy = legacyImageBarriers[i];
+    legacy = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+    legacy.srcAccessMask = VkAccessFlags(barrier.srcAccessMask);
+    legacy.dstAccessMask = VkAccessFlags(barrier.dstAccessMask);
+    legacy.oldLayout = barrier.oldLayout;
+    legacy.newLayout = barrier.newLayout;
+    legacy.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+    legacy.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+    legacy.image = barrier.image;
+    legacy.subresourceRange = barrier.subresourceRange;
+  }
+
+  // No stage isn't allowed there
+  if(!srcStages)
+    srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  if(!dstStages)
+    dstStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+  vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, memory ? 1 : 0, &memoryBarrier, 0, 0, imageBarrierCount, legacyImageBarriers.data());
+}
+
+static void recordBarriers(const RenderGraph& graph, VkCommandBuffer commandBuffer, const RenderBarrierBatch& batch)
+{
+  const VkImageMemoryBarrier2KHR* imageBarriers = graph.imageBarriers.data() + batch.firstImageBarrier;
+  const VkMemoryBarrier2KHR* memory = batch.memoryBarrier ? &batch.memory : NULL;
+
+  recordPipelineBarriers(graph.pipelineBarrier2, commandBuffer, memory, imageBarriers, batch.imageBarrierCount);
+  captureBarriers(graph.capture, memory, imageBarriers, batch.imageBarrierCount);
+}
+
+void executeRenderGraph(RenderGraph& graph, VkCommandBuffer commandBuffer, Profiler* profiler)
+{
+  for(RenderGraphPass& pass : graph.passes)
+  {
+    if(pass.culled)
+      continue;
+
+    if(pass.barrierBatch != ~0u)
+      recordBarriers(graph, commandBuffer, graph.batches[pass.barrierBatch]);
+
+    if(profiler)
+      beginProfilerScope(*profiler, commandBuffer, pass.name);
+
+    pass.record(commandBuffer);
+
+    if(profiler)
+      endProfilerScope(*profiler, commandBuffer);
+  }
+
+  if(graph.finalBatch != ~0u)
+    recordBarriers(graph, commandBuffer, graph.batches[graph.finalBatch]);
+}
+
+void printRenderGraphStats(const char* name, const RenderGraphStats& stats)
+{
+  printf("Render graph %s: %u passes (%u culled), %u barrier batches with %u image and %u memory barriers, %u transients in %.1f MB (%.1f MB without aliasing)\n",
+    name, stats.passCount, stats.passesCulled, stats.barrierBatches, stats.imageBarriers, stats.memoryBarriers,
+    stats.transientCount, double(stats.transientBytes) / (1024 * 1024), double(stats.transientBytesUnaliased) / (1024 * 1024));
+}
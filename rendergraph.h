@@ -0,0 +1,207 @@
+#pragma once
+
+#include "capture.h"
+#include "profiler.h"
+#include "resources.h"
+#include "sync.h"
+
+#include <functional>
+#include <vector>
+
+// How a pass uses a resource. Each one stands for the stages, access and image layout the barriers need,
+// see kRenderUsages in rendergraph.cpp. Passes can use the same resource in more than one way.
+enum RenderUsage
+{
+  RenderUsage_None, // Only as the previous usage of an imported resource nothing has to wait for
+
+  RenderUsage_ColorAttachment,
+  RenderUsage_DepthAttachment,
+  RenderUsage_SampledFragment,
+  RenderUsage_SampledCompute,
+  RenderUsage_StorageReadVertex,
+  RenderUsage_StorageReadCompute,
+  RenderUsage_StorageWriteCompute,
+  RenderUsage_StorageWriteFragment,
+  RenderUsage_IndirectRead,
+  RenderUsage_TransferRead,
+  RenderUsage_TransferWrite,
+  RenderUsage_Present, // Only as the final usage of an imported image
+  RenderUsage_HostRead, // Only as the final usage of an imported buffer, mapped and read once the frame is done
+
+  RenderUsage_Count
+};
+
+// Index into graph.resources, only good for the frame it was declared in
+typedef uint32_t RenderResource;
+
+typedef std::function<void(VkCommandBuffer commandBuffer)> RenderPassCallback;
+
+struct RenderImageDesc
+{
+  VkFormat format;
+  uint32_t width, height;
+  uint32_t mipLevels; // Transients only, the graph's view and barriers cover every level
+  VkImageUsageFlags usage;
+  VkImageAspectFlags aspect;
+};
+
+struct RenderGraphAccess
+{
+  RenderResource resource;
+  RenderUsage usage;
+};
+
+struct RenderGraphPass
+{
+  const char* name; // Also the profiler scope, must outlive the profiler
+  std::vector<RenderGraphAccess> accesses;
+  RenderPassCallback record;
+
+  bool sideEffects; // Has an effect the graph can't see, a copy for the host say, so it's never culled
+  bool culled;
+  uint32_t barrierBatch; // Barriers recorded in front of the pass, ~0u if it needs none
+};
+
+// Where a resource is at while the barriers are worked out
+struct RenderResourceState
+{
+  VkPipelineStageFlags2KHR writeStages; // Last write
+  VkAccessFlags2KHR writeAccess;
+  VkPipelineStageFlags2KHR readStages; // Reads since the last write, a write has to wait for them
+  VkPipelineStageFlags2KHR visibleStages; // Stages the last write has already been made visible to
+  VkImageLayout layout;
+};
+
+struct RenderGraphResource
+{
+  const char* name;
+  bool isImage;
+  bool imported;
+  bool output; // Used after the graph, so passes writing it are kept
+  bool discard; // Old contents don't matter, the first barrier transitions from UNDEFINED
+
+  RenderImageDesc desc; // Images
+  VkImage image;
+  VkImageView imageView;
+  VkBuffer buffer;
+
+  RenderUsage previousUsage; // Imported, the last use before the graph
+  RenderUsage finalUsage; // Imported, None leaves an image in whatever layout the last pass used
+
+  // Filled in by compileRenderGraph
+  uint32_t firstPass, lastPass; // ~0u if no pass that survived culling uses it
+  VkPipelineStageFlags2KHR usedStages; // Every use in the frame
+  VkAccessFlags2KHR usedAccess;
+  uint32_t transient; // Index into graph.transients, ~0u if imported
+  RenderResourceState state;
+};
+
+// A transient image and where it lives in the shared memory. Kept from frame to frame, as long as the graph
+// declares the same transients in the same passes they are reused as they are, otherwise the old ones are
+// retired through the deletion queue.
+struct RenderTransient
+{
+  RenderImageDesc desc;
+  uint32_t firstPass, lastPass;
+
+  VkImage image;
+  VkImageView imageView;
+  VkMemoryRequirements requirements;
+  VkDeviceSize offset; // In graph.transientMemory
+
+  // Every use of every transient sharing memory with this one, its first use waits for all of them. That
+  // covers the ones before it in the frame and the ones after it in the previous frame alike.
+  VkPipelineStageFlags2KHR aliasStages;
+  VkAccessFlags2KHR aliasAccess;
+};
+
+struct RenderBarrierBatch
+{
+  uint32_t firstImageBarrier;
+  uint32_t imageBarrierCount;
+  bool memoryBarrier;
+  VkMemoryBarrier2KHR memory; // All buffer and execution dependencies of the batch in one global barrier
+};
+
+struct RenderGraphStats
+{
+  uint32_t passCount;
+  uint32_t passesCulled;
+  uint32_t barrierBatches; // vkCmdPipelineBarrier calls
+  uint32_t imageBarriers;
+  uint32_t memoryBarriers;
+
+  uint32_t transientCount;
+  VkDeviceSize transientBytes; // What the transients take with aliasing
+  VkDeviceSize transientBytesUnaliased; // What they would take in their own allocations
+};
+
+// Passes declare which resources they use and how, the graph works out the barriers between them, culls
+// passes nothing looks at and places transient images whose lifetimes don't overlap in the same memory.
+// The graph is declared again every frame, which costs next to nothing and lets the passes capture per
+// frame state; only the transients and their memory persist.
+struct RenderGraph
+{
+  VkDevice device;
+  const MemoryAllocator* allocator; // For the memory types, the transients get a VkDeviceMemory of their own
+  DeletionQueue* deletions; // Where replaced transients wait for the frames using them
+  PFN_vkCmdPipelineBarrier2KHR pipelineBarrier2; // NULL without synchronization2, then barriers go through vkCmdPipelineBarrier
+  CommandCapture* capture; // Barriers are captured too while it's capturing, NULL by default
+
+  std::vector<RenderGraphPass> passes;
+  std::vector<RenderGraphResource> resources;
+
+  std::vector<RenderTransient> transients;
+  VkDeviceMemory transientMemory; // VK_NULL_HANDLE without transients
+  VkDeviceSize transientMemorySize;
+
+  std::vector<RenderBarrierBatch> batches;
+  std::vector<VkImageMemoryBarrier2KHR> imageBarriers;
+  uint32_t finalBatch; // After the last pass, ~0u if none
+
+  RenderGraphStats stats;
+};
+
+// synchronization2 needs VK_KHR_synchronization2 turned on in createDevice. The owner of the deletion queue
+// collects it against the frame timeline.
+void createRenderGraph(RenderGraph& graph, VkDevice device, const MemoryAllocator& allocator, bool synchronization2, DeletionQueue& deletions);
+
+// The device has to be idle
+void destroyRenderGraph(RenderGraph& graph);
+
+// Starts declaring the next frame
+void beginRenderGraph(RenderGraph& graph);
+
+// Imported resources live outside the graph. previousUsage is how the resource was last used on this queue
+// before the graph runs, or the stage a semaphore wait gates it at, so the first barrier waits for it.
+RenderResource importImage(RenderGraph& graph, const char* name, VkImage image, VkImageView imageView, VkImageAspectFlags aspect, RenderUsage previousUsage, bool discard);
+RenderResource importBuffer(RenderGraph& graph, const char* name, VkBuffer buffer, RenderUsage previousUsage);
+
+// Contents only live from the first pass that uses it to the last
+RenderResource createTransientImage(RenderGraph& graph, const char* name, const RenderImageDesc& desc);
+
+// Marks the resource as used after the graph. An image can also be given the usage it has to be left in, a
+// buffer can be made visible to the host.
+void setRenderGraphOutput(RenderGraph& graph, RenderResource resource, RenderUsage finalUsage = RenderUsage_None);
+
+// Passes run in the order they're added
+uint32_t addRenderGraphPass(RenderGraph& graph, const char* name, const RenderPassCallback& record, bool sideEffects = false);
+void useRenderResource(RenderGraph& graph, uint32_t pass, RenderResource resource, RenderUsage usage);
+
+// Transients have their handles once the graph is compiled, so only look them up from the callbacks
+VkImage getRenderGraphImage(const RenderGraph& graph, RenderResource resource);
+VkImageView getRenderGraphImageView(const RenderGraph& graph, RenderResource resource);
+
+// Culls, places the transients and works out the barriers. When the transients differ from last frame's, when
+// the size changes say, the old ones go to the deletion queue until the frame timeline gets to lastUseValue,
+// the last frame submitted with them.
+void compileRenderGraph(RenderGraph& graph, uint64_t lastUseValue);
+
+// Each pass is wrapped in a profiler scope with its name when a profiler is given
+void executeRenderGraph(RenderGraph& graph, VkCommandBuffer commandBuffer, Profiler* profiler);
+
+// name tells the graphs apart
+void printRenderGraphStats(const char* name, const RenderGraphStats& stats);
+
+// One barrier call, through vkCmdPipelineBarrier when pipelineBarrier2 is NULL. memory may be NULL.
+void recordPipelineBarriers(PFN_vkCmdPipelineBarrier2KHR pipelineBarrier2, VkCommandBuffer commandBuffer, const VkMemoryBarrier2KHR* memory, const VkImageMemoryBarrier2KHR* imageBarriers, uint32_t imageBarrierCount);
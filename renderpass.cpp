@@ -0,0 +1,171 @@
+#include "renderpass.h"
+
+VkSampleCountFlagBits pickSampleCount(VkPhysicalDevice physicalDevice, uint32_t requested)
+{
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  VkSampleCountFlags supported = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+
+  for(uint32_t samples = VK_SAMPLE_COUNT_64_BIT ; samples > VK_SAMPLE_COUNT_1_BIT ; samples /= 2)
+  {
+    if(samples <= requested && (supported & samples))
+      return VkSampleCountFlagBits(samples);
+  }
+
+  return VK_SAMPLE_COUNT_1_BIT;
+}
+
+VkFormat pickDepthFormat(VkPhysicalDevice physicalDevice)
+{
+  VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D16_UNORM };
+
+  for(VkFormat format : candidates)
+  {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+    if(properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+      return format;
+  }
+
+  assert(!"No depth format, the spec says D16 is always there");
+  return VK_FORMAT_D16_UNORM;
+}
+
+VkRenderPass createRenderPass(VkDevice device, const RenderPassConfig& config)
+{
+  bool multisampled = config.samples != VK_SAMPLE_COUNT_1_BIT;
+  VkAttachmentStoreOp discardOp = config.transient ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+
+  // Color, depth, and the resolve target when multisampled, createFramebuffer follows the same order
+  VkAttachmentDescription attachments[3] = {};
+  attachments[0].format = config.colorFormat;
+  attachments[0].samples = config.samples;
+  attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  // The target has to be stored or there's nothing to show, multisampled color is done once it's resolved
+  attachments[0].storeOp = multisampled ? discardOp : VK_ATTACHMENT_STORE_OP_STORE;
+  // We don't need a stencil, so operations are don't care.
+  attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[0].initialLayout = multisampled ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  attachments[1].format = config.depthFormat;
+  attachments[1].samples = config.samples;
+  attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[1].storeOp = discardOp;
+  attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  // Every pixel is written by the resolve, what was there before doesn't matter
+  attachments[2].format = config.colorFormat;
+  attachments[2].samples = VK_SAMPLE_COUNT_1_BIT;
+  attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[2].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  attachments[2].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[2].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[2].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  attachments[2].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference colorAttachments = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+  VkAttachmentReference depthAttachment = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+  VkAttachmentReference resolveAttachment = { 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+  // Need at least one subpass for some reason
+  VkSubpassDescription subpass = {};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &colorAttachments;
+  subpass.pResolveAttachments = multisampled ? &resolveAttachment : NULL;
+  subpass.pDepthStencilAttachment = &depthAttachment;
+
+  // Depth and multisampled color are shared by every frame in flight, so this frame's clears wait for the last
+  // frame's pass to be done with them. The target's own barriers come from the render graph.
+  VkSubpassDependency dependency = {};
+  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependency.dstSubpass = 0;
+  dependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+  VkRenderPassCreateInfo createInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO };
+  createInfo.attachmentCount = multisampled ? 3 : 2;
+  createInfo.pAttachments = attachments;
+  createInfo.subpassCount = 1;
+  createInfo.pSubpasses = &subpass;
+  createInfo.dependencyCount = 1;
+  createInfo.pDependencies = &dependency;
+
+  VkRenderPass renderPass;
+  VK_CHECK(vkCreateRenderPass(device, &createInfo, 0, &renderPass));
+
+  return renderPass;
+}
+
+void createRenderAttachments(RenderAttachments& attachments, VkDevice device, const MemoryAllocator& allocator, const RenderPassConfig& config, uint32_t width, uint32_t height)
+{
+  attachments = {};
+
+  if(config.samples != VK_SAMPLE_COUNT_1_BIT)
+    createAttachmentImage(attachments.color, device, allocator.memoryProperties, width, height, config.colorFormat, config.samples, VK_IMAGE_ASPECT_COLOR_BIT, config.transient);
+
+  createAttachmentImage(attachments.depth, device, allocator.memoryProperties, width, height, config.depthFormat, config.samples, VK_IMAGE_ASPECT_DEPTH_BIT, config.transient);
+}
+
+void destroyRenderAttachments(const RenderAttachments& attachments, VkDevice device)
+{
+  if(attachments.color.image)
+    destroyAttachmentImage(attachments.color, device);
+
+  destroyAttachmentImage(attachments.depth, device);
+}
+
+void retireRenderAttachments(const RenderAttachments& attachments, DeletionQueue& deletions, uint64_t lastUseValue)
+{
+  for(const AttachmentImage* image : { &attachments.color, &attachments.depth })
+  {
+    deferDeletion(deletions, VK_OBJECT_TYPE_IMAGE_VIEW, (uint64_t)image->imageView, lastUseValue);
+    deferDeletion(deletions, VK_OBJECT_TYPE_IMAGE, (uint64_t)image->image, lastUseValue);
+    deferDeletion(deletions, VK_OBJECT_TYPE_DEVICE_MEMORY, (uint64_t)image->memory, lastUseValue);
+  }
+}
+
+VkDeviceSize getRenderAttachmentBytes(const RenderAttachments& attachments, VkDevice device)
+{
+  VkDeviceSize bytes = 0;
+
+  for(const AttachmentImage* image : { &attachments.color, &attachments.depth })
+  {
+    VkDeviceSize committed = image->size;
+    if(image->lazy)
+      vkGetDeviceMemoryCommitment(device, image->memory, &committed);
+
+    bytes += image->image ? committed : 0;
+  }
+
+  return bytes;
+}
+
+VkFramebuffer createFramebuffer(VkDevice device, VkRenderPass renderPass, const RenderAttachments& attachments, VkImageView target, uint32_t width, uint32_t height)
+{
+  // In createRenderPass order
+  VkImageView multisampledViews[] = { attachments.color.imageView, attachments.depth.imageView, target };
+  VkImageView views[] = { target, attachments.depth.imageView };
+
+  VkFramebufferCreateInfo createInfo = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+  createInfo.renderPass = renderPass;
+  createInfo.attachmentCount = attachments.color.image ? 3 : 2;
+  createInfo.pAttachments = attachments.color.image ? multisampledViews : views;
+  createInfo.width = width;
+  createInfo.height = height;
+  createInfo.layers = 1;
+
+  VkFramebuffer framebuffer;
+  VK_CHECK(vkCreateFramebuffer(device, &createInfo, 0, &framebuffer));
+
+  return framebuffer;
+}
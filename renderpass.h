@@ -0,0 +1,44 @@
+#pragma once
+
+#include "resources.h"
+#include "sync.h"
+
+// How the main pass renders, picked from the device at startup
+struct RenderPassConfig
+{
+  VkFormat colorFormat; // The target's, what the pass renders or resolves to
+  VkFormat depthFormat;
+  VkSampleCountFlagBits samples;
+  bool transient; // Depth and multisampled color never leave the pass, only the attachment benchmark turns this off
+};
+
+// Highest count both color and depth framebuffers can do, up to the one asked for
+VkSampleCountFlagBits pickSampleCount(VkPhysicalDevice physicalDevice, uint32_t requested);
+
+// Every device has D16 and one of the other two, nothing here needs stencil
+VkFormat pickDepthFormat(VkPhysicalDevice physicalDevice);
+
+// Renders into the target, or with more than one sample into a multisampled color attachment that is resolved
+// into the target at the end of the subpass. Depth and the multisampled color are cleared on load and dropped
+// on store, so on a tiler they never leave tile memory. The target is a color attachment already when the pass
+// begins, the render graph sees to that.
+VkRenderPass createRenderPass(VkDevice device, const RenderPassConfig& config);
+
+// Depth and multisampled color for one target size, shared by every frame in flight
+struct RenderAttachments
+{
+  AttachmentImage color; // Only when multisampled
+  AttachmentImage depth;
+};
+
+void createRenderAttachments(RenderAttachments& attachments, VkDevice device, const MemoryAllocator& allocator, const RenderPassConfig& config, uint32_t width, uint32_t height);
+void destroyRenderAttachments(const RenderAttachments& attachments, VkDevice device);
+
+// Destroyed once the last frame that rendered with them is done
+void retireRenderAttachments(const RenderAttachments& attachments, DeletionQueue& deletions, uint64_t lastUseValue);
+
+// What the attachments really take, lazily allocated memory is only backed as far as the driver needed it
+VkDeviceSize getRenderAttachmentBytes(const RenderAttachments& attachments, VkDevice device);
+
+// Color target, depth and the resolve target in createRenderPass order
+VkFramebuffer createFramebuffer(VkDevice device, VkRenderPass renderPass, const RenderAttachments& attachments, VkImageView target, uint32_t width, uint32_t height);
@@ -0,0 +1,657 @@
+// farvkr-replay: plays back a command stream farvkr --capture recorded, offscreen, and times every frame.
+//
+//   farvkr-replay [--paced] [--loops N] [--frames-in-flight N] [--csv PATH] [--validation] CAPTURE
+//
+// The capture has the shaders and the mesh in it, so nothing else has to be around, and no window or display
+// either. Frames go to the GPU as fast as it takes them, or with --paced as far apart as they were recorded.
+// CPU time is how long a frame took to record, GPU time comes from timestamps around its commands.
+
+#include "capture.h"
+#include "device.h"
+#include "renderpass.h"
+#include "rendergraph.h"
+#include "transient.h"
+#include "upload.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+
+const uint32_t kMaxFramesInFlight = 3;
+
+struct ReplayOptions
+{
+  const char* capturePath = NULL;
+  const char* csvPath = NULL;
+  uint32_t loops = 1;
+  uint32_t framesInFlight = 2;
+  bool paced = false;
+  bool validation = false;
+};
+
+struct ReplayFrame
+{
+  VkCommandPool commandPool;
+  VkCommandBuffer commandBuffer;
+  VkQueryPool timestampPool;
+  uint64_t timelineValue; // 0 until the slot was submitted
+  uint32_t replayed; // Index into the results of the frame submitted last, for the GPU time
+};
+
+// The frame's color target and what the render pass needs around it, remade when the captured size changes
+struct ReplayTarget
+{
+  Image color;
+  RenderAttachments attachments;
+  VkFramebuffer framebuffer;
+  uint32_t width, height;
+  bool fresh; // Still UNDEFINED, the captured barriers expect it to have been read from already
+};
+
+struct ReplayResult
+{
+  uint32_t frameIndex;
+  double cpuTime; // ms
+  double gpuTime; // ms, negative if the timestamps weren't there
+};
+
+static bool parseOptions(ReplayOptions& options, int argc, char** argv)
+{
+  for(int i = 1 ; i < argc ; i++)
+  {
+    const char* arg = argv[i];
+    bool hasValue = i + 1 < argc;
+
+    if(strcmp(arg, "--paced") == 0)
+      options.paced = true;
+    else if(strcmp(arg, "--validation") == 0)
+      options.validation = true;
+    else if(strcmp(arg, "--loops") == 0 && hasValue)
+      options.loops = std::max(atoi(argv[++i]), 1);
+    else if(strcmp(arg, "--frames-in-flight") == 0 && hasValue)
+      options.framesInFlight = std::min(std::max(uint32_t(atoi(argv[++i])), 1u), kMaxFramesInFlight);
+    else if(strcmp(arg, "--csv") == 0 && hasValue)
+      options.csvPath = argv[++i];
+    else if(arg[0] != '-' && !options.capturePath)
+      options.capturePath = arg;
+    else
+      return false;
+  }
+
+  return options.capturePath != NULL;
+}
+
+static std::string getCaptureString(const char (&name)[kArchiveNameSize])
+{
+  return std::string(name, strnlen(name, kArchiveNameSize));
+}
+
+static VkImageLayout getReplayLayout(uint32_t layout)
+{
+  // There is no swapchain here, a frame captured in the window hands its image to the copy engine instead
+  return layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VkImageLayout(layout);
+}
+
+static void createReplayTarget(ReplayTarget& target, VkDevice device, MemoryAllocator& allocator, VkRenderPass renderPass, const RenderPassConfig& config, uint32_t width, uint32_t height)
+{
+  createImage(target.color, device, allocator, width, height, config.colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+  createRenderAttachments(target.attachments, device, allocator, config, width, height);
+  target.framebuffer = createFramebuffer(device, renderPass, target.attachments, target.color.imageView, width, height);
+  target.width = width;
+  target.height = height;
+  target.fresh = true;
+}
+
+static void destroyReplayTarget(ReplayTarget& target, VkDevice device, MemoryAllocator& allocator)
+{
+  vkDestroyFramebuffer(device, target.framebuffer, NULL);
+  destroyRenderAttachments(target.attachments, device);
+  destroyImage(target.color, device, allocator);
+  target.framebuffer = VK_NULL_HANDLE;
+}
+
+// Everything the interpreter needs besides the command buffer
+struct ReplayContext
+{
+  const PipelineManager* pipelines;
+  const std::vector<uint32_t>* pipelineHandles; // Capture table index to manager handle
+  const BindlessHeap* heap;
+  const GpuMesh* mesh;
+  TransientAllocator* transient;
+  PFN_vkCmdPipelineBarrier2KHR pipelineBarrier2;
+  VkRenderPass renderPass;
+};
+
+// Commands are only 4 byte aligned in the stream, so everything is copied out rather than pointed at
+static void replayCommands(const ReplayContext& context, VkCommandBuffer commandBuffer, const ReplayTarget& target, const uint8_t* commands, size_t size)
+{
+  VkPipelineLayout layout = context.heap->layout;
+  size_t offset = 0;
+
+  while(offset + sizeof(CaptureCommandHeader) <= size)
+  {
+    CaptureCommandHeader header;
+    memcpy(&header, commands + offset, sizeof(header));
+    offset += sizeof(header);
+
+    const uint8_t* payload = commands + offset;
+    assert(offset + header.size <= size);
+    offset += header.size;
+
+    switch(header.kind)
+    {
+    case CaptureCommand_Barrier:
+    {
+      CaptureBarrier barrier;
+      memcpy(&barrier, payload, sizeof(barrier));
+
+      VkMemoryBarrier2KHR memory = { VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR };
+      memory.srcStageMask = barrier.srcStageMask;
+      memory.srcAccessMask = barrier.srcAccessMask;
+      memory.dstStageMask = barrier.dstStageMask;
+      memory.dstAccessMask = barrier.dstAccessMask;
+
+      std::vector<VkImageMemoryBarrier2KHR> imageBarriers(barrier.imageBarrierCount);
+      for(uint32_t i = 0 ; i < barrier.imageBarrierCount ; i++)
+      {
+        CaptureImageBarrier image;
+        memcpy(&image, payload + sizeof(barrier) + i * sizeof(image), sizeof(image));
+
+        VkImageMemoryBarrier2KHR& result = imageBarriers[i];
+        result = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR };
+        result.srcStageMask = image.srcStageMask;
+        result.srcAccessMask = image.srcAccessMask;
+        result.dstStageMask = image.dstStageMask;
+        result.dstAccessMask = image.dstAccessMask;
+        result.oldLayout = getReplayLayout(image.oldLayout);
+        result.newLayout = getReplayLayout(image.newLayout);
+        result.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        result.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        result.image = target.color.image;
+        result.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        result.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        result.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+      }
+
+      recordPipelineBarriers(context.pipelineBarrier2, commandBuffer, barrier.memoryBarrier ? &memory : NULL, imageBarriers.data(), barrier.imageBarrierCount);
+      break;
+    }
+
+    case CaptureCommand_BeginPass:
+    {
+      CaptureBeginPass pass;
+      memcpy(&pass, payload, sizeof(pass));
+
+      VkClearValue clearValues[2] = {};
+      memcpy(clearValues[0].color.float32, pass.clearColor, sizeof(pass.clearColor));
+      clearValues[1].depthStencil.depth = pass.clearDepth;
+
+      VkRenderPassBeginInfo passBeginInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+      passBeginInfo.renderPass = context.renderPass;
+      passBeginInfo.framebuffer = target.framebuffer;
+      passBeginInfo.renderArea.extent.width = target.width;
+      passBeginInfo.renderArea.extent.height = target.height;
+      passBeginInfo.clearValueCount = 2;
+      passBeginInfo.pClearValues = clearValues;
+
+      vkCmdBeginRenderPass(commandBuffer, &passBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+      VkViewport viewport = { 0, float(target.height), float(target.width), -float(target.height), 0, 1 };
+      VkRect2D scissor = {};
+      scissor.extent.width = target.width;
+      scissor.extent.height = target.height;
+
+      vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+      vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+      break;
+    }
+
+    case CaptureCommand_EndPass:
+      vkCmdEndRenderPass(commandBuffer);
+      break;
+
+    case CaptureCommand_BindPipeline:
+    {
+      uint32_t index;
+      memcpy(&index, payload, sizeof(index));
+
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(*context.pipelines, (*context.pipelineHandles)[index]));
+      bindBindlessHeap(*context.heap, commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+      break;
+    }
+
+    case CaptureCommand_BindMesh:
+    {
+      VkDeviceSize vertexOffset = 0;
+      vkCmdBindVertexBuffers(commandBuffer, 0, 1, &context.mesh->vertexBuffer.buffer, &vertexOffset);
+      vkCmdBindIndexBuffer(commandBuffer, context.mesh->indexBuffer.buffer, 0, context.mesh->indexType);
+      break;
+    }
+
+    case CaptureCommand_PushConstants:
+    {
+      uint32_t pushOffset;
+      memcpy(&pushOffset, payload, sizeof(pushOffset));
+
+      // The payload is padded, what's left of it after the offset is at most 3 bytes more than was pushed
+      uint8_t constants[kBindlessPushConstantSize];
+      uint32_t pushSize = std::min(uint32_t(header.size - sizeof(pushOffset)), kBindlessPushConstantSize - pushOffset) & ~3u;
+      memcpy(constants, payload + sizeof(pushOffset), pushSize);
+
+      vkCmdPushConstants(commandBuffer, layout, kBindlessPushStages, pushOffset, pushSize, constants);
+      break;
+    }
+
+    case CaptureCommand_DrawData:
+    {
+      MeshDraw draw;
+      memcpy(&draw, payload, sizeof(draw));
+
+      TransientAllocation allocation = allocateTransient(*context.transient, sizeof(draw));
+      copyTransient(*context.transient, allocation.data, &draw, sizeof(draw));
+      bindTransientUniforms(*context.transient, commandBuffer, layout, allocation.offset);
+      break;
+    }
+
+    case CaptureCommand_DrawIndexed:
+    {
+      CaptureDraw draw;
+      memcpy(&draw, payload, sizeof(draw));
+
+      vkCmdDrawIndexed(commandBuffer, draw.indexCount, draw.instanceCount, draw.firstIndex, draw.vertexOffset, draw.firstInstance);
+      break;
+    }
+
+    default:
+      printf("Replay: unknown command %u, the rest of the frame is skipped\n", header.kind);
+      return;
+    }
+  }
+}
+
+// Uniform draw data per frame, for sizing the transient allocator
+static uint32_t countDrawData(const CaptureFrameHeader* frame)
+{
+  const uint8_t* commands = reinterpret_cast<const uint8_t*>(frame + 1);
+  uint32_t count = 0;
+
+  for(size_t offset = 0 ; offset + sizeof(CaptureCommandHeader) <= frame->size ; )
+  {
+    CaptureCommandHeader header;
+    memcpy(&header, commands + offset, sizeof(header));
+    offset += sizeof(header) + header.size;
+
+    count += header.kind == CaptureCommand_DrawData;
+  }
+
+  return count;
+}
+
+static double getPercentile(std::vector<double> values, double percentile)
+{
+  if(values.empty())
+    return 0;
+
+  std::sort(values.begin(), values.end());
+  return values[std::min(size_t(percentile * values.size()), values.size() - 1)];
+}
+
+static void printTimes(const char* name, const std::vector<double>& times)
+{
+  if(times.empty())
+  {
+    printf("Replay: no %s times\n", name);
+    return;
+  }
+
+  double total = 0;
+  for(double time : times)
+    total += time;
+
+  printf("Replay: %s %.3f ms mean, %.3f p50, %.3f p99, %.3f max\n", name, total / times.size(), getPercentile(times, 0.5), getPercentile(times, 0.99), *std::max_element(times.begin(), times.end()));
+}
+
+static bool writeResults(const char* path, const std::vector<ReplayResult>& results)
+{
+  FILE* file = fopen(path, "w");
+  if(!file)
+  {
+    printf("Replay: can't open %s\n", path);
+    return false;
+  }
+
+  fprintf(file, "frame,cpu_ms,gpu_ms\n");
+  for(const ReplayResult& result : results)
+    fprintf(file, "%u,%.4f,%.4f\n", result.frameIndex, result.cpuTime, result.gpuTime);
+
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  ReplayOptions options;
+  if(!parseOptions(options, argc, argv))
+  {
+    printf("Usage: %s [--paced] [--loops N] [--frames-in-flight N] [--csv PATH] [--validation] CAPTURE\n", argv[0]);
+    return 1;
+  }
+
+  AssetArchive archive;
+  if(!openArchive(archive, options.capturePath))
+    return 1;
+
+  CaptureStream stream;
+  if(!openCaptureStream(stream, archive) || stream.frames.empty())
+  {
+    closeArchive(archive);
+    return 1;
+  }
+
+  const CaptureHeader& header = *stream.header;
+
+  VkInstance instance = createInstance(false, options.validation);
+  assert(instance);
+
+  VkPhysicalDevice physicalDevices[16];
+  uint32_t physicalDeviceCount = sizeof(physicalDevices) / sizeof(physicalDevices[0]);
+  VK_CHECK(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices));
+
+  VkPhysicalDevice physicalDevice = pickPhysicalDevice(physicalDevices, physicalDeviceCount);
+  assert(physicalDevice);
+
+  VkPhysicalDeviceProperties props;
+  vkGetPhysicalDeviceProperties(physicalDevice, &props);
+
+  QueueFamilies families = getQueueFamilies(physicalDevice);
+  VkDevice device = createDevice(instance, physicalDevice, families, false);
+  assert(device);
+
+  VkQueue queue;
+  vkGetDeviceQueue(device, families.graphics, 0, &queue);
+
+  MemoryAllocator allocator;
+  createMemoryAllocator(allocator, device, physicalDevice);
+
+  // The mesh is the only upload and it has to be in before the first frame, no point in the transfer queue
+  UploadManager uploader;
+  createUploadManager(uploader, device, physicalDevice, allocator, queue, families.graphics, families.graphics);
+
+  BindlessHeap heap;
+  createBindlessHeap(heap, device, physicalDevice);
+
+  PipelineCache pipelineCache;
+  createPipelineCache(pipelineCache, device, physicalDevice, "pipeline_cache.bin", false);
+
+  // The depth format and sample count only have to be ones the pipelines can render with here, the pixels
+  // aren't compared against anything
+  RenderPassConfig config = {};
+  config.colorFormat = VkFormat(header.colorFormat);
+  config.depthFormat = pickDepthFormat(physicalDevice);
+  config.samples = pickSampleCount(physicalDevice, header.samples);
+  config.transient = true;
+
+  if(uint32_t(config.samples) != header.samples)
+    printf("Replay: captured with %u samples, replaying with %u\n", header.samples, uint32_t(config.samples));
+
+  VkRenderPass renderPass = createRenderPass(device, config);
+
+  // Every shader is in the capture under the path it was loaded from, so the manager finds them like it would in an asset archive
+  PipelineManager pipelines;
+  createPipelineManager(pipelines, device, pipelineCache, renderPass, config.samples, heap.layout, &archive, false);
+
+  std::vector<uint32_t> pipelineHandles(header.pipelineCount);
+  for(uint32_t i = 0 ; i < header.pipelineCount ; i++)
+  {
+    const CapturePipeline& captured = stream.pipelines[i];
+
+    PipelineDesc desc;
+    desc.kind = PipelineKind(captured.kind);
+    desc.name = getCaptureString(captured.name);
+    desc.shaders[0] = getCaptureString(captured.shaders[0]);
+    desc.shaders[1] = getCaptureString(captured.shaders[1]);
+    desc.quantized = captured.quantized != 0;
+    desc.features = captured.features;
+    desc.specialized[0] = captured.specialized[0];
+    desc.specialized[1] = captured.specialized[1];
+
+    pipelineHandles[i] = addPipeline(pipelines, desc);
+  }
+
+  MeshAsset asset;
+  if(!findMeshAsset(archive, kCaptureMeshName, asset) || asset.header->vertexSize != sizeof(Vertex))
+  {
+    printf("Replay: no mesh in %s\n", options.capturePath);
+    return 1;
+  }
+
+  MeshView view = {};
+  view.vertices = static_cast<const Vertex*>(asset.vertices);
+  view.vertexCount = asset.header->vertexCount;
+  view.indices = asset.indices;
+  view.indexCount = asset.header->indexCount;
+  view.shortIndices = asset.header->indexSize == 2;
+  memcpy(view.center, asset.header->center, sizeof(view.center));
+  view.radius = asset.header->radius;
+
+  GpuMesh mesh;
+  createGpuMesh(mesh, view, header.quantized != 0, device, allocator, uploader);
+  flushUploads(uploader);
+
+  uint32_t maxDrawData = 0;
+  for(const CaptureFrameHeader* frame : stream.frames)
+    maxDrawData = std::max(maxDrawData, countDrawData(frame));
+
+  TransientAllocator transient;
+  createTransientAllocator(transient, device, physicalDevice, allocator, heap, options.framesInFlight, maxDrawData * kBindlessDynamicUniformRange, false);
+
+  VkSemaphore frameTimeline = createTimelineSemaphore(device);
+  uint64_t frameTimelineValue = 0;
+
+  ReplayFrame frames[kMaxFramesInFlight] = {};
+  for(uint32_t i = 0 ; i < options.framesInFlight ; i++)
+  {
+    ReplayFrame& frame = frames[i];
+
+    VkCommandPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = families.graphics;
+    VK_CHECK(vkCreateCommandPool(device, &poolInfo, 0, &frame.commandPool));
+
+    VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+    allocateInfo.commandPool = frame.commandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 1;
+    VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &frame.commandBuffer));
+
+    VkQueryPoolCreateInfo queryInfo = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+    queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryInfo.queryCount = 2;
+    VK_CHECK(vkCreateQueryPool(device, &queryInfo, 0, &frame.timestampPool));
+  }
+
+  // Nothing is timed until every pipeline and the mesh are in, the same place the headless renderer waits
+  waitForUploads(uploader);
+  waitForPipelines(pipelines);
+  updatePipelines(pipelines, 0, 0);
+
+  for(uint32_t i = 0 ; i < header.pipelineCount ; i++)
+  {
+    if(getPipeline(pipelines, pipelineHandles[i]) == VK_NULL_HANDLE)
+    {
+      printf("Replay: pipeline %s failed to build\n", stream.pipelines[i].name);
+      return 1;
+    }
+  }
+
+  ReplayContext context = {};
+  context.pipelines = &pipelines;
+  context.pipelineHandles = &pipelineHandles;
+  context.heap = &heap;
+  context.mesh = &mesh;
+  context.transient = &transient;
+  context.pipelineBarrier2 = isSynchronization2Supported(physicalDevice) ? (PFN_vkCmdPipelineBarrier2KHR)vkGetDeviceProcAddr(device, "vkCmdPipelineBarrier2KHR") : NULL;
+  context.renderPass = renderPass;
+
+  ReplayTarget target = {};
+
+  std::vector<ReplayResult> results;
+  results.reserve(stream.frames.size() * options.loops);
+
+  printf("Replay: %zu frames, %u pipelines, %u loops on %s\n", stream.frames.size(), header.pipelineCount, options.loops, props.deviceName);
+
+  double start = getTimeMs();
+
+  for(uint32_t loop = 0 ; loop < options.loops ; loop++)
+  {
+    double loopStart = getTimeMs();
+
+    for(const CaptureFrameHeader* captured : stream.frames)
+    {
+      uint32_t frameSlot = uint32_t(results.size() % options.framesInFlight);
+      ReplayFrame& frame = frames[frameSlot];
+
+      waitTimelineSemaphore(device, frameTimeline, frame.timelineValue);
+
+      // The slot's last frame is done, its timestamps are there without waiting
+      if(frame.timelineValue)
+      {
+        uint64_t timestamps[2];
+        if(vkGetQueryPoolResults(device, frame.timestampPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+          results[frame.replayed].gpuTime = double(timestamps[1] - timestamps[0]) * props.limits.timestampPeriod * 1e-6;
+      }
+
+      if(options.paced)
+      {
+        double due = loopStart + captured->time;
+        double now = getTimeMs();
+        if(due > now)
+          std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(due - now));
+      }
+
+      double recordStart = getTimeMs();
+
+      if(target.width != captured->width || target.height != captured->height)
+      {
+        if(target.framebuffer)
+        {
+          VK_CHECK(vkDeviceWaitIdle(device));
+          destroyReplayTarget(target, device, allocator);
+        }
+
+        createReplayTarget(target, device, allocator, renderPass, config, captured->width, captured->height);
+      }
+
+      beginTransientFrame(transient, frameSlot);
+
+      VkCommandBuffer commandBuffer = frame.commandBuffer;
+
+      VK_CHECK(vkResetCommandPool(device, frame.commandPool, 0));
+
+      VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+      beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+      VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+      uint64_t uploadWaitValue = acquireUploads(uploader, commandBuffer);
+
+      if(target.fresh)
+      {
+        VkImageMemoryBarrier barrier = imageBarrier(target.color.image, 0, VK_IMAGE_LAYOUT_UNDEFINED, 0, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_DEPENDENCY_BY_REGION_BIT, 0, 0, 0, 0, 1, &barrier);
+        target.fresh = false;
+      }
+
+      vkCmdResetQueryPool(commandBuffer, frame.timestampPool, 0, 2);
+      vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.timestampPool, 0);
+
+      replayCommands(context, commandBuffer, target, reinterpret_cast<const uint8_t*>(captured + 1), captured->size);
+
+      vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.timestampPool, 1);
+
+      VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+      fenceTransient(transient);
+
+      frame.timelineValue = ++frameTimelineValue;
+      frame.replayed = uint32_t(results.size());
+
+      VkPipelineStageFlags uploadWaitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+      VkTimelineSemaphoreSubmitInfo timelineInfo = { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+      timelineInfo.waitSemaphoreValueCount = uploadWaitValue ? 1 : 0;
+      timelineInfo.pWaitSemaphoreValues = &uploadWaitValue;
+      timelineInfo.signalSemaphoreValueCount = 1;
+      timelineInfo.pSignalSemaphoreValues = &frame.timelineValue;
+
+      VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+      submitInfo.pNext = &timelineInfo;
+      submitInfo.waitSemaphoreCount = uploadWaitValue ? 1 : 0;
+      submitInfo.pWaitSemaphores = &uploader.timeline;
+      submitInfo.pWaitDstStageMask = &uploadWaitStage;
+      submitInfo.commandBufferCount = 1;
+      submitInfo.pCommandBuffers = &commandBuffer;
+      submitInfo.signalSemaphoreCount = 1;
+      submitInfo.pSignalSemaphores = &frameTimeline;
+
+      VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+      results.push_back({ captured->frameIndex, getTimeMs() - recordStart, -1.0 });
+    }
+  }
+
+  VK_CHECK(vkDeviceWaitIdle(device));
+
+  double seconds = (getTimeMs() - start) / 1000.0;
+
+  // The last frame of every slot was never picked up in the loop
+  for(uint32_t i = 0 ; i < options.framesInFlight ; i++)
+  {
+    ReplayFrame& frame = frames[i];
+
+    uint64_t timestamps[2];
+    if(frame.timelineValue && vkGetQueryPoolResults(device, frame.timestampPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+      results[frame.replayed].gpuTime = double(timestamps[1] - timestamps[0]) * props.limits.timestampPeriod * 1e-6;
+  }
+
+  std::vector<double> cpuTimes, gpuTimes;
+  for(const ReplayResult& result : results)
+  {
+    cpuTimes.push_back(result.cpuTime);
+    if(result.gpuTime >= 0)
+      gpuTimes.push_back(result.gpuTime);
+  }
+
+  printf("Replay: %zu frames in %.2f s (%.1f fps)%s\n", results.size(), seconds, results.size() / seconds, options.paced ? ", paced" : "");
+  printTimes("CPU", cpuTimes);
+  printTimes("GPU", gpuTimes);
+
+  if(options.csvPath && writeResults(options.csvPath, results))
+    printf("Replay: per frame times written to %s\n", options.csvPath);
+
+  if(target.framebuffer)
+    destroyReplayTarget(target, device, allocator);
+
+  for(uint32_t i = 0 ; i < options.framesInFlight ; i++)
+  {
+    vkDestroyQueryPool(device, frames[i].timestampPool, NULL);
+    vkFreeCommandBuffers(device, frames[i].commandPool, 1, &frames[i].commandBuffer);
+    vkDestroyCommandPool(device, frames[i].commandPool, NULL);
+  }
+
+  vkDestroySemaphore(device, frameTimeline, NULL);
+  destroyTransientAllocator(transient, allocator);
+  destroyGpuMesh(mesh, device, allocator);
+  destroyPipelineManager(pipelines);
+  vkDestroyRenderPass(device, renderPass, NULL);
+  destroyPipelineCache(pipelineCache, device);
+  destroyBindlessHeap(heap);
+  destroyUploadManager(uploader, allocator);
+  destroyMemoryAllocator(allocator);
+
+  vkDestroyDevice(device, NULL);
+  vkDestroyInstance(instance, NULL);
+
+  closeArchive(archive);
+}
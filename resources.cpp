@@ -0,0 +1,196 @@
+#include "resources.h"
+
+void createBuffer(Buffer& result, VkDevice device, MemoryAllocator& allocator, size_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryFlags, VkMemoryPropertyFlags preferredFlags)
+{
+  VkBufferCreateInfo createInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+  createInfo.size = size;
+  createInfo.usage = usage;
+
+  VkBuffer buffer = 0;
+  VK_CHECK(vkCreateBuffer(device, &createInfo, 0, &buffer));
+
+  VkMemoryRequirements memoryRequirements;
+  vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
+
+  Allocation allocation = allocateMemory(allocator, memoryRequirements, ResourceKind_Linear, memoryFlags, preferredFlags);
+
+  VK_CHECK(vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset));
+
+  result.buffer = buffer;
+  result.allocation = allocation;
+  result.data = allocation.data; // The allocator keeps host visible blocks mapped
+  result.size = size;
+  result.memoryFlags = getMemoryFlags(allocator, allocation);
+}
+
+void destroyBuffer(const Buffer& buffer, VkDevice device, MemoryAllocator& allocator)
+{
+  vkDestroyBuffer(device, buffer.buffer, 0);
+  freeMemory(allocator, buffer.allocation);
+}
+
+// Allocations in non coherent memory are aligned to nonCoherentAtomSize, so the range can be flushed as is
+static VkMappedMemoryRange getMappedRange(const Buffer& buffer)
+{
+  VkMappedMemoryRange range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE };
+  range.memory = buffer.allocation.memory;
+  range.offset = buffer.allocation.offset;
+  range.size = buffer.allocation.block == ~0u ? VK_WHOLE_SIZE : buffer.allocation.size;
+  return range;
+}
+
+void flushBuffer(const Buffer& buffer, VkDevice device)
+{
+  if(buffer.memoryFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+    return;
+
+  VkMappedMemoryRange range = getMappedRange(buffer);
+  VK_CHECK(vkFlushMappedMemoryRanges(device, 1, &range));
+}
+
+void invalidateBuffer(const Buffer& buffer, VkDevice device)
+{
+  if(buffer.memoryFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+    return;
+
+  VkMappedMemoryRange range = getMappedRange(buffer);
+  VK_CHECK(vkInvalidateMappedMemoryRanges(device, 1, &range));
+}
+
+void createImage(Image& result, VkDevice device, MemoryAllocator& allocator, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, uint32_t mipLevels, uint32_t familyCount, const uint32_t* families)
+{
+  VkImageCreateInfo createInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+  createInfo.imageType = VK_IMAGE_TYPE_2D;
+  createInfo.format = format;
+  createInfo.extent = { width, height, 1 };
+  createInfo.mipLevels = mipLevels;
+  createInfo.arrayLayers = 1;
+  createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  createInfo.usage = usage;
+  createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  if(familyCount > 1)
+  {
+    createInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    createInfo.queueFamilyIndexCount = familyCount;
+    createInfo.pQueueFamilyIndices = families;
+  }
+
+  VkImage image = 0;
+  VK_CHECK(vkCreateImage(device, &createInfo, 0, &image));
+
+  VkMemoryRequirements memoryRequirements;
+  vkGetImageMemoryRequirements(device, image, &memoryRequirements);
+
+  Allocation allocation = allocateMemory(allocator, memoryRequirements, ResourceKind_Optimal, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  VK_CHECK(vkBindImageMemory(device, image, allocation.memory, allocation.offset));
+
+  result.image = image;
+  result.imageView = createImageView(device, image, format, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+  result.allocation = allocation;
+}
+
+void destroyImage(const Image& image, VkDevice device, MemoryAllocator& allocator)
+{
+  vkDestroyImageView(device, image.imageView, 0);
+  vkDestroyImage(device, image.image, 0);
+  freeMemory(allocator, image.allocation);
+}
+
+void createAttachmentImage(AttachmentImage& result, VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties, uint32_t width, uint32_t height, VkFormat format, VkSampleCountFlagBits samples, VkImageAspectFlags aspect, bool transient)
+{
+  VkImageCreateInfo createInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+  createInfo.imageType = VK_IMAGE_TYPE_2D;
+  createInfo.format = format;
+  createInfo.extent = { width, height, 1 };
+  createInfo.mipLevels = 1;
+  createInfo.arrayLayers = 1;
+  createInfo.samples = samples;
+  createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  createInfo.usage = (aspect & VK_IMAGE_ASPECT_DEPTH_BIT) ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  if(transient)
+    createInfo.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+
+  VkImage image = 0;
+  VK_CHECK(vkCreateImage(device, &createInfo, 0, &image));
+
+  VkMemoryRequirements memoryRequirements;
+  vkGetImageMemoryRequirements(device, image, &memoryRequirements);
+
+  // Desktop GPUs have no lazily allocated memory, there it's plain device local
+  uint32_t memoryType = selectMemoryType(memoryProperties, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, transient ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : 0);
+  assert(memoryType != ~0u);
+
+  VkMemoryAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+  allocateInfo.allocationSize = memoryRequirements.size;
+  allocateInfo.memoryTypeIndex = memoryType;
+
+  VkDeviceMemory memory = 0;
+  VK_CHECK(vkAllocateMemory(device, &allocateInfo, 0, &memory));
+  VK_CHECK(vkBindImageMemory(device, image, memory, 0));
+
+  result.image = image;
+  result.imageView = createImageView(device, image, format, aspect);
+  result.memory = memory;
+  result.size = memoryRequirements.size;
+  result.lazy = (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+}
+
+void destroyAttachmentImage(const AttachmentImage& image, VkDevice device)
+{
+  vkDestroyImageView(device, image.imageView, 0);
+  vkDestroyImage(device, image.image, 0);
+  vkFreeMemory(device, image.memory, 0);
+}
+
+VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t mipLevels, uint32_t baseMipLevel)
+{
+  VkImageViewCreateInfo createInfo = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+  createInfo.image = image;
+  createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  createInfo.format = format;
+  createInfo.subresourceRange.aspectMask = aspect;
+  createInfo.subresourceRange.baseMipLevel = baseMipLevel;
+  createInfo.subresourceRange.levelCount = mipLevels;
+  createInfo.subresourceRange.layerCount = 1;
+
+  VkImageView view;
+  VK_CHECK(vkCreateImageView(device, &createInfo, 0, &view));
+  
+  return view;
+}
+
+VkImageMemoryBarrier imageBarrier(VkImage image, VkAccessFlags srcAccessMask, VkImageLayout srcImageLayout, VkAccessFlags dstAccessMask, VkImageLayout dstImageLayout)
+{
+  VkImageMemoryBarrier imMemBarrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+  imMemBarrier.srcAccessMask = srcAccessMask;
+  imMemBarrier.dstAccessMask = dstAccessMask;
+  imMemBarrier.oldLayout = srcImageLayout;
+  imMemBarrier.newLayout = dstImageLayout;
+  imMemBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED; // We won't be switching graphics queues when we do this just image layouts
+  imMemBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED; // We won't be switching graphics queues when we do this just image layouts
+  imMemBarrier.image = image;
+  imMemBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT; // Assume that we don't have depth and are only transitioning color
+  imMemBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS; // Transitioning entire image like all mip levels
+  imMemBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS; // Transitioning all array layers
+
+  return imMemBarrier;
+}
+
+VkBufferMemoryBarrier bufferBarrier(VkBuffer buffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+{
+  VkBufferMemoryBarrier bufMemBarrier = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+  bufMemBarrier.srcAccessMask = srcAccessMask;
+  bufMemBarrier.dstAccessMask = dstAccessMask;
+  bufMemBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufMemBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufMemBarrier.buffer = buffer;
+  bufMemBarrier.offset = 0;
+  bufMemBarrier.size = VK_WHOLE_SIZE;
+
+  return bufMemBarrier;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "allocator.h"
+
+struct Buffer
+{
+  VkBuffer buffer;
+  Allocation allocation;
+  void* data; // Persistently mapped if the memory is host visible
+  size_t size;
+  VkMemoryPropertyFlags memoryFlags; // What we actually got, preferred flags may not be available
+};
+
+struct Image
+{
+  VkImage image;
+  VkImageView imageView;
+  Allocation allocation;
+};
+
+// Depth or multisampled color that only lives inside a render pass. Transient ones get TRANSIENT_ATTACHMENT
+// usage and lazily allocated memory where the device has it, so a tiler can keep them in tile memory and never
+// back them at all. Each has its own VkDeviceMemory, that's what lazy memory is committed per.
+struct AttachmentImage
+{
+  VkImage image;
+  VkImageView imageView;
+  VkDeviceMemory memory;
+  VkDeviceSize size;
+  bool lazy; // Memory is lazily allocated, vkGetDeviceMemoryCommitment says how much of it is really there
+};
+
+void createBuffer(Buffer& result, VkDevice device, MemoryAllocator& allocator, size_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryFlags, VkMemoryPropertyFlags preferredFlags = 0);
+void destroyBuffer(const Buffer& buffer, VkDevice device, MemoryAllocator& allocator);
+
+// Makes host writes visible to the device / device writes visible to the host when the memory isn't coherent
+void flushBuffer(const Buffer& buffer, VkDevice device);
+void invalidateBuffer(const Buffer& buffer, VkDevice device);
+
+// With more than one queue family the image is shared between them, no ownership transfers needed
+void createImage(Image& result, VkDevice device, MemoryAllocator& allocator, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, uint32_t mipLevels = 1, uint32_t familyCount = 0, const uint32_t* families = NULL);
+void destroyImage(const Image& image, VkDevice device, MemoryAllocator& allocator);
+
+// aspect picks the usage, depth or color attachment
+void createAttachmentImage(AttachmentImage& result, VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties, uint32_t width, uint32_t height, VkFormat format, VkSampleCountFlagBits samples, VkImageAspectFlags aspect, bool transient);
+void destroyAttachmentImage(const AttachmentImage& image, VkDevice device);
+
+VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT, uint32_t mipLevels = 1, uint32_t baseMipLevel = 0);
+
+VkImageMemoryBarrier imageBarrier(VkImage image, VkAccessFlags srcAccessMask, VkImageLayout srcImageLayout, VkAccessFlags dstAccessMask, VkImageLayout dstImageLayout);
+VkBufferMemoryBarrier bufferBarrier(VkBuffer buffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask);
@@ -0,0 +1,333 @@
+#include "scene.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCENE_CULL_X86 1
+#endif
+
+void createSceneObjects(SceneObjects& objects, uint32_t count)
+{
+  objects.count = count;
+  objects.capacity = (count + kSceneCullLanes - 1) / kSceneCullLanes * kSceneCullLanes;
+
+  // Capacity is a multiple of 8 floats, so every array starts 32 byte aligned too
+  size_t arraySize = size_t(objects.capacity) * sizeof(float);
+  objects.memory = static_cast<float*>(aligned_alloc(32, std::max(arraySize * 10, size_t(32))));
+  assert(objects.memory);
+
+  float** arrays[] = { &objects.offsetX, &objects.offsetY, &objects.offsetZ, &objects.scale, &objects.centerX, &objects.centerY, &objects.centerZ, &objects.extentX, &objects.extentY, &objects.extentZ };
+  for(size_t i = 0 ; i < sizeof(arrays) / sizeof(arrays[0]) ; i++)
+    *arrays[i] = objects.memory + i * objects.capacity;
+
+  memset(objects.memory, 0, arraySize * 10);
+
+  for(uint32_t i = 0 ; i < objects.capacity ; i++)
+    objects.scale[i] = 1;
+}
+
+void destroySceneObjects(SceneObjects& objects)
+{
+  free(objects.memory);
+  objects = {};
+}
+
+void updateSceneBounds(SceneObjects& objects, const float meshCenter[3], const float meshExtent[3])
+{
+  // Straight loops over the arrays, the compiler vectorizes these on its own. The padding goes through too,
+  // culling never reports it.
+  for(uint32_t i = 0 ; i < objects.capacity ; i++)
+  {
+    float scale = objects.scale[i];
+
+    objects.centerX[i] = (meshCenter[0] + objects.offsetX[i]) * scale;
+    objects.centerY[i] = (meshCenter[1] + objects.offsetY[i]) * scale;
+    objects.centerZ[i] = (meshCenter[2] + objects.offsetZ[i]) * scale;
+    objects.extentX[i] = meshExtent[0] * scale;
+    objects.extentY[i] = meshExtent[1] * scale;
+    objects.extentZ[i] = meshExtent[2] * scale;
+  }
+}
+
+CullKernel getBestCullKernel()
+{
+#ifdef SCENE_CULL_X86
+  if(__builtin_cpu_supports("avx2"))
+    return CullKernel_Avx2;
+
+  return CullKernel_Sse;
+#else
+  return CullKernel_Scalar;
+#endif
+}
+
+const char* getCullKernelName(CullKernel kernel)
+{
+  switch(kernel)
+  {
+  case CullKernel_Scalar: return "scalar";
+  case CullKernel_Sse: return "sse";
+  case CullKernel_Avx2: return "avx2";
+  }
+
+  return "?";
+}
+
+// A box touches the frustum unless it's entirely behind one plane: the center's distance to the plane against
+// the box's extent projected on the normal. The SIMD kernels do the same operations in the same order, so
+// they match this exactly rather than just closely.
+static uint32_t cullScalar(const SceneObjects& objects, const float planes[6][4], uint32_t begin, uint32_t end, uint32_t* visible)
+{
+  uint32_t visibleCount = 0;
+
+  for(uint32_t i = begin ; i < end ; i++)
+  {
+    bool inside = true;
+
+    for(uint32_t p = 0 ; p < 6 ; p++)
+    {
+      float distance = planes[p][0] * objects.centerX[i] + planes[p][1] * objects.centerY[i] + planes[p][2] * objects.centerZ[i] + planes[p][3];
+      float radius = fabsf(planes[p][0]) * objects.extentX[i] + fabsf(planes[p][1]) * objects.extentY[i] + fabsf(planes[p][2]) * objects.extentZ[i];
+
+      inside = inside && distance > -radius;
+    }
+
+    visible[visibleCount] = i;
+    visibleCount += inside;
+  }
+
+  return visibleCount;
+}
+
+// Lanes past end are padding or belong to the next range
+static inline uint32_t maskLanes(uint32_t mask, uint32_t base, uint32_t end)
+{
+  return end - base < kSceneCullLanes ? mask & ((1u << (end - base)) - 1) : mask;
+}
+
+// Stores every lane and only advances past the visible ones. Scenes with a good part of the objects visible
+// mispredict a loop over the set bits all the time, this costs the same for any mask.
+static inline uint32_t appendVisible(uint32_t mask, uint32_t base, uint32_t* visible, uint32_t visibleCount)
+{
+  for(uint32_t lane = 0 ; lane < kSceneCullLanes ; lane++)
+  {
+    visible[visibleCount] = base + lane;
+    visibleCount += (mask >> lane) & 1;
+  }
+
+  return visibleCount;
+}
+
+#ifdef SCENE_CULL_X86
+static inline __m128 cullPlanesSse(const SceneObjects& objects, const float planes[6][4], uint32_t i)
+{
+  __m128 cx = _mm_load_ps(objects.centerX + i), cy = _mm_load_ps(objects.centerY + i), cz = _mm_load_ps(objects.centerZ + i);
+  __m128 ex = _mm_load_ps(objects.extentX + i), ey = _mm_load_ps(objects.extentY + i), ez = _mm_load_ps(objects.extentZ + i);
+
+  __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+  __m128 sign = _mm_set1_ps(-0.0f);
+
+  for(uint32_t p = 0 ; p < 6 ; p++)
+  {
+    __m128 nx = _mm_set1_ps(planes[p][0]), ny = _mm_set1_ps(planes[p][1]), nz = _mm_set1_ps(planes[p][2]);
+
+    __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_mul_ps(nz, cz)), _mm_set1_ps(planes[p][3]));
+    __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign, nx), ex), _mm_mul_ps(_mm_andnot_ps(sign, ny), ey)), _mm_mul_ps(_mm_andnot_ps(sign, nz), ez));
+
+    inside = _mm_and_ps(inside, _mm_cmpgt_ps(distance, _mm_xor_ps(radius, sign)));
+  }
+
+  return inside;
+}
+
+static uint32_t cullSse(const SceneObjects& objects, const float planes[6][4], uint32_t begin, uint32_t end, uint32_t* visible)
+{
+  uint32_t visibleCount = 0;
+
+  for(uint32_t i = begin ; i < end ; i += kSceneCullLanes)
+  {
+    uint32_t mask = uint32_t(_mm_movemask_ps(cullPlanesSse(objects, planes, i))) | uint32_t(_mm_movemask_ps(cullPlanesSse(objects, planes, i + 4))) << 4;
+    visibleCount = appendVisible(maskLanes(mask, i, end), i, visible, visibleCount);
+  }
+
+  return visibleCount;
+}
+
+// Built for AVX2 on its own and only called when the CPU has it, the rest of the program stays baseline x86-64
+__attribute__((target("avx2")))
+static uint32_t cullAvx2(const SceneObjects& objects, const float planes[6][4], uint32_t begin, uint32_t end, uint32_t* visible)
+{
+  __m256 sign = _mm256_set1_ps(-0.0f);
+
+  __m256 nx[6], ny[6], nz[6], nd[6], ax[6], ay[6], az[6];
+  for(uint32_t p = 0 ; p < 6 ; p++)
+  {
+    nx[p] = _mm256_set1_ps(planes[p][0]);
+    ny[p] = _mm256_set1_ps(planes[p][1]);
+    nz[p] = _mm256_set1_ps(planes[p][2]);
+    nd[p] = _mm256_set1_ps(planes[p][3]);
+    ax[p] = _mm256_andnot_ps(sign, nx[p]);
+    ay[p] = _mm256_andnot_ps(sign, ny[p]);
+    az[p] = _mm256_andnot_ps(sign, nz[p]);
+  }
+
+  uint32_t visibleCount = 0;
+
+  for(uint32_t i = begin ; i < end ; i += kSceneCullLanes)
+  {
+    __m256 cx = _mm256_load_ps(objects.centerX + i), cy = _mm256_load_ps(objects.centerY + i), cz = _mm256_load_ps(objects.centerZ + i);
+    __m256 ex = _mm256_load_ps(objects.extentX + i), ey = _mm256_load_ps(objects.extentY + i), ez = _mm256_load_ps(objects.extentZ + i);
+
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+    for(uint32_t p = 0 ; p < 6 ; p++)
+    {
+      __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[p], cx), _mm256_mul_ps(ny[p], cy)), _mm256_mul_ps(nz[p], cz)), nd[p]);
+      __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax[p], ex), _mm256_mul_ps(ay[p], ey)), _mm256_mul_ps(az[p], ez));
+
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_xor_ps(radius, sign), _CMP_GT_OQ));
+    }
+
+    visibleCount = appendVisible(maskLanes(uint32_t(_mm256_movemask_ps(inside)), i, end), i, visible, visibleCount);
+  }
+
+  return visibleCount;
+}
+#endif
+
+uint32_t cullSceneObjects(const SceneObjects& objects, const float planes[6][4], uint32_t begin, uint32_t end, uint32_t* visible, CullKernel kernel)
+{
+  assert(begin % kSceneCullLanes == 0 && end <= objects.count);
+
+#ifdef SCENE_CULL_X86
+  if(kernel == CullKernel_Avx2)
+    return cullAvx2(objects, planes, begin, end, visible);
+
+  if(kernel == CullKernel_Sse)
+    return cullSse(objects, planes, begin, end, visible);
+#endif
+
+  return cullScalar(objects, planes, begin, end, visible);
+}
+
+uint32_t cullSceneObjectsParallel(const SceneObjects& objects, const float planes[6][4], uint32_t* visible, CullKernel kernel, WorkerPool& pool)
+{
+  uint32_t chunkCount = (objects.count + kSceneCullChunk - 1) / kSceneCullChunk;
+
+  // Each chunk writes where its objects start, then the results are moved down in order. Visible objects
+  // are usually a small part of a big scene, so the moves cost little next to the culling.
+  std::vector<uint32_t> counts(chunkCount);
+
+  parallelFor(pool, chunkCount, [&](uint32_t chunk, uint32_t)
+  {
+    uint32_t begin = chunk * kSceneCullChunk;
+    uint32_t end = std::min(begin + kSceneCullChunk, objects.count);
+
+    counts[chunk] = cullSceneObjects(objects, planes, begin, end, visible + begin, kernel);
+  }, "cull objects");
+
+  uint32_t visibleCount = 0;
+  for(uint32_t chunk = 0 ; chunk < chunkCount ; chunk++)
+  {
+    if(visibleCount != chunk * kSceneCullChunk)
+      memmove(visible + visibleCount, visible + chunk * kSceneCullChunk, counts[chunk] * sizeof(uint32_t));
+
+    visibleCount += counts[chunk];
+  }
+
+  return visibleCount;
+}
+
+static float benchmarkRandom(uint32_t& seed)
+{
+  seed = seed * 1664525u + 1013904223u;
+  return float(seed >> 8) * (1.0f / 16777216.0f);
+}
+
+void benchmarkSceneCulling(uint32_t count, uint32_t threadCount)
+{
+  const uint32_t kRuns = 20;
+
+  // Same frustum the GPU culls against, with objects scattered over twice its width so about half survive
+  const float planes[6][4] =
+  {
+    { 1, 0, 0, 1 }, { -1, 0, 0, 1 },
+    { 0, 1, 0, 1 }, { 0, -1, 0, 1 },
+    { 0, 0, 1, 1 }, { 0, 0, -1, 1 },
+  };
+
+  SceneObjects objects;
+  createSceneObjects(objects, count);
+
+  uint32_t seed = 1;
+  for(uint32_t i = 0 ; i < count ; i++)
+  {
+    float scale = 0.001f + 0.01f * benchmarkRandom(seed);
+
+    objects.offsetX[i] = (benchmarkRandom(seed) * 4 - 2) / scale;
+    objects.offsetY[i] = (benchmarkRandom(seed) * 2 - 1) / scale;
+    objects.offsetZ[i] = (benchmarkRandom(seed) * 2 - 1) / scale;
+    objects.scale[i] = scale;
+  }
+
+  const float meshCenter[3] = { 0, 0, 0 };
+  const float meshExtent[3] = { 1, 1, 1 };
+  updateSceneBounds(objects, meshCenter, meshExtent);
+
+  std::vector<uint32_t> reference(objects.capacity);
+  std::vector<uint32_t> visible(objects.capacity);
+
+  uint32_t referenceCount = cullSceneObjects(objects, planes, 0, count, reference.data(), CullKernel_Scalar);
+
+  printf("Cull benchmark, %u objects, %u visible, best of %u runs:\n", count, referenceCount, kRuns);
+
+  // Fastest run, the first ones also pay for faulting the arrays in
+  auto report = [&](const char* name, const std::function<uint32_t()>& cull)
+  {
+    double best = 1e30;
+    uint32_t visibleCount = 0;
+
+    for(uint32_t run = 0 ; run < kRuns ; run++)
+    {
+      double start = getTimeMs();
+      visibleCount = cull();
+      best = std::min(best, getTimeMs() - start);
+    }
+
+    bool match = visibleCount == referenceCount && memcmp(visible.data(), reference.data(), referenceCount * sizeof(uint32_t)) == 0;
+
+    printf("  %-16s %8.3f ms, %6.2f objects/ns%s\n", name, best, count / (best * 1e6), match ? "" : ", DOES NOT MATCH SCALAR");
+  };
+
+  CullKernel best = getBestCullKernel();
+
+  for(CullKernel kernel : { CullKernel_Scalar, CullKernel_Sse, CullKernel_Avx2 })
+  {
+    if(kernel > best)
+      break;
+
+    report(getCullKernelName(kernel), [&]() { return cullSceneObjects(objects, planes, 0, count, visible.data(), kernel); });
+  }
+
+  for(uint32_t threads = 1 ; ; threads = std::min(threads * 2, threadCount))
+  {
+    WorkerPool pool;
+    createWorkerPool(pool, threads);
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s %u threads", getCullKernelName(best), threads);
+    report(name, [&]() { return cullSceneObjectsParallel(objects, planes, visible.data(), best, pool); });
+
+    destroyWorkerPool(pool);
+
+    if(threads >= threadCount)
+      break;
+  }
+
+  destroySceneObjects(objects);
+}
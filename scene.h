@@ -0,0 +1,62 @@
+#pragma once
+
+#include "workers.h"
+
+#include <stdint.h>
+
+const uint32_t kSceneCullLanes = 8; // Objects per SIMD iteration, the arrays are padded to a multiple of it
+const uint32_t kSceneCullChunk = 4096; // Objects per task when culling on the worker pool
+
+// Every object in the scene as structure of arrays, so culling streams through exactly the floats it reads
+// and 8 objects fill an AVX register. The transforms are the offset and scale a MeshDraw has, the bounds are
+// the world space box that puts the mesh's box in, refreshed by updateSceneBounds after transforms change.
+struct SceneObjects
+{
+  uint32_t count;
+  uint32_t capacity; // count rounded up to kSceneCullLanes
+
+  float* memory; // One 32 byte aligned block for all the arrays below, capacity floats each
+
+  float* offsetX;
+  float* offsetY;
+  float* offsetZ;
+  float* scale;
+
+  float* centerX;
+  float* centerY;
+  float* centerZ;
+  float* extentX; // Half size
+  float* extentY;
+  float* extentZ;
+};
+
+enum CullKernel
+{
+  CullKernel_Scalar, // The reference the others have to match
+  CullKernel_Sse, // Two 4 wide halves per iteration
+  CullKernel_Avx2,
+};
+
+// Transforms start out as identity and bounds as empty, set the transforms and call updateSceneBounds
+void createSceneObjects(SceneObjects& objects, uint32_t count);
+void destroySceneObjects(SceneObjects& objects);
+
+// World space boxes for every object from its transform and the mesh's box, in the vertex buffer's space
+void updateSceneBounds(SceneObjects& objects, const float meshCenter[3], const float meshExtent[3]);
+
+// The fastest kernel this CPU runs, AVX2 or SSE on x86 and scalar everywhere else
+CullKernel getBestCullKernel();
+const char* getCullKernelName(CullKernel kernel);
+
+// Writes the index of every object in [begin, end) that touches the frustum to visible, in order, and returns
+// how many. begin has to be a multiple of kSceneCullLanes, and visible needs room for end - begin rounded up
+// to it, the SIMD kernels store whole groups. Planes are xyz normal pointing inside, w distance, the same test
+// cull_comp.glsl does with spheres.
+uint32_t cullSceneObjects(const SceneObjects& objects, const float planes[6][4], uint32_t begin, uint32_t end, uint32_t* visible, CullKernel kernel);
+
+// The same for every object, kSceneCullChunk objects per task across the pool. visible needs room for capacity indices.
+uint32_t cullSceneObjectsParallel(const SceneObjects& objects, const float planes[6][4], uint32_t* visible, CullKernel kernel, WorkerPool& pool);
+
+// Times every kernel and the best one on 1 to threadCount threads over count random objects, checks they all
+// agree with the scalar one
+void benchmarkSceneCulling(uint32_t count, uint32_t threadCount);
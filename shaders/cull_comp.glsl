@@ -0,0 +1,72 @@
+#version 450
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Frustum culls one object per invocation and appends a draw for every object that survives.
+// The draws are consumed by vkCmdDrawIndexedIndirectCount with the count this writes.
+
+layout (local_size_x = 64) in;
+
+struct DrawCommand
+{
+  uint indexCount;
+  uint instanceCount;
+  uint firstIndex;
+  int vertexOffset;
+  uint firstInstance;
+};
+
+layout (push_constant) uniform Cull
+{
+  vec4 planes[6]; // xyz normal pointing inside, w distance
+  vec4 meshSphere; // Bounding sphere in the vertex buffer's space
+  uint objectCount;
+  uint indexCount;
+  uint objectBuffer; // Bindless indices
+  uint drawBuffer;
+} cull;
+
+// Both alias the bindless storage buffer table in set 0.
+// Same offset and scale as the push constant in mesh_vert.glsl.
+layout (set = 0, binding = 0) readonly buffer Objects
+{
+  vec4 transforms[];
+} objectBuffers[];
+
+// The count lives in front of the draws, padded to 16 bytes
+layout (set = 0, binding = 0) buffer Draws
+{
+  uint drawCount;
+  uint pad[3];
+  DrawCommand draws[];
+} drawBuffers[];
+
+void main()
+{
+  uint objectIndex = gl_GlobalInvocationID.x;
+  if(objectIndex >= cull.objectCount)
+    return;
+
+  vec4 transform = objectBuffers[cull.objectBuffer].transforms[objectIndex];
+  vec3 center = (cull.meshSphere.xyz + transform.xyz) * transform.w;
+  float radius = cull.meshSphere.w * transform.w;
+
+  bool visible = true;
+  for(int i = 0; i < 6; i++)
+    visible = visible && dot(cull.planes[i].xyz, center) + cull.planes[i].w > -radius;
+
+  if(!visible)
+    return;
+
+  uint drawIndex = atomicAdd(drawBuffers[cull.drawBuffer].drawCount, 1);
+
+  // The vertex shader finds the object's transform through gl_InstanceIndex
+  DrawCommand draw;
+  draw.indexCount = cull.indexCount;
+  draw.instanceCount = 1;
+  draw.firstIndex = 0;
+  draw.vertexOffset = 0;
+  draw.firstInstance = objectIndex;
+
+  drawBuffers[cull.drawBuffer].draws[drawIndex] = draw;
+}
@@ -0,0 +1,66 @@
+#version 450
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+// -DTEXTURED samples the streamed textures. Also a specialization constant, constant_id is the ShaderFeature bit.
+#ifdef TEXTURED
+layout (constant_id = 3) const bool kTextured = true;
+#else
+layout (constant_id = 3) const bool kTextured = false;
+#endif
+
+layout (location = 0) in vec3 normal;
+layout (location = 1) in vec2 uv;
+layout (location = 2) flat in uint textureSlot;
+
+layout (push_constant) uniform Constants
+{
+  vec4 offsetScale;
+  uint objectBuffer;
+  uint textureTable; // Bindless index of the streamer's table for this frame, ~0u without textures
+  uint textureSampler;
+  uint textureCount;
+  uint feedbackPixel; // Pixel of every 8x8 block that writes feedback this frame
+} constants;
+
+// The texture streamer's table: the bindless image of every texture, ~0u while it's loading, then the
+// feedback the streamer reads back, per texture one plus the most texels across the uv range any pixel wanted
+layout (set = 0, binding = 0) buffer TextureTables
+{
+  uint words[];
+} textureTables[];
+
+layout (set = 1, binding = 0) uniform texture2D textures[];
+layout (set = 2, binding = 0) uniform sampler samplers[];
+
+layout (location = 0) out vec4 outputColor;
+
+void main()
+{
+  vec3 lightDirection = normalize(vec3(0.3, 0.5, 0.8));
+  float diffuse = max(dot(normalize(normal), lightDirection), 0.0);
+
+  vec3 albedo = vec3(1.0, 0, 1.0);
+
+  // Derivatives up here, they're undefined in the branches below
+  vec2 uvDx = dFdx(uv);
+  vec2 uvDy = dFdy(uv);
+
+  if(kTextured && constants.textureTable != ~0u)
+  {
+    // As a power of two, the texels across [0, 1] this pixel needs to get one texel per pixel
+    vec2 footprint = max(abs(uvDx), abs(uvDy));
+    float density = clamp(ceil(-log2(max(footprint.x, footprint.y))), 0.0, 30.0);
+
+    // A different pixel out of every 8x8 each frame, so the atomics don't all pile onto one address
+    uvec2 pixel = uvec2(gl_FragCoord.xy) & 7u;
+    if(pixel.x + pixel.y * 8u == constants.feedbackPixel)
+      atomicMax(textureTables[constants.textureTable].words[constants.textureCount + textureSlot], uint(density) + 1u);
+
+    uint image = textureTables[constants.textureTable].words[textureSlot];
+    if(image != ~0u)
+      albedo = textureGrad(sampler2D(textures[nonuniformEXT(image)], samplers[constants.textureSampler]), uv, uvDx, uvDy).rgb;
+  }
+
+  outputColor = vec4(albedo * (0.3 + 0.7 * diffuse), 1.0);
+}
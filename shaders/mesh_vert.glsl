@@ -0,0 +1,90 @@
+#version 450
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Built with -DQUANTIZED for the 16 byte vertex format (half float position and uv, octahedral normal) and
+// -DINDIRECT for draws generated by cull_comp.glsl, which read their transform from the object buffer. The push
+// constant block is shared by every pipeline through the bindless layout, so members only ever get appended.
+// -DUNIFORM_DRAWS takes the CPU draws' transform from the transient uniform set at a dynamic offset instead of
+// the push constants, for comparing the two.
+// INDIRECT and UNIFORM_DRAWS are specialization constants as well, the define only sets the default. Their
+// constant_id is the ShaderFeature bit, see variants.h and shaders/permute.sh for the variants that get built.
+
+layout (location = 0) in vec3 position;
+#ifdef QUANTIZED
+layout (location = 1) in vec2 octahedralNormal;
+#else
+layout (location = 1) in vec3 normal;
+#endif
+layout (location = 2) in vec2 uv;
+
+layout (push_constant) uniform Constants
+{
+  vec4 offsetScale; // CPU draws
+  uint objectBuffer; // Bindless index, indirect draws
+  uint textureTable; // The rest is MeshTextureConstants, see mesh_fs.glsl
+  uint textureSampler;
+  uint textureCount;
+  uint feedbackPixel;
+} constants;
+
+#ifdef INDIRECT
+layout (constant_id = 1) const bool kIndirect = true;
+#else
+layout (constant_id = 1) const bool kIndirect = false;
+#endif
+
+#ifdef UNIFORM_DRAWS
+layout (constant_id = 2) const bool kUniformDraws = true;
+#else
+layout (constant_id = 2) const bool kUniformDraws = false;
+#endif
+
+layout (set = 0, binding = 0) readonly buffer Objects
+{
+  vec4 transforms[];
+} objectBuffers[];
+
+layout (set = 4, binding = 0) uniform DrawData
+{
+  vec4 offsetScale;
+} drawData;
+
+layout (location = 0) out vec3 outputNormal;
+layout (location = 1) out vec2 outputUv;
+layout (location = 2) flat out uint outputTexture;
+
+#ifdef QUANTIZED
+vec3 decodeOctahedral(vec2 e)
+{
+  vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.y += n.y >= 0.0 ? -t : t;
+  return normalize(n);
+}
+#endif
+
+void main()
+{
+  vec4 offsetScale = constants.offsetScale;
+  if(kIndirect)
+    offsetScale = objectBuffers[constants.objectBuffer].transforms[gl_InstanceIndex];
+  else if(kUniformDraws)
+    offsetScale = drawData.offsetScale;
+
+  vec3 p = (position + offsetScale.xyz) * offsetScale.w;
+
+  // The mesh is fitted into [-1, 1], Vulkan clip space depth is [0, 1]
+  gl_Position = vec4(p.xy, p.z * 0.5 + 0.5, 1.0);
+
+#ifdef QUANTIZED
+  outputNormal = decodeOctahedral(octahedralNormal);
+#else
+  outputNormal = normal;
+#endif
+
+  // CPU and indirect draws alike have the draw's index in the scene as their instance
+  outputUv = uv;
+  outputTexture = constants.textureCount > 0 ? uint(gl_InstanceIndex) % constants.textureCount : 0;
+}
@@ -0,0 +1,77 @@
+#!/bin/sh
+# Builds the mesh shader variants and writes the manifest variants.cpp picks them from, run by make shaders.
+#
+# Every variant is a feature mask, the bits are ShaderFeature in variants.h and each one is a define here.
+# A variant with nothing specialized has its specialization constants frozen and folded by spirv-opt, the
+# code for the features it doesn't have is gone. The specialized ones keep the bits in SPECIALIZED as
+# specialization constants, set when the pipeline is created, for the combinations nobody precompiled.
+# QUANTIZED changes the vertex input, so it's always compiled in and never specialized.
+set -e
+
+cd "$(dirname "$0")"
+
+FEATURES="QUANTIZED INDIRECT UNIFORM_DRAWS TEXTURED"
+MANIFEST=variants.txt
+FROZEN=""
+
+echo "# shader features specialized path, written by permute.sh" > $MANIFEST.tmp
+
+# variant SHADER SOURCE STAGE FEATURES SPECIALIZED
+variant()
+{
+  defines=""
+  bit=1
+  for feature in $FEATURES
+  do
+    if [ $(( $4 & bit )) -ne 0 ]; then
+      defines="$defines -D$feature"
+    fi
+    bit=$(( bit * 2 ))
+  done
+
+  output="${1}_f${4}_s${5}.spv"
+  glslc -fshader-stage=$3 $defines $2 -o $output.tmp
+
+  if [ $5 -eq 0 ]; then
+    spirv-opt --freeze-spec-const -O $output.tmp -o $output
+  else
+    spirv-opt -O $output.tmp -o $output
+  fi
+  rm $output.tmp
+
+  # Features the shader doesn't look at fold to the same code, those lines share the first one's file
+  if [ $5 -eq 0 ]; then
+    for existing in $FROZEN
+    do
+      case $existing in ${1}_*) ;; *) continue ;; esac
+
+      if cmp -s $existing $output; then
+        rm $output
+        output=$existing
+        break
+      fi
+    done
+  fi
+
+  if [ $5 -eq 0 ] && [ "$output" = "${1}_f${4}_s${5}.spv" ]; then
+    FROZEN="$FROZEN $output"
+  fi
+
+  echo "$1 $4 $5 shaders/$output" >> $MANIFEST.tmp
+}
+
+# Everything the app asks for precompiled: quantized or not, times push constants, indirect or uniform draws
+for features in 0 1 2 3 4 5
+do
+  variant mesh_vert mesh_vert.glsl vertex $features 0
+done
+
+# Indirect and uniform draws left to the pipeline
+variant mesh_vert mesh_vert.glsl vertex 0 6
+variant mesh_vert mesh_vert.glsl vertex 1 6
+
+variant mesh_frag mesh_fs.glsl fragment 0 0
+variant mesh_frag mesh_fs.glsl fragment 8 0
+variant mesh_frag mesh_fs.glsl fragment 0 8
+
+mv $MANIFEST.tmp $MANIFEST
@@ -0,0 +1,145 @@
+#version 450
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Every step of the post processing chain, one of BLOOM_DOWN, BLOOM_UP, TONEMAP or FXAA picks which.
+// One invocation per destination pixel, see recordPostProcess for the order they run in.
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+// Same layout as PostConstants in post.cpp
+layout (push_constant) uniform Post
+{
+  uint source; // Sampled image
+  uint sourceLevel;
+  uint destination; // Storage image
+  uint sampler;
+  uint bloom; // Sampled, the whole bloom chain
+  uint flags;
+  float threshold;
+  float intensity;
+  float exposure;
+} post;
+
+const uint kFirstLevel = 1;
+const uint kSwapRedBlue = 2;
+
+layout (set = 1, binding = 0) uniform texture2D textures[];
+layout (set = 2, binding = 0) uniform sampler samplers[];
+
+// Both alias the bindless storage image table in set 3, the bloom chain is RGBA16F and the rest RGBA8
+layout (set = 3, binding = 0, rgba16f) uniform image2D images[];
+layout (set = 3, binding = 0, rgba8) uniform writeonly image2D images8[];
+
+vec4 sampleSource(vec2 uv, float level)
+{
+  return textureLod(sampler2D(textures[nonuniformEXT(post.source)], samplers[nonuniformEXT(post.sampler)]), uv, level);
+}
+
+float luma(vec3 color)
+{
+  return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+void main()
+{
+  ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+
+#if defined(BLOOM_DOWN) || defined(BLOOM_UP)
+  ivec2 size = imageSize(images[nonuniformEXT(post.destination)]);
+#else
+  ivec2 size = imageSize(images8[nonuniformEXT(post.destination)]);
+#endif
+
+  if(pixel.x >= size.x || pixel.y >= size.y)
+    return;
+
+  vec2 uv = (vec2(pixel) + 0.5) / vec2(size);
+
+#if defined(BLOOM_DOWN)
+  // Four bilinear taps a source texel off the center, a 4x4 box around the two by two texels this pixel covers
+  vec2 texel = 1.0 / vec2(textureSize(sampler2D(textures[nonuniformEXT(post.source)], samplers[nonuniformEXT(post.sampler)]), int(post.sourceLevel)));
+  float level = float(post.sourceLevel);
+
+  vec3 color = sampleSource(uv + vec2(-texel.x, -texel.y), level).rgb;
+  color += sampleSource(uv + vec2(texel.x, -texel.y), level).rgb;
+  color += sampleSource(uv + vec2(-texel.x, texel.y), level).rgb;
+  color += sampleSource(uv + vec2(texel.x, texel.y), level).rgb;
+  color *= 0.25;
+
+  // Only what's brighter than the threshold blooms, with a soft knee so it doesn't pop
+  if((post.flags & kFirstLevel) != 0)
+  {
+    float brightness = max(color.r, max(color.g, color.b));
+    float excess = max(brightness - post.threshold, 0.0);
+    color *= excess / max(brightness, 1e-4);
+  }
+
+  imageStore(images[nonuniformEXT(post.destination)], pixel, vec4(color, 1.0));
+#elif defined(BLOOM_UP)
+  // 3x3 tent over the smaller level below, added to what this level already has
+  vec2 texel = 1.0 / vec2(textureSize(sampler2D(textures[nonuniformEXT(post.source)], samplers[nonuniformEXT(post.sampler)]), int(post.sourceLevel)));
+  float level = float(post.sourceLevel);
+
+  vec3 color = sampleSource(uv, level).rgb * 4.0;
+  color += sampleSource(uv + vec2(-texel.x, 0.0), level).rgb * 2.0;
+  color += sampleSource(uv + vec2(texel.x, 0.0), level).rgb * 2.0;
+  color += sampleSource(uv + vec2(0.0, -texel.y), level).rgb * 2.0;
+  color += sampleSource(uv + vec2(0.0, texel.y), level).rgb * 2.0;
+  color += sampleSource(uv + vec2(-texel.x, -texel.y), level).rgb;
+  color += sampleSource(uv + vec2(texel.x, -texel.y), level).rgb;
+  color += sampleSource(uv + vec2(-texel.x, texel.y), level).rgb;
+  color += sampleSource(uv + vec2(texel.x, texel.y), level).rgb;
+  color *= 1.0 / 16.0;
+
+  vec3 current = imageLoad(images[nonuniformEXT(post.destination)], pixel).rgb;
+  imageStore(images[nonuniformEXT(post.destination)], pixel, vec4(current + color, 1.0));
+#elif defined(TONEMAP)
+  vec3 color = texelFetch(sampler2D(textures[nonuniformEXT(post.source)], samplers[nonuniformEXT(post.sampler)]), pixel, 0).rgb;
+  color += textureLod(sampler2D(textures[nonuniformEXT(post.bloom)], samplers[nonuniformEXT(post.sampler)]), uv, 0.0).rgb * post.intensity;
+  color *= post.exposure;
+
+  // Narkowicz's fit of the ACES curve
+  color = clamp((color * (2.51 * color + 0.03)) / (color * (2.43 * color + 0.59) + 0.14), 0.0, 1.0);
+
+  // The swapchain is UNORM, so the encode is ours
+  vec3 srgb = mix(color * 12.92, 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055, step(0.0031308, color));
+
+  // FXAA wants the luma next to the color
+  imageStore(images8[nonuniformEXT(post.destination)], pixel, vec4(srgb, luma(srgb)));
+#elif defined(FXAA)
+  // The small FXAA: blend along the edge direction the luma of the corners gives
+  const float kReduceMin = 1.0 / 128.0;
+  const float kReduceMul = 1.0 / 8.0;
+  const float kSpanMax = 8.0;
+
+  vec2 texel = 1.0 / vec2(size);
+
+  float lumaNW = sampleSource(uv + vec2(-texel.x, -texel.y), 0.0).a;
+  float lumaNE = sampleSource(uv + vec2(texel.x, -texel.y), 0.0).a;
+  float lumaSW = sampleSource(uv + vec2(-texel.x, texel.y), 0.0).a;
+  float lumaSE = sampleSource(uv + vec2(texel.x, texel.y), 0.0).a;
+  vec4 center = sampleSource(uv, 0.0);
+
+  float lumaMin = min(center.a, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+  float lumaMax = max(center.a, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+  vec2 direction = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));
+
+  float reduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * kReduceMul, kReduceMin);
+  float scale = 1.0 / (min(abs(direction.x), abs(direction.y)) + reduce);
+  direction = clamp(direction * scale, vec2(-kSpanMax), vec2(kSpanMax)) * texel;
+
+  vec3 near = 0.5 * (sampleSource(uv + direction * (1.0 / 3.0 - 0.5), 0.0).rgb + sampleSource(uv + direction * (2.0 / 3.0 - 0.5), 0.0).rgb);
+  vec3 far = near * 0.5 + 0.25 * (sampleSource(uv - direction * 0.5, 0.0).rgb + sampleSource(uv + direction * 0.5, 0.0).rgb);
+
+  // The wide taps went past the edge when they bring in something outside the local range
+  float lumaFar = luma(far);
+  vec3 color = (lumaFar < lumaMin || lumaFar > lumaMax) ? near : far;
+
+  if((post.flags & kSwapRedBlue) != 0)
+    color = color.bgr;
+
+  imageStore(images8[nonuniformEXT(post.destination)], pixel, vec4(color, 1.0));
+#endif
+}
@@ -1,8 +0,0 @@
-#version 450
-
-layout (location = 0) out vec4 outputColor;
-
-void main()
-{
-  outputColor = vec4(1.0, 0, 1.0, 1.0);
-}
@@ -0,0 +1,102 @@
+#include "sync.h"
+
+VkSemaphore createSemaphore(VkDevice device)
+{
+  // Create semaphore needed for presenting
+  VkSemaphoreCreateInfo createInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+
+  VkSemaphore semaphore;
+  VK_CHECK(vkCreateSemaphore(device, &createInfo, 0, &semaphore));
+
+  return semaphore;
+}
+
+VkSemaphore createTimelineSemaphore(VkDevice device, uint64_t initialValue)
+{
+  // A timeline semaphore holds a 64 bit counter, so one semaphore can track every frame we have submitted
+  VkSemaphoreTypeCreateInfo typeInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+  typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  typeInfo.initialValue = initialValue;
+
+  VkSemaphoreCreateInfo createInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+  createInfo.pNext = &typeInfo;
+
+  VkSemaphore semaphore;
+  VK_CHECK(vkCreateSemaphore(device, &createInfo, 0, &semaphore));
+
+  return semaphore;
+}
+
+void waitTimelineSemaphore(VkDevice device, VkSemaphore semaphore, uint64_t value)
+{
+  VkSemaphoreWaitInfo waitInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+  waitInfo.semaphoreCount = 1;
+  waitInfo.pSemaphores = &semaphore;
+  waitInfo.pValues = &value;
+
+  VK_CHECK(vkWaitSemaphores(device, &waitInfo, UINT64_MAX));
+}
+
+uint64_t getTimelineSemaphoreValue(VkDevice device, VkSemaphore semaphore)
+{
+  uint64_t value = 0;
+  VK_CHECK(vkGetSemaphoreCounterValue(device, semaphore, &value));
+
+  return value;
+}
+
+void deferDeletion(DeletionQueue& queue, VkObjectType type, uint64_t handle, uint64_t timelineValue)
+{
+  if(handle)
+    queue.entries.push_back({ type, handle, timelineValue });
+}
+
+static void destroyObject(VkDevice device, const DeferredDeletion& entry)
+{
+  switch(entry.type)
+  {
+  case VK_OBJECT_TYPE_FRAMEBUFFER:
+    vkDestroyFramebuffer(device, (VkFramebuffer)entry.handle, 0);
+    break;
+  case VK_OBJECT_TYPE_IMAGE_VIEW:
+    vkDestroyImageView(device, (VkImageView)entry.handle, 0);
+    break;
+  case VK_OBJECT_TYPE_IMAGE:
+    vkDestroyImage(device, (VkImage)entry.handle, 0);
+    break;
+  case VK_OBJECT_TYPE_DEVICE_MEMORY:
+    vkFreeMemory(device, (VkDeviceMemory)entry.handle, 0);
+    break;
+  case VK_OBJECT_TYPE_SEMAPHORE:
+    vkDestroySemaphore(device, (VkSemaphore)entry.handle, 0);
+    break;
+  case VK_OBJECT_TYPE_SWAPCHAIN_KHR:
+    vkDestroySwapchainKHR(device, (VkSwapchainKHR)entry.handle, 0);
+    break;
+  default:
+    assert(!"deferred deletion of an object type destroyObject doesn't know");
+  }
+}
+
+void collectDeletions(DeletionQueue& queue, VkDevice device, uint64_t completedValue)
+{
+  // Only ever a handful of entries, a swapchain, its attachments and the graph's transients at most
+  size_t kept = 0;
+  for(const DeferredDeletion& entry : queue.entries)
+  {
+    if(entry.timelineValue <= completedValue)
+    {
+      destroyObject(device, entry);
+      queue.destroyed++;
+    }
+    else
+      queue.entries[kept++] = entry;
+  }
+
+  queue.entries.resize(kept);
+}
+
+void flushDeletions(DeletionQueue& queue, VkDevice device)
+{
+  collectDeletions(queue, device, UINT64_MAX);
+}
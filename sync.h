@@ -0,0 +1,35 @@
+#pragma once
+
+#include "common.h"
+
+#include <vector>
+
+VkSemaphore createSemaphore(VkDevice device);
+VkSemaphore createTimelineSemaphore(VkDevice device, uint64_t initialValue = 0);
+
+void waitTimelineSemaphore(VkDevice device, VkSemaphore semaphore, uint64_t value);
+uint64_t getTimelineSemaphoreValue(VkDevice device, VkSemaphore semaphore);
+
+struct DeferredDeletion
+{
+  VkObjectType type;
+  uint64_t handle;
+  uint64_t timelineValue; // Destroyed once the frame timeline gets here
+};
+
+// Objects submitted frames may still use, destroyed once the frame timeline says those frames are done
+// instead of waiting for the whole device to go idle
+struct DeletionQueue
+{
+  std::vector<DeferredDeletion> entries;
+  uint32_t destroyed;
+};
+
+// Framebuffers, images, image views, memory, semaphores and swapchains, handles cast with (uint64_t) like the debug utils take them
+void deferDeletion(DeletionQueue& queue, VkObjectType type, uint64_t handle, uint64_t timelineValue);
+
+// Destroys whatever completedValue covers, call once per frame
+void collectDeletions(DeletionQueue& queue, VkDevice device, uint64_t completedValue);
+
+// Destroys everything left, the device has to be idle
+void flushDeletions(DeletionQueue& queue, VkDevice device);
@@ -0,0 +1,665 @@
+#include "textures.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+const uint32_t kFeedbackPixels = 64; // Pixels in the 8x8 block mesh_fs.glsl picks the feedback pixel from
+
+struct TextureFormatInfo
+{
+  VkFormat format;
+  uint32_t blockSize;
+  uint32_t blockBytes;
+};
+
+// What farvkr-pack writes
+static const TextureFormatInfo kTextureFormats[] =
+{
+  { VK_FORMAT_R8G8B8A8_UNORM, 1, 4 },
+  { VK_FORMAT_BC1_RGB_UNORM_BLOCK, 4, 8 },
+};
+
+static const TextureFormatInfo* findTextureFormat(VkFormat format)
+{
+  for(const TextureFormatInfo& info : kTextureFormats)
+  {
+    if(info.format == format)
+      return &info;
+  }
+
+  return NULL;
+}
+
+// Streaming copies mips between images, so it needs transfers both ways on top of filtered sampling
+static bool isTextureFormatSupported(VkPhysicalDevice physicalDevice, VkFormat format)
+{
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+  VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_TRANSFER_SRC_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+  return (properties.optimalTilingFeatures & required) == required;
+}
+
+static void unpack565(uint16_t color, uint8_t* rgb)
+{
+  rgb[0] = uint8_t(((color >> 11) & 31) * 255 / 31);
+  rgb[1] = uint8_t(((color >> 5) & 63) * 255 / 63);
+  rgb[2] = uint8_t((color & 31) * 255 / 31);
+}
+
+// For devices without BC, the other way around from compressBc1Block in pack.cpp
+static void decodeBc1(const uint8_t* blocks, uint32_t width, uint32_t height, uint8_t* pixels)
+{
+  uint32_t blocksWide = (width + 3) / 4;
+
+  for(uint32_t by = 0 ; by < (height + 3) / 4 ; by++)
+  {
+    for(uint32_t bx = 0 ; bx < blocksWide ; bx++)
+    {
+      const uint8_t* block = blocks + (size_t(by) * blocksWide + bx) * 8;
+
+      uint16_t color0 = uint16_t(block[0] | (block[1] << 8));
+      uint16_t color1 = uint16_t(block[2] | (block[3] << 8));
+      uint32_t indices = uint32_t(block[4]) | (uint32_t(block[5]) << 8) | (uint32_t(block[6]) << 16) | (uint32_t(block[7]) << 24);
+
+      uint8_t palette[4][4] = {};
+      unpack565(color0, palette[0]);
+      unpack565(color1, palette[1]);
+
+      for(uint32_t c = 0 ; c < 3 ; c++)
+      {
+        if(color0 > color1)
+        {
+          palette[2][c] = uint8_t((2 * palette[0][c] + palette[1][c]) / 3);
+          palette[3][c] = uint8_t((palette[0][c] + 2 * palette[1][c]) / 3);
+        }
+        else
+          palette[2][c] = uint8_t((palette[0][c] + palette[1][c]) / 2);
+      }
+
+      palette[0][3] = palette[1][3] = palette[2][3] = 255;
+      palette[3][3] = color0 > color1 ? 255 : 0;
+
+      for(uint32_t i = 0 ; i < 16 ; i++)
+      {
+        uint32_t x = bx * 4 + i % 4;
+        uint32_t y = by * 4 + i / 4;
+        if(x < width && y < height)
+          memcpy(pixels + (size_t(y) * width + x) * 4, palette[(indices >> (i * 2)) & 3], 4);
+      }
+    }
+  }
+}
+
+// In the format the image has, the archive's data unless it has to be decoded
+static const uint8_t* getMipData(const StreamedTexture& texture, uint32_t mip, std::vector<uint8_t>& decoded)
+{
+  const TextureMip& info = texture.header->mips[mip];
+  const uint8_t* data = texture.data + info.offset;
+
+  if(!texture.decode)
+    return data;
+
+  decoded.resize(size_t(info.width) * info.height * 4);
+  decodeBc1(data, info.width, info.height, decoded.data());
+
+  return decoded.data();
+}
+
+static size_t getRowPitch(const StreamedTexture& texture, uint32_t mip)
+{
+  return size_t((texture.header->mips[mip].width + texture.blockSize - 1) / texture.blockSize) * texture.blockBytes;
+}
+
+static uint32_t getRowCount(const StreamedTexture& texture, uint32_t mip)
+{
+  return (texture.header->mips[mip].height + texture.blockSize - 1) / texture.blockSize;
+}
+
+// What an image with mips [firstMip, mipCount) takes, near enough for planning
+static VkDeviceSize getChainBytes(const StreamedTexture& texture, uint32_t firstMip)
+{
+  VkDeviceSize bytes = 0;
+  for(uint32_t mip = firstMip ; mip < texture.header->mipCount ; mip++)
+    bytes += VkDeviceSize(getRowPitch(texture, mip)) * getRowCount(texture, mip);
+
+  return bytes;
+}
+
+static void createChainImage(TextureStreamer& streamer, const StreamedTexture& texture, uint32_t firstMip, Image& image)
+{
+  const TextureMip& top = texture.header->mips[firstMip];
+  createImage(image, streamer.device, *streamer.allocator, top.width, top.height, texture.format, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, texture.header->mipCount - firstMip);
+}
+
+static void updatePeakBytes(TextureStreamer& streamer)
+{
+  streamer.peakBytes = std::max(streamer.peakBytes, streamer.residentBytes + streamer.retiredBytes);
+}
+
+// The old image stays until the frames that may use it are done
+static void retireTextureImage(TextureStreamer& streamer, StreamedTexture& texture, uint64_t timelineValue)
+{
+  if(!texture.image.image)
+    return;
+
+  streamer.retired.push_back({ texture.image, texture.handle, texture.bytes, timelineValue });
+  streamer.residentBytes -= texture.bytes;
+  streamer.retiredBytes += texture.bytes;
+}
+
+static void swapTextureImage(TextureStreamer& streamer, StreamedTexture& texture, const Image& image, uint32_t firstMip, VkDeviceSize bytes, uint64_t timelineValue)
+{
+  retireTextureImage(streamer, texture, timelineValue);
+
+  texture.image = image;
+  texture.residentMip = firstMip;
+  texture.handle = registerSampledImage(*streamer.heap, image.imageView);
+  texture.bytes = bytes;
+  texture.changedFrame = streamer.frameIndex;
+
+  streamer.residentBytes += bytes;
+}
+
+bool createTextureStreamer(TextureStreamer& streamer, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator& allocator, UploadManager& uploader, BindlessHeap& heap, const AssetArchive& archive, uint32_t frameCount, bool memoryBudget, VkDeviceSize budgetOverride)
+{
+  streamer.device = device;
+  streamer.physicalDevice = physicalDevice;
+  streamer.allocator = &allocator;
+  streamer.uploader = &uploader;
+  streamer.heap = &heap;
+
+  // createDevice turns both on when they're there
+  VkPhysicalDeviceFeatures features;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+
+  streamer.feedback = features.fragmentStoresAndAtomics;
+  bool compression = features.textureCompressionBC && isTextureFormatSupported(physicalDevice, VK_FORMAT_BC1_RGB_UNORM_BLOCK);
+
+  for(uint32_t i = 0 ; i < archive.entryCount ; i++)
+  {
+    const ArchiveEntry& entry = archive.entries[i];
+    if(entry.kind != AssetKind_Texture)
+      continue;
+
+    TextureAsset asset;
+    if(!findTextureAsset(archive, entry.name, asset))
+    {
+      printf("Texture %s: mips outside the asset, skipped\n", entry.name);
+      continue;
+    }
+
+    const TextureFormatInfo* format = findTextureFormat(VkFormat(asset.header->format));
+    if(!format)
+    {
+      printf("Texture %s: format %u isn't one farvkr streams, skipped\n", entry.name, asset.header->format);
+      continue;
+    }
+
+    StreamedTexture texture = {};
+    texture.name = entry.name;
+    texture.header = asset.header;
+    texture.data = asset.data;
+    texture.decode = format->blockSize > 1 && !compression;
+    texture.format = texture.decode ? VK_FORMAT_R8G8B8A8_UNORM : format->format;
+    texture.blockSize = texture.decode ? 1 : format->blockSize;
+    texture.blockBytes = texture.decode ? 4 : format->blockBytes;
+
+    texture.minResidentMip = asset.header->mipCount - 1;
+    while(texture.minResidentMip > 0 && std::max(asset.header->mips[texture.minResidentMip - 1].width, asset.header->mips[texture.minResidentMip - 1].height) <= kTextureMinResidentSize)
+      texture.minResidentMip--;
+
+    texture.residentMip = asset.header->mipCount;
+    texture.handle = kBindlessInvalid;
+    texture.requestedMip = texture.minResidentMip;
+
+    streamer.textures.push_back(std::move(texture));
+  }
+
+  if(streamer.textures.empty())
+    return false;
+
+  if(compression)
+    printf("Textures: %zu streamed, BC1 on the device\n", streamer.textures.size());
+  else
+    printf("Textures: %zu streamed, BC1 decoded on load, the device can't sample it\n", streamer.textures.size());
+
+  VkSamplerCreateInfo samplerInfo = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+  samplerInfo.magFilter = VK_FILTER_LINEAR;
+  samplerInfo.minFilter = VK_FILTER_LINEAR;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+  VK_CHECK(vkCreateSampler(device, &samplerInfo, 0, &streamer.sampler));
+
+  streamer.samplerHandle = registerSampler(heap, streamer.sampler);
+
+  // Written by the CPU every frame and read back by it, so cached memory if there is some
+  uint32_t textureCount = uint32_t(streamer.textures.size());
+  streamer.frames.resize(frameCount);
+  streamer.estimates.assign(textureCount, 0);
+
+  for(TextureFrame& frame : streamer.frames)
+  {
+    createBuffer(frame.table, device, allocator, textureCount * 2 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    assert(frame.table.data);
+
+    uint32_t* words = static_cast<uint32_t*>(frame.table.data);
+    for(uint32_t i = 0 ; i < textureCount ; i++)
+    {
+      words[i] = kBindlessInvalid;
+      words[textureCount + i] = 0;
+    }
+
+    flushBuffer(frame.table, device);
+
+    frame.tableHandle = registerStorageBuffer(heap, frame.table.buffer);
+    frame.constants = { frame.tableHandle, streamer.samplerHandle, textureCount, kFeedbackPixels };
+  }
+
+  // The biggest device local heap is the one images end up in
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+  streamer.heapIndex = 0;
+  for(uint32_t i = 0 ; i < memoryProperties.memoryHeapCount ; i++)
+  {
+    const VkMemoryHeap& memoryHeap = memoryProperties.memoryHeaps[i];
+    if((memoryHeap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && memoryHeap.size > memoryProperties.memoryHeaps[streamer.heapIndex].size)
+      streamer.heapIndex = i;
+  }
+
+  streamer.memoryBudget = memoryBudget;
+  streamer.budgetOverride = budgetOverride;
+  streamer.budget = budgetOverride ? budgetOverride : memoryProperties.memoryHeaps[streamer.heapIndex].size / 2;
+
+  // The small mips go in right away, they're tiny next to the rest
+  std::vector<uint8_t> decoded;
+
+  for(StreamedTexture& texture : streamer.textures)
+  {
+    createChainImage(streamer, texture, texture.minResidentMip, texture.pending);
+    texture.pendingMip = texture.minResidentMip;
+    texture.pendingBytes = texture.pending.allocation.size;
+
+    for(uint32_t mip = texture.minResidentMip ; mip < texture.header->mipCount ; mip++)
+    {
+      const TextureMip& info = texture.header->mips[mip];
+      texture.uploadToken = uploadImageRows(uploader, texture.pending.image, mip - texture.minResidentMip, info.width, info.height, texture.blockSize, 0, getRowCount(texture, mip), getMipData(texture, mip, decoded), getRowPitch(texture, mip));
+      streamer.uploadedBytes += VkDeviceSize(getRowPitch(texture, mip)) * getRowCount(texture, mip);
+    }
+
+    texture.uploaded = true;
+
+    streamer.residentBytes += texture.pendingBytes;
+    streamer.minimumBytes += texture.pendingBytes;
+  }
+
+  updatePeakBytes(streamer);
+
+  return true;
+}
+
+void destroyTextureStreamer(TextureStreamer& streamer)
+{
+  for(StreamedTexture& texture : streamer.textures)
+  {
+    if(texture.image.image)
+    {
+      releaseBindless(*streamer.heap, BindlessKind_SampledImage, texture.handle);
+      destroyImage(texture.image, streamer.device, *streamer.allocator);
+    }
+
+    if(texture.pending.image)
+      destroyImage(texture.pending, streamer.device, *streamer.allocator);
+  }
+
+  for(RetiredTexture& retired : streamer.retired)
+  {
+    releaseBindless(*streamer.heap, BindlessKind_SampledImage, retired.handle);
+    destroyImage(retired.image, streamer.device, *streamer.allocator);
+  }
+
+  for(TextureFrame& frame : streamer.frames)
+  {
+    releaseBindless(*streamer.heap, BindlessKind_StorageBuffer, frame.tableHandle);
+    destroyBuffer(frame.table, streamer.device, *streamer.allocator);
+  }
+
+  if(!streamer.textures.empty())
+  {
+    releaseBindless(*streamer.heap, BindlessKind_Sampler, streamer.samplerHandle);
+    vkDestroySampler(streamer.device, streamer.sampler, 0);
+  }
+
+  streamer.textures.clear();
+  streamer.frames.clear();
+  streamer.retired.clear();
+}
+
+// Finer requests win right away, coarser ones only once the finer one is old enough. The feedback only
+// samples a few pixels per frame, so a texture can miss a frame or two without anything flipping back and forth.
+static void requestTextureMip(StreamedTexture& texture, uint32_t density, uint64_t frameIndex)
+{
+  const TextureMip& top = texture.header->mips[0];
+  uint32_t levels = 31 - __builtin_clz(std::max(std::max(top.width, top.height), 1u));
+  uint32_t mip = std::min(levels > density ? levels - density : 0, texture.minResidentMip);
+
+  texture.lastUsedFrame = frameIndex;
+
+  if(mip <= texture.requestedMip || frameIndex - texture.requestFrame > kTextureRequestFrames)
+  {
+    texture.requestedMip = mip;
+    texture.requestFrame = frameIndex;
+  }
+}
+
+void requestTextureDensity(TextureStreamer& streamer, uint32_t texture, uint32_t density)
+{
+  streamer.estimates[texture] = std::max(streamer.estimates[texture], density + 1);
+}
+
+// What's left of the budget after the rest of the process and everything else on the GPU, with some room for them to grow
+static void updateTextureBudget(TextureStreamer& streamer)
+{
+  if(streamer.budgetOverride || !streamer.memoryBudget)
+    return;
+
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT };
+  VkPhysicalDeviceMemoryProperties2 memoryProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2 };
+  memoryProperties.pNext = &budgetProperties;
+  vkGetPhysicalDeviceMemoryProperties2(streamer.physicalDevice, &memoryProperties);
+
+  VkDeviceSize heapBudget = budgetProperties.heapBudget[streamer.heapIndex] / 10 * 9;
+  VkDeviceSize heapUsage = budgetProperties.heapUsage[streamer.heapIndex];
+
+  VkDeviceSize ours = streamer.residentBytes + streamer.retiredBytes;
+  VkDeviceSize others = heapUsage > ours ? heapUsage - ours : 0;
+
+  streamer.budget = std::max(heapBudget > others ? heapBudget - others : 0, streamer.minimumBytes);
+}
+
+// One mip less, copied out of the current image on the GPU. Textures holding more than they asked for go
+// first, then the least recently used. With keep set, only ones used less recently than it are fair game.
+static bool evictTextureMip(TextureStreamer& streamer, const StreamedTexture* keep, uint64_t frameValue)
+{
+  StreamedTexture* victim = NULL;
+
+  for(StreamedTexture& texture : streamer.textures)
+  {
+    // An image swapped in this frame is still being copied into
+    if(&texture == keep || !texture.image.image || texture.pending.image || texture.residentMip >= texture.minResidentMip || texture.changedFrame == streamer.frameIndex)
+      continue;
+
+    bool surplus = texture.residentMip < texture.requestedMip;
+    if(keep && !surplus && texture.lastUsedFrame >= keep->lastUsedFrame)
+      continue;
+
+    bool victimSurplus = victim && victim->residentMip < victim->requestedMip;
+    if(!victim || (surplus && !victimSurplus) || (surplus == victimSurplus && texture.lastUsedFrame < victim->lastUsedFrame))
+      victim = &texture;
+  }
+
+  if(!victim)
+    return false;
+
+  uint32_t firstMip = victim->residentMip + 1;
+
+  Image image;
+  createChainImage(streamer, *victim, firstMip, image);
+
+  streamer.copies.push_back({ victim->image.image, image.image, victim->header, firstMip, victim->header->mipCount - firstMip, 1, 0 });
+
+  // The copy reads the old image in this frame
+  swapTextureImage(streamer, *victim, image, firstMip, image.allocation.size, frameValue);
+
+  streamer.mipsEvicted++;
+  return true;
+}
+
+static void startTexturePromotion(TextureStreamer& streamer, StreamedTexture& texture)
+{
+  texture.pendingMip = texture.residentMip - 1;
+  createChainImage(streamer, texture, texture.pendingMip, texture.pending);
+  texture.pendingBytes = texture.pending.allocation.size;
+  texture.uploadRow = 0;
+  texture.uploaded = false;
+
+  streamer.residentBytes += texture.pendingBytes;
+}
+
+// Hands rows of the pending mip to the uploader, as many as fit in byteBudget but always some
+static VkDeviceSize streamTextureRows(TextureStreamer& streamer, StreamedTexture& texture, VkDeviceSize byteBudget)
+{
+  uint32_t mip = texture.pendingMip;
+  const TextureMip& info = texture.header->mips[mip];
+
+  size_t rowPitch = getRowPitch(texture, mip);
+  uint32_t rowCount = getRowCount(texture, mip);
+
+  // Decoded once when the first rows go
+  const uint8_t* data = texture.decoded.empty() ? getMipData(texture, mip, texture.decoded) : texture.decoded.data();
+
+  // Queues that only copy whole mips get the whole mip
+  uint32_t granularity = streamer.uploader->rowGranularity;
+  uint32_t rows = rowCount - texture.uploadRow;
+
+  if(granularity)
+    rows = std::min(rows, std::max(uint32_t(byteBudget / rowPitch) / granularity, 1u) * granularity);
+
+  texture.uploadToken = uploadImageRows(*streamer.uploader, texture.pending.image, 0, info.width, info.height, texture.blockSize, texture.uploadRow, rows, data + size_t(texture.uploadRow) * rowPitch, rowPitch);
+  texture.uploadRow += rows;
+
+  if(texture.uploadRow == rowCount)
+  {
+    texture.uploaded = true;
+    texture.decoded = std::vector<uint8_t>();
+  }
+
+  return VkDeviceSize(rows) * rowPitch;
+}
+
+static void finishTextureLoad(TextureStreamer& streamer, StreamedTexture& texture, uint64_t frameValue)
+{
+  // A promotion copies everything below its new mip, the first load uploaded all of it
+  if(texture.image.image)
+  {
+    streamer.copies.push_back({ texture.image.image, texture.pending.image, texture.header, texture.residentMip, texture.header->mipCount - texture.residentMip, 0, 1 });
+    streamer.mipsStreamed++;
+  }
+
+  streamer.residentBytes -= texture.pendingBytes;
+  swapTextureImage(streamer, texture, texture.pending, texture.pendingMip, texture.pendingBytes, frameValue);
+
+  texture.pending = {};
+  texture.pendingBytes = 0;
+}
+
+void updateTextureStreaming(TextureStreamer& streamer, uint32_t frameSlot, uint64_t frameValue, uint64_t completedValue)
+{
+  TextureFrame& frame = streamer.frames[frameSlot];
+  uint32_t textureCount = uint32_t(streamer.textures.size());
+  uint64_t frameIndex = ++streamer.frameIndex;
+
+  streamer.copies.clear();
+
+  for(size_t i = 0 ; i < streamer.retired.size() ; )
+  {
+    RetiredTexture& retired = streamer.retired[i];
+    if(retired.timelineValue > completedValue)
+    {
+      i++;
+      continue;
+    }
+
+    releaseBindless(*streamer.heap, BindlessKind_SampledImage, retired.handle);
+    destroyImage(retired.image, streamer.device, *streamer.allocator);
+    streamer.retiredBytes -= retired.bytes;
+
+    retired = streamer.retired.back();
+    streamer.retired.pop_back();
+  }
+
+  // The slot's last frame is done, so is its feedback
+  invalidateBuffer(frame.table, streamer.device);
+
+  uint32_t* words = static_cast<uint32_t*>(frame.table.data);
+
+  for(uint32_t i = 0 ; i < textureCount ; i++)
+  {
+    uint32_t request = std::max(words[textureCount + i], streamer.estimates[i]);
+    if(request)
+      requestTextureMip(streamer.textures[i], request - 1, frameIndex);
+
+    streamer.estimates[i] = 0;
+  }
+
+  if(frameIndex % kTextureBudgetInterval == 1)
+    updateTextureBudget(streamer);
+
+  for(StreamedTexture& texture : streamer.textures)
+  {
+    if(texture.pending.image && texture.uploaded && isUploadReady(*streamer.uploader, texture.uploadToken))
+      finishTextureLoad(streamer, texture, frameValue);
+  }
+
+  // The budget went down, or other processes took some of it
+  while(streamer.residentBytes > streamer.budget && evictTextureMip(streamer, NULL, frameValue))
+    ;
+
+  // Most recently used first, and the ones furthest from what they want before those that are nearly there
+  std::vector<StreamedTexture*> order(textureCount);
+  for(uint32_t i = 0 ; i < textureCount ; i++)
+    order[i] = &streamer.textures[i];
+
+  std::sort(order.begin(), order.end(), [](const StreamedTexture* a, const StreamedTexture* b)
+  {
+    if(a->lastUsedFrame != b->lastUsedFrame)
+      return a->lastUsedFrame > b->lastUsedFrame;
+
+    return int(a->residentMip) - int(a->requestedMip) > int(b->residentMip) - int(b->requestedMip);
+  });
+
+  // Rows of the mips already on their way go first, so a started mip finishes before new ones take its bandwidth
+  VkDeviceSize frameUpload = 0;
+  VkDeviceSize queuedUpload = 0;
+
+  for(StreamedTexture* texture : order)
+  {
+    if(!texture->pending.image || texture->uploaded)
+      continue;
+
+    if(frameUpload < kTextureUploadBytesPerFrame)
+      frameUpload += streamTextureRows(streamer, *texture, kTextureUploadBytesPerFrame - frameUpload);
+
+    queuedUpload += VkDeviceSize(getRowCount(*texture, texture->pendingMip) - texture->uploadRow) * getRowPitch(*texture, texture->pendingMip);
+  }
+
+  // New mips while there's upload bandwidth for them in the next few frames and room in the budget
+  for(StreamedTexture* texture : order)
+  {
+    if(queuedUpload >= kTextureUploadBytesPerFrame * 4)
+      break;
+
+    if(!texture->image.image || texture->pending.image || texture->requestedMip >= texture->residentMip)
+      continue;
+
+    VkDeviceSize bytes = getChainBytes(*texture, texture->residentMip - 1);
+
+    while(streamer.residentBytes + bytes > streamer.budget && evictTextureMip(streamer, texture, frameValue))
+      ;
+
+    if(streamer.residentBytes + bytes > streamer.budget)
+      continue;
+
+    startTexturePromotion(streamer, *texture);
+
+    if(frameUpload < kTextureUploadBytesPerFrame)
+      frameUpload += streamTextureRows(streamer, *texture, kTextureUploadBytesPerFrame - frameUpload);
+
+    queuedUpload += VkDeviceSize(getRowCount(*texture, texture->pendingMip) - texture->uploadRow) * getRowPitch(*texture, texture->pendingMip);
+  }
+
+  streamer.uploadedBytes += frameUpload;
+  streamer.maxFrameUpload = std::max(streamer.maxFrameUpload, frameUpload);
+  updatePeakBytes(streamer);
+
+  for(uint32_t i = 0 ; i < textureCount ; i++)
+  {
+    words[i] = streamer.textures[i].handle;
+    words[textureCount + i] = 0;
+  }
+
+  flushBuffer(frame.table, streamer.device);
+
+  frame.constants.feedbackPixel = streamer.feedback ? uint32_t(frameIndex % kFeedbackPixels) : kFeedbackPixels;
+}
+
+void recordTextureStreaming(const TextureStreamer& streamer, VkCommandBuffer commandBuffer)
+{
+  if(streamer.copies.empty())
+    return;
+
+  std::vector<VkImageMemoryBarrier> barriers;
+  std::vector<VkImageCopy> regions;
+
+  // The sources were last sampled by earlier frames, the destination mips have nothing worth keeping
+  for(const TextureCopy& copy : streamer.copies)
+  {
+    barriers.push_back(imageBarrier(copy.source, 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL));
+
+    VkImageMemoryBarrier barrier = imageBarrier(copy.destination, 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    barrier.subresourceRange.baseMipLevel = copy.destinationLevel;
+    barrier.subresourceRange.levelCount = copy.mipCount;
+    barriers.push_back(barrier);
+  }
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0, 0, 0, uint32_t(barriers.size()), barriers.data());
+  barriers.clear();
+
+  for(const TextureCopy& copy : streamer.copies)
+  {
+    regions.clear();
+
+    for(uint32_t i = 0 ; i < copy.mipCount ; i++)
+    {
+      const TextureMip& mip = copy.header->mips[copy.firstMip + i];
+
+      VkImageCopy region = {};
+      region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, copy.sourceLevel + i, 0, 1 };
+      region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, copy.destinationLevel + i, 0, 1 };
+      region.extent = { mip.width, mip.height, 1 };
+      regions.push_back(region);
+    }
+
+    vkCmdCopyImage(commandBuffer, copy.source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, copy.destination, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uint32_t(regions.size()), regions.data());
+
+    VkImageMemoryBarrier barrier = imageBarrier(copy.destination, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    barrier.subresourceRange.baseMipLevel = copy.destinationLevel;
+    barrier.subresourceRange.levelCount = copy.mipCount;
+    barriers.push_back(barrier);
+  }
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, 0, 0, 0, uint32_t(barriers.size()), barriers.data());
+}
+
+MeshTextureConstants getTextureConstants(const TextureStreamer* streamer, uint32_t frameSlot)
+{
+  if(!streamer)
+    return { kBindlessInvalid, kBindlessInvalid, 0, kFeedbackPixels };
+
+  return streamer->frames[frameSlot].constants;
+}
+
+void printTextureStats(const TextureStreamer& streamer)
+{
+  const double kMB = 1024.0 * 1024.0;
+
+  printf("Textures: %zu, budget %.1f MB, %.1f MB resident, peak %.1f MB with replaced images, %.1f MB never evicted\n",
+    streamer.textures.size(), streamer.budget / kMB, streamer.residentBytes / kMB, streamer.peakBytes / kMB, streamer.minimumBytes / kMB);
+  printf("Textures: %u mips streamed in, %u evicted, %.1f MB uploaded, at most %.2f MB in one frame\n",
+    streamer.mipsStreamed, streamer.mipsEvicted, streamer.uploadedBytes / kMB, streamer.maxFrameUpload / kMB);
+}
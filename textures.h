@@ -0,0 +1,140 @@
+#pragma once
+
+#include "archive.h"
+#include "bindless.h"
+#include "mesh.h"
+#include "upload.h"
+
+#include <string>
+#include <vector>
+
+const uint32_t kTextureMinResidentSize = 128; // Mips this size and smaller are loaded up front and never evicted
+const VkDeviceSize kTextureUploadBytesPerFrame = 8 * 1024 * 1024; // Mip rows handed to the uploader per frame
+const uint32_t kTextureRequestFrames = 30; // A finer mip request holds this long before a coarser one replaces it
+const uint32_t kTextureBudgetInterval = 30; // Frames between VK_EXT_memory_budget queries
+
+struct StreamedTexture
+{
+  std::string name;
+  const TextureAssetHeader* header; // In the archive, mips are uploaded straight from the mapping
+  const uint8_t* data;
+  bool decode; // BC1 in the archive but not on the device, decoded to RGBA8 before it's uploaded
+  VkFormat format; // What the image has
+  uint32_t blockSize; // Texels per block side, 1 for uncompressed formats
+  uint32_t blockBytes;
+  uint32_t minResidentMip; // First mip no bigger than kTextureMinResidentSize, everything from here on stays
+
+  // Mips [residentMip, mipCount) of the chain. image.image is VK_NULL_HANDLE until the first load is in.
+  Image image;
+  uint32_t residentMip;
+  uint32_t handle; // Bindless, kBindlessInvalid until the first load is in
+  VkDeviceSize bytes;
+  uint64_t changedFrame; // Frame the image was swapped in
+
+  // A bigger image on its way in, VK_NULL_HANDLE if there is none. Its top mip is uploaded a few rows per
+  // frame, then the rest is copied over from the current image. The first load uploads all of it at once.
+  Image pending;
+  uint32_t pendingMip;
+  VkDeviceSize pendingBytes;
+  uint32_t uploadRow; // Rows of pendingMip handed to the uploader so far
+  bool uploaded;
+  uint64_t uploadToken;
+  std::vector<uint8_t> decoded; // pendingMip in RGBA8 while it uploads, only with decode
+
+  uint32_t requestedMip; // Finest mip the feedback or the size estimate asked for lately
+  uint64_t requestFrame;
+  uint64_t lastUsedFrame; // Eviction goes least recently used first
+};
+
+// A new image's mips copied from the image it replaces, recorded by recordTextureStreaming
+struct TextureCopy
+{
+  VkImage source;
+  VkImage destination;
+  const TextureAssetHeader* header;
+  uint32_t firstMip; // In the chain
+  uint32_t mipCount;
+  uint32_t sourceLevel; // Where firstMip is in each image
+  uint32_t destinationLevel;
+};
+
+struct RetiredTexture
+{
+  Image image;
+  uint32_t handle;
+  VkDeviceSize bytes;
+  uint64_t timelineValue; // Destroyed once the frame timeline gets here
+};
+
+// Per frame slot, the table the shaders look the textures up in and write their feedback to
+struct TextureFrame
+{
+  Buffer table; // Image handle per texture, then feedback per texture
+  uint32_t tableHandle;
+  MeshTextureConstants constants;
+};
+
+// Keeps every texture's small mips resident and streams the bigger ones in as the shaders ask for them,
+// under a memory budget. Changing what's resident builds a new image with the new mip range: a mip more
+// is uploaded and the rest copied over on the GPU, a mip less is only a copy, so evicting never uploads
+// anything and at most kTextureUploadBytesPerFrame goes to the uploader in any frame. The images are
+// swapped in the bindless heap between frames, the old ones are kept until the frames using them are done.
+struct TextureStreamer
+{
+  VkDevice device;
+  VkPhysicalDevice physicalDevice;
+  MemoryAllocator* allocator;
+  UploadManager* uploader;
+  BindlessHeap* heap;
+
+  VkSampler sampler;
+  uint32_t samplerHandle;
+  bool feedback; // fragmentStoresAndAtomics, without it requests only come from requestTextureDensity
+
+  std::vector<StreamedTexture> textures;
+  std::vector<TextureFrame> frames;
+  std::vector<uint32_t> estimates; // From requestTextureDensity since the last update, 0 for none
+
+  std::vector<TextureCopy> copies; // This frame's
+  std::vector<RetiredTexture> retired;
+
+  bool memoryBudget; // VK_EXT_memory_budget, otherwise the budget is half the heap
+  uint32_t heapIndex; // Device local heap the textures live in
+  VkDeviceSize budgetOverride; // 0 to go by the heap
+  VkDeviceSize budget;
+  VkDeviceSize minimumBytes; // What the small mips of every texture take, the budget never goes below it
+
+  VkDeviceSize residentBytes; // Current and pending images
+  VkDeviceSize retiredBytes; // Replaced, waiting for frames in flight
+  uint64_t frameIndex;
+
+  VkDeviceSize peakBytes;
+  VkDeviceSize uploadedBytes;
+  VkDeviceSize maxFrameUpload;
+  uint32_t mipsStreamed;
+  uint32_t mipsEvicted;
+};
+
+// Streams every texture in the archive, in name order, which is the order draws pick them in. The small mips
+// are uploaded right away, the archive has to stay open until the streamer is destroyed. Returns false if the
+// archive has no textures the device can use.
+bool createTextureStreamer(TextureStreamer& streamer, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator& allocator, UploadManager& uploader, BindlessHeap& heap, const AssetArchive& archive, uint32_t frameCount, bool memoryBudget, VkDeviceSize budgetOverride);
+
+// The device has to be idle
+void destroyTextureStreamer(TextureStreamer& streamer);
+
+// Asks for the mip that has 2^density texels across the uv range, for when there's no shader feedback
+void requestTextureDensity(TextureStreamer& streamer, uint32_t texture, uint32_t density);
+
+// Call once per frame after acquireUploads, when the frame slot's last frame is done. Reads that frame's
+// feedback, swaps in finished images, starts new ones and evicts to stay in the budget. frameValue is what
+// the frame timeline reaches once this frame is done, completedValue where it is now.
+void updateTextureStreaming(TextureStreamer& streamer, uint32_t frameSlot, uint64_t frameValue, uint64_t completedValue);
+
+// The copies updateTextureStreaming queued, outside a render pass and before anything samples the textures
+void recordTextureStreaming(const TextureStreamer& streamer, VkCommandBuffer commandBuffer);
+
+// What the mesh shaders need for the frame slot, untextured without a streamer
+MeshTextureConstants getTextureConstants(const TextureStreamer* streamer, uint32_t frameSlot);
+
+void printTextureStats(const TextureStreamer& streamer);
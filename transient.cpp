@@ -0,0 +1,143 @@
+#include "transient.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define TRANSIENT_STREAMING_X86
+#endif
+
+void createTransientAllocator(TransientAllocator& allocator, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator& memoryAllocator, const BindlessHeap& heap, uint32_t frameCount, VkDeviceSize frameSize, bool streamingCopy)
+{
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  allocator.device = device;
+  allocator.alignment = std::max(properties.limits.minUniformBufferOffsetAlignment, VkDeviceSize(16));
+  allocator.frameSize = (std::max(frameSize, kTransientFrameSize) + allocator.alignment - 1) / allocator.alignment * allocator.alignment;
+  allocator.streamingCopy = streamingCopy;
+
+  // Dynamic offsets are 32 bit
+  assert(allocator.frameSize * frameCount <= ~0u);
+
+  createBuffer(allocator.buffer, device, memoryAllocator, allocator.frameSize * frameCount, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  assert(allocator.buffer.data && (uintptr_t(allocator.buffer.data) & 15) == 0);
+
+  VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 };
+
+  VkDescriptorPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+  poolInfo.maxSets = 1;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+  VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, 0, &allocator.descriptorPool));
+
+  VkDescriptorSetAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+  allocateInfo.descriptorPool = allocator.descriptorPool;
+  allocateInfo.descriptorSetCount = 1;
+  allocateInfo.pSetLayouts = &heap.dynamicUniformLayout;
+  VK_CHECK(vkAllocateDescriptorSets(device, &allocateInfo, &allocator.uniformSet));
+
+  // Written once, draws only ever change the dynamic offset
+  VkDescriptorBufferInfo bufferInfo = { allocator.buffer.buffer, 0, kBindlessDynamicUniformRange };
+
+  VkWriteDescriptorSet write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+  write.dstSet = allocator.uniformSet;
+  write.dstBinding = 0;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+  write.pBufferInfo = &bufferInfo;
+  vkUpdateDescriptorSets(device, 1, &write, 0, NULL);
+
+  allocator.frameSlot = 0;
+  allocator.offset = 0;
+  allocator.pushBytes = 0;
+
+  allocator.frames = 0;
+  allocator.totalBytes = 0;
+  allocator.totalPushBytes = 0;
+  allocator.peakBytes = 0;
+
+  printf("Transient: %u frame slots of %.1f MB, %u byte alignment, %s memory%s\n", frameCount, allocator.frameSize / (1024.0 * 1024.0), uint32_t(allocator.alignment),
+    (allocator.buffer.memoryFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ? "device local" : "host", streamingCopy ? ", streaming copies" : "");
+}
+
+void destroyTransientAllocator(TransientAllocator& allocator, MemoryAllocator& memoryAllocator)
+{
+  vkDestroyDescriptorPool(allocator.device, allocator.descriptorPool, 0);
+  destroyBuffer(allocator.buffer, allocator.device, memoryAllocator);
+}
+
+void beginTransientFrame(TransientAllocator& allocator, uint32_t frameSlot)
+{
+  VkDeviceSize used = allocator.offset;
+  if(used || allocator.pushBytes)
+  {
+    allocator.frames++;
+    allocator.totalBytes += used;
+    allocator.totalPushBytes += allocator.pushBytes;
+    allocator.peakBytes = std::max(allocator.peakBytes, used);
+  }
+
+  allocator.frameSlot = frameSlot;
+  allocator.offset = 0;
+  allocator.pushBytes = 0;
+}
+
+TransientAllocation allocateTransient(TransientAllocator& allocator, VkDeviceSize size)
+{
+  size = (size + allocator.alignment - 1) / allocator.alignment * allocator.alignment;
+
+  VkDeviceSize offset = allocator.offset.fetch_add(size);
+  assert(offset + size <= allocator.frameSize);
+
+  offset += allocator.frameSlot * allocator.frameSize;
+
+  TransientAllocation allocation;
+  allocation.data = static_cast<char*>(allocator.buffer.data) + offset;
+  allocation.offset = uint32_t(offset);
+  return allocation;
+}
+
+void copyTransient(const TransientAllocator& allocator, void* destination, const void* source, size_t size)
+{
+  assert((uintptr_t(destination) & 15) == 0 && (size & 15) == 0);
+
+#ifdef TRANSIENT_STREAMING_X86
+  if(allocator.streamingCopy)
+  {
+    __m128i* dst = static_cast<__m128i*>(destination);
+    const __m128i* src = static_cast<const __m128i*>(source);
+
+    for(size_t i = 0 ; i < size / 16 ; i++)
+      _mm_stream_si128(dst + i, _mm_loadu_si128(src + i));
+    return;
+  }
+#endif
+
+  memcpy(destination, source, size);
+}
+
+void fenceTransient(const TransientAllocator& allocator)
+{
+#ifdef TRANSIENT_STREAMING_X86
+  if(allocator.streamingCopy)
+    _mm_sfence();
+#endif
+}
+
+void bindTransientUniforms(const TransientAllocator& allocator, VkCommandBuffer commandBuffer, VkPipelineLayout layout, uint32_t offset)
+{
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, kBindlessDynamicUniformSet, 1, &allocator.uniformSet, 1, &offset);
+}
+
+void printTransientStats(const TransientAllocator& allocator)
+{
+  if(!allocator.frames)
+    return;
+
+  printf("Transient: %.1f KB uniforms and %.1f KB push constants per frame on average over %u frames, %.1f KB peak of %.1f KB per slot\n",
+    allocator.totalBytes / 1024.0 / allocator.frames, allocator.totalPushBytes / 1024.0 / allocator.frames, allocator.frames,
+    allocator.peakBytes / 1024.0, allocator.frameSize / 1024.0);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "bindless.h"
+#include "resources.h"
+
+#include <atomic>
+
+const VkDeviceSize kTransientFrameSize = 4 * 1024 * 1024; // Per frame slot, the smallest createTransientAllocator makes
+
+// Where an allocation went. offset is from the start of the buffer, which is what the dynamic offset of the
+// uniform set wants.
+struct TransientAllocation
+{
+  void* data;
+  uint32_t offset;
+};
+
+// Data the CPU writes once per frame and the GPU reads once, bump allocated from one persistently mapped
+// buffer. The buffer has a region per frame slot, and a region only starts over once its slot's last frame is
+// done, so nothing is ever freed or waited for. Allocating is one atomic add, so the threads recording
+// secondaries allocate side by side. Every allocation starts on minUniformBufferOffsetAlignment and the
+// uniform set covers kBindlessDynamicUniformRange bytes of the buffer at the offset a draw binds it with.
+// The memory is device local as well as host visible where the device has that (resizable BAR, integrated
+// GPUs), which is write combined: fast as long as it's written in order and never read back.
+struct TransientAllocator
+{
+  VkDevice device;
+  Buffer buffer;
+  VkDeviceSize frameSize;
+  VkDeviceSize alignment;
+  bool streamingCopy; // copyTransient uses non temporal stores
+
+  VkDescriptorPool descriptorPool;
+  VkDescriptorSet uniformSet; // The whole buffer as set kBindlessDynamicUniformSet
+
+  uint32_t frameSlot;
+  std::atomic<VkDeviceSize> offset; // Into the slot's region
+  std::atomic<VkDeviceSize> pushBytes; // Push constants recorded this frame, for comparing against
+
+  uint32_t frames;
+  VkDeviceSize totalBytes;
+  VkDeviceSize totalPushBytes;
+  VkDeviceSize peakBytes; // Most any frame took
+};
+
+// frameSize is rounded up to kTransientFrameSize
+void createTransientAllocator(TransientAllocator& allocator, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator& memoryAllocator, const BindlessHeap& heap, uint32_t frameCount, VkDeviceSize frameSize, bool streamingCopy);
+void destroyTransientAllocator(TransientAllocator& allocator, MemoryAllocator& memoryAllocator);
+
+// Once per frame, after the slot's wait and before anything allocates. Counts what the frame before used.
+void beginTransientFrame(TransientAllocator& allocator, uint32_t frameSlot);
+
+// Any thread. size is rounded up to the alignment, running out of the slot's region is a bug.
+TransientAllocation allocateTransient(TransientAllocator& allocator, VkDeviceSize size);
+
+// Copies into transient memory, with streamingCopy in non temporal stores that go around the cache and fill
+// whole write combining buffers. destination 16 byte aligned, which allocations always are, and size a multiple of 16.
+void copyTransient(const TransientAllocator& allocator, void* destination, const void* source, size_t size);
+
+// Streaming stores aren't ordered with anything else, every thread that copied calls this before its
+// copies may be submitted
+void fenceTransient(const TransientAllocator& allocator);
+
+// Binds the uniform set for a draw whose data is at offset
+void bindTransientUniforms(const TransientAllocator& allocator, VkCommandBuffer commandBuffer, VkPipelineLayout layout, uint32_t offset);
+
+void printTransientStats(const TransientAllocator& allocator);
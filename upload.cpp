@@ -0,0 +1,370 @@
+#include "upload.h"
+
+#include "sync.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+const VkDeviceSize kUploadAlignment = 16;
+
+void createUploadManager(UploadManager& manager, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator& allocator, VkQueue queue, uint32_t familyIndex, uint32_t dstFamilyIndex, VkDeviceSize stagingSize)
+{
+  manager.device = device;
+  manager.queue = queue;
+  manager.familyIndex = familyIndex;
+  manager.dstFamilyIndex = dstFamilyIndex;
+  manager.ownershipTransfer = familyIndex != dstFamilyIndex;
+
+  // Graphics and compute families always copy any texel, dedicated transfer families may want coarser pieces
+  uint32_t familyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, 0);
+
+  std::vector<VkQueueFamilyProperties> families(familyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+  manager.rowGranularity = families[familyIndex].minImageTransferGranularity.height;
+
+  // Written once by the CPU and read once by the copy, so uncached write combined memory is what we want
+  createBuffer(manager.staging, device, allocator, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  assert(manager.staging.data);
+
+  manager.head = 0;
+  manager.tail = 0;
+
+  manager.timeline = createTimelineSemaphore(device);
+  manager.timelineValue = 0;
+  manager.acquiredValue = 0;
+
+  for(uint32_t i = 0 ; i < kUploadBatchCount ; i++)
+  {
+    UploadBatch& batch = manager.batches[i];
+
+    VkCommandPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = familyIndex;
+    VK_CHECK(vkCreateCommandPool(device, &poolInfo, 0, &batch.commandPool));
+
+    VkCommandBufferAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+    allocateInfo.commandPool = batch.commandPool;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 1;
+    VK_CHECK(vkAllocateCommandBuffers(device, &allocateInfo, &batch.commandBuffer));
+
+    batch.timelineValue = 0;
+    batch.recording = false;
+  }
+
+  manager.currentBatch = 0;
+
+  manager.bytesUploaded = 0;
+  manager.batchesSubmitted = 0;
+  manager.stallTime = 0;
+}
+
+void destroyUploadManager(UploadManager& manager, MemoryAllocator& allocator)
+{
+  if(manager.timelineValue)
+    waitTimelineSemaphore(manager.device, manager.timeline, manager.timelineValue);
+
+  for(uint32_t i = 0 ; i < kUploadBatchCount ; i++)
+    vkDestroyCommandPool(manager.device, manager.batches[i].commandPool, 0);
+
+  vkDestroySemaphore(manager.device, manager.timeline, 0);
+  destroyBuffer(manager.staging, manager.device, allocator);
+}
+
+static UploadBatch& beginBatch(UploadManager& manager)
+{
+  UploadBatch& batch = manager.batches[manager.currentBatch];
+  if(batch.recording)
+    return batch;
+
+  // With a handful of batches this is long done unless uploads outrun the transfer queue
+  if(batch.timelineValue)
+    waitTimelineSemaphore(manager.device, manager.timeline, batch.timelineValue);
+
+  VK_CHECK(vkResetCommandPool(manager.device, batch.commandPool, 0));
+
+  VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_CHECK(vkBeginCommandBuffer(batch.commandBuffer, &beginInfo));
+
+  batch.recording = true;
+  return batch;
+}
+
+// Frees the ring space of every finished batch, they stay in flight until the graphics queue acquires them
+static void retireBatches(UploadManager& manager)
+{
+  uint64_t completed = getTimelineSemaphoreValue(manager.device, manager.timeline);
+
+  for(const UploadAcquire& acquire : manager.inFlight)
+  {
+    if(acquire.timelineValue > completed)
+      break;
+
+    manager.tail = std::max(manager.tail, acquire.stagingEnd);
+  }
+}
+
+static VkDeviceSize reserveStaging(UploadManager& manager, VkDeviceSize size)
+{
+  VkDeviceSize ringSize = manager.staging.size;
+  assert(size <= ringSize / 2);
+
+  for(;;)
+  {
+    VkDeviceSize begin = (manager.head + kUploadAlignment - 1) & ~(kUploadAlignment - 1);
+
+    // A copy can't wrap around the end of the ring, start over at the beginning instead
+    if(begin % ringSize + size > ringSize)
+      begin = (begin / ringSize + 1) * ringSize;
+
+    if(begin + size - manager.tail <= ringSize)
+    {
+      manager.head = begin + size;
+      return begin % ringSize;
+    }
+
+    retireBatches(manager);
+
+    if(begin + size - manager.tail <= ringSize)
+      continue;
+
+    // Still full, the data we need to overwrite belongs to a batch that hasn't finished yet
+    double waitStart = getTimeMs();
+
+    flushUploads(manager);
+
+    for(const UploadAcquire& acquire : manager.inFlight)
+    {
+      if(acquire.stagingEnd > manager.tail)
+      {
+        waitTimelineSemaphore(manager.device, manager.timeline, acquire.timelineValue);
+        manager.tail = acquire.stagingEnd;
+        break;
+      }
+    }
+
+    manager.stallTime += getTimeMs() - waitStart;
+  }
+}
+
+uint64_t uploadBufferData(UploadManager& manager, const Buffer& buffer, VkDeviceSize offset, const void* data, size_t size)
+{
+  assert(offset + size <= buffer.size);
+
+  // Big uploads go through in pieces, so they never need more than half the ring at once
+  VkDeviceSize chunkSize = manager.staging.size / 2;
+
+  for(VkDeviceSize done = 0 ; done < size ; )
+  {
+    VkDeviceSize copySize = std::min(VkDeviceSize(size) - done, chunkSize);
+    VkDeviceSize stagingOffset = reserveStaging(manager, copySize);
+
+    memcpy(static_cast<char*>(manager.staging.data) + stagingOffset, static_cast<const char*>(data) + done, copySize);
+
+    UploadBatch& batch = beginBatch(manager);
+
+    VkBufferCopy region = { stagingOffset, offset + done, copySize };
+    vkCmdCopyBuffer(batch.commandBuffer, manager.staging.buffer, buffer.buffer, 1, &region);
+
+    if(manager.ownershipTransfer)
+    {
+      VkBufferMemoryBarrier release = bufferBarrier(buffer.buffer, VK_ACCESS_TRANSFER_WRITE_BIT, 0);
+      release.srcQueueFamilyIndex = manager.familyIndex;
+      release.dstQueueFamilyIndex = manager.dstFamilyIndex;
+      release.offset = offset + done;
+      release.size = copySize;
+
+      manager.releases.push_back(release);
+    }
+
+    done += copySize;
+  }
+
+  manager.bytesUploaded += size;
+
+  // The batch that holds the last piece signals this value, and batches finish in order
+  return manager.timelineValue + 1;
+}
+
+uint64_t uploadImageRows(UploadManager& manager, VkImage image, uint32_t mipLevel, uint32_t width, uint32_t height, uint32_t blockSize, uint32_t firstRow, uint32_t rowCount, const void* data, size_t rowPitch)
+{
+  uint32_t totalRows = (height + blockSize - 1) / blockSize;
+  assert(firstRow + rowCount <= totalRows);
+  assert(manager.rowGranularity ? firstRow % manager.rowGranularity == 0 : (firstRow == 0 && rowCount == totalRows));
+
+  // Pieces of whole rows, and a multiple of what the queue can copy. Without a granularity it's the whole mip at once.
+  VkDeviceSize chunkRows = rowCount;
+  if(manager.rowGranularity)
+    chunkRows = std::max(VkDeviceSize(manager.staging.size / 2 / rowPitch) / manager.rowGranularity, VkDeviceSize(1)) * manager.rowGranularity;
+  assert(std::min(chunkRows, VkDeviceSize(rowCount)) * rowPitch <= manager.staging.size / 2);
+
+  VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, mipLevel, 1, 0, 1 };
+
+  for(uint32_t done = 0 ; done < rowCount ; )
+  {
+    uint32_t copyRows = uint32_t(std::min(VkDeviceSize(rowCount - done), chunkRows));
+    VkDeviceSize copySize = VkDeviceSize(copyRows) * rowPitch;
+    VkDeviceSize stagingOffset = reserveStaging(manager, copySize);
+
+    memcpy(static_cast<char*>(manager.staging.data) + stagingOffset, static_cast<const char*>(data) + size_t(done) * rowPitch, copySize);
+
+    UploadBatch& batch = beginBatch(manager);
+
+    // Nothing in the mip is worth keeping before its first rows go in
+    if(firstRow + done == 0)
+    {
+      VkImageMemoryBarrier barrier = imageBarrier(image, 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+      barrier.subresourceRange = range;
+
+      vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, 0, 0, 0, 1, &barrier);
+    }
+
+    uint32_t y = (firstRow + done) * blockSize;
+
+    VkBufferImageCopy region = {};
+    region.bufferOffset = stagingOffset;
+    region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mipLevel, 0, 1 };
+    region.imageOffset = { 0, int32_t(y), 0 };
+    region.imageExtent = { width, std::min(copyRows * blockSize, height - y), 1 };
+    vkCmdCopyBufferToImage(batch.commandBuffer, manager.staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    done += copyRows;
+  }
+
+  // The last rows hand the mip to the shaders
+  if(firstRow + rowCount == totalRows)
+  {
+    VkImageMemoryBarrier release = imageBarrier(image, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    release.subresourceRange = range;
+
+    if(manager.ownershipTransfer)
+    {
+      release.srcQueueFamilyIndex = manager.familyIndex;
+      release.dstQueueFamilyIndex = manager.dstFamilyIndex;
+    }
+
+    manager.imageReleases.push_back(release);
+  }
+
+  manager.bytesUploaded += VkDeviceSize(rowCount) * rowPitch;
+
+  return manager.timelineValue + 1;
+}
+
+void flushUploads(UploadManager& manager)
+{
+  UploadBatch& batch = manager.batches[manager.currentBatch];
+  if(!batch.recording)
+    return;
+
+  UploadAcquire acquire = {};
+
+  if(!manager.releases.empty() || !manager.imageReleases.empty())
+  {
+    vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, 0, uint32_t(manager.releases.size()), manager.releases.data(), uint32_t(manager.imageReleases.size()), manager.imageReleases.data());
+
+    // The acquire has to match the release apart from the access masks
+    for(VkBufferMemoryBarrier& barrier : manager.releases)
+    {
+      barrier.srcAccessMask = 0;
+      barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    }
+
+    acquire.barriers.swap(manager.releases);
+
+    // Within one family the release was just the layout change, the semaphore wait covers the rest
+    if(manager.ownershipTransfer)
+    {
+      for(VkImageMemoryBarrier& barrier : manager.imageReleases)
+      {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+      }
+
+      acquire.imageBarriers.swap(manager.imageReleases);
+    }
+
+    manager.imageReleases.clear();
+  }
+
+  VK_CHECK(vkEndCommandBuffer(batch.commandBuffer));
+
+  flushBuffer(manager.staging, manager.device);
+
+  // The semaphore signal makes the copies available, the wait in the graphics submit makes them visible
+  batch.timelineValue = ++manager.timelineValue;
+  batch.recording = false;
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo = { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+  timelineInfo.signalSemaphoreValueCount = 1;
+  timelineInfo.pSignalSemaphoreValues = &batch.timelineValue;
+
+  VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+  submitInfo.pNext = &timelineInfo;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &batch.commandBuffer;
+  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pSignalSemaphores = &manager.timeline;
+
+  VK_CHECK(vkQueueSubmit(manager.queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+  acquire.timelineValue = batch.timelineValue;
+  acquire.stagingEnd = manager.head;
+  manager.inFlight.push_back(std::move(acquire));
+
+  manager.currentBatch = (manager.currentBatch + 1) % kUploadBatchCount;
+  manager.batchesSubmitted++;
+}
+
+uint64_t acquireUploads(UploadManager& manager, VkCommandBuffer commandBuffer)
+{
+  uint64_t completed = getTimelineSemaphoreValue(manager.device, manager.timeline);
+  uint64_t waitValue = 0;
+
+  std::vector<VkBufferMemoryBarrier> barriers;
+  std::vector<VkImageMemoryBarrier> imageBarriers;
+
+  // Only finished batches, waiting on one that is still copying would stall the whole frame
+  while(!manager.inFlight.empty() && manager.inFlight.front().timelineValue <= completed)
+  {
+    UploadAcquire& acquire = manager.inFlight.front();
+
+    barriers.insert(barriers.end(), acquire.barriers.begin(), acquire.barriers.end());
+    imageBarriers.insert(imageBarriers.end(), acquire.imageBarriers.begin(), acquire.imageBarriers.end());
+    manager.tail = std::max(manager.tail, acquire.stagingEnd);
+    waitValue = acquire.timelineValue;
+
+    manager.inFlight.pop_front();
+  }
+
+  if(!barriers.empty() || !imageBarriers.empty())
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, 0, uint32_t(barriers.size()), barriers.data(), uint32_t(imageBarriers.size()), imageBarriers.data());
+
+  if(waitValue)
+    manager.acquiredValue = waitValue;
+
+  return waitValue;
+}
+
+bool isUploadReady(const UploadManager& manager, uint64_t token)
+{
+  return token <= manager.acquiredValue;
+}
+
+void waitForUploads(UploadManager& manager)
+{
+  flushUploads(manager);
+
+  if(manager.timelineValue)
+    waitTimelineSemaphore(manager.device, manager.timeline, manager.timelineValue);
+}
+
+void printUploadStats(const UploadManager& manager)
+{
+  printf("Uploads: %.1f MB in %u batches on family %u, %.2f ms stalled on a full staging ring\n",
+    double(manager.bytesUploaded) / (1024 * 1024), manager.batchesSubmitted, manager.familyIndex, manager.stallTime);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "resources.h"
+
+#include <deque>
+#include <vector>
+
+const VkDeviceSize kUploadRingSize = 64 * 1024 * 1024;
+const uint32_t kUploadBatchCount = 4; // Batches that can be in flight on the transfer queue at once
+
+struct UploadBatch
+{
+  VkCommandPool commandPool;
+  VkCommandBuffer commandBuffer;
+  uint64_t timelineValue; // Signaled when the batch is done, 0 if it was never submitted
+  bool recording;
+};
+
+// Ownership acquires the graphics queue still has to record for a submitted batch
+struct UploadAcquire
+{
+  uint64_t timelineValue;
+  VkDeviceSize stagingEnd; // Ring space before this is free once the batch is done
+  std::vector<VkBufferMemoryBarrier> barriers;
+  std::vector<VkImageMemoryBarrier> imageBarriers;
+};
+
+// Streams data to device local buffers through a persistently mapped staging ring. Copies are batched into one
+// submit per flush on the transfer queue, which is a dedicated DMA queue when the device has one. Each upload
+// hands back a token, a value on the upload timeline, and the render loop only ever picks up batches that are
+// already done, so a big upload never holds up a frame.
+struct UploadManager
+{
+  VkDevice device;
+  VkQueue queue;
+  uint32_t familyIndex;
+  uint32_t dstFamilyIndex; // Family that uses the uploaded resources
+  bool ownershipTransfer; // Families differ, so buffers are released here and acquired on the graphics queue
+  uint32_t rowGranularity; // Image copies start on a multiple of this many rows, 0 if the queue only copies whole mips
+
+  Buffer staging;
+  VkDeviceSize head; // Byte positions that only ever grow, the ring offset is position % size
+  VkDeviceSize tail;
+
+  VkSemaphore timeline;
+  uint64_t timelineValue; // Last value submitted
+  uint64_t acquiredValue; // Uploads up to this value are usable on the graphics queue
+
+  UploadBatch batches[kUploadBatchCount];
+  uint32_t currentBatch;
+
+  std::vector<VkBufferMemoryBarrier> releases; // For the batch being recorded
+  std::vector<VkImageMemoryBarrier> imageReleases; // Layout changes to SHADER_READ_ONLY_OPTIMAL, also releases with ownershipTransfer
+  std::deque<UploadAcquire> inFlight;
+
+  uint64_t bytesUploaded;
+  uint32_t batchesSubmitted;
+  double stallTime; // ms spent waiting for ring space
+};
+
+void createUploadManager(UploadManager& manager, VkDevice device, VkPhysicalDevice physicalDevice, MemoryAllocator& allocator, VkQueue queue, uint32_t familyIndex, uint32_t dstFamilyIndex, VkDeviceSize stagingSize = kUploadRingSize);
+void destroyUploadManager(UploadManager& manager, MemoryAllocator& allocator);
+
+// Copies data into the ring and records the copy into the current batch. Only blocks if the ring is full.
+// Returns the token to check with isUploadReady, valid once the batch is flushed.
+uint64_t uploadBufferData(UploadManager& manager, const Buffer& buffer, VkDeviceSize offset, const void* data, size_t size);
+
+// Uploads rows [firstRow, firstRow + rowCount) of one mip, rows of blockSize x blockSize texel blocks for
+// compressed formats, tightly packed rowPitch apart starting at data. The mip goes to TRANSFER_DST_OPTIMAL with
+// its first row and to SHADER_READ_ONLY_OPTIMAL with its last, so a big mip can be spread over a few frames.
+// firstRow has to be a multiple of rowGranularity, or 0 with every row at once if that's 0. The token is the
+// one to wait for once the last rows are in.
+uint64_t uploadImageRows(UploadManager& manager, VkImage image, uint32_t mipLevel, uint32_t width, uint32_t height, uint32_t blockSize, uint32_t firstRow, uint32_t rowCount, const void* data, size_t rowPitch);
+
+// Submits the current batch if anything was recorded, call once per frame
+void flushUploads(UploadManager& manager);
+
+// Call while recording a graphics command buffer. Records the acquires for every batch that has finished and
+// returns the value the submit has to wait for on manager.timeline, 0 if there is nothing to wait for.
+// The wait is always already satisfied, it is only there for the memory dependency.
+uint64_t acquireUploads(UploadManager& manager, VkCommandBuffer commandBuffer);
+
+// True once the upload has been acquired, so it can be used from the command buffer acquireUploads recorded into
+bool isUploadReady(const UploadManager& manager, uint64_t token);
+
+// Waits for everything flushed so far, for loading screens and shutdown
+void waitForUploads(UploadManager& manager);
+
+void printUploadStats(const UploadManager& manager);
@@ -0,0 +1,136 @@
+#include "variants.h"
+
+bool loadShaderVariants(ShaderVariantRegistry& registry, const char* manifestPath)
+{
+  registry.requests = 0;
+  registry.precompiled = 0;
+  registry.specializedShaders = 0;
+
+  FILE* file = fopen(manifestPath, "r");
+  if(!file)
+  {
+    printf("Shader variants: can't open %s, make shaders writes it\n", manifestPath);
+    return false;
+  }
+
+  // shader features specialized path, # starts a comment
+  char line[512];
+  while(fgets(line, sizeof(line), file))
+  {
+    if(line[0] == '#' || line[0] == '\n')
+      continue;
+
+    char shader[128], path[256];
+    unsigned features = 0, specialized = 0;
+    if(sscanf(line, "%127s %u %u %255s", shader, &features, &specialized, path) != 4)
+    {
+      printf("Shader variants: bad line in %s: %s", manifestPath, line);
+      continue;
+    }
+
+    registry.variants.push_back({ shader, features, specialized, path });
+  }
+
+  fclose(file);
+
+  printf("Shader variants: %zu in %s\n", registry.variants.size(), manifestPath);
+  return !registry.variants.empty();
+}
+
+ShaderFeatures getShaderFeatureMask(const ShaderVariantRegistry& registry, const char* shader)
+{
+  ShaderFeatures mask = 0;
+
+  for(const ShaderVariant& variant : registry.variants)
+  {
+    if(variant.shader == shader)
+      mask |= variant.features | variant.specialized;
+  }
+
+  return mask;
+}
+
+const ShaderVariant* findShaderVariant(const ShaderVariantRegistry& registry, const char* shader, ShaderFeatures features)
+{
+  features &= getShaderFeatureMask(registry, shader);
+
+  const ShaderVariant* best = NULL;
+
+  for(const ShaderVariant& variant : registry.variants)
+  {
+    if(variant.shader != shader)
+      continue;
+
+    // What isn't specialized has to be compiled in exactly
+    if((features & ~variant.specialized) != variant.features)
+      continue;
+
+    // Fewer specialization constants means more was folded at build time, a precompiled one has none
+    if(!best || __builtin_popcount(variant.specialized) < __builtin_popcount(best->specialized))
+      best = &variant;
+  }
+
+  return best;
+}
+
+bool getVariantPipelineDesc(const ShaderVariantRegistry& registry, const char* name, const char* vertexShader, const char* fragmentShader, ShaderFeatures features, PipelineDesc& desc)
+{
+  const ShaderVariant* vertex = findShaderVariant(registry, vertexShader, features);
+  const ShaderVariant* fragment = findShaderVariant(registry, fragmentShader, features);
+
+  if(!vertex || !fragment)
+    return false;
+
+  // Only what the shaders look at, so feature sets that make no difference to them come out the same
+  desc.kind = PipelineKind_Graphics;
+  desc.name = name;
+  desc.shaders[0] = vertex->path;
+  desc.shaders[1] = fragment->path;
+  desc.quantized = (features & ShaderFeature_Quantized) != 0;
+  desc.features = features & (vertex->specialized | fragment->specialized);
+  desc.specialized[0] = vertex->specialized;
+  desc.specialized[1] = fragment->specialized;
+
+  return true;
+}
+
+uint32_t addVariantPipeline(ShaderVariantRegistry& registry, PipelineManager& manager, const char* name, const char* vertexShader, const char* fragmentShader, ShaderFeatures features)
+{
+  registry.requests++;
+
+  PipelineDesc desc;
+  if(!getVariantPipelineDesc(registry, name, vertexShader, fragmentShader, features, desc))
+  {
+    printf("Shader variants: nothing in the manifest builds %s and %s with features 0x%x\n", vertexShader, fragmentShader, features);
+    return ~0u;
+  }
+
+  for(const VariantPipeline& existing : registry.pipelines)
+  {
+    const PipelineDesc& other = existing.desc;
+
+    if(other.shaders[0] == desc.shaders[0] && other.shaders[1] == desc.shaders[1] && other.quantized == desc.quantized &&
+      other.features == desc.features && other.specialized[0] == desc.specialized[0] && other.specialized[1] == desc.specialized[1])
+      return existing.pipeline;
+  }
+
+  for(uint32_t specialized : desc.specialized)
+  {
+    if(specialized)
+      registry.specializedShaders++;
+    else
+      registry.precompiled++;
+  }
+
+  registry.pipelines.push_back({ desc, addPipeline(manager, desc) });
+  return registry.pipelines.back().pipeline;
+}
+
+void printShaderVariantStats(const ShaderVariantRegistry& registry)
+{
+  if(!registry.requests)
+    return;
+
+  printf("Shader variants: %u requests made %zu pipelines, %u shaders precompiled and %u specialized\n",
+    registry.requests, registry.pipelines.size(), registry.precompiled, registry.specializedShaders);
+}
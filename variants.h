@@ -0,0 +1,68 @@
+#pragma once
+
+#include "pipelines.h"
+
+#include <string>
+#include <vector>
+
+// Feature bits the mesh shaders are built with. Each one is a define in the GLSL, and where it doesn't change
+// the shader's interface also a specialization constant with the bit's index as constant_id.
+enum ShaderFeature
+{
+  ShaderFeature_Quantized = 1 << 0, // QUANTIZED, the 16 byte vertex format, never specialized since the vertex input changes
+  ShaderFeature_Indirect = 1 << 1, // INDIRECT, transforms from the object buffer for GPU culled draws
+  ShaderFeature_UniformDraws = 1 << 2, // UNIFORM_DRAWS, transforms from the transient uniform set
+  ShaderFeature_Textured = 1 << 3, // TEXTURED, samples the streamed textures
+};
+
+typedef uint32_t ShaderFeatures;
+
+const char* const kShaderVariantManifest = "shaders/variants.txt";
+
+// A line of the manifest shaders/permute.sh writes
+struct ShaderVariant
+{
+  std::string shader; // What it was built from, mesh_vert say
+  ShaderFeatures features; // Compiled in with defines
+  ShaderFeatures specialized; // Left as specialization constants, 0 for a variant with everything folded
+  std::string path;
+};
+
+struct VariantPipeline
+{
+  PipelineDesc desc; // What it was resolved to, shaders and specialization
+  uint32_t pipeline; // Handle into the manager it was added to
+};
+
+// Picks the SPIR-V for a feature set out of the manifest. A precompiled variant with exactly those features
+// comes first, its specialization constants are already folded and the code for the other features gone.
+// Anything the build didn't precompile falls back to a variant that has the rest as specialization constants,
+// so every combination works without an uber shader branching at runtime. Pipelines are deduplicated on what
+// they resolve to, asking twice or for features a shader doesn't look at gets the same handle.
+struct ShaderVariantRegistry
+{
+  std::vector<ShaderVariant> variants;
+  std::vector<VariantPipeline> pipelines; // All in one manager
+
+  uint32_t requests;
+  uint32_t precompiled; // Shaders resolved to a folded variant
+  uint32_t specializedShaders; // Resolved to one with specialization constants
+};
+
+// false if the manifest is missing or has nothing in it, make shaders writes it
+bool loadShaderVariants(ShaderVariantRegistry& registry, const char* manifestPath);
+
+// The features shader looks at, the union of what its variants were built with
+ShaderFeatures getShaderFeatureMask(const ShaderVariantRegistry& registry, const char* shader);
+
+// NULL if no variant can do those features
+const ShaderVariant* findShaderVariant(const ShaderVariantRegistry& registry, const char* shader, ShaderFeatures features);
+
+// Fills in a graphics pipeline for the two shaders with these features, false if either has no variant for them
+bool getVariantPipelineDesc(const ShaderVariantRegistry& registry, const char* name, const char* vertexShader, const char* fragmentShader, ShaderFeatures features, PipelineDesc& desc);
+
+// The pipeline's handle in manager, the same one for every request that resolves the same way. Every request
+// has to go to the same manager. ~0u if there is no variant for the features.
+uint32_t addVariantPipeline(ShaderVariantRegistry& registry, PipelineManager& manager, const char* name, const char* vertexShader, const char* fragmentShader, ShaderFeatures features);
+
+void printShaderVariantStats(const ShaderVariantRegistry& registry);
@@ -0,0 +1,325 @@
+#include "workers.h"
+
+#include <algorithm>
+
+#include <string.h>
+
+// Which thread of which pool this is. The thread driving a pool isn't one of its workers, it's thread 0.
+static thread_local const WorkerPool* gCurrentPool = NULL;
+static thread_local uint32_t gCurrentThread = 0;
+static thread_local uint32_t gJobDepth = 0; // Jobs running on this thread, more than 1 when a job waits for others
+
+static uint32_t getCurrentThread(const WorkerPool& pool)
+{
+  return gCurrentPool == &pool ? gCurrentThread : 0;
+}
+
+static void wakeSleepers(WorkerPool& pool)
+{
+  std::lock_guard<std::mutex> lock(pool.mutex);
+  if(pool.sleeping)
+    pool.wake.notify_all();
+}
+
+static void pushJobs(WorkerPool& pool, uint32_t threadIndex, Job* const* jobs, size_t count)
+{
+  WorkerThread& thread = *pool.queues[threadIndex];
+  {
+    // queued changes with the deque, so it never counts a job someone already took
+    std::lock_guard<std::mutex> lock(thread.mutex);
+    thread.jobs.insert(thread.jobs.end(), jobs, jobs + count);
+    pool.queued += uint32_t(count);
+  }
+
+  wakeSleepers(pool);
+}
+
+// Newest job of our own, or the oldest one of the next thread that has any
+static Job* takeJob(WorkerPool& pool, uint32_t threadIndex)
+{
+  if(pool.queued == 0)
+    return NULL;
+
+  uint32_t threadCount = uint32_t(pool.queues.size());
+
+  for(uint32_t i = 0 ; i < threadCount ; i++)
+  {
+    WorkerThread& thread = *pool.queues[(threadIndex + i) % threadCount];
+
+    std::lock_guard<std::mutex> lock(thread.mutex);
+    if(thread.jobs.empty())
+      continue;
+
+    Job* job = NULL;
+    if(i == 0)
+    {
+      job = thread.jobs.back();
+      thread.jobs.pop_back();
+    }
+    else
+    {
+      job = thread.jobs.front();
+      thread.jobs.pop_front();
+    }
+
+    pool.queued--;
+    return job;
+  }
+
+  return NULL;
+}
+
+static void signalCounter(WorkerPool& pool, JobCounter& counter)
+{
+  std::vector<Job*> ready;
+  {
+    std::lock_guard<std::mutex> lock(counter.mutex);
+    if(--counter.pending != 0)
+      return;
+
+    ready.swap(counter.waiting);
+  }
+
+  // Whoever waits on the counter may be asleep, pushing wakes them too
+  if(ready.empty())
+    wakeSleepers(pool);
+  else
+    pushJobs(pool, getCurrentThread(pool), ready.data(), ready.size());
+}
+
+static void executeJob(WorkerPool& pool, Job* job, uint32_t threadIndex)
+{
+  WorkerThread& thread = *pool.queues[threadIndex];
+
+  gJobDepth++;
+  double start = getTimeMs();
+  job->function(threadIndex);
+  double end = getTimeMs();
+  gJobDepth--;
+
+  thread.timings.push_back({ job->name, start, end });
+
+  // A job run while another one waits is already in that one's time
+  if(gJobDepth == 0)
+    thread.busyTime += end - start;
+
+  if(job->signal)
+    signalCounter(pool, *job->signal);
+
+  delete job;
+}
+
+static void workerThread(WorkerPool* pool, uint32_t threadIndex)
+{
+  gCurrentPool = pool;
+  gCurrentThread = threadIndex;
+
+  for(;;)
+  {
+    if(Job* job = takeJob(*pool, threadIndex))
+    {
+      executeJob(*pool, job, threadIndex);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    pool->sleeping++;
+    pool->wake.wait(lock, [&]() { return pool->quit || pool->queued != 0; });
+    pool->sleeping--;
+
+    if(pool->quit)
+      return;
+  }
+}
+
+void createWorkerPool(WorkerPool& pool, uint32_t threadCount)
+{
+  assert(threadCount > 0);
+
+  pool.queued = 0;
+  pool.sleeping = 0;
+  pool.quit = false;
+
+  pool.trace = NULL;
+  pool.traceBase = getTimeMs();
+  pool.statsStart = pool.traceBase;
+
+  for(uint32_t i = 0 ; i < threadCount ; i++)
+  {
+    pool.queues.push_back(new WorkerThread());
+    pool.queues.back()->busyTime = 0;
+  }
+
+  for(uint32_t i = 1 ; i < threadCount ; i++)
+    pool.threads.emplace_back(workerThread, &pool, i);
+}
+
+void destroyWorkerPool(WorkerPool& pool)
+{
+  {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.quit = true;
+  }
+  pool.wake.notify_all();
+
+  for(std::thread& thread : pool.threads)
+    thread.join();
+
+  pool.threads.clear();
+
+  for(WorkerThread* thread : pool.queues)
+  {
+    assert(thread->jobs.empty());
+    delete thread;
+  }
+
+  pool.queues.clear();
+
+  if(pool.trace)
+  {
+    fprintf(pool.trace, "\n]\n");
+    fclose(pool.trace);
+    pool.trace = NULL;
+  }
+}
+
+uint32_t getWorkerThreadCount(const WorkerPool& pool)
+{
+  return uint32_t(pool.threads.size()) + 1;
+}
+
+void runJob(WorkerPool& pool, const char* name, const JobFunction& function, JobCounter* signal, JobCounter* after)
+{
+  Job* job = new Job{ name, function, signal };
+
+  if(signal)
+    signal->pending++;
+
+  if(after)
+  {
+    // signalCounter takes the waiting jobs under the same lock, so the job can't be left behind
+    std::lock_guard<std::mutex> lock(after->mutex);
+    if(after->pending != 0)
+    {
+      after->waiting.push_back(job);
+      return;
+    }
+  }
+
+  pushJobs(pool, getCurrentThread(pool), &job, 1);
+}
+
+void waitForJobs(WorkerPool& pool, JobCounter& counter)
+{
+  uint32_t threadIndex = getCurrentThread(pool);
+
+  while(counter.pending != 0)
+  {
+    if(Job* job = takeJob(pool, threadIndex))
+    {
+      executeJob(pool, job, threadIndex);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    pool.sleeping++;
+    pool.wake.wait(lock, [&]() { return counter.pending == 0 || pool.queued != 0; });
+    pool.sleeping--;
+  }
+
+  // The last job may still be inside signalCounter, the counter can go away once it's out
+  std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void parallelFor(WorkerPool& pool, uint32_t taskCount, const WorkerTask& task, const char* name)
+{
+  // Waking the workers costs more than a single task is worth
+  if(pool.threads.empty() || taskCount <= 1)
+  {
+    uint32_t threadIndex = getCurrentThread(pool);
+    for(uint32_t i = 0 ; i < taskCount ; i++)
+      task(i, threadIndex);
+    return;
+  }
+
+  JobCounter counter;
+  counter.pending = taskCount;
+
+  // Pushed last to first, so this thread starts at the first task and the others steal from the far end
+  std::vector<Job*> jobs(taskCount);
+  for(uint32_t i = 0 ; i < taskCount ; i++)
+    jobs[taskCount - 1 - i] = new Job{ name, [&task, i](uint32_t threadIndex) { task(i, threadIndex); }, &counter };
+
+  pushJobs(pool, getCurrentThread(pool), jobs.data(), jobs.size());
+  waitForJobs(pool, counter);
+}
+
+bool setJobTrace(WorkerPool& pool, const char* path)
+{
+  assert(!pool.trace);
+
+  pool.trace = fopen(path, "w");
+  if(!pool.trace)
+    return false;
+
+  fprintf(pool.trace, "[\n");
+  fprintf(pool.trace, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"farvkr jobs\"}}");
+
+  for(uint32_t i = 0 ; i < pool.queues.size() ; i++)
+    fprintf(pool.trace, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}", i, i == 0 ? "main" : "worker", i);
+
+  return true;
+}
+
+void collectJobTimings(WorkerPool& pool)
+{
+  for(uint32_t i = 0 ; i < pool.queues.size() ; i++)
+  {
+    WorkerThread& thread = *pool.queues[i];
+
+    for(const JobTiming& timing : thread.timings)
+    {
+      double time = timing.end - timing.start;
+
+      // Only a handful of names
+      JobStats* stats = NULL;
+      for(JobStats& existing : pool.stats)
+        if(existing.name == timing.name || strcmp(existing.name, timing.name) == 0)
+          stats = &existing;
+
+      if(!stats)
+      {
+        pool.stats.push_back({ timing.name, 0, 0, 0 });
+        stats = &pool.stats.back();
+      }
+
+      stats->count++;
+      stats->totalTime += time;
+      stats->maxTime = std::max(stats->maxTime, time);
+
+      // Chrome trace wants microseconds
+      if(pool.trace)
+        fprintf(pool.trace, ",\n{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", timing.name, i, (timing.start - pool.traceBase) * 1000.0, time * 1000.0);
+    }
+
+    thread.timings.clear();
+  }
+}
+
+void printJobStats(WorkerPool& pool)
+{
+  collectJobTimings(pool);
+
+  if(pool.stats.empty())
+    return;
+
+  double elapsed = getTimeMs() - pool.statsStart;
+
+  printf("Jobs: %u threads over %.1f s\n", getWorkerThreadCount(pool), elapsed / 1000.0);
+
+  for(const JobStats& stats : pool.stats)
+    printf("  %-20s %8u jobs, %.3f ms mean, %.3f ms max, %.1f ms total\n", stats.name, stats.count, stats.totalTime / stats.count, stats.maxTime, stats.totalTime);
+
+  for(uint32_t i = 0 ; i < pool.queues.size() ; i++)
+    printf("  thread %u busy %.1f%%\n", i, elapsed > 0 ? pool.queues[i]->busyTime / elapsed * 100.0 : 0.0);
+}
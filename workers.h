@@ -0,0 +1,109 @@
+#pragma once
+
+#include "common.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::function<void(uint32_t taskIndex, uint32_t threadIndex)> WorkerTask;
+typedef std::function<void(uint32_t threadIndex)> JobFunction;
+
+struct Job;
+
+// Counts jobs that haven't finished. Jobs can be started after a counter reaches zero, and waitForJobs
+// blocks on one. A counter can be reused once it's back at zero.
+struct JobCounter
+{
+  std::atomic<uint32_t> pending{0};
+
+  std::mutex mutex;
+  std::vector<Job*> waiting; // Started when pending gets to zero
+};
+
+struct Job
+{
+  const char* name; // Must outlive the pool, string literals in practice
+  JobFunction function;
+  JobCounter* signal; // Decremented once the job is done, may be NULL
+};
+
+// When and where a job ran, for the stats and the trace
+struct JobTiming
+{
+  const char* name;
+  double start; // ms, getTimeMs
+  double end;
+};
+
+// Per name totals over every job collected so far
+struct JobStats
+{
+  const char* name;
+  uint32_t count;
+  double totalTime;
+  double maxTime;
+};
+
+// Jobs pushed by this thread, or stolen from here by the others
+struct WorkerThread
+{
+  std::mutex mutex;
+  std::deque<Job*> jobs; // The owner pushes and pops at the back, thieves take from the front
+  std::vector<JobTiming> timings; // Only the owner appends, collected while the pool is idle
+  double busyTime; // Collected so far
+};
+
+// Work stealing job scheduler on a fixed set of threads. The calling thread joins in as thread 0 whenever it
+// waits, so a pool of one thread has no workers at all and just runs everything inline. Each thread has its
+// own deque: it works on what it pushed itself newest first, which keeps nested jobs hot in its cache, and
+// takes the oldest job of another thread when it runs out. A thread waiting for jobs keeps running others
+// until they're done instead of blocking, so jobs can wait for jobs. The pool is driven from one outside
+// thread, the one that created it.
+struct WorkerPool
+{
+  std::vector<std::thread> threads;
+  std::vector<WorkerThread*> queues; // One per thread, calling thread included
+
+  std::mutex mutex;
+  std::condition_variable wake; // A job was pushed or a counter got to zero, or quit
+  std::atomic<uint32_t> queued; // Pushed and not yet taken, across every deque
+  uint32_t sleeping; // Threads waiting on wake
+  bool quit;
+
+  FILE* trace; // Chrome trace (chrome://tracing, Perfetto) of every job, NULL if not requested
+  double traceBase;
+
+  std::vector<JobStats> stats;
+  double statsStart;
+};
+
+void createWorkerPool(WorkerPool& pool, uint32_t threadCount);
+void destroyWorkerPool(WorkerPool& pool);
+
+// Calling thread included
+uint32_t getWorkerThreadCount(const WorkerPool& pool);
+
+// Runs function on some thread of the pool once after is at zero, NULL runs it right away. signal counts the
+// job until it's done and may be NULL. threadIndex is stable per thread so it can pick per thread resources.
+void runJob(WorkerPool& pool, const char* name, const JobFunction& function, JobCounter* signal, JobCounter* after = NULL);
+
+// Runs jobs, any jobs, until counter gets to zero, and only sleeps when there is nothing left to run
+void waitForJobs(WorkerPool& pool, JobCounter& counter);
+
+// Runs task for every index in [0, taskCount) and returns when all of them are done. Callable from a job,
+// the tasks go to the calling thread's deque and the other threads steal them from there.
+void parallelFor(WorkerPool& pool, uint32_t taskCount, const WorkerTask& task, const char* name = "parallel for");
+
+// Writes every job from now on to a Chrome trace, returns false if the file can't be created
+bool setJobTrace(WorkerPool& pool, const char* path);
+
+// Folds the timings of every job finished so far into the stats and the trace. Nothing may be running.
+void collectJobTimings(WorkerPool& pool);
+
+// Per job name totals and how busy each thread was, since the pool was created
+void printJobStats(WorkerPool& pool);